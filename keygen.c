@@ -12,6 +12,8 @@
 //    Server/client simulation of the classic "One-time Pad" encryption scheme.
 //
 //    This file contains code that is specific to the key generation utility.
+//    Keys go to stdout, or with -o straight into a (possibly paged) file
+//    generated by several threads at once.
 //
 // *****************************************************************************
 //
@@ -20,42 +22,269 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "otp.h"
+#include "otp_pad.h"
+#include "otp_padgen.h"
+
+
+// *****************************************************************************
+//
+// static int splitPage(char *path, long index)
+//
+// Purpose: Print one page of a paged pad file as an ordinary key.
+//
+// *****************************************************************************
+//
+static int splitPage(char *path, long index)
+{
+    struct stat info;  // Pad file information
+    char   *map;       // Mapped pad file
+    char   *page;      // Page characters
+    long   len;        // Characters in the page
+    int    fd;         // Pad file descriptor
+    int    rc = 0;     // Result
+
+    if((fd = open(path, O_RDONLY)) == -1 || fstat(fd, &info) == -1)
+    {
+        perror(path);
+        if(fd != -1)
+        {
+            close(fd);
+        }
+        return -1;
+    }
+
+    map = (info.st_size > 0) ?
+          mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if(map == MAP_FAILED)
+    {
+        fprintf(stderr, "%s: not a paged pad file\n", path);
+        return -1;
+    }
+
+    if((page = padFindPage(map, info.st_size, index, &len)) == NULL)
+    {
+        fprintf(stderr, "%s: no valid page %ld\n", path, index);
+        rc = -1;
+    }
+    else if(writeAll(STDOUT_FILENO, page, len) == -1 ||
+            writeAll(STDOUT_FILENO, "\n", 1) == -1)
+    {
+        perror("write failed");
+        rc = -1;
+    }
+
+    munmap(map, info.st_size);
+
+    return rc;
+}
+
+
+// *****************************************************************************
+//
+// static int fetchPad(char *server, long len, int fd)
+//
+// Purpose: Have a server ("port" or "host:port") generate the pad.
+//
+// *****************************************************************************
+//
+static int fetchPad(char *server, long len, int fd)
+{
+    char   host[256] = "localhost"; // Server host name
+    char   *colon;      // Separates host from port
+    long   svrType;     // Either server type will do
+    int    sock;        // Connection to the server
+    int    port;        // Server port
+    long   id;          // Pad ID the server kept it under (0 = none)
+    long   retryMs;     // Delay a busy server asked for
+    time_t giveUp = time(NULL) + PADGEN_BUSY_SECS; // Stop retrying then
+
+    if((colon = strrchr(server, ':')) != NULL)
+    {
+        snprintf(host, sizeof(host), "%.*s", (int)(colon - server), server);
+        server = colon + 1;
+    }
+    port = atoi(server);
+
+    // A full server says so either instead of its type or instead of a
+    // pad ID; either way nothing has been written yet, so wait as long
+    // as it asks and try again.
+    //
+    while(1)
+    {
+        if((sock = connectServer(host, port)) == -1)
+        {
+            fprintf(stderr, "Error: could not contact %s on port %d\n", host, port);
+            return -1;
+        }
+
+        id = -1;
+        if(recvLong(&sock, &svrType) == 0)
+        {
+            if(svrType == OTP_BUSY)
+            {
+                id = (recvLong(&sock, &retryMs) == 0) ? PADGEN_BUSY : -1;
+            }
+            else
+            {
+                id = padgenRequest(&sock, len, fd, &retryMs);
+            }
+        }
+        close(sock);
+
+        if(id == PADGEN_BUSY && time(NULL) + retryMs / 1000 < giveUp)
+        {
+            usleep(retryMs * 1000);
+            continue;
+        }
+        if(id < 0)
+        {
+            fprintf(stderr, "Error: pad request to %s on port %d %s\n", host, port,
+                    (id == PADGEN_BUSY) ? "was turned away, server busy" :
+                    (id == PADGEN_TOO_LARGE) ? "was refused, server buffers too small" :
+                    "failed");
+            return -1;
+        }
+        break;
+    }
+
+    // The ID is what otp_enc -k and otp_dec -k take to use the server's
+    // copy as key.
+    //
+    if(id > 0)
+    {
+        fprintf(stderr, "Pad ID: %08lx\n", id);
+    }
+
+    return 0;
+}
+
 
 int main(int argc, char **argv)
 {
+    long keySize = 0;  // Holds the user-specified length of the key
+    long done;         // Characters generated so far
+    long len;          // Characters in the current block
+    long pageSize = 0; // Characters per page in a paged pad file
+    long page = -1;    // Page to split out (-x)
+    char *outPath = NULL; // Pad file to write (-o)
+    char *server = NULL;  // Server to generate the pad (-s)
+    int  outFd;        // Where a server-generated pad goes
+    int  threads = 0;  // Generator threads for -o (0 = one per CPU)
+    int  opt;          // Current command line option
+    char *buf;         // Block of generated characters
+
+    // -o writes the pad straight into a file using threads (-t), split
+    // into pages of -p characters if asked. -x prints one page of a paged
+    // pad file as a plain key. -s has a server generate the pad instead.
+    //
+    while((opt = getopt(argc, argv, "o:p:s:t:x:")) != -1)
+    {
+        switch(opt)
+        {
+            case 'o':
+                outPath = optarg;
+                break;
+            case 'p':
+                pageSize = atol(optarg);
+                break;
+            case 's':
+                server = optarg;
+                break;
+            case 't':
+                threads = atoi(optarg);
+                break;
+            case 'x':
+                page = atol(optarg);
+                break;
+            default:
+                optind = argc + 1; // Force the usage message
+                break;
+        }
+    }
+
     // If we did not get a length for the key, display usage and exit.
     //
-    if(argc == 1)
+    if(optind != argc - 1 || (pageSize != 0 && (outPath == NULL || server != NULL)))
     {
-        printf("Usage: %s length_of_key\n", argv[0]);
+        printf("Usage: %s [-o pad_file [-t threads] [-p page_size]] length_of_key\n"
+               "       %s -s [host:]port [-o pad_file] length_of_key\n"
+               "       %s -x page pad_file\n", argv[0], argv[0], argv[0]);
         exit(1);
     }
 
-    // Allowed characters include capital A-Z and space.
-    //
-    char allowedChars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ ";
+    if(page >= 0)
+    {
+        return (splitPage(argv[optind], page) == -1) ? 1 : 0;
+    }
 
-    int keySize = 0;  // Holds the user-specified length of the key
-    int seed;         // Seeds the randomizer
-    int idx;          // Loop index
+    keySize = atol(argv[optind]);  // Grab the key length (convert to a long)
 
-    keySize = atoi(argv[1]);  // Grab the key length (convert to an int)
+    if(server != NULL)
+    {
+        outFd = (outPath != NULL) ?
+                open(outPath, O_WRONLY | O_CREAT | O_TRUNC, 0600) : STDOUT_FILENO;
+        if(outFd == -1)
+        {
+            perror(outPath);
+            exit(1);
+        }
+        return (fetchPad(server, keySize, outFd) == -1) ? 1 : 0;
+    }
 
-    seed = time(NULL);        // Seed the randomizer
-    srand(seed);              // Ditto
+    if(outPath != NULL)
+    {
+        return (padWriteFile(outPath, keySize, pageSize, threads) == -1) ? 1 : 0;
+    }
+
+    // Generate a block at a time from the kernel CSPRNG and write each
+    // block out in one go. The extra character is room for the trailing
+    // newline on the last block.
+    //
+    if((buf = malloc(PAD_BLOCK + 1)) == NULL)
+    {
+        perror("malloc failed");
+        exit(1);
+    }
 
-    for(idx = 0; idx < keySize; idx++)
+    for(done = 0; done < keySize; done += len)
     {
-        // Grab a random index from allowedChars and print to stdout. Do this
-        // until we have reached the desired key length.
+        len = keySize - done;
+        len = (len > PAD_BLOCK) ? PAD_BLOCK : len;
+
+        if(padFill(buf, len) == -1)
+        {
+            perror("getrandom failed");
+            exit(1);
+        }
+
+        // Add a trailing newline after the last block.
         //
-        printf("%c", allowedChars[rand() % (int)strlen(allowedChars)]);
+        if(done + len == keySize)
+        {
+            buf[len] = '\n';
+        }
+
+        if(writeAll(STDOUT_FILENO, buf, len + (done + len == keySize)) == -1)
+        {
+            perror("write failed");
+            exit(1);
+        }
     }
 
-    // Add a trailing newline.
+    // An empty key is still a line.
     //
-    printf("\n");
+    if(keySize <= 0)
+    {
+        printf("\n");
+    }
+
+    free(buf);
 
     return 0;
 }
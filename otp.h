@@ -30,6 +30,142 @@
 
 #define MAX_MSG 4196 // power of 2, speeds things up a smidge
 
+#define OTP_ENCODE 1 // Server/client type for encoding
+#define OTP_DECODE 0 // Server/client type for decoding
+#define OTP_BUSY   2 // Sent instead of the server type by a full server,
+                     // followed by the ms to wait before retrying
+#define OTP_BUSY_ACK "BUSY" // Size acknowledgement of a full server,
+                            // followed by a space and the ms to wait,
+                            // padded to the length of OTP_ACK_INSIZE
+#define OTP_TOO_LARGE "TOO LARGE" // Size acknowledgement of a server whose
+                                  // buffers could never hold the request,
+                                  // padded the same way
+
+// Acknowledgements of the classic protocol. Each is read as exactly this
+// many characters, however the network splits them up.
+//
+#define OTP_ACK_INSIZE  "I got your input file size"
+#define OTP_ACK_KEYSIZE "I got your key file size"
+#define OTP_ACK_INPUT   "I got your input file"
+
+// Classic clients open with the input file size. Negative first numbers
+// are opcodes selecting one of the extended protocols instead.
+//
+#define OP_MUX    -1 // Multiplexed streams over one connection (otp_mux.h)
+#define OP_RESUME -2 // Resumable chunked session (otp_resume.h)
+#define OP_PADGEN -3 // Server-side pad generation (otp_padgen.h)
+#define OP_PADKEY -4 // Key taken from the server's pad store (otp_padkey.h)
+
+
+// Command line of otp_enc and otp_dec, filled in by clientOptions().
+//
+struct clientOpts
+{
+    int    stripes;         // Parallel connections for one transfer (-s)
+    int    resumable;       // Use a resumable session (-r)
+    int    mux;             // Send it as a multiplexed stream (-m)
+    int    crc;             // Checksum its frames (-c, with -m)
+    int    local;           // Run the codec here, without a server (-l)
+    int    threads;         // Local worker threads, 0 = one per CPU (-t)
+    char   *outPath;        // Local output file, NULL = stdout (-o)
+    char   *padRef;         // Key in the server's pad store (-k), or NULL
+    long   padId;           // Its pad ID
+    long   padOffset;       // And offset
+    char   *inPath;         // Input file
+    char   *keyPath;        // Key file (NULL with -k)
+    char   *servers;        // Port or server list (NULL with -l)
+};
+
+
+// What the socket and codec helpers below report as they go, for the
+// servers' statistics, deadlines and hardware counters (and the load
+// generator's counters, with -H). Each hook is NULL until installed with
+// otpSetHooks(), so programs that install none don't link the modules
+// behind them.
+//
+struct otpHooks
+{
+    void   (*moved)(int sent, long bytes);       // Bytes crossed a socket
+                                                 // (sent = 1 if they went out)
+    void   (*begin)(void);                       // Going into a PERF_* section
+    void   (*end)(int section, long bytes);      // Coming out of it
+};
+
+
+// *****************************************************************************
+//
+// void otpSetHooks(struct otpHooks *hooks)
+//
+//    Entry:   struct otpHooks *hooks
+//                Hooks to call from now on (copied)
+//
+//    Exit:    None.
+//
+//    Purpose: Install the hooks. Call once, before forking or starting
+//    threads; children keep them.
+//
+// *****************************************************************************
+//
+void otpSetHooks(struct otpHooks *hooks);
+
+
+// *****************************************************************************
+//
+// void otpMoved(int sent, long bytes)
+//
+//    Entry:   int sent
+//                1 if the bytes went out, 0 if they came in
+//             long bytes
+//                Number of bytes
+//
+//    Exit:    None.
+//
+//    Purpose: Report bytes moved by socket code outside these helpers
+//    (the multiplexed queues) to the installed hook, if any.
+//
+// *****************************************************************************
+//
+void otpMoved(int sent, long bytes);
+
+
+// *****************************************************************************
+//
+// int writeAll(int fd, char *buf, long len)
+//
+//    Entry:   int fd
+//                File to write to
+//             char *buf
+//                Characters to write
+//             long len
+//                Number of characters
+//
+//    Exit:    Returns 0 on success, -1 on failure.
+//
+//    Purpose: Write a whole buffer, looping over partial writes.
+//
+// *****************************************************************************
+//
+int writeAll(int fd, char *buf, long len);
+
+
+// *****************************************************************************
+//
+// int clientOptions(int argc, char **argv, struct clientOpts *opts)
+//
+//    Entry:   int argc, char **argv
+//                Command line of otp_enc or otp_dec
+//             struct clientOpts *opts
+//                Receives the options and file names
+//
+//    Exit:    Returns 0 on success, -1 after printing the usage message.
+//
+//    Purpose: Parse the options both clients take and check that the
+//    right files and servers follow them.
+//
+// *****************************************************************************
+//
+int clientOptions(int argc, char **argv, struct clientOpts *opts);
+
 
 // *****************************************************************************
 // 
@@ -108,11 +244,13 @@ int recvNum(int *sock);
 //                Socket for the current network connection
 //             char *str
 //                Short string to receive from across the connection (see
-//                recvStream() for receiving long strings).
+//                recvStream() for receiving long strings). Must hold
+//                MAX_MSG characters.
 //
 //    Exit:    None.
 //
 //    Purpose: Receive a short string from across a network connection.
+//    Whatever one recv() returns is taken, and null terminated.
 //
 // *****************************************************************************
 //
@@ -127,7 +265,8 @@ void recvStr(int *sock, char *str);
 //                Socket for the current network connection
 //             char *str
 //                Long string to receive from across the connection (see
-//                recvStr() for receiving short strings).
+//                recvStr() for receiving short strings), with room for
+//                maxChars characters and a terminator.
 //             long maxChars
 //                Long integer containing the  number of characters expected
 //                to arrive in the string.
@@ -201,4 +340,236 @@ void encodeChars(char *inputChars, char *keyChars);
 void decodeChars(char *inputChars, char *keyChars);
 
 
+// *****************************************************************************
+// 
+// int verifyBuf(char *buf, long len)
+//
+//    Entry:   char *buf
+//                Characters to check (need not be null terminated)
+//             long len
+//                Number of characters to check
+//
+//    Exit:    Returns status of verification: 1 = yes, 0 = no
+//
+//    Purpose: Length-based verifyInput() for chunks of a larger input.
+//
+// *****************************************************************************
+//
+int verifyBuf(char *buf, long len);
+
+
+// *****************************************************************************
+// 
+// void encodeBuf(char *inputChars, char *keyChars, long len)
+//
+//    Entry:   char *inputChars
+//                Characters to be encoded (need not be null terminated)
+//             char *keyChars
+//                Key characters lined up with inputChars
+//             long len
+//                Number of characters to encode
+//
+//    Exit:    The inputChars buffer is encoded in-place.
+//
+//    Purpose: Length-based encodeChars() for chunks of a larger input.
+//    Position-independent, so any range can be encoded on its own as long
+//    as the key is lined up with it.
+//
+// *****************************************************************************
+//
+void encodeBuf(char *inputChars, char *keyChars, long len);
+
+
+// *****************************************************************************
+// 
+// void decodeBuf(char *inputChars, char *keyChars, long len)
+//
+//    Entry:   char *inputChars
+//                Characters to be decoded (need not be null terminated)
+//             char *keyChars
+//                Key characters lined up with inputChars
+//             long len
+//                Number of characters to decode
+//
+//    Exit:    The inputChars buffer is decoded in-place.
+//
+//    Purpose: Length-based decodeChars() for chunks of a larger input.
+//
+// *****************************************************************************
+//
+void decodeBuf(char *inputChars, char *keyChars, long len);
+
+
+// *****************************************************************************
+// 
+// int sendBuf(int *sock, char *buf, long len)
+//
+//    Entry:   int *sock
+//                Socket for the current network connection
+//             char *buf
+//                Buffer to send across the connection
+//             long len
+//                Number of characters in the buffer
+//
+//    Exit:    Returns 0 on success, -1 on failure.
+//
+//    Purpose: Send an entire buffer across a network connection, looping
+//    over partial sends. Unlike sendStr(), errors are returned to the
+//    caller instead of exiting.
+//
+// *****************************************************************************
+//
+int sendBuf(int *sock, char *buf, long len);
+
+
+// *****************************************************************************
+// 
+// int recvBuf(int *sock, char *buf, long len)
+//
+//    Entry:   int *sock
+//                Socket for the current network connection
+//             char *buf
+//                Buffer to fill (at least len characters long)
+//             long len
+//                Exact number of characters to receive
+//
+//    Exit:    Returns 0 on success, -1 on failure or a closed socket.
+//
+//    Purpose: Receive exactly len characters from across a network
+//    connection. Errors are returned to the caller instead of exiting.
+//
+// *****************************************************************************
+//
+int recvBuf(int *sock, char *buf, long len);
+
+
+// *****************************************************************************
+// 
+// int sendLong(int *sock, long num)
+//
+//    Entry:   int *sock
+//                Socket for the current network connection
+//             long num
+//                Number to send across the connection
+//
+//    Exit:    Returns 0 on success, -1 on failure.
+//
+//    Purpose: Same wire format as sendNum(), but returns errors instead of
+//    exiting.
+//
+// *****************************************************************************
+//
+int sendLong(int *sock, long num);
+
+
+// *****************************************************************************
+// 
+// int recvLong(int *sock, long *num)
+//
+//    Entry:   int *sock
+//                Socket for the current network connection
+//             long *num
+//                Receives the number translated to host byte order
+//
+//    Exit:    Returns 0 on success, -1 on failure or a closed socket.
+//
+//    Purpose: Same wire format as recvNum(), but returns errors instead of
+//    exiting.
+//
+// *****************************************************************************
+//
+int recvLong(int *sock, long *num);
+
+
+// *****************************************************************************
+// 
+// int sendLong64(int *sock, long num)
+//
+//    Entry:   int *sock
+//                Socket for the current network connection
+//             long num
+//                Number to send across the connection
+//
+//    Exit:    Returns 0 on success, -1 on failure.
+//
+//    Purpose: Like sendLong(), but all 64 bits go across (big endian), for
+//    sizes and offsets that may not fit in 32.
+//
+// *****************************************************************************
+//
+int sendLong64(int *sock, long num);
+
+
+// *****************************************************************************
+// 
+// int recvLong64(int *sock, long *num)
+//
+//    Entry:   int *sock
+//                Socket for the current network connection
+//             long *num
+//                Receives the number translated to host byte order
+//
+//    Exit:    Returns 0 on success, -1 on failure or a closed socket.
+//
+//    Purpose: Receive a number sent by sendLong64().
+//
+// *****************************************************************************
+//
+int recvLong64(int *sock, long *num);
+
+
+// *****************************************************************************
+// 
+// int connectServer(char *host, int port)
+//
+//    Entry:   char *host
+//                Name of the host running the server
+//             int port
+//                Port the server is listening on
+//
+//    Exit:    Returns a connected socket descriptor, -1 on failure.
+//
+//    Purpose: Open a TCP connection to one of the servers.
+//
+// *****************************************************************************
+//
+int connectServer(char *host, int port);
+
+
+// *****************************************************************************
+// 
+// long otpRequest(int *sock, char *inContent, long inSize, char *keyContent,
+//                 long keySize, char *outContent, long *retryMs)
+//
+//    Entry:   int *sock
+//                Connected socket that has already received the server type
+//             char *inContent
+//                Input characters to encode/decode
+//             long inSize
+//                Number of input characters
+//             char *keyContent
+//                Key characters
+//             long keySize
+//                Number of key characters
+//             char *outContent
+//                Buffer receiving inSize result characters (may be inContent)
+//             long *retryMs
+//                Receives the server's retry delay if it was busy
+//
+//    Exit:    Number of result characters received, -1 on failure, -2 if
+//             the server was too busy to take the request (nothing but
+//             the sizes was sent), -3 if the connection failed before the
+//             server took the input size (nothing of the input or key was
+//             sent, so the request can safely be sent again), -4 if the
+//             request is too large for the server ever to take.
+//
+//    Purpose: Run one size/ack/payload exchange with a server over a
+//    connection whose server type has already been checked.
+//
+// *****************************************************************************
+//
+long otpRequest(int *sock, char *inContent, long inSize, char *keyContent,
+                long keySize, char *outContent, long *retryMs);
+
+
 #endif
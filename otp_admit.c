@@ -0,0 +1,307 @@
+//
+// *****************************************************************************
+//
+// Author:    Erik Ratcliffe
+// Date:      June 5, 2015
+// Project:   Program 4 - OTP
+// Filename:  otp_admit.c
+// Class:     CS 344 (Spring 2015)
+//
+//
+// Overview:
+//    Server/client simulation of the classic "One-time Pad" encryption scheme.
+//
+//    This file contains the server's admission control (see otp_admit.h).
+//
+// *****************************************************************************
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include "otp_admit.h"
+
+
+// One child's reservations, added up.
+//
+struct admitEntry
+{
+    pid_t pid;     // Child holding the reservation (0 = entry unused)
+    long  bytes;   // Characters reserved
+};
+
+
+struct admitTable
+{
+    pthread_mutex_t lock;                 // Guards the table
+    int    maxConn;                       // Connection limit
+    long   maxBytes;                      // Characters in flight limit
+    long   inFlight;                      // Characters reserved now
+    struct admitEntry entry[ADMIT_TABLE]; // Reservations
+};
+
+
+static struct admitTable *table = NULL;   // Shared table
+static struct admitEntry *mine = NULL;    // Calling child's reservation
+
+
+// *****************************************************************************
+//
+// int admitInit(int maxConn, long maxBytes)
+//
+// Purpose: Set up the shared admission table.
+//
+// *****************************************************************************
+//
+int admitInit(int maxConn, long maxBytes)
+{
+    pthread_mutexattr_t attr; // Makes the lock work across processes
+
+    table = mmap(NULL, sizeof(*table), PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(table == MAP_FAILED)
+    {
+        table = NULL;
+        return -1;
+    }
+
+    maxConn = (maxConn <= 0) ? ADMIT_MAX_CONN : maxConn;
+    table->maxConn = (maxConn > ADMIT_TABLE) ? ADMIT_TABLE : maxConn;
+    table->maxBytes = (maxBytes <= 0) ? ADMIT_MAX_BYTES : maxBytes;
+
+    // Robust, so a child killed while holding the lock doesn't wedge
+    // admissions.
+    //
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&table->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+
+    return 0;
+}
+
+
+// *****************************************************************************
+//
+// static void admitLock(void)
+//
+// Purpose: Take the table lock, recovering it if its holder died.
+//
+// *****************************************************************************
+//
+static void admitLock(void)
+{
+    if(pthread_mutex_lock(&table->lock) == EOWNERDEAD)
+    {
+        pthread_mutex_consistent(&table->lock);
+    }
+}
+
+
+// *****************************************************************************
+//
+// void admitTune(int *maxConn, long *maxBytes)
+//
+// Purpose: Change the limits at runtime.
+//
+// *****************************************************************************
+//
+void admitTune(int *maxConn, long *maxBytes)
+{
+    if(table == NULL)
+    {
+        *maxConn = 0;
+        *maxBytes = 0;
+        return;
+    }
+
+    admitLock();
+
+    if(*maxConn > 0)
+    {
+        table->maxConn = (*maxConn > ADMIT_TABLE) ? ADMIT_TABLE : *maxConn;
+    }
+    if(*maxBytes > 0)
+    {
+        table->maxBytes = *maxBytes;
+    }
+    *maxConn = table->maxConn;
+    *maxBytes = table->maxBytes;
+
+    pthread_mutex_unlock(&table->lock);
+}
+
+
+// *****************************************************************************
+//
+// static long admitDelay(double load)
+//
+// Purpose: Retry delay for a given load (1.0 = exactly at the limit). The
+// further over, the longer clients are asked to stay away.
+//
+// *****************************************************************************
+//
+static long admitDelay(double load)
+{
+    long ms = (long)(ADMIT_RETRY_MS * load); // Scaled delay
+
+    if(ms < ADMIT_RETRY_MS)
+    {
+        return ADMIT_RETRY_MS;
+    }
+
+    return (ms > ADMIT_RETRY_MAX) ? ADMIT_RETRY_MAX : ms;
+}
+
+
+// *****************************************************************************
+//
+// long admitConn(int children)
+//
+// Purpose: Connection limit check.
+//
+// *****************************************************************************
+//
+long admitConn(int children)
+{
+    if(table == NULL || children < table->maxConn)
+    {
+        return 0;
+    }
+
+    return admitDelay((double)(children + 1) / table->maxConn);
+}
+
+
+// *****************************************************************************
+//
+// long admitBytes(long bytes)
+//
+// Purpose: Reserve room for a request's input.
+//
+// *****************************************************************************
+//
+long admitBytes(long bytes)
+{
+    long delay = 0;  // Retry delay if we're full
+    int  idx;        // Loop index
+
+    if(table == NULL || bytes <= 0)
+    {
+        return 0;
+    }
+
+    admitLock();
+
+    if(table->inFlight > 0 && table->inFlight + bytes > table->maxBytes)
+    {
+        delay = admitDelay((double)(table->inFlight + bytes) / table->maxBytes);
+    }
+    else if(mine != NULL)
+    {
+        mine->bytes += bytes;
+        table->inFlight += bytes;
+    }
+    else
+    {
+        // There's an entry for every connection we admit, so one is free
+        // unless the limit was raised past the table; then the request
+        // just goes unaccounted.
+        //
+        for(idx = 0; idx < ADMIT_TABLE && mine == NULL; idx++)
+        {
+            if(table->entry[idx].pid == 0)
+            {
+                mine = &table->entry[idx];
+                mine->pid = getpid();
+                mine->bytes = bytes;
+                table->inFlight += bytes;
+            }
+        }
+    }
+
+    pthread_mutex_unlock(&table->lock);
+
+    return delay;
+}
+
+
+// *****************************************************************************
+//
+// void admitDone(long bytes)
+//
+// Purpose: Give back one of the calling child's reservations.
+//
+// *****************************************************************************
+//
+void admitDone(long bytes)
+{
+    if(mine == NULL || bytes <= 0)
+    {
+        return;
+    }
+
+    // A request that went unaccounted (see admitBytes()) has nothing of
+    // its own here, so never give back more than the entry holds.
+    //
+    admitLock();
+    bytes = (bytes > mine->bytes) ? mine->bytes : bytes;
+    table->inFlight -= bytes;
+    mine->bytes -= bytes;
+    if(mine->bytes == 0)
+    {
+        memset(mine, 0, sizeof(*mine));
+        mine = NULL;
+    }
+    pthread_mutex_unlock(&table->lock);
+}
+
+
+// *****************************************************************************
+//
+// void admitReap(pid_t pid)
+//
+// Purpose: Give back whatever a child still had reserved.
+//
+// *****************************************************************************
+//
+void admitReap(pid_t pid)
+{
+    int idx;  // Loop index
+
+    if(table == NULL)
+    {
+        return;
+    }
+
+    admitLock();
+    for(idx = 0; idx < ADMIT_TABLE; idx++)
+    {
+        if(table->entry[idx].pid == pid)
+        {
+            table->inFlight -= table->entry[idx].bytes;
+            memset(&table->entry[idx], 0, sizeof(table->entry[idx]));
+        }
+    }
+    pthread_mutex_unlock(&table->lock);
+}
+
+
+// *****************************************************************************
+//
+// long admitInFlight(void)
+//
+// Purpose: Characters reserved right now.
+//
+// *****************************************************************************
+//
+long admitInFlight(void)
+{
+    return (table != NULL) ? __atomic_load_n(&table->inFlight, __ATOMIC_RELAXED) : 0;
+}
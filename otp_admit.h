@@ -0,0 +1,172 @@
+//
+// *****************************************************************************
+//
+// Author:    Erik Ratcliffe
+// Date:      June 5, 2015
+// Project:   Program 4 - OTP
+// Filename:  otp_admit.h
+// Class:     CS 344 (Spring 2015)
+//
+//
+// Overview:
+//    Server/client simulation of the classic "One-time Pad" encryption scheme.
+//
+//    This file contains the definitions and function prototypes for the
+//    server's admission control. An overloaded server turns work away
+//    early with a "busy, retry after N ms" answer instead of letting
+//    clients pile up in the listen backlog until they time out:
+//
+//    - Connections over the limit are answered by the parent right after
+//      accept(): OTP_BUSY instead of the server type, then the retry
+//      delay in ms. No child is forked.
+//
+//    - Requests that would push the characters in flight over the limit
+//      are answered before any payload is read: a classic request gets
+//      OTP_BUSY_ACK ("BUSY <ms>") instead of its size acknowledgement, a
+//      resumable session gets RESUME_BUSY and the delay instead of its
+//      session ID and offset.
+//
+//    The pool (otp_pool.h) treats both answers as a reason to wait and
+//    try again, not as a failed server.
+//
+// *****************************************************************************
+//
+
+#ifndef OTP_ADMIT_H
+#define OTP_ADMIT_H
+
+
+#include <sys/types.h>
+
+
+#define ADMIT_TABLE      1024          // Most connections that can be admitted
+#define ADMIT_MAX_CONN   256           // Default connection limit
+#define ADMIT_MAX_BYTES  (1L << 30)    // Default limit on characters in flight
+#define ADMIT_BACKLOG    128           // Default listen() backlog
+#define ADMIT_RETRY_MS   100           // Shortest retry delay we hand out
+#define ADMIT_RETRY_MAX  1000          // Longest retry delay we hand out
+
+
+// *****************************************************************************
+//
+// int admitInit(int maxConn, long maxBytes)
+//
+//    Entry:   int maxConn
+//                Connections served at once (0 = ADMIT_MAX_CONN, at most
+//                ADMIT_TABLE)
+//             long maxBytes
+//                Characters of input in flight at once (0 = ADMIT_MAX_BYTES)
+//
+//    Exit:    Returns 0 on success, -1 on failure.
+//
+//    Purpose: Set up the shared admission table. Call once in the server
+//    before accepting.
+//
+// *****************************************************************************
+//
+int admitInit(int maxConn, long maxBytes);
+
+
+// *****************************************************************************
+//
+// void admitTune(int *maxConn, long *maxBytes)
+//
+//    Entry:   int *maxConn, long *maxBytes
+//                New limits (<= 0 leaves a limit as it is)
+//
+//    Exit:    Both set to the limits now in force.
+//
+//    Purpose: Server side: change the limits at runtime (see otp_ctl.h).
+//    Connections already admitted are left alone.
+//
+// *****************************************************************************
+//
+void admitTune(int *maxConn, long *maxBytes);
+
+
+// *****************************************************************************
+//
+// long admitConn(int children)
+//
+//    Entry:   int children
+//                Children currently serving connections
+//
+//    Exit:    0 if another connection may be served, otherwise the delay
+//             in ms to tell the client.
+//
+//    Purpose: Connection limit check, made by the parent after accept().
+//
+// *****************************************************************************
+//
+long admitConn(int children);
+
+
+// *****************************************************************************
+//
+// long admitBytes(long bytes)
+//
+//    Entry:   long bytes
+//                Characters of input the calling child's request announced
+//
+//    Exit:    0 if the request is admitted, otherwise the delay in ms to
+//             tell the client.
+//
+//    Purpose: Reserve room for a request's input. A request larger than
+//    the whole limit is still admitted when nothing else is in flight, so
+//    it can't be starved forever. A child serving several requests at
+//    once (multiplexed streams) calls this for each; the reservations add
+//    up. They last until admitDone() or until the child is reaped.
+//
+// *****************************************************************************
+//
+long admitBytes(long bytes);
+
+
+// *****************************************************************************
+//
+// void admitDone(long bytes)
+//
+//    Entry:   long bytes
+//                Characters to give back, as passed to admitBytes()
+//
+//    Exit:    None.
+//
+//    Purpose: Give back one of the calling child's reservations.
+//
+// *****************************************************************************
+//
+void admitDone(long bytes);
+
+
+// *****************************************************************************
+//
+// void admitReap(pid_t pid)
+//
+//    Entry:   pid_t pid
+//                Child the server has just reaped
+//
+//    Exit:    None.
+//
+//    Purpose: Give back whatever a child still had reserved.
+//
+// *****************************************************************************
+//
+void admitReap(pid_t pid);
+
+
+// *****************************************************************************
+//
+// long admitInFlight(void)
+//
+//    Entry:   None.
+//
+//    Exit:    Characters reserved by all children right now.
+//
+//    Purpose: For the stats (see otp_stats.h).
+//
+// *****************************************************************************
+//
+long admitInFlight(void);
+
+
+#endif
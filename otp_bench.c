@@ -0,0 +1,679 @@
+//
+// *****************************************************************************
+//
+// Author:    Erik Ratcliffe
+// Date:      June 5, 2015
+// Project:   Program 4 - OTP
+// Filename:  otp_bench.c
+// Class:     CS 344 (Spring 2015)
+//
+//
+// Overview:
+//    Server/client simulation of the classic "One-time Pad" encryption scheme.
+//
+//    This file contains the load generator. It drives otp_enc_d (and, if
+//    given one, otp_dec_d) over -c connections with a mix of payload
+//    sizes for -d seconds, checks every result, and reports throughput
+//    and latency percentiles.
+//
+//    With -r the load is open loop: request i is due at start + i / rate,
+//    whether or not earlier requests have come back, and its latency runs
+//    from when it was due, not from when a connection got round to it. A
+//    server that stalls therefore shows up as one slow request per
+//    request that should have been sent during the stall, rather than
+//    just one (coordinated omission). Without -r each connection sends
+//    its next request as soon as the last one is back (closed loop),
+//    which measures capacity but hides stalls.
+//
+//    Without -M each request takes a pooled connection (see otp_pool.h)
+//    that has already been opened and told the server type, and uses it
+//    up, since the classic protocol takes one request per connection. A
+//    filler thread tops the pools up for the whole run, so what is
+//    measured is a request on a warm connection; one that finds the pool
+//    empty connects on the spot, and that shows in its latency.
+//
+//    With -M each connection stays open and carries its requests as
+//    streams of the multiplexed protocol (see otp_mux.h), one at a time,
+//    instead of a new classic connection per request.
+//
+//    With -H it also reports what the clients' sends and receives cost
+//    per byte in hardware counters (see otp_perf.h).
+//
+// *****************************************************************************
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include "otp.h"
+#include "otp_mux.h"
+#include "otp_perf.h"
+#include "otp_pool.h"
+
+
+#define BENCH_CONNS      8       // Default connections (-c)
+#define BENCH_SECS       10      // Default run length (-d)
+#define BENCH_MIX        "1000"  // Default payload mix (-m)
+#define BENCH_MAX_MIX    16      // Most payload sizes in a mix
+#define BENCH_MAX_CONNS  1024    // Most connections
+#define BENCH_SUB_BITS   6       // log2(BENCH_SUB)
+#define BENCH_SUB        64      // Histogram buckets per power of two
+#define BENCH_BUCKETS    (BENCH_SUB * 40) // Tops out at ~2^45 ns (9 hours)
+#define BENCH_FILL_US    1000    // Filler's nap when the pools are full
+
+
+// One payload size in the mix, with its input, key and expected results.
+//
+struct benchPayload
+{
+    long   size;     // Characters
+    long   weight;   // Share of requests
+    char   *plain;   // Input
+    char   *key;     // Key (as long as the input)
+    char   *cipher;  // What the encoding server should send back
+};
+
+
+// One connection's worth of load, and what it measured.
+//
+struct benchWorker
+{
+    pthread_t thread;                // Worker thread
+    int    slot;                     // Its place among the workers
+    unsigned int seed;               // For picking payloads
+    char   *out, *back;              // Encoded and decoded results
+    long   requests;                 // Round trips done
+    long   errors;                   // Requests that failed
+    long   wrong;                    // Results that didn't check out
+    long   chars;                    // Characters sent and received back
+    long   hist[BENCH_BUCKETS];      // Latencies (ns)
+    struct muxConn encMux, decMux;   // Multiplexed connections (-M)
+    int    encUp, decUp;             // Set while they're open
+};
+
+
+static struct benchPayload mix[BENCH_MAX_MIX]; // Payload sizes
+static int    numMix = 0;            // Entries in mix[]
+static long   totalWeight = 0;       // Sum of the weights
+static struct otpPool encPool;       // Encoding servers
+static struct otpPool decPool;       // Decoding servers
+static int    haveDec = 0;           // Round trip through decPool too?
+static int    muxMode = 0;           // Requests as streams on one connection
+static int    muxCrc = 0;            // Checksum their frames
+static double rate = 0;              // Requests per second (0 = closed loop)
+static long   startNs, endNs;        // Run window (CLOCK_MONOTONIC)
+static long   ticket = 0;            // Next open loop request
+
+
+// *****************************************************************************
+//
+// static long benchNow(void)
+//
+// Purpose: Monotonic clock in ns.
+//
+// *****************************************************************************
+//
+static long benchNow(void)
+{
+    struct timespec now;  // Current time
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+
+// *****************************************************************************
+//
+// static int benchBucket(long ns)
+//
+// Purpose: Histogram bucket for a latency: exact below BENCH_SUB, then
+// BENCH_SUB buckets per power of two (within 1.6% of their values).
+//
+// *****************************************************************************
+//
+static int benchBucket(long ns)
+{
+    int msb;     // Highest set bit
+    int bucket;  // Bucket it falls in
+
+    if(ns < BENCH_SUB)
+    {
+        return (ns < 0) ? 0 : (int)ns;
+    }
+
+    msb = 63 - __builtin_clzl(ns);
+    bucket = (msb - BENCH_SUB_BITS + 1) * BENCH_SUB +
+             (int)(ns >> (msb - BENCH_SUB_BITS)) - BENCH_SUB;
+
+    return (bucket >= BENCH_BUCKETS) ? BENCH_BUCKETS - 1 : bucket;
+}
+
+
+// *****************************************************************************
+//
+// static long benchValue(int bucket)
+//
+// Purpose: Highest latency that falls in a bucket, so percentiles err on
+// the slow side.
+//
+// *****************************************************************************
+//
+static long benchValue(int bucket)
+{
+    int shift;  // Power of two the bucket is in
+
+    if(bucket < BENCH_SUB)
+    {
+        return bucket;
+    }
+
+    shift = bucket / BENCH_SUB - 1;
+
+    return ((long)(bucket % BENCH_SUB + BENCH_SUB + 1) << shift) - 1;
+}
+
+
+// *****************************************************************************
+//
+// static int benchMix(char *spec)
+//
+// Purpose: Parse "size[:weight],..." and build each payload with its
+// expected results. Returns -1 on a bad spec.
+//
+// *****************************************************************************
+//
+static int benchMix(char *spec)
+{
+    struct benchPayload *p;  // Payload being built
+    char   *list, *entry, *save; // Copy of the spec and strtok state
+    char   *end;             // End of a parsed number
+    long   idx;              // Loop index
+    unsigned int seed = time(NULL); // For the payloads
+
+    list = strdup(spec);
+    for(entry = strtok_r(list, ",", &save); entry != NULL;
+        entry = strtok_r(NULL, ",", &save))
+    {
+        if(numMix == BENCH_MAX_MIX)
+        {
+            free(list);
+            return -1;
+        }
+
+        p = &mix[numMix];
+        p->size = strtol(entry, &end, 10);
+        p->weight = (*end == ':') ? strtol(end + 1, &end, 10) : 1;
+        if(*end != '\0' || p->size <= 0 || p->weight <= 0)
+        {
+            free(list);
+            return -1;
+        }
+
+        // Random letters and spaces for the input and key, and the
+        // cipher text worked out here so every answer can be checked.
+        //
+        p->plain = malloc(p->size);
+        p->key = malloc(p->size);
+        p->cipher = malloc(p->size);
+        if(p->plain == NULL || p->key == NULL || p->cipher == NULL)
+        {
+            free(list);
+            return -1;
+        }
+        for(idx = 0; idx < p->size; idx++)
+        {
+            p->plain[idx] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ "[rand_r(&seed) % 27];
+            p->key[idx] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ "[rand_r(&seed) % 27];
+        }
+        memcpy(p->cipher, p->plain, p->size);
+        encodeBuf(p->cipher, p->key, p->size);
+
+        totalWeight += p->weight;
+        numMix++;
+    }
+
+    free(list);
+
+    return (numMix == 0) ? -1 : 0;
+}
+
+
+// *****************************************************************************
+//
+// static int benchMuxOpen(struct muxConn *mc, struct otpPool *pool, int slot)
+//
+// Purpose: Open a worker's multiplexed connection to one of the pool's
+// servers, spreading workers over them. Returns 1 if it's open.
+//
+// *****************************************************************************
+//
+static int benchMuxOpen(struct muxConn *mc, struct otpPool *pool, int slot)
+{
+    struct poolEndpoint *ep = &pool->ep[slot % pool->numEndpoints]; // Server
+
+    if(muxConnect(mc, ep->host, ep->port, pool->svrType) != 0)
+    {
+        return 0;
+    }
+    mc->crc = muxCrc;
+
+    return 1;
+}
+
+
+// *****************************************************************************
+//
+// static long benchMux(struct benchWorker *w, int dec, char *in, char *key,
+//                      long size, char *out)
+//
+// Purpose: Run one request as a stream on the worker's multiplexed
+// connection, reopening it if the last one failed. A stream turned away
+// busy is retried as poolRequest() retries a busy server. Returns the
+// characters back, -1 on failure.
+//
+// *****************************************************************************
+//
+static long benchMux(struct benchWorker *w, int dec, char *in, char *key,
+                     long size, char *out)
+{
+    struct muxConn *mc = dec ? &w->decMux : &w->encMux; // Connection
+    int    *up = dec ? &w->decUp : &w->encUp;          // Open?
+    int    status;                                     // How the stream ended
+    long   delay = 0;                                  // Current busy backoff
+    time_t giveUp = time(NULL) + POOL_BUSY_SECS;       // Stop retrying then
+
+    if(!*up && !(*up = benchMuxOpen(mc, dec ? &decPool : &encPool, w->slot)))
+    {
+        return -1;
+    }
+
+    do
+    {
+        if(muxSubmit(mc, in, size, key, size, out) == -1 || muxWait(mc, &status) == -1)
+        {
+            muxClose(mc);
+            *up = 0;
+            return -1;
+        }
+    } while(status == MUX_ERR_BUSY && poolBackoff(&delay, mc->retryMs, giveUp));
+
+    return (status == 0) ? size : -1;
+}
+
+
+// *****************************************************************************
+//
+// static long benchRequest(struct benchWorker *w, int dec, char *in,
+//                          char *key, long size, char *out)
+//
+// Purpose: Run one request the way the run was asked to.
+//
+// *****************************************************************************
+//
+static long benchRequest(struct benchWorker *w, int dec, char *in, char *key,
+                         long size, char *out)
+{
+    if(muxMode)
+    {
+        return benchMux(w, dec, in, key, size, out);
+    }
+
+    return poolRequest(dec ? &decPool : &encPool, in, size, key, size, out);
+}
+
+
+// *****************************************************************************
+//
+// static void *benchFill(void *arg)
+//
+// Purpose: Thread body for the filler: keep the pools topped up with
+// warm connections until the run is over.
+//
+// *****************************************************************************
+//
+static void *benchFill(void *arg)
+{
+    int    opened;  // Connections opened this round
+
+    while(benchNow() < endNs)
+    {
+        opened = poolFill(&encPool);
+        if(haveDec)
+        {
+            opened += poolFill(&decPool);
+        }
+        if(opened == 0)
+        {
+            usleep(BENCH_FILL_US);
+        }
+    }
+
+    return NULL;
+}
+
+
+// *****************************************************************************
+//
+// static void *benchWork(void *arg)
+//
+// Purpose: Thread body for one connection: send requests until the run
+// is over, timing and checking each.
+//
+// *****************************************************************************
+//
+static void *benchWork(void *arg)
+{
+    struct benchWorker *w = arg;  // This connection
+    struct benchPayload *p;       // Payload for this request
+    struct timespec due;          // When an open loop request is due
+    long   begin, done;           // Request start and finish (ns)
+    long   pick;                  // Weighted payload pick
+    int    ok;                    // Result checked out?
+
+    while(1)
+    {
+        // Open loop: take the next request off the schedule and wait for
+        // its time, or go straight away if we're behind.
+        //
+        if(rate > 0)
+        {
+            begin = startNs + (long)(__atomic_fetch_add(&ticket, 1, __ATOMIC_RELAXED) *
+                                     (1000000000.0 / rate));
+            if(begin >= endNs)
+            {
+                break;
+            }
+            due.tv_sec = begin / 1000000000L;
+            due.tv_nsec = begin % 1000000000L;
+            while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due, NULL) != 0)
+            {
+                continue;  // Interrupted; the deadline hasn't moved
+            }
+        }
+        else if((begin = benchNow()) >= endNs)
+        {
+            break;
+        }
+
+        pick = rand_r(&w->seed) % totalWeight;
+        for(p = mix; pick >= p->weight; p++)
+        {
+            pick -= p->weight;
+        }
+
+        if(benchRequest(w, 0, p->plain, p->key, p->size, w->out) != p->size ||
+           (haveDec && benchRequest(w, 1, w->out, p->key, p->size, w->back) != p->size))
+        {
+            w->errors++;
+            continue;
+        }
+        done = benchNow();
+
+        ok = (memcmp(w->out, p->cipher, p->size) == 0);
+        if(haveDec)
+        {
+            ok = ok && (memcmp(w->back, p->plain, p->size) == 0);
+        }
+        if(!ok)
+        {
+            w->wrong++;
+        }
+
+        w->requests++;
+        w->chars += p->size * (haveDec ? 2 : 1);
+        w->hist[benchBucket(done - begin)]++;
+    }
+
+    return NULL;
+}
+
+
+// *****************************************************************************
+//
+// static void benchReport(struct benchWorker *w, int conns, long elapsed)
+//
+// Purpose: Add up the workers and print the results.
+//
+// *****************************************************************************
+//
+static void benchReport(struct benchWorker *w, int conns, long elapsed)
+{
+    static long hist[BENCH_BUCKETS];  // All latencies
+    double quant[] = { 0.5, 0.9, 0.99, 0.999, 1.0 }; // Percentiles shown
+    char   *label[] = { "p50", "p90", "p99", "p999", "max" };
+    long   requests = 0, errors = 0, wrong = 0, chars = 0; // Totals
+    long   seen, want;                // Latencies counted so far, and needed
+    double secs = elapsed / 1e9;      // Run length
+    int    idx, b, q;                 // Loop indexes
+
+    for(idx = 0; idx < conns; idx++)
+    {
+        requests += w[idx].requests;
+        errors += w[idx].errors;
+        wrong += w[idx].wrong;
+        chars += w[idx].chars;
+        for(b = 0; b < BENCH_BUCKETS; b++)
+        {
+            hist[b] += w[idx].hist[b];
+        }
+    }
+
+    printf("requests    %ld in %.2f s (%s, %d connections%s%s)\n", requests, secs,
+           (rate > 0) ? "open loop" : "closed loop", conns,
+           haveDec ? ", encode+decode" : ", encode", muxMode ? ", multiplexed" : "");
+    if(rate > 0)
+    {
+        printf("rate        %.1f/s asked, %.1f/s done\n", rate, requests / secs);
+    }
+    else
+    {
+        printf("rate        %.1f/s\n", requests / secs);
+    }
+    printf("throughput  %.2f MB/s\n", chars / secs / 1e6);
+    printf("errors      %ld failed, %ld wrong\n", errors, wrong);
+
+    if(requests == 0)
+    {
+        return;
+    }
+
+    // Each percentile is the first bucket by which that share of the
+    // requests had come back.
+    //
+    printf("latency    ");
+    seen = hist[0];
+    b = 0;
+    for(q = 0; q < 5; q++)
+    {
+        want = (long)(quant[q] * requests + 0.999999);
+        while(seen < want && b < BENCH_BUCKETS - 1)
+        {
+            seen += hist[++b];
+        }
+        printf(" %s %.1fus", label[q], benchValue(b) / 1000.0);
+    }
+    printf("\n");
+}
+
+
+int main(int argc, char **argv)
+{
+    struct benchWorker *worker;   // One per connection
+    pthread_t filler;             // Keeps the pools warm (without -M)
+    struct otpHooks hooks;        // Counters around the sends and receives (-H)
+    int    conns = BENCH_CONNS;   // Connections (-c)
+    int    secs = BENCH_SECS;     // Run length (-d)
+    char   *spec = BENCH_MIX;     // Payload mix (-m)
+    long   largest = 0;           // Largest payload
+    int    counting = 0;          // Read hardware counters (-H)
+    int    opt;                   // Current command line option
+    int    idx;                   // Loop index
+
+    // -c connections, -r requests per second (open loop; closed loop
+    // without it), -d seconds, -m payload mix as size[:weight],... -M
+    // sends the requests as streams on one multiplexed connection per
+    // worker, and -C puts a checksum on every frame. -H reads hardware
+    // counters around the clients' sends and receives.
+    //
+    while((opt = getopt(argc, argv, "CHMc:d:m:r:")) != -1)
+    {
+        switch(opt)
+        {
+            case 'C':
+                muxCrc = 1;
+                break;
+
+            case 'H':
+                counting = 1;
+                break;
+
+            case 'M':
+                muxMode = 1;
+                break;
+
+            case 'c':
+                conns = atoi(optarg);
+                break;
+
+            case 'd':
+                secs = atoi(optarg);
+                break;
+
+            case 'm':
+                spec = optarg;
+                break;
+
+            case 'r':
+                rate = atof(optarg);
+                break;
+
+            default:
+                argc = 0; // Fall into the usage message below
+                break;
+        }
+    }
+
+    if(argc - optind < 1 || conns < 1 || conns > BENCH_MAX_CONNS || secs < 1 ||
+       (muxCrc && !muxMode))
+    {
+        fprintf(stderr, "Usage: %s [-c connections] [-r requests_per_sec] [-d secs]\n"
+                        "       [-m size[:weight],...] [-M [-C]] [-H] enc_servers [dec_servers]\n", argv[0]);
+        exit(1);
+    }
+
+    if(benchMix(spec) == -1)
+    {
+        fprintf(stderr, "ERROR: bad payload mix: %s\n", spec);
+        exit(1);
+    }
+    for(idx = 0; idx < numMix; idx++)
+    {
+        largest = (mix[idx].size > largest) ? mix[idx].size : largest;
+    }
+
+    // One warm connection per worker (a multiplexed one with -M), opened
+    // before the clock starts. Without -M the filler replaces them as
+    // they're used up.
+    //
+    if(poolInit(&encPool, argv[optind], OTP_ENCODE, conns, POOL_ROUND_ROBIN) == -1 ||
+       (argc - optind > 1 &&
+        poolInit(&decPool, argv[optind + 1], OTP_DECODE, conns, POOL_ROUND_ROBIN) == -1))
+    {
+        fprintf(stderr, "ERROR: bad server list\n");
+        exit(1);
+    }
+    haveDec = (argc - optind > 1);
+
+    if((worker = calloc(conns, sizeof(*worker))) == NULL)
+    {
+        perror("calloc failed");
+        exit(1);
+    }
+
+    if(!muxMode)
+    {
+        poolFill(&encPool);
+        if(haveDec)
+        {
+            poolFill(&decPool);
+        }
+    }
+    for(idx = 0; idx < conns && muxMode; idx++)
+    {
+        worker[idx].slot = idx;
+        worker[idx].encUp = benchMuxOpen(&worker[idx].encMux, &encPool, idx);
+        worker[idx].decUp = haveDec && benchMuxOpen(&worker[idx].decMux, &decPool, idx);
+    }
+
+    // Counting starts here, so neither the expected results nor the
+    // warm connections are in it.
+    //
+    if(perfInit(counting) == -1)
+    {
+        perror("Hardware counter setup failed");
+        exit(1);
+    }
+    if(counting)
+    {
+        hooks.moved = NULL;
+        hooks.begin = perfBegin;
+        hooks.end = perfEnd;
+        otpSetHooks(&hooks);
+    }
+
+    startNs = benchNow();
+    endNs = startNs + secs * 1000000000L;
+    if(!muxMode && pthread_create(&filler, NULL, benchFill, NULL) != 0)
+    {
+        perror("Filler setup failed");
+        exit(1);
+    }
+    for(idx = 0; idx < conns; idx++)
+    {
+        worker[idx].seed = (unsigned int)(startNs + idx);
+        worker[idx].out = malloc(largest);
+        worker[idx].back = malloc(largest);
+        if(worker[idx].out == NULL || worker[idx].back == NULL ||
+           pthread_create(&worker[idx].thread, NULL, benchWork, &worker[idx]) != 0)
+        {
+            perror("Worker setup failed");
+            exit(1);
+        }
+    }
+
+    for(idx = 0; idx < conns; idx++)
+    {
+        pthread_join(worker[idx].thread, NULL);
+        if(worker[idx].encUp)
+        {
+            muxClose(&worker[idx].encMux);
+        }
+        if(worker[idx].decUp)
+        {
+            muxClose(&worker[idx].decMux);
+        }
+        free(worker[idx].out);
+        free(worker[idx].back);
+    }
+
+    if(!muxMode)
+    {
+        pthread_join(filler, NULL);
+    }
+
+    benchReport(worker, conns, benchNow() - startNs);
+    perfReport(stdout);
+
+    poolDestroy(&encPool);
+    if(haveDec)
+    {
+        poolDestroy(&decPool);
+    }
+    free(worker);
+
+    return 0;
+}
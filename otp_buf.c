@@ -0,0 +1,532 @@
+//
+// *****************************************************************************
+//
+// Author:    Erik Ratcliffe
+// Date:      June 5, 2015
+// Project:   Program 4 - OTP
+// Filename:  otp_buf.c
+// Class:     CS 344 (Spring 2015)
+//
+//
+// Overview:
+//    Server/client simulation of the classic "One-time Pad" encryption scheme.
+//
+//    This file contains the server's payload buffer pool (see otp_buf.h).
+//
+// *****************************************************************************
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <linux/mempolicy.h>
+#include "otp_buf.h"
+
+
+// Header at the start of every block, free or not. Blocks are found by
+// their offset in the arena, which every child sees at the same address.
+//
+struct bufBlock
+{
+    int    order;    // log2 of the block size
+    int    free;     // On a free list?
+    pid_t  pid;      // Child holding it (0 = the server)
+    long   next;     // Free list links (offsets, -1 = none)
+    long   prev;
+};
+
+
+struct bufPool
+{
+    pthread_mutex_t lock;                  // Guards everything below
+    long   size;                           // Arena size
+    long   slice;                          // Size of each node's slice
+    int    nodes;                          // Number of slices
+    int    top;                            // Largest order in a slice
+    long   head[BUF_MAX_NODES][BUF_MAX_ORDER + 1]; // Free list per slice and order
+    long   held;                           // Blocks handed out
+    struct bufUsage usage;                 // Counters
+};
+
+
+static struct bufPool *pool = NULL;        // Shared allocator state
+static char *arena = NULL;                 // Shared blocks
+static int  home = 0;                      // Slice this process takes from first
+
+
+// *****************************************************************************
+//
+// static struct bufBlock *bufAt(long off)
+//
+// Purpose: Block header at an arena offset.
+//
+// *****************************************************************************
+//
+static struct bufBlock *bufAt(long off)
+{
+    return (struct bufBlock *)(arena + off);
+}
+
+
+// *****************************************************************************
+//
+// static void bufPush(long off, int order)
+//
+// Purpose: Put a block on its free list. Caller holds the lock.
+//
+// *****************************************************************************
+//
+static void bufPush(long off, int order)
+{
+    struct bufBlock *blk = bufAt(off); // Block going on the list
+
+    blk->order = order;
+    blk->free = 1;
+    blk->pid = 0;
+    blk->prev = -1;
+    blk->next = pool->head[off / pool->slice][order];
+
+    if(blk->next != -1)
+    {
+        bufAt(blk->next)->prev = off;
+    }
+
+    pool->head[off / pool->slice][order] = off;
+}
+
+
+// *****************************************************************************
+//
+// static void bufUnlink(long off)
+//
+// Purpose: Take a block off its free list. Caller holds the lock.
+//
+// *****************************************************************************
+//
+static void bufUnlink(long off)
+{
+    struct bufBlock *blk = bufAt(off); // Block coming off the list
+
+    if(blk->prev == -1)
+    {
+        pool->head[off / pool->slice][blk->order] = blk->next;
+    }
+    else
+    {
+        bufAt(blk->prev)->next = blk->next;
+    }
+
+    if(blk->next != -1)
+    {
+        bufAt(blk->next)->prev = blk->prev;
+    }
+
+    blk->free = 0;
+}
+
+
+// *****************************************************************************
+//
+// static void bufLock(void)
+//
+// Purpose: Take the pool lock, recovering it if its holder died.
+//
+// *****************************************************************************
+//
+static void bufLock(void)
+{
+    if(pthread_mutex_lock(&pool->lock) == EOWNERDEAD)
+    {
+        pthread_mutex_consistent(&pool->lock);
+    }
+}
+
+
+// *****************************************************************************
+//
+// int bufInit(long budget, int *nodes, int count)
+//
+// Purpose: Map the arena and set up its free lists.
+//
+// *****************************************************************************
+//
+int bufInit(long budget, int *nodes, int count)
+{
+    pthread_mutexattr_t attr; // Makes the lock work across processes
+    unsigned long mask[16];   // Node of one slice, for mbind()
+    long slice;               // Size of each slice
+    long off;                 // Where the next block is carved
+    int  order;               // Its order
+    int  node;                // Slice being carved
+    int  huge = 2;            // What backs the arena
+
+    count = (nodes == NULL || count < 1) ? 1 : count;
+    count = (count > BUF_MAX_NODES) ? BUF_MAX_NODES : count;
+
+    // Every slice is a whole number of huge pages, so no page straddles
+    // two nodes.
+    //
+    budget = (budget <= 0) ? BUF_BUDGET : budget;
+    slice = (budget / count + BUF_HUGE_PAGE - 1) / BUF_HUGE_PAGE * BUF_HUGE_PAGE;
+    budget = slice * count;
+
+    pool = mmap(NULL, sizeof(*pool), PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(pool == MAP_FAILED)
+    {
+        pool = NULL;
+        return -1;
+    }
+
+    // Reserved huge pages if the system has enough of them for the whole
+    // budget (without MAP_NORESERVE, so a shortfall fails here rather
+    // than as a SIGBUS later), otherwise ordinary pages with transparent
+    // huge pages asked for. Ordinary pages are only backed once touched,
+    // so a large budget costs nothing up front.
+    //
+    arena = mmap(NULL, budget, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if(arena == MAP_FAILED)
+    {
+        huge = 0;
+        arena = mmap(NULL, budget, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    }
+    if(arena == MAP_FAILED)
+    {
+        munmap(pool, sizeof(*pool));
+        pool = NULL;
+        arena = NULL;
+        return -1;
+    }
+#ifdef MADV_HUGEPAGE
+    if(huge == 0 && madvise(arena, budget, MADV_HUGEPAGE) == 0)
+    {
+        huge = 1;
+    }
+#endif
+
+    // Bind each slice to its node before carving it touches the first
+    // page. The binding is only a preference, so a node that runs out of
+    // memory spills over rather than failing, and a kernel without NUMA
+    // support (ENOSYS) just leaves the pages where they fall.
+    //
+    for(node = 0; nodes != NULL && count > 1 && node < count; node++)
+    {
+        if(nodes[node] >= 0 && nodes[node] < (int)(sizeof(mask) * 8))
+        {
+            memset(mask, 0, sizeof(mask));
+            mask[nodes[node] / 64] = 1UL << (nodes[node] % 64);
+            syscall(SYS_mbind, arena + node * slice, slice, MPOL_PREFERRED,
+                    mask, sizeof(mask) * 8, 0);
+        }
+    }
+
+    pool->size = budget;
+    pool->slice = slice;
+    pool->nodes = count;
+    pool->usage.budget = budget;
+    pool->usage.huge = huge;
+
+    // Carve each slice into the largest blocks that fit, biggest first,
+    // so every block sits at a multiple of its own size from the start of
+    // its slice and its buddy is always at that offset ^ size.
+    //
+    pool->top = BUF_MIN_ORDER;
+    for(node = 0; node < count; node++)
+    {
+        for(order = 0; order <= BUF_MAX_ORDER; order++)
+        {
+            pool->head[node][order] = -1;
+        }
+
+        for(off = 0; slice - off >= (1L << BUF_MIN_ORDER); off += 1L << order)
+        {
+            order = BUF_MAX_ORDER;
+            while((1L << order) > slice - off)
+            {
+                order--;
+            }
+            if(pool->top < order)
+            {
+                pool->top = order;
+            }
+            bufPush(node * slice + off, order);
+        }
+    }
+
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&pool->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+
+    return 0;
+}
+
+
+// *****************************************************************************
+//
+// void bufNode(int slice)
+//
+// Purpose: Take buffers from the given slice first.
+//
+// *****************************************************************************
+//
+void bufNode(int slice)
+{
+    if(pool != NULL && slice >= 0 && slice < pool->nodes)
+    {
+        home = slice;
+    }
+}
+
+
+// *****************************************************************************
+//
+// static int bufOrder(long size)
+//
+// Purpose: Order of the smallest block that holds size bytes (past the
+// largest order if none does).
+//
+// *****************************************************************************
+//
+static int bufOrder(long size)
+{
+    int order = BUF_MIN_ORDER;  // Candidate order
+
+    while(order <= pool->top && (1L << order) - BUF_HEADER < size)
+    {
+        order++;
+    }
+
+    return order;
+}
+
+
+// *****************************************************************************
+//
+// int bufFits(long size, int count)
+//
+// Purpose: Could the budget ever cover count buffers of size bytes?
+//
+// *****************************************************************************
+//
+int bufFits(long size, int count)
+{
+    int order;  // Block order each buffer needs
+
+    if(pool == NULL)
+    {
+        return 1;
+    }
+
+    // Each slice is carved biggest block first, so it holds exactly
+    // slice / 2^order blocks of any one order.
+    //
+    order = bufOrder((size < 1) ? 1 : size);
+
+    return order <= pool->top && (pool->slice >> order) * pool->nodes >= count;
+}
+
+
+// *****************************************************************************
+//
+// char *bufGet(long size)
+//
+// Purpose: Take a buffer from the pool.
+//
+// *****************************************************************************
+//
+char *bufGet(long size)
+{
+    struct bufBlock *blk;  // Block handed out
+    long off = -1;         // Its offset
+    int  order;            // Order the request needs
+    int  have;             // Order of the free block found
+    int  idx;              // Slices tried, starting from our own
+
+    size = (size < 1) ? 1 : size;
+
+    if(pool == NULL)
+    {
+        return malloc(size);
+    }
+
+    order = bufOrder(size);
+
+    bufLock();
+
+    for(idx = 0; idx < pool->nodes && off == -1; idx++)
+    {
+        for(have = order; have <= pool->top && off == -1; have++)
+        {
+            off = pool->head[(home + idx) % pool->nodes][have];
+        }
+    }
+
+    if(off == -1)
+    {
+        pool->usage.failures++;
+        pthread_mutex_unlock(&pool->lock);
+        return NULL;
+    }
+
+    // Split it down, putting the upper half back each time.
+    //
+    bufUnlink(off);
+    for(have = bufAt(off)->order; have > order; have--)
+    {
+        bufPush(off + (1L << (have - 1)), have - 1);
+    }
+
+    blk = bufAt(off);
+    blk->order = order;
+    blk->pid = getpid();
+
+    pool->held++;
+    pool->usage.allocs++;
+    pool->usage.inUse += 1L << order;
+    if(pool->usage.highWater < pool->usage.inUse)
+    {
+        pool->usage.highWater = pool->usage.inUse;
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+
+    return arena + off + BUF_HEADER;
+}
+
+
+// *****************************************************************************
+//
+// static void bufFree(long off)
+//
+// Purpose: Give a block back, merging it with its buddy for as long as
+// the buddy is free too. Caller holds the lock.
+//
+// *****************************************************************************
+//
+static void bufFree(long off)
+{
+    struct bufBlock *bud;            // Buddy block
+    int  order = bufAt(off)->order;  // Order of the merged block
+    long base = off - off % pool->slice; // Start of the block's slice
+    long buddy;                      // Buddy's offset
+
+    pool->held--;
+    pool->usage.inUse -= 1L << order;
+
+    for(; order < pool->top; order++)
+    {
+        buddy = base + ((off - base) ^ (1L << order));
+        if(buddy + (1L << order) > base + pool->slice)
+        {
+            break;
+        }
+
+        bud = bufAt(buddy);
+        if(!bud->free || bud->order != order)
+        {
+            break;
+        }
+
+        bufUnlink(buddy);
+        off = (buddy < off) ? buddy : off;
+    }
+
+    bufPush(off, order);
+}
+
+
+// *****************************************************************************
+//
+// void bufPut(char *buf)
+//
+// Purpose: Give a buffer back to the pool.
+//
+// *****************************************************************************
+//
+void bufPut(char *buf)
+{
+    if(buf == NULL)
+    {
+        return;
+    }
+
+    if(pool == NULL || buf < arena || buf >= arena + pool->size)
+    {
+        free(buf);
+        return;
+    }
+
+    bufLock();
+    bufFree(buf - BUF_HEADER - arena);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+
+// *****************************************************************************
+//
+// void bufReap(pid_t pid)
+//
+// Purpose: Give back every buffer a reaped child still held.
+//
+// *****************************************************************************
+//
+void bufReap(pid_t pid)
+{
+    struct bufBlock *blk;  // Block being looked at
+    long off;              // Its offset
+    long next;             // Offset of the block after it
+
+    if(pool == NULL || pid <= 0)
+    {
+        return;
+    }
+
+    bufLock();
+
+    // Blocks tile the arena, so walk them header to header. Nothing to do
+    // in the usual case of a child that gave everything back.
+    //
+    for(off = 0; pool->held > 0 && off < pool->size; off = next)
+    {
+        blk = bufAt(off);
+        next = off + (1L << blk->order);
+
+        if(!blk->free && blk->pid == pid)
+        {
+            bufFree(off);
+        }
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+}
+
+
+// *****************************************************************************
+//
+// void bufStats(struct bufUsage *usage)
+//
+// Purpose: Copy out the counters.
+//
+// *****************************************************************************
+//
+void bufStats(struct bufUsage *usage)
+{
+    memset(usage, 0, sizeof(*usage));
+
+    if(pool != NULL)
+    {
+        bufLock();
+        *usage = pool->usage;
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
@@ -0,0 +1,196 @@
+//
+// *****************************************************************************
+//
+// Author:    Erik Ratcliffe
+// Date:      June 5, 2015
+// Project:   Program 4 - OTP
+// Filename:  otp_buf.h
+// Class:     CS 344 (Spring 2015)
+//
+//
+// Overview:
+//    Server/client simulation of the classic "One-time Pad" encryption scheme.
+//
+//    This file contains the definitions and function prototypes for the
+//    server's payload buffer pool. Input, key and result buffers used to
+//    be malloc()ed at whatever size the client announced and freed again
+//    in every child, which meant page faults over every new buffer and no
+//    bound at all on what one bogus size could ask for.
+//
+//    Instead, the server maps one arena of -m bytes (the memory budget),
+//    backed by huge pages if it can get them, before it forks, and the
+//    children share it. Buffers come out of the arena in power-of-two
+//    size classes from BUF_MIN_ORDER up, handed out by a buddy allocator:
+//    a free block is split in halves until it's the right size, and a
+//    block given back is merged with its free buddy, so memory freed by
+//    one request is reused by the next at any size. Pages stay mapped
+//    between requests, so a reused buffer doesn't fault. A request the
+//    budget can't cover gets NULL rather than pushing the machine into
+//    swap; the server then answers busy.
+//
+//    With children placed on NUMA nodes (-A, see otp_numa.h), the arena
+//    is split into one slice per node, each with its pages bound to that
+//    node and its own free lists. A child takes from its own node's slice
+//    first and only falls back to another node when its own is full.
+//
+//    Each block records the child holding it, and the server gives back
+//    whatever a child still held when it's reaped. Outside the server
+//    (the clients) bufGet() and bufPut() are just malloc() and free().
+//
+// *****************************************************************************
+//
+
+#ifndef OTP_BUF_H
+#define OTP_BUF_H
+
+
+#include <sys/types.h>
+
+
+#define BUF_MIN_ORDER   12             // Smallest block (4K)
+#define BUF_MAX_ORDER   40             // Largest block the lists can hold (1T)
+#define BUF_HEADER      64             // Block header, ahead of the buffer
+#define BUF_BUDGET      2147483648L    // Default arena size (2G)
+#define BUF_HUGE_PAGE   2097152        // Huge page size the arena is rounded to
+#define BUF_SKIP        65536          // Scratch for characters not kept
+#define BUF_MAX_NODES   16             // Most NUMA node slices
+
+
+// Allocator counters, for the stats.
+//
+struct bufUsage
+{
+    long   budget;       // Arena size
+    long   inUse;        // Bytes in blocks handed out
+    long   highWater;    // Most bytes ever in use at once
+    long   allocs;       // Buffers handed out
+    long   failures;     // Requests the budget couldn't cover
+    int    huge;         // 2 = hugetlbfs pages, 1 = transparent huge pages
+                         // advised, 0 = ordinary pages
+};
+
+
+// *****************************************************************************
+//
+// int bufInit(long budget, int *nodes, int count)
+//
+//    Entry:   long budget
+//                Arena size in bytes (0 for BUF_BUDGET)
+//             int *nodes
+//                NUMA node of each slice, NULL for one slice left to the
+//                kernel
+//             int count
+//                Number of slices (at most BUF_MAX_NODES are used)
+//
+//    Exit:    Returns 0 on success, -1 if the arena can't be mapped.
+//
+//    Purpose: Map the arena and set up its free lists. Call once in the
+//    server before accepting.
+//
+// *****************************************************************************
+//
+int bufInit(long budget, int *nodes, int count);
+
+
+// *****************************************************************************
+//
+// void bufNode(int slice)
+//
+//    Entry:   int slice
+//                Slice to take buffers from first, as numbered in bufInit()
+//
+//    Exit:    None.
+//
+//    Purpose: Child side: take buffers from the slice on the child's own
+//    node.
+//
+// *****************************************************************************
+//
+void bufNode(int slice);
+
+
+// *****************************************************************************
+//
+// char *bufGet(long size)
+//
+//    Entry:   long size
+//                Bytes needed
+//
+//    Exit:    A buffer of at least size bytes, NULL if the budget can't
+//             cover it.
+//
+//    Purpose: Take a buffer from the pool.
+//
+// *****************************************************************************
+//
+char *bufGet(long size);
+
+
+// *****************************************************************************
+//
+// int bufFits(long size, int count)
+//
+//    Entry:   long size
+//                Bytes per buffer
+//             int count
+//                Buffers needed at once
+//
+//    Exit:    1 if the budget could ever cover them, 0 if not.
+//
+//    Purpose: Tell a request too big for the pool from a pool that's
+//    busy right now.
+//
+// *****************************************************************************
+//
+int bufFits(long size, int count);
+
+
+// *****************************************************************************
+//
+// void bufPut(char *buf)
+//
+//    Entry:   char *buf
+//                Buffer from bufGet() (NULL is ignored)
+//
+//    Exit:    None.
+//
+//    Purpose: Give a buffer back to the pool.
+//
+// *****************************************************************************
+//
+void bufPut(char *buf);
+
+
+// *****************************************************************************
+//
+// void bufReap(pid_t pid)
+//
+//    Entry:   pid_t pid
+//                Child the server has just reaped
+//
+//    Exit:    None.
+//
+//    Purpose: Server side: give back every buffer the child still held.
+//
+// *****************************************************************************
+//
+void bufReap(pid_t pid);
+
+
+// *****************************************************************************
+//
+// void bufStats(struct bufUsage *usage)
+//
+//    Entry:   struct bufUsage *usage
+//                Receives the counters (all zero outside the server)
+//
+//    Exit:    None.
+//
+//    Purpose: For the stats (see otp_stats.h).
+//
+// *****************************************************************************
+//
+void bufStats(struct bufUsage *usage);
+
+
+#endif
@@ -0,0 +1,232 @@
+//
+// *****************************************************************************
+//
+// Author:    Erik Ratcliffe
+// Date:      June 5, 2015
+// Project:   Program 4 - OTP
+// Filename:  otp_check.c
+// Class:     CS 344 (Spring 2015)
+//
+//
+// Overview:
+//    Server/client simulation of the classic "One-time Pad" encryption scheme.
+//
+//    This file contains the self checks run by `make check`: known answers
+//    for the CRC32C checksum and the ChaCha20 block function, a round trip
+//    through padPack() and padUnpack(), and the pad reuse index against a
+//    scratch index file. Each check prints one line; the exit status is 1
+//    if any of them failed.
+//
+// *****************************************************************************
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "otp_crc.h"
+#include "otp_pad.h"
+#include "otp_reuse.h"
+
+
+#define CHECK_CRC_LEN    10000  // Bytes for the CRC comparisons, past 3 lanes
+#define CHECK_PACK_LEN   1003   // Longest pad packed, not a whole group
+#define CHECK_REUSE_LEN  2000   // Characters in each reuse index message
+
+
+static int failed = 0;  // Checks that failed so far
+
+
+// *****************************************************************************
+//
+// static void checkReport(char *name, int ok)
+//
+// Purpose: Print the result of one check and remember a failure.
+//
+// *****************************************************************************
+//
+static void checkReport(char *name, int ok)
+{
+    printf("%-40s %s\n", name, ok ? "ok" : "FAILED");
+    failed += !ok;
+}
+
+
+// *****************************************************************************
+//
+// static uint32_t checkCrcBits(const char *src, long len)
+//
+// Purpose: CRC32C the slow way, one bit at a time, to hold crcCopy() to.
+//
+// *****************************************************************************
+//
+static uint32_t checkCrcBits(const char *src, long len)
+{
+    uint32_t crc = 0xffffffff;  // Running CRC, inverted
+    long     idx;               // Loop index
+    int      bit;               // Loop index
+
+    for(idx = 0; idx < len; idx++)
+    {
+        crc ^= (unsigned char)src[idx];
+        for(bit = 0; bit < 8; bit++)
+        {
+            crc = (crc & 1) ? (crc >> 1) ^ 0x82F63B78 : crc >> 1;
+        }
+    }
+
+    return ~crc;
+}
+
+
+// *****************************************************************************
+//
+// static void checkCrc(void)
+//
+// Purpose: The CRC32C check value, then crcCopy() against the bitwise
+// CRC for whole and split buffers, copying as it goes.
+//
+// *****************************************************************************
+//
+static void checkCrc(void)
+{
+    char     src[CHECK_CRC_LEN];  // Bytes to checksum
+    char     dst[CHECK_CRC_LEN];  // Where crcCopy() copies them
+    uint32_t want;                // CRC of all of src
+    uint32_t crc;                 // CRC built up in pieces
+    long     idx;                 // Loop index
+    long     split;               // Where src is cut in two
+
+    checkReport("crc32c of \"123456789\"",
+                crcCopy(0, NULL, "123456789", 9) == 0xe3069283);
+
+    for(idx = 0; idx < CHECK_CRC_LEN; idx++)
+    {
+        src[idx] = (char)(idx * 7 + (idx >> 8));
+    }
+    want = checkCrcBits(src, CHECK_CRC_LEN);
+
+    memset(dst, 0, sizeof(dst));
+    checkReport("crc32c copy matches bitwise crc",
+                crcCopy(0, dst, src, CHECK_CRC_LEN) == want &&
+                memcmp(dst, src, CHECK_CRC_LEN) == 0);
+
+    for(split = 0; split <= CHECK_CRC_LEN; split += 997)
+    {
+        crc = crcCopy(crcCopy(0, NULL, src, split), NULL, src + split,
+                      CHECK_CRC_LEN - split);
+        if(crc != want)
+        {
+            break;
+        }
+    }
+    checkReport("crc32c in two pieces", split > CHECK_CRC_LEN);
+}
+
+
+// *****************************************************************************
+//
+// static void checkPack(void)
+//
+// Purpose: padPack() and padUnpack() round trip for every length up to
+// CHECK_PACK_LEN, and an out of range group is refused.
+//
+// *****************************************************************************
+//
+static void checkPack(void)
+{
+    char          pad[CHECK_PACK_LEN];   // Pad characters
+    char          back[CHECK_PACK_LEN];  // Unpacked again
+    unsigned char packed[(CHECK_PACK_LEN + PAD_GROUP - 1) / PAD_GROUP * 3];
+    unsigned char bad[3] = { 0xff, 0xff, 0xff }; // Above 27^5 - 1
+    long          len;                   // Characters packed
+    int           ok;                    // Every length came back?
+
+    ok = (padFill(pad, CHECK_PACK_LEN) == 0);
+    for(len = 0; len <= CHECK_PACK_LEN && ok; len++)
+    {
+        ok = padPack(pad, len, packed) == (len + PAD_GROUP - 1) / PAD_GROUP * 3 &&
+             padUnpack(packed, len, back) == 0 &&
+             memcmp(pad, back, len) == 0;
+    }
+    checkReport("padPack/padUnpack round trip", ok);
+    checkReport("padUnpack refuses a bad group", padUnpack(bad, PAD_GROUP, back) == -1);
+}
+
+
+// *****************************************************************************
+//
+// static void checkReuse(void)
+//
+// Purpose: The reuse index, in a scratch file: first use, resend and reuse,
+// and a refused message leaves none of its key behind.
+//
+// *****************************************************************************
+//
+static void checkReuse(void)
+{
+    char path[] = "/tmp/otp_checkXXXXXX";  // Scratch index file
+    char in[2 * CHECK_REUSE_LEN];          // Input characters
+    char key[2 * CHECK_REUSE_LEN];         // Fresh key, then used key
+    char used[CHECK_REUSE_LEN];            // Key of the first message
+    int  fd;                               // Scratch file, to create it
+
+    // reuseInit() wants the file missing or an index, so the name is
+    // taken and the file emptied.
+    //
+    if((fd = mkstemp(path)) == -1)
+    {
+        checkReport("reuse index", 0);
+        return;
+    }
+    close(fd);
+    unlink(path);
+
+    if(reuseInit(path) == -1 || padFill(in, sizeof(in)) == -1 ||
+       padFill(key, sizeof(key)) == -1)
+    {
+        unlink(path);
+        checkReport("reuse index", 0);
+        return;
+    }
+    memcpy(used, key + CHECK_REUSE_LEN, CHECK_REUSE_LEN);
+
+    checkReport("reuse index: first use",
+                reuseCheck(in, used, CHECK_REUSE_LEN) == REUSE_OK);
+    checkReport("reuse index: resend",
+                reuseCheck(in, used, CHECK_REUSE_LEN) == REUSE_OK);
+    checkReport("reuse index: used key, other input",
+                reuseCheck(in + 1, used, CHECK_REUSE_LEN) == REUSE_FOUND);
+
+    // The second half of key is the used one, so the whole message is
+    // refused; its fresh first half must still be usable afterwards.
+    //
+    checkReport("reuse index: fresh then used key",
+                reuseCheck(in, key, 2 * CHECK_REUSE_LEN) == REUSE_FOUND);
+    checkReport("reuse index: refused key left out",
+                reuseCheck(in + 2, key, CHECK_REUSE_LEN) == REUSE_OK);
+
+    unlink(path);
+}
+
+
+int main(void)
+{
+    checkCrc();
+    checkReport("chacha20 block (RFC 8439 2.3.2)", padSelfTest() == 0);
+    checkPack();
+
+    // The reuse index reports what it refuses on stderr; that's expected
+    // here.
+    //
+    checkReuse();
+
+    if(failed > 0)
+    {
+        printf("%d check%s failed\n", failed, (failed == 1) ? "" : "s");
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,253 @@
+//
+// *****************************************************************************
+//
+// Author:    Erik Ratcliffe
+// Date:      June 5, 2015
+// Project:   Program 4 - OTP
+// Filename:  otp_crc.c
+// Class:     CS 344 (Spring 2015)
+//
+//
+// Overview:
+//    Server/client simulation of the classic "One-time Pad" encryption scheme.
+//
+//    This file contains the CRC32C checksums (see otp_crc.h).
+//
+// *****************************************************************************
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "otp_crc.h"
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#include <wmmintrin.h>
+#endif
+
+
+#define CRC_POLY    0x82F63B78  // Castagnoli polynomial, bit reflected
+
+
+static uint32_t crcTable[8][256];  // Table for eight bytes at a time
+
+// Checksum in use, picked on first call. Works on the inverted CRC.
+//
+static uint32_t (*crcImpl)(uint32_t crc, char *dst, const char *src, long len) = NULL;
+static pthread_once_t crcOnce = PTHREAD_ONCE_INIT; // Runs crcPick()
+
+
+// *****************************************************************************
+//
+// static uint32_t crcSoft(uint32_t crc, char *dst, const char *src, long len)
+//
+// Purpose: Table checksum, eight bytes at a time, copying as it goes.
+//
+// *****************************************************************************
+//
+static uint32_t crcSoft(uint32_t crc, char *dst, const char *src, long len)
+{
+    const unsigned char *in = (const unsigned char *)src; // Bytes to read
+    uint64_t word;  // Next eight bytes, first byte lowest
+    int      idx;   // Loop index
+
+    for(; len >= 8; len -= 8, in += 8)
+    {
+        word = 0;
+        for(idx = 7; idx >= 0; idx--)
+        {
+            word = (word << 8) | in[idx];
+        }
+        if(dst != NULL)
+        {
+            memcpy(dst, in, 8);
+            dst += 8;
+        }
+
+        word ^= crc;
+        crc = crcTable[7][word & 0xff] ^ crcTable[6][(word >> 8) & 0xff] ^
+              crcTable[5][(word >> 16) & 0xff] ^ crcTable[4][(word >> 24) & 0xff] ^
+              crcTable[3][(word >> 32) & 0xff] ^ crcTable[2][(word >> 40) & 0xff] ^
+              crcTable[1][(word >> 48) & 0xff] ^ crcTable[0][word >> 56];
+    }
+
+    for(; len > 0; len--, in++)
+    {
+        if(dst != NULL)
+        {
+            *dst++ = *in;
+        }
+        crc = crcTable[0][(crc ^ *in) & 0xff] ^ (crc >> 8);
+    }
+
+    return crc;
+}
+
+
+#if defined(__x86_64__)
+
+static uint32_t crcLaneK;  // Multiplier that shifts a CRC past CRC_LANE bytes
+
+
+// *****************************************************************************
+//
+// static uint32_t crcShift(uint32_t crc)
+//
+// Purpose: The CRC crc would become after CRC_LANE more zero bytes. The
+// carry-less product with x^(8 * CRC_LANE - 33) is 64 bits, and the crc32
+// instruction reduces it (multiplying by x^33 on the way).
+//
+// *****************************************************************************
+//
+__attribute__((target("sse4.2,pclmul")))
+static uint32_t crcShift(uint32_t crc)
+{
+    __m128i prod = _mm_clmulepi64_si128(_mm_cvtsi32_si128(crc),
+                                        _mm_cvtsi32_si128(crcLaneK), 0);
+
+    return (uint32_t)_mm_crc32_u64(0, (uint64_t)_mm_cvtsi128_si64(prod));
+}
+
+
+// *****************************************************************************
+//
+// static uint32_t crcHard(uint32_t crc, char *dst, const char *src, long len)
+//
+// Purpose: SSE4.2 checksum, copying as it goes. Each crc32 takes three
+// cycles to finish but a new one can start every cycle, so three lanes of
+// CRC_LANE bytes are run side by side and then merged.
+//
+// *****************************************************************************
+//
+__attribute__((target("sse4.2,pclmul")))
+static uint32_t crcHard(uint32_t crc, char *dst, const char *src, long len)
+{
+    uint64_t crc0, crc1, crc2;  // One CRC per lane
+    uint64_t word0, word1, word2; // Next eight bytes of each lane
+    long     idx;               // Offset within the lanes
+
+    for(; len >= 3 * CRC_LANE; len -= 3 * CRC_LANE, src += 3 * CRC_LANE)
+    {
+        crc0 = crc;
+        crc1 = crc2 = 0;
+        for(idx = 0; idx < CRC_LANE; idx += 8)
+        {
+            memcpy(&word0, src + idx, 8);
+            memcpy(&word1, src + CRC_LANE + idx, 8);
+            memcpy(&word2, src + 2 * CRC_LANE + idx, 8);
+            crc0 = _mm_crc32_u64(crc0, word0);
+            crc1 = _mm_crc32_u64(crc1, word1);
+            crc2 = _mm_crc32_u64(crc2, word2);
+            if(dst != NULL)
+            {
+                memcpy(dst + idx, &word0, 8);
+                memcpy(dst + CRC_LANE + idx, &word1, 8);
+                memcpy(dst + 2 * CRC_LANE + idx, &word2, 8);
+            }
+        }
+        dst = (dst != NULL) ? dst + 3 * CRC_LANE : NULL;
+
+        // A CRC is linear: lane 1 run on from lane 0's result is lane 0
+        // shifted past lane 1, plus lane 1 started from zero.
+        //
+        crc = crcShift(crcShift((uint32_t)crc0) ^ (uint32_t)crc1) ^ (uint32_t)crc2;
+    }
+
+    crc0 = crc;
+    for(; len >= 8; len -= 8, src += 8)
+    {
+        memcpy(&word0, src, 8);
+        crc0 = _mm_crc32_u64(crc0, word0);
+        if(dst != NULL)
+        {
+            memcpy(dst, &word0, 8);
+            dst += 8;
+        }
+    }
+    crc = (uint32_t)crc0;
+
+    for(; len > 0; len--, src++)
+    {
+        if(dst != NULL)
+        {
+            *dst++ = *src;
+        }
+        crc = _mm_crc32_u8(crc, (unsigned char)*src);
+    }
+
+    return crc;
+}
+
+#endif
+
+
+// *****************************************************************************
+//
+// static void crcPick(void)
+//
+// Purpose: Build the table and pick the fastest checksum this CPU has.
+// Runs once, under pthread_once(), so no caller sees a half-built table.
+//
+// *****************************************************************************
+//
+static void crcPick(void)
+{
+    uint32_t crc;   // Table entry being built
+    long     bit;   // Loop index
+    int      n, k;  // Table indexes
+
+    for(n = 0; n < 256; n++)
+    {
+        crc = n;
+        for(bit = 0; bit < 8; bit++)
+        {
+            crc = (crc & 1) ? (crc >> 1) ^ CRC_POLY : crc >> 1;
+        }
+        crcTable[0][n] = crc;
+    }
+    for(n = 0; n < 256; n++)
+    {
+        for(k = 1; k < 8; k++)
+        {
+            crcTable[k][n] = (crcTable[k - 1][n] >> 8) ^
+                             crcTable[0][crcTable[k - 1][n] & 0xff];
+        }
+    }
+
+    crcImpl = crcSoft;
+
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("pclmul"))
+    {
+        // x^(8 * CRC_LANE - 33), bit reflected: start from 1 (the top
+        // bit) and multiply by x one bit at a time.
+        //
+        crc = 0x80000000;
+        for(bit = 0; bit < 8 * CRC_LANE - 33; bit++)
+        {
+            crc = (crc & 1) ? (crc >> 1) ^ CRC_POLY : crc >> 1;
+        }
+        crcLaneK = crc;
+        crcImpl = crcHard;
+    }
+#endif
+}
+
+
+// *****************************************************************************
+//
+// uint32_t crcCopy(uint32_t crc, char *dst, const char *src, long len)
+//
+// Purpose: Copy and checksum in one pass.
+//
+// *****************************************************************************
+//
+uint32_t crcCopy(uint32_t crc, char *dst, const char *src, long len)
+{
+    pthread_once(&crcOnce, crcPick);
+
+    return ~crcImpl(~crc, dst, src, len);
+}
@@ -0,0 +1,60 @@
+//
+// *****************************************************************************
+//
+// Author:    Erik Ratcliffe
+// Date:      June 5, 2015
+// Project:   Program 4 - OTP
+// Filename:  otp_crc.h
+// Class:     CS 344 (Spring 2015)
+//
+//
+// Overview:
+//    Server/client simulation of the classic "One-time Pad" encryption scheme.
+//
+//    This file contains the function prototypes for the CRC32C (Castagnoli)
+//    checksums that guard multiplexed frames (see otp_mux.h). The cipher
+//    turns a corrupted character into a wrong one without complaint, so
+//    corruption in transit would otherwise only show up after decoding.
+//
+//    The checksum is taken while the payload is copied, so the bytes are
+//    only read once. On x86 CPUs with SSE4.2 the crc32 instruction does the
+//    work, three independent streams at a time, and the three partial
+//    results are merged with a carry-less multiply (PCLMUL). Other CPUs use
+//    a table, eight bytes at a time. Which one runs is decided once, on
+//    first use.
+//
+// *****************************************************************************
+//
+
+#ifndef OTP_CRC_H
+#define OTP_CRC_H
+
+
+#include <stdint.h>
+
+
+#define CRC_LEN     4      // Checksum bytes on the wire
+#define CRC_LANE    1024   // Bytes per stream when three run side by side
+
+
+// *****************************************************************************
+//
+// uint32_t crcCopy(uint32_t crc, char *dst, const char *src, long len)
+//
+//    Entry:   uint32_t crc
+//                CRC32C of the bytes before src (0 to start)
+//             char *dst
+//                Where to copy the bytes (NULL to only checksum them)
+//             const char *src, long len
+//                Bytes to checksum
+//
+//    Exit:    CRC32C of everything so far, src included.
+//
+//    Purpose: Copy and checksum in one pass.
+//
+// *****************************************************************************
+//
+uint32_t crcCopy(uint32_t crc, char *dst, const char *src, long len);
+
+
+#endif
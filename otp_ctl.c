@@ -0,0 +1,446 @@
+//
+// *****************************************************************************
+//
+// Author:    Erik Ratcliffe
+// Date:      June 5, 2015
+// Project:   Program 4 - OTP
+// Filename:  otp_ctl.c
+// Class:     CS 344 (Spring 2015)
+//
+//
+// Overview:
+//    Server/client simulation of the classic "One-time Pad" encryption scheme.
+//
+//    This file contains the server's control socket (see otp_ctl.h).
+//
+// *****************************************************************************
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "otp_admit.h"
+#include "otp_ctl.h"
+#include "otp_deadline.h"
+#include "otp_log.h"
+#include "otp_sched.h"
+#include "otp_trace.h"
+
+
+static int  listener = -1;       // The server's listening socket
+static int  backlogNow;          // Its backlog
+
+static char *logName[] = { "off", "errors", "all" };
+
+
+// *****************************************************************************
+//
+// int ctlInit(char *path, int listenSock, int backlog)
+//
+// Purpose: Set up the control socket.
+//
+// *****************************************************************************
+//
+int ctlInit(char *path, int listenSock, int backlog)
+{
+    struct sockaddr_un addr;  // Control socket address
+    int    sock;              // Control socket
+
+    listener = listenSock;
+    backlogNow = backlog;
+
+    if(path == NULL)
+    {
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if(strlen(path) >= sizeof(addr.sun_path))
+    {
+        return -2;
+    }
+    strcpy(addr.sun_path, path);
+
+    // A socket left behind by an earlier run would make bind() fail.
+    //
+    unlink(path);
+
+    // Anyone who can connect can change the limits, so only our own user
+    // may. The socket is non-blocking for the same reason as the stats
+    // socket: a client gone before we accept can't hang the server.
+    //
+    if((sock = socket(AF_UNIX, SOCK_STREAM, 0)) == -1)
+    {
+        return -2;
+    }
+    if(bind(sock, (struct sockaddr *)&addr, sizeof(addr)) == -1 ||
+       chmod(path, 0600) == -1 || listen(sock, 16) == -1 ||
+       fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK) == -1)
+    {
+        close(sock);
+        return -2;
+    }
+
+    return sock;
+}
+
+
+// *****************************************************************************
+//
+// static int ctlAdd(char *out, int len, char *fmt, ...)
+//
+// Purpose: Append to the answer, stopping quietly when it's full. Returns
+// the new length.
+//
+// *****************************************************************************
+//
+static int ctlAdd(char *out, int len, char *fmt, ...)
+{
+    va_list ap;  // Format arguments
+    int     num; // Characters the format wanted
+
+    if(len >= CTL_OUT - 1)
+    {
+        return len;
+    }
+
+    va_start(ap, fmt);
+    num = vsnprintf(out + len, CTL_OUT - len, fmt, ap);
+    va_end(ap);
+
+    return (num < 0 || len + num >= CTL_OUT) ? CTL_OUT - 1 : len + num;
+}
+
+
+// *****************************************************************************
+//
+// static int ctlShow(char *out, int len, char *only, int children)
+//
+// Purpose: Append the settings now in force, or just the one named only
+// (NULL for all). Every tuning call with nothing to change just reads.
+// Returns the new length.
+//
+// *****************************************************************************
+//
+static int ctlShow(char *out, int len, char *only, int children)
+{
+    long   secs[4] = { -1, -1, -1, -1 }; // Phase deadlines
+    long   idle = -1, rate = -1;         // Idle limit, minimum throughput
+    long   chars = 0, small = 0;         // Characters in flight, small limit
+    long   trace = -1;                   // Trace threshold
+    long   rotate = 0;                   // Log size limit
+    int    conns = 0, slots = 0;         // Connections, large slots
+    int    level = -1;                   // Log level
+
+    admitTune(&conns, &chars);
+    schedTune(&slots, &small);
+    deadlineTune(secs, &idle, &rate);
+    traceTune(&trace);
+    logTune(&level, &rotate);
+
+    if(only == NULL || strcmp(only, "connections") == 0)
+    {
+        len = ctlAdd(out, len, "connections %d\n", conns);
+    }
+    if(only == NULL || strcmp(only, "chars") == 0)
+    {
+        len = ctlAdd(out, len, "chars %ld\n", chars);
+    }
+    if(only == NULL || strcmp(only, "backlog") == 0)
+    {
+        len = ctlAdd(out, len, "backlog %d\n", backlogNow);
+    }
+    if(only == NULL || strcmp(only, "slots") == 0)
+    {
+        len = ctlAdd(out, len, "slots %d\n", slots);
+    }
+    if(only == NULL || strcmp(only, "small") == 0)
+    {
+        len = ctlAdd(out, len, "small %ld\n", small);
+    }
+    if(only == NULL || strcmp(only, "deadlines") == 0)
+    {
+        len = ctlAdd(out, len, "deadlines %ld,%ld,%ld,%ld\n",
+                     secs[0], secs[1], secs[2], secs[3]);
+    }
+    if(only == NULL || strcmp(only, "idle") == 0)
+    {
+        len = ctlAdd(out, len, "idle %ld\n", idle);
+    }
+    if(only == NULL || strcmp(only, "rate") == 0)
+    {
+        len = ctlAdd(out, len, "rate %ld\n", rate);
+    }
+    if(only == NULL || strcmp(only, "trace") == 0)
+    {
+        len = (trace < 0) ? ctlAdd(out, len, "trace off\n") :
+                            ctlAdd(out, len, "trace %ld\n", trace);
+    }
+    if(only == NULL || strcmp(only, "log") == 0)
+    {
+        len = ctlAdd(out, len, "log %s\n", (level < 0) ? "none" : logName[level]);
+    }
+    if(only == NULL || strcmp(only, "rotate") == 0)
+    {
+        len = ctlAdd(out, len, "rotate %ld\n", rotate);
+    }
+    if(only == NULL)
+    {
+        len = ctlAdd(out, len, "children %d\n", children);
+    }
+
+    return len;
+}
+
+
+// *****************************************************************************
+//
+// static char *ctlSet(char *name, char *value)
+//
+// Purpose: Change one setting. Returns NULL on success, otherwise what
+// was wrong.
+//
+// *****************************************************************************
+//
+static char *ctlSet(char *name, char *value)
+{
+    long   secs[4] = { -1, -1, -1, -1 }; // Phase deadlines
+    long   idle = -1, rate = -1;         // Idle limit, minimum throughput
+    long   chars = 0, small = 0;         // Characters in flight, small limit
+    long   rotate = 0;                   // Log size limit
+    long   num;                          // value as a number
+    char   *end;                         // End of the number
+    char   extra;                        // Anything after four deadlines
+    int    conns = 0, slots = 0;         // Connections, large slots
+    int    level;                        // Log level
+
+    num = strtol(value, &end, 10);
+    if(end == value || *end != '\0')
+    {
+        num = -1;
+    }
+
+    if(strcmp(name, "deadlines") == 0)
+    {
+        if(sscanf(value, "%ld,%ld,%ld,%ld%c", &secs[0], &secs[1], &secs[2],
+                  &secs[3], &extra) != 4 ||
+           secs[0] < 0 || secs[1] < 0 || secs[2] < 0 || secs[3] < 0)
+        {
+            return "want four comma separated seconds";
+        }
+        deadlineTune(secs, &idle, &rate);
+    }
+    else if(strcmp(name, "idle") == 0 || strcmp(name, "rate") == 0)
+    {
+        if(num < 0)
+        {
+            return "want a number, 0 for none";
+        }
+        idle = (name[0] == 'i') ? num : -1;
+        rate = (name[0] == 'r') ? num : -1;
+        deadlineTune(secs, &idle, &rate);
+    }
+    else if(strcmp(name, "log") == 0)
+    {
+        for(level = LOG_OFF; level <= LOG_ALL && strcmp(value, logName[level]) != 0; level++)
+        {
+        }
+        if(level > LOG_ALL)
+        {
+            return "want all, errors or off";
+        }
+        logTune(&level, &rotate);
+        if(level < 0)
+        {
+            return "no access log (-L)";
+        }
+    }
+    else if(strcmp(name, "trace") == 0)
+    {
+        if(num < 0)
+        {
+            return "want a number of ms";
+        }
+        traceTune(&num);
+        if(num < 0)
+        {
+            return "can't start tracing";
+        }
+    }
+    else if(num <= 0)
+    {
+        return "want a number above 0";
+    }
+    else if(strcmp(name, "connections") == 0 || strcmp(name, "chars") == 0)
+    {
+        conns = (name[1] == 'o') ? (int)num : 0;
+        chars = (name[1] == 'h') ? num : 0;
+        admitTune(&conns, &chars);
+    }
+    else if(strcmp(name, "slots") == 0 || strcmp(name, "small") == 0)
+    {
+        slots = (name[1] == 'l') ? (int)num : 0;
+        small = (name[1] == 'm') ? num : 0;
+        schedTune(&slots, &small);
+    }
+    else if(strcmp(name, "rotate") == 0)
+    {
+        level = -1;
+        rotate = num;
+        logTune(&level, &rotate);
+        if(level < 0)
+        {
+            return "no access log (-L)";
+        }
+    }
+    else if(strcmp(name, "backlog") == 0)
+    {
+        // listen() on a socket that's already listening just changes
+        // its backlog; connections waiting in it stay.
+        //
+        if(listen(listener, (int)num) == -1)
+        {
+            return "listen() failed";
+        }
+        backlogNow = (int)num;
+    }
+    else
+    {
+        return "no such setting (try help)";
+    }
+
+    return NULL;
+}
+
+
+// *****************************************************************************
+//
+// static int ctlCommand(char *out, int len, char *line, int children)
+//
+// Purpose: Carry out one command line and append its answer. Returns the
+// new length.
+//
+// *****************************************************************************
+//
+static int ctlCommand(char *out, int len, char *line, int children)
+{
+    char   *word[3];     // Words of the command
+    char   *tok;         // One word
+    char   *save;        // strtok_r() state
+    char   *why;         // What was wrong with a set
+    int    count = 0;    // Words found
+
+    for(tok = strtok_r(line, " \t\r", &save); tok != NULL; tok = strtok_r(NULL, " \t\r", &save))
+    {
+        if(count < 3)
+        {
+            word[count] = tok;
+        }
+        count++;
+    }
+
+    if(count == 0)
+    {
+        return len;
+    }
+
+    if(count == 1 && strcmp(word[0], "show") == 0)
+    {
+        return ctlShow(out, len, NULL, children);
+    }
+
+    if(count == 1 && strcmp(word[0], "help") == 0)
+    {
+        return ctlAdd(out, len, "show\nset connections|chars|backlog|slots|small|"
+                                "deadlines|idle|rate|trace|log|rotate <value>\n");
+    }
+
+    if(count == 3 && strcmp(word[0], "set") == 0)
+    {
+        if((why = ctlSet(word[1], word[2])) != NULL)
+        {
+            return ctlAdd(out, len, "error: %s %s: %s\n", word[1], word[2], why);
+        }
+
+        fprintf(stderr, "Control: set %s %s\n", word[1], word[2]);
+        return ctlShow(out, len, word[1], children);
+    }
+
+    return ctlAdd(out, len, "error: unknown command (try help)\n");
+}
+
+
+// *****************************************************************************
+//
+// void ctlServe(int sock, int children)
+//
+// Purpose: Answer one control connection.
+//
+// *****************************************************************************
+//
+void ctlServe(int sock, int children)
+{
+    static char in[CTL_IN];      // Commands received
+    static char out[CTL_OUT];    // The answer
+    struct pollfd pfd;           // Waits for commands
+    struct timespec now;         // Time, for the wait
+    long   until;                // When the wait is up (ms)
+    long   left;                 // Time left to wait (ms)
+    char   *line, *nl;           // Command being carried out, and its end
+    int    cli;                  // Control connection
+    int    have = 0;             // Bytes in in[]
+    int    len = 0;              // Answer length
+    int    num;                  // Bytes from one recv()
+
+    if((cli = accept(sock, NULL, NULL)) == -1)
+    {
+        return;
+    }
+
+    // Read until the commands so far end with a newline, the client
+    // closes its side, or the wait is up. The wait covers the whole
+    // read, so a client sending a byte at a time can't stretch it.
+    //
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    until = now.tv_sec * 1000L + now.tv_nsec / 1000000L + CTL_WAIT_MS;
+    pfd.fd = cli;
+    pfd.events = POLLIN;
+    while(have < CTL_IN - 1 && (have == 0 || in[have - 1] != '\n'))
+    {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        left = until - (now.tv_sec * 1000L + now.tv_nsec / 1000000L);
+        if(left <= 0 || poll(&pfd, 1, (int)left) != 1 ||
+           (num = recv(cli, in + have, CTL_IN - 1 - have, MSG_DONTWAIT)) <= 0)
+        {
+            break;
+        }
+        have += num;
+    }
+    in[have] = '\0';
+
+    for(line = in; *line != '\0'; line = nl)
+    {
+        if((nl = strchr(line, '\n')) != NULL)
+        {
+            *nl++ = '\0';
+        }
+        else
+        {
+            nl = line + strlen(line);
+        }
+        len = ctlCommand(out, len, line, children);
+    }
+
+    send(cli, out, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+    close(cli);
+}
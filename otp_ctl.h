@@ -0,0 +1,96 @@
+//
+// *****************************************************************************
+//
+// Author:    Erik Ratcliffe
+// Date:      June 5, 2015
+// Project:   Program 4 - OTP
+// Filename:  otp_ctl.h
+// Class:     CS 344 (Spring 2015)
+//
+//
+// Overview:
+//    Server/client simulation of the classic "One-time Pad" encryption scheme.
+//
+//    This file contains the definitions and function prototypes for the
+//    server's control socket (-C). Limits used to be fixed at startup,
+//    so changing one meant restarting the server and dropping every
+//    request in flight. Instead, operators can connect to a unix socket
+//    (mode 0600, so only the server's user can) and send one command per
+//    line:
+//
+//       show                 every setting, and the children serving now
+//       set <name> <value>   change a setting; the answer is its new value
+//       help                 the names below
+//
+//    Names, with the options that set them at startup:
+//
+//       connections  -c     backlog  -q     deadlines  -d     trace   -T
+//       chars        -b     slots    -j     idle       -i     log     (-L)
+//                           small    -s     rate       -r     rotate  -R
+//
+//    deadlines takes four comma separated seconds as -d does, and log
+//    takes all, errors (only connections that failed) or off. Answers
+//    are "<name> <value>" lines, or a line starting with "error:".
+//
+//    Every change takes effect in the server and the children at once,
+//    without closing the listening socket or anything in flight: limits
+//    only decide what's admitted or scheduled next, and a connection
+//    already over a lowered deadline is dropped as it would have been
+//    had the deadline been that low all along. Each change is noted on
+//    stderr.
+//
+// *****************************************************************************
+//
+
+#ifndef OTP_CTL_H
+#define OTP_CTL_H
+
+
+#define CTL_WAIT_MS      200     // Longest the server waits for a command
+#define CTL_IN           4096    // Longest command text per connection
+#define CTL_OUT          4096    // Longest answer
+
+
+// *****************************************************************************
+//
+// int ctlInit(char *path, int listenSock, int backlog)
+//
+//    Entry:   char *path
+//                Where to create the control socket, or NULL for none
+//             int listenSock
+//                The server's listening socket
+//             int backlog
+//                Its listen() backlog
+//
+//    Exit:    The listening control socket (-1 if path is NULL), or -2 if
+//             it can't be set up.
+//
+//    Purpose: Set up the control socket. Call once in the server after
+//    everything it tunes.
+//
+// *****************************************************************************
+//
+int ctlInit(char *path, int listenSock, int backlog);
+
+
+// *****************************************************************************
+//
+// void ctlServe(int sock, int children)
+//
+//    Entry:   int sock
+//                Control socket from ctlInit(), ready to accept
+//             int children
+//                Children serving connections now
+//
+//    Exit:    None.
+//
+//    Purpose: Server side: answer one control connection. A client gets
+//    CTL_WAIT_MS to send its commands, so the server is never held up
+//    for long.
+//
+// *****************************************************************************
+//
+void ctlServe(int sock, int children);
+
+
+#endif
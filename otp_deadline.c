@@ -0,0 +1,662 @@
+//
+// *****************************************************************************
+//
+// Author:    Erik Ratcliffe
+// Date:      June 5, 2015
+// Project:   Program 4 - OTP
+// Filename:  otp_deadline.c
+// Class:     CS 344 (Spring 2015)
+//
+//
+// Overview:
+//    Server/client simulation of the classic "One-time Pad" encryption scheme.
+//
+//    This file contains connection deadlines and the server's timer wheel
+//    (see otp_deadline.h).
+//
+// *****************************************************************************
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include "otp_deadline.h"
+#include "otp_stats.h"
+
+
+#define DEADLINE_RECHECK 5000   // Longest a child goes unchecked (ms)
+#define WHEEL_BITS       6      // log2(DEADLINE_SLOTS)
+
+
+// One connection, written by its child and read by the server. The child
+// bumps seq to odd before an update and back to even after, so the server
+// never acts on a half-written phase change.
+//
+struct deadlineEntry
+{
+    int    used;        // Set while the entry belongs to a connection
+    pid_t  pid;         // Child serving the connection (0 until forked)
+    unsigned seq;       // Update counter (odd while updating)
+    int    phase;       // PHASE_*
+    long   phaseStart;  // When the phase started (ms)
+    long   lastActive;  // When bytes last moved (ms)
+    long   bytes;       // Bytes moved in this phase
+    long   queued;      // Time spent in the scheduler's queue this phase (ms)
+    long   queuedSince; // When the current wait started (ms, 0 = not waiting)
+};
+
+
+// The server's timer for one child, linked into a wheel slot by index.
+//
+struct deadlineTimer
+{
+    int    armed;       // Set while linked into the wheel
+    int    next, prev;  // Neighbours in the slot (-1 = none)
+    int    level, slot; // Where it's linked
+    long   expires;     // Tick it's due
+};
+
+
+static struct deadlineEntry *table = NULL;     // Shared entries
+static struct deadlineEntry *mine = NULL;      // Calling child's entry
+
+static long   limit[PHASE_COUNT];              // Phase deadlines (ms, 0 = none)
+static long   idleLimit;                       // Idle limit (ms, 0 = none)
+static long   rateLimit;                       // Minimum bytes per second
+
+static struct deadlineTimer timer[DEADLINE_MAX];        // One per entry
+static int    wheel[DEADLINE_LEVELS][DEADLINE_SLOTS];   // Slot list heads
+static long   tickNow;                         // Last tick processed
+static int    armedCount = 0;                  // Timers in the wheel
+
+
+// *****************************************************************************
+//
+// static long deadlineNow(void)
+//
+// Purpose: Monotonic clock in ms.
+//
+// *****************************************************************************
+//
+static long deadlineNow(void)
+{
+    struct timespec now;  // Current time
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec * 1000L + now.tv_nsec / 1000000L;
+}
+
+
+// *****************************************************************************
+//
+// int deadlineInit(char *phases, int idle, long minRate)
+//
+// Purpose: Set up the shared table and the timer wheel.
+//
+// *****************************************************************************
+//
+int deadlineInit(char *phases, int idle, long minRate)
+{
+    long secs[4];  // Phase deadlines as given
+    int  idx, lvl; // Loop indexes
+
+    if(phases == NULL)
+    {
+        phases = DEADLINE_PHASES;
+    }
+    if(sscanf(phases, "%ld,%ld,%ld,%ld", &secs[0], &secs[1], &secs[2], &secs[3]) != 4)
+    {
+        return -1;
+    }
+
+    table = mmap(NULL, sizeof(*table) * DEADLINE_MAX, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(table == MAP_FAILED)
+    {
+        table = NULL;
+        return -1;
+    }
+
+    limit[PHASE_HANDSHAKE] = secs[0] * 1000;
+    limit[PHASE_HEADER] = secs[1] * 1000;
+    limit[PHASE_PAYLOAD] = secs[2] * 1000;
+    limit[PHASE_RESPONSE] = secs[3] * 1000;
+    limit[PHASE_STREAM] = 0;
+    idleLimit = (idle > 0) ? idle * 1000L : 0;
+    rateLimit = (minRate > 0) ? minRate : 0;
+
+    for(lvl = 0; lvl < DEADLINE_LEVELS; lvl++)
+    {
+        for(idx = 0; idx < DEADLINE_SLOTS; idx++)
+        {
+            wheel[lvl][idx] = -1;
+        }
+    }
+    tickNow = deadlineNow() / DEADLINE_TICK;
+
+    return 0;
+}
+
+
+// *****************************************************************************
+//
+// void deadlineTune(long secs[4], long *idle, long *minRate)
+//
+// Purpose: Change the limits at runtime. They're only read in the server,
+// which checks each child again within DEADLINE_RECHECK ms.
+//
+// *****************************************************************************
+//
+void deadlineTune(long secs[4], long *idle, long *minRate)
+{
+    int idx;  // Loop index
+
+    for(idx = 0; idx < 4; idx++)
+    {
+        if(secs[idx] >= 0)
+        {
+            limit[PHASE_HANDSHAKE + idx] = secs[idx] * 1000;
+        }
+        secs[idx] = limit[PHASE_HANDSHAKE + idx] / 1000;
+    }
+
+    if(*idle >= 0)
+    {
+        idleLimit = *idle * 1000;
+    }
+    if(*minRate >= 0)
+    {
+        rateLimit = *minRate;
+    }
+    *idle = idleLimit / 1000;
+    *minRate = rateLimit;
+}
+
+
+// *****************************************************************************
+//
+// static void wheelAdd(int idx, long expires)
+//
+// Purpose: Link a timer into the wheel. Level 0 holds the next
+// DEADLINE_SLOTS ticks one per slot; each level up covers DEADLINE_SLOTS
+// times as much per slot, and its timers cascade down a level as the one
+// below wraps around.
+//
+// *****************************************************************************
+//
+static void wheelAdd(int idx, long expires)
+{
+    struct deadlineTimer *t = &timer[idx];  // Timer being linked
+    long   span = DEADLINE_SLOTS;           // Ticks covered up to this level
+    int    lvl = 0;                         // Level it goes in
+
+    if(expires <= tickNow)
+    {
+        expires = tickNow + 1;
+    }
+
+    while(lvl < DEADLINE_LEVELS - 1 && expires - tickNow >= span)
+    {
+        span *= DEADLINE_SLOTS;
+        lvl++;
+    }
+    if(expires - tickNow >= span)
+    {
+        expires = tickNow + span - 1;
+    }
+
+    t->expires = expires;
+    t->level = lvl;
+    t->slot = (expires >> (WHEEL_BITS * lvl)) & (DEADLINE_SLOTS - 1);
+    t->prev = -1;
+    t->next = wheel[lvl][t->slot];
+    if(t->next != -1)
+    {
+        timer[t->next].prev = idx;
+    }
+    wheel[lvl][t->slot] = idx;
+    t->armed = 1;
+    armedCount++;
+}
+
+
+// *****************************************************************************
+//
+// static void wheelRemove(int idx)
+//
+// Purpose: Unlink a timer from the wheel.
+//
+// *****************************************************************************
+//
+static void wheelRemove(int idx)
+{
+    struct deadlineTimer *t = &timer[idx];  // Timer being unlinked
+
+    if(!t->armed)
+    {
+        return;
+    }
+
+    if(t->prev != -1)
+    {
+        timer[t->prev].next = t->next;
+    }
+    else
+    {
+        wheel[t->level][t->slot] = t->next;
+    }
+    if(t->next != -1)
+    {
+        timer[t->next].prev = t->prev;
+    }
+
+    t->armed = 0;
+    armedCount--;
+}
+
+
+// *****************************************************************************
+//
+// static void deadlineRead(int idx, struct deadlineEntry *copy)
+//
+// Purpose: Take a consistent copy of an entry the child may be updating.
+//
+// *****************************************************************************
+//
+static void deadlineRead(int idx, struct deadlineEntry *copy)
+{
+    unsigned seq;  // Update counter before the copy
+
+    do
+    {
+        seq = __atomic_load_n(&table[idx].seq, __ATOMIC_ACQUIRE);
+        memcpy(copy, &table[idx], sizeof(*copy));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while((seq & 1) || seq != __atomic_load_n(&table[idx].seq, __ATOMIC_RELAXED));
+}
+
+
+// *****************************************************************************
+//
+// static void deadlineCheck(int idx)
+//
+// Purpose: Kill a child that is over a limit, otherwise re-arm its timer
+// for the earliest moment it could be.
+//
+// *****************************************************************************
+//
+static void deadlineCheck(int idx)
+{
+    struct deadlineEntry e;      // Consistent copy of the entry
+    long   now = deadlineNow();  // Current time (ms)
+    long   next = now + DEADLINE_RECHECK; // Next time to look
+    long   due;                  // When one limit runs out
+    char   *why = NULL;          // Limit the child is over
+
+    deadlineRead(idx, &e);
+    if(!e.used || e.pid <= 0)
+    {
+        return;
+    }
+
+    if(limit[e.phase] > 0)
+    {
+        due = e.phaseStart + limit[e.phase];
+        why = (now >= due) ? "phase deadline" : why;
+        next = (due < next) ? due : next;
+    }
+
+    // A child waiting in the scheduler's queue is moving no bytes
+    // through no fault of its client, so only the phase deadline applies
+    // until it gets its slot. Time it spent queued is added back below.
+    //
+    if(idleLimit > 0 && e.queuedSince == 0)
+    {
+        due = e.lastActive + idleLimit;
+        why = (now >= due) ? "idle" : why;
+        next = (due < next) ? due : next;
+    }
+
+    // The throughput check starts after the grace period, and trips once
+    // the bytes moved so far would have taken less time at the minimum
+    // rate than has passed.
+    //
+    if(rateLimit > 0 && e.queuedSince == 0 &&
+       (e.phase == PHASE_PAYLOAD || e.phase == PHASE_RESPONSE))
+    {
+        e.phaseStart += e.queued;
+        due = e.phaseStart + e.bytes * 1000 / rateLimit;
+        due = (due < e.phaseStart + DEADLINE_GRACE * 1000L) ?
+              e.phaseStart + DEADLINE_GRACE * 1000L : due;
+        why = (now >= due) ? "too slow" : why;
+        next = (due < next) ? due : next;
+    }
+
+    if(why != NULL)
+    {
+        fprintf(stderr, "Dropping client (pid %d): %s\n", (int)e.pid, why);
+        kill(e.pid, SIGKILL);
+        statsCount(STAT_ERR_DEADLINE, 1);
+        return;
+    }
+
+    wheelAdd(idx, (next + DEADLINE_TICK - 1) / DEADLINE_TICK);
+}
+
+
+// *****************************************************************************
+//
+// int deadlineReserve(void)
+//
+// Purpose: Claim an entry for a connection about to be forked.
+//
+// *****************************************************************************
+//
+int deadlineReserve(void)
+{
+    int idx;  // Loop index
+
+    if(table == NULL)
+    {
+        return -1;
+    }
+
+    for(idx = 0; idx < DEADLINE_MAX; idx++)
+    {
+        if(!table[idx].used)
+        {
+            memset(&table[idx], 0, sizeof(table[idx]));
+            table[idx].used = 1;
+            table[idx].phase = PHASE_HANDSHAKE;
+            table[idx].phaseStart = deadlineNow();
+            table[idx].lastActive = table[idx].phaseStart;
+            return idx;
+        }
+    }
+
+    return -1;
+}
+
+
+// *****************************************************************************
+//
+// void deadlineStart(int idx, pid_t pid)
+//
+// Purpose: Start timing the child.
+//
+// *****************************************************************************
+//
+void deadlineStart(int idx, pid_t pid)
+{
+    if(idx < 0)
+    {
+        return;
+    }
+
+    // Catch the wheel up first: with no timers it isn't ticking.
+    //
+    if(armedCount == 0)
+    {
+        tickNow = deadlineNow() / DEADLINE_TICK;
+    }
+
+    table[idx].pid = pid;
+    deadlineCheck(idx);
+}
+
+
+// *****************************************************************************
+//
+// void deadlineRelease(int idx)
+//
+// Purpose: Give back an entry that never got a child.
+//
+// *****************************************************************************
+//
+void deadlineRelease(int idx)
+{
+    if(idx >= 0)
+    {
+        table[idx].used = 0;
+    }
+}
+
+
+// *****************************************************************************
+//
+// void deadlineChild(int idx)
+//
+// Purpose: Child side: remember our entry.
+//
+// *****************************************************************************
+//
+void deadlineChild(int idx)
+{
+    mine = (idx >= 0) ? &table[idx] : NULL;
+}
+
+
+// *****************************************************************************
+//
+// void deadlinePhase(int phase)
+//
+// Purpose: Child side: enter a new phase.
+//
+// *****************************************************************************
+//
+void deadlinePhase(int phase)
+{
+    statsPhase(phase);
+
+    if(mine == NULL)
+    {
+        return;
+    }
+
+    __atomic_add_fetch(&mine->seq, 1, __ATOMIC_ACQ_REL);
+    mine->phase = phase;
+    mine->phaseStart = deadlineNow();
+    mine->lastActive = mine->phaseStart;
+    mine->bytes = 0;
+    mine->queued = 0;
+    mine->queuedSince = 0;
+    __atomic_add_fetch(&mine->seq, 1, __ATOMIC_RELEASE);
+}
+
+
+// *****************************************************************************
+//
+// void deadlineProgress(long bytes)
+//
+// Purpose: Child side: count bytes moved.
+//
+// *****************************************************************************
+//
+void deadlineProgress(long bytes)
+{
+    if(mine == NULL || bytes <= 0)
+    {
+        return;
+    }
+
+    __atomic_add_fetch(&mine->seq, 1, __ATOMIC_ACQ_REL);
+    mine->lastActive = deadlineNow();
+    mine->bytes += bytes;
+    __atomic_add_fetch(&mine->seq, 1, __ATOMIC_RELEASE);
+}
+
+
+// *****************************************************************************
+//
+// void deadlineQueue(int waiting)
+//
+// Purpose: Child side: start or stop a wait in the scheduler's queue.
+//
+// *****************************************************************************
+//
+void deadlineQueue(int waiting)
+{
+    long now;  // Current time (ms)
+
+    if(mine == NULL || (waiting != 0) == (mine->queuedSince != 0))
+    {
+        return;
+    }
+
+    now = deadlineNow();
+    __atomic_add_fetch(&mine->seq, 1, __ATOMIC_ACQ_REL);
+    if(waiting)
+    {
+        mine->queuedSince = now;
+    }
+    else
+    {
+        mine->queued += now - mine->queuedSince;
+        mine->queuedSince = 0;
+        mine->lastActive = now;
+    }
+    __atomic_add_fetch(&mine->seq, 1, __ATOMIC_RELEASE);
+}
+
+
+// *****************************************************************************
+//
+// int deadlineWait(void)
+//
+// Purpose: How long the accept loop may block.
+//
+// *****************************************************************************
+//
+int deadlineWait(void)
+{
+    long wait;  // Time to the next tick (ms)
+
+    if(armedCount == 0)
+    {
+        return -1;
+    }
+
+    wait = (tickNow + 1) * DEADLINE_TICK - deadlineNow();
+
+    return (wait < 0) ? 0 : (int)wait;
+}
+
+
+// *****************************************************************************
+//
+// void deadlineRun(void)
+//
+// Purpose: Advance the wheel to the current time and check every child
+// whose timer expired.
+//
+// *****************************************************************************
+//
+void deadlineRun(void)
+{
+    long target = deadlineNow() / DEADLINE_TICK; // Tick to catch up to
+    int  lvl, idx, slot;                         // Wheel position, timer
+
+    if(table == NULL)
+    {
+        return;
+    }
+
+    if(armedCount == 0)
+    {
+        tickNow = target;
+        return;
+    }
+
+    while(tickNow < target)
+    {
+        tickNow++;
+
+        // Each time a level wraps around, the current slot of the level
+        // above is spread back out over the levels below.
+        //
+        for(lvl = 1; lvl < DEADLINE_LEVELS; lvl++)
+        {
+            if(((tickNow >> (WHEEL_BITS * (lvl - 1))) & (DEADLINE_SLOTS - 1)) != 0)
+            {
+                break;
+            }
+
+            slot = (tickNow >> (WHEEL_BITS * lvl)) & (DEADLINE_SLOTS - 1);
+            while((idx = wheel[lvl][slot]) != -1)
+            {
+                wheelRemove(idx);
+                wheelAdd(idx, timer[idx].expires);
+            }
+        }
+
+        slot = tickNow & (DEADLINE_SLOTS - 1);
+        while((idx = wheel[0][slot]) != -1)
+        {
+            wheelRemove(idx);
+            deadlineCheck(idx);
+        }
+    }
+}
+
+
+// *****************************************************************************
+//
+// void deadlineReap(pid_t pid)
+//
+// Purpose: Drop the child's timer and entry.
+//
+// *****************************************************************************
+//
+void deadlineReap(pid_t pid)
+{
+    int idx;  // Loop index
+
+    if(table == NULL)
+    {
+        return;
+    }
+
+    for(idx = 0; idx < DEADLINE_MAX; idx++)
+    {
+        if(table[idx].used && table[idx].pid == pid)
+        {
+            wheelRemove(idx);
+            table[idx].used = 0;
+        }
+    }
+}
+
+
+// *****************************************************************************
+//
+// void deadlineCount(long count[PHASE_COUNT])
+//
+// Purpose: Count the connections in each phase.
+//
+// *****************************************************************************
+//
+void deadlineCount(long count[PHASE_COUNT])
+{
+    struct deadlineEntry e;  // Consistent copy of an entry
+    int    idx;              // Loop index
+
+    memset(count, 0, sizeof(long) * PHASE_COUNT);
+
+    for(idx = 0; idx < DEADLINE_MAX && table != NULL; idx++)
+    {
+        if(table[idx].used)
+        {
+            deadlineRead(idx, &e);
+            if(e.used && e.pid > 0)
+            {
+                count[e.phase]++;
+            }
+        }
+    }
+}
@@ -0,0 +1,302 @@
+//
+// *****************************************************************************
+//
+// Author:    Erik Ratcliffe
+// Date:      June 5, 2015
+// Project:   Program 4 - OTP
+// Filename:  otp_deadline.h
+// Class:     CS 344 (Spring 2015)
+//
+//
+// Overview:
+//    Server/client simulation of the classic "One-time Pad" encryption scheme.
+//
+//    This file contains the definitions and function prototypes for
+//    connection deadlines. The socket calls in a child block without a
+//    timeout, so a client that stalls (or trickles a byte a minute) would
+//    hold its child forever. Instead, every child records which phase its
+//    connection is in and how many bytes have moved, in a table shared
+//    with the server, and the server enforces:
+//
+//    - a deadline per phase (handshake, header, payload, response),
+//    - an idle limit (no bytes moved at all), and
+//    - a minimum throughput once a payload or response phase has had
+//      DEADLINE_GRACE seconds to get going.
+//
+//    Time a child spends waiting for a scheduler slot is its server's
+//    doing, not its client's, so it counts only towards the phase
+//    deadline.
+//
+//    A child over any limit is killed; the usual reaping then gives back
+//    whatever it held. The server keeps one timer per child in a
+//    hierarchical timer wheel (DEADLINE_LEVELS levels of DEADLINE_SLOTS
+//    slots, DEADLINE_TICK ms per tick), so checking costs nothing for
+//    children whose next expiry is far off. Timers are set for the
+//    earliest moment a child could be over a limit; when one fires the
+//    child is checked against the table and either killed or re-armed,
+//    since progress only ever moves its limits later.
+//
+// *****************************************************************************
+//
+
+#ifndef OTP_DEADLINE_H
+#define OTP_DEADLINE_H
+
+
+#include <sys/types.h>
+
+
+#define DEADLINE_MAX     1024    // Children tracked at once
+#define DEADLINE_TICK    100     // Timer wheel resolution (ms)
+#define DEADLINE_SLOTS   64      // Slots per wheel level
+#define DEADLINE_LEVELS  4       // Wheel levels (64^4 ticks is ~19 days)
+#define DEADLINE_GRACE   10      // Seconds before the throughput check starts
+
+#define DEADLINE_IDLE    60      // Default idle limit (s)
+#define DEADLINE_RATE    1024    // Default minimum throughput (bytes/s)
+#define DEADLINE_PHASES  "30,10,0,0" // Default phase deadlines (s, 0 = none)
+
+#define PHASE_HANDSHAKE  0       // Accepted, waiting for the first number
+#define PHASE_HEADER     1       // Reading sizes / session or stream setup
+#define PHASE_PAYLOAD    2       // Receiving input and key
+#define PHASE_RESPONSE   3       // Sending the result
+#define PHASE_STREAM     4       // Long-lived (multiplexed): idle limit only
+#define PHASE_COUNT      5       // Number of phases
+
+
+// *****************************************************************************
+//
+// int deadlineInit(char *phases, int idle, long minRate)
+//
+//    Entry:   char *phases
+//                Comma separated deadlines in seconds for the handshake,
+//                header, payload and response phases (0 = none), or NULL
+//                for DEADLINE_PHASES
+//             int idle
+//                Seconds without any bytes moving (0 = none)
+//             long minRate
+//                Minimum bytes per second in payload and response phases
+//                (0 = none)
+//
+//    Exit:    Returns 0 on success, -1 if phases is malformed or the table
+//             can't be set up.
+//
+//    Purpose: Set up the shared table and the timer wheel. Call once in
+//    the server before accepting.
+//
+// *****************************************************************************
+//
+int deadlineInit(char *phases, int idle, long minRate);
+
+
+// *****************************************************************************
+//
+// void deadlineTune(long secs[4], long *idle, long *minRate)
+//
+//    Entry:   long secs[4]
+//                New handshake, header, payload and response deadlines
+//                in seconds (0 = none)
+//             long *idle
+//                New idle limit in seconds (0 = none)
+//             long *minRate
+//                New minimum throughput in bytes per second (0 = none)
+//
+//             A negative value leaves that limit as it is.
+//
+//    Exit:    All set to the limits now in force.
+//
+//    Purpose: Server side: change the deadlines at runtime (see
+//    otp_ctl.h). Every child is checked against the new limits within
+//    DEADLINE_RECHECK ms at most.
+//
+// *****************************************************************************
+//
+void deadlineTune(long secs[4], long *idle, long *minRate);
+
+
+// *****************************************************************************
+//
+// int deadlineReserve(void)
+//
+//    Entry:   None.
+//
+//    Exit:    Index of a free entry, -1 if the table is full.
+//
+//    Purpose: Claim an entry for a connection about to be forked, starting
+//    its handshake phase. The child inherits the index.
+//
+// *****************************************************************************
+//
+int deadlineReserve(void);
+
+
+// *****************************************************************************
+//
+// void deadlineStart(int idx, pid_t pid)
+//
+//    Entry:   int idx
+//                Entry from deadlineReserve()
+//             pid_t pid
+//                Child serving the connection
+//
+//    Exit:    None.
+//
+//    Purpose: Server side: start timing the child.
+//
+// *****************************************************************************
+//
+void deadlineStart(int idx, pid_t pid);
+
+
+// *****************************************************************************
+//
+// void deadlineRelease(int idx)
+//
+//    Entry:   int idx
+//                Entry from deadlineReserve(), or -1
+//
+//    Exit:    None.
+//
+//    Purpose: Server side: give the entry back when there is no child to
+//    time (the fork failed).
+//
+// *****************************************************************************
+//
+void deadlineRelease(int idx);
+
+
+// *****************************************************************************
+//
+// void deadlineChild(int idx)
+//
+//    Entry:   int idx
+//                Entry from deadlineReserve()
+//
+//    Exit:    None.
+//
+//    Purpose: Child side: make idx the entry deadlinePhase() and
+//    deadlineProgress() update.
+//
+// *****************************************************************************
+//
+void deadlineChild(int idx);
+
+
+// *****************************************************************************
+//
+// void deadlinePhase(int phase)
+//
+//    Entry:   int phase
+//                PHASE_*
+//
+//    Exit:    None.
+//
+//    Purpose: Child side: enter a new phase, restarting its deadline and
+//    throughput count, and record the old one's time for the stats. A
+//    no-op outside a server child.
+//
+// *****************************************************************************
+//
+void deadlinePhase(int phase);
+
+
+// *****************************************************************************
+//
+// void deadlineProgress(long bytes)
+//
+//    Entry:   long bytes
+//                Bytes just sent or received
+//
+//    Exit:    None.
+//
+//    Purpose: Child side: count bytes moved, for the idle and throughput
+//    limits. Called by the socket helpers; a no-op outside a server child.
+//
+// *****************************************************************************
+//
+void deadlineProgress(long bytes);
+
+
+// *****************************************************************************
+//
+// void deadlineQueue(int waiting)
+//
+//    Entry:   int waiting
+//                1 going into the scheduler's queue, 0 coming out
+//
+//    Exit:    None.
+//
+//    Purpose: Child side: time spent waiting for a scheduler slot (see
+//    otp_sched.h) doesn't count against the idle and throughput limits,
+//    only the phase deadline. A no-op outside a server child.
+//
+// *****************************************************************************
+//
+void deadlineQueue(int waiting);
+
+
+// *****************************************************************************
+//
+// int deadlineWait(void)
+//
+//    Entry:   None.
+//
+//    Exit:    Milliseconds until the next wheel tick is due (-1 if no
+//             timers are set, so the server can sleep indefinitely).
+//
+//    Purpose: Server side: how long the accept loop may block.
+//
+// *****************************************************************************
+//
+int deadlineWait(void);
+
+
+// *****************************************************************************
+//
+// void deadlineRun(void)
+//
+//    Entry:   None.
+//
+//    Exit:    None.
+//
+//    Purpose: Server side: advance the wheel to the current time, check
+//    every child whose timer expired, and kill those over a limit.
+//
+// *****************************************************************************
+//
+void deadlineRun(void);
+
+
+// *****************************************************************************
+//
+// void deadlineReap(pid_t pid)
+//
+//    Entry:   pid_t pid
+//                Child the server has just reaped
+//
+//    Exit:    None.
+//
+//    Purpose: Server side: drop the child's timer and entry.
+//
+// *****************************************************************************
+//
+void deadlineReap(pid_t pid);
+
+
+// *****************************************************************************
+//
+// void deadlineCount(long count[PHASE_COUNT])
+//
+//    Entry:   long count[PHASE_COUNT]
+//                Receives the number of connections in each phase
+//
+//    Exit:    None.
+//
+//    Purpose: Server side: for the stats (see otp_stats.h).
+//
+// *****************************************************************************
+//
+void deadlineCount(long count[PHASE_COUNT]);
+
+
+#endif
@@ -27,6 +27,11 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include "otp.h"
+#include "otp_local.h"
+#include "otp_mux.h"
+#include "otp_padkey.h"
+#include "otp_pool.h"
+#include "otp_resume.h"
 
 
 #define CLI_TYPE 1   // 1 = encode, 0 = decode
@@ -34,33 +39,45 @@
 
 int main(int argc, char **argv)
 {
-    int    sock;                    // Socket descriptor
     long   inFileSize, keyFileSize; // Input and key file sizes
     int    inFp, keyFp;             // Input and key file descriptors
     int    inChars, keyChars;       // Number of input and key file chars read
     long   actualRecv;              // Total chars from a long string transfer
-    int    serverType;              // Type of server (1 = encode, 0 = decode)
+    struct clientOpts opts;         // Options, files and servers
     char   *inContent, *keyContent; // Read content of input and key files
-    char   buf[MAX_MSG];            // Buffer used to transfer strings/numbers
-    struct sockaddr_in myServ;      // Information describing server socket
-    struct hostent *server;         // Information describing the connected server
+    struct otpPool pool;            // Connection pool for the server list
     struct stat inFile, keyFile;    // File information for input and key files
 
-    // If we did not get four items on our command line, vital information
-    // is missing. Display a usage message and exit.
+    // Options first; clientOptions() prints the usage if anything is
+    // missing.
     //
-    if(argc < 4)
+    if(clientOptions(argc, argv, &opts) == -1)
     {
-        fprintf(stderr, "Usage: %s [input file] [key file] [port]\n", argv[0]);
         exit(1);
     }
 
-    // Get file size info for input and key files. 
+    // Local batch mode: map the files and run the codec right here.
     //
-    stat(argv[1], &inFile);
-    stat(argv[2], &keyFile);
+    if(opts.local)
+    {
+        if(localRun(opts.inPath, opts.keyPath, opts.outPath, opts.threads, CLI_TYPE) == -1)
+        {
+            exit(1);
+        }
+        return 0;
+    }
+
+    // Get file size info for input and key files. A key in the pad store
+    // is the server's to check.
+    //
+    stat(opts.inPath, &inFile);
     inFileSize = inFile.st_size;
-    keyFileSize = keyFile.st_size;
+    keyFileSize = inFileSize;
+    if(opts.keyPath != NULL)
+    {
+        stat(opts.keyPath, &keyFile);
+        keyFileSize = keyFile.st_size;
+    }
  
     // Verify that the key file is larger than the input file
     //
@@ -72,7 +89,7 @@ int main(int argc, char **argv)
 
     // Open the input file
     //
-    inFp = open(argv[1], O_RDONLY);
+    inFp = open(opts.inPath, O_RDONLY);
     if(inFp == -1)
     {
         perror("Error opening input file");
@@ -104,100 +121,111 @@ int main(int argc, char **argv)
     //
     if(!verifyInput(inContent))
     {
-        fprintf(stderr, "ERROR: %s contains invalid characters (only A-Z and spaces allowed)\n", argv[1]);
+        fprintf(stderr, "ERROR: %s contains invalid characters (only A-Z and spaces allowed)\n", opts.inPath);
         exit(1);
     }
 
-    // Open the key file
+    // Read the key file, unless the key is in the server's pad store.
     //
-    keyFp = open(argv[2], O_RDONLY);
-    if(keyFp == -1)
+    keyContent = NULL;
+    if(opts.keyPath != NULL)
     {
-        perror("Error opening key file");
-        exit(1);
-    }
+        // Open the key file
+        //
+        keyFp = open(opts.keyPath, O_RDONLY);
+        if(keyFp == -1)
+        {
+            perror("Error opening key file");
+            exit(1);
+        }
+
+        // Create a properly sized buffer to hold the content 
+        //
+        keyContent = malloc(sizeof(char) * keyFileSize);
 
-    // Create a properly sized buffer to hold the content 
-    //
-    keyContent = malloc(sizeof(char) * keyFileSize);
+        // Read in the contents of the key file
+        //
+        keyChars = read(keyFp, keyContent, keyFileSize);
+        if(keyChars == -1)
+        {
+            perror("Error reading key file");
+            exit(1);
+        }
+
+        // Replace the trailing newline in the captured key file content with 
+        // a null terminator and close the key file.
+        //
+        keyContent[keyFileSize - 1] = '\0';
+        close(keyFp);
+    }
 
-    // Read in the contents of the key file
+    // Set up a connection pool over the server list from the command
+    // line. A plain port means localhost, which is all the original
+    // clients supported; "host:port,host:port" spreads requests over
+    // several servers and fails over between them.
     //
-    keyChars = read(keyFp, keyContent, keyFileSize);
-    if(keyChars == -1)
+    if(poolInit(&pool, opts.servers, CLI_TYPE, 0, POOL_ROUND_ROBIN) == -1)
     {
-        perror("Error reading key file");
+        fprintf(stderr, "ERROR: bad server list: %s\n", opts.servers);
         exit(1);
     }
 
-    // Replace the trailing newline in the captured key file content with 
-    // a null terminator and close the key file.
+    // Send the sizes (adjusted to accommodate for the removed newlines)
+    // and both files, then receive the content of the input file back
+    // from the server. With stripes, each range goes over its own
+    // connection and lands at its own offset. With -m the request goes
+    // as one stream over the multiplexed protocol.
     //
-    keyContent[keyFileSize - 1] = '\0';
-    close(keyFp);
-
-    // Set up the socket: AF_INET for Internet domain, SOCK_STREAM for
-    // TCP, 0 for default Internet protocol. If this was a UDP socket,
-    // SOCK_STREAM would be SOCK_DGRAM instead.
+    // The pool identifies which server we connected to: 1 = encode,
+    // 0 = decode. If we are not connected to an appropriate server, exit
+    // with an error.
     //
-    if((sock = socket(AF_INET, SOCK_STREAM, 0)) == -1)
-    { 
-        perror("Socket failed");
-        exit(1);
+    inFileSize -= 1;
+    keyFileSize -= 1;
+    if(opts.padRef != NULL)
+    {
+        actualRecv = padkeyRequest(&pool, opts.padId, opts.padOffset, inContent, inFileSize,
+                                   inContent);
     }
-
-    // We're assuming localhost for all server/client connection with this
-    // project. The gethostbyname() function returns a hostent structure
-    // with information about the server we are connecting to (i.e.
-    // hostname, alias list, address list, etc). 
-    //
-    if((server = gethostbyname("localhost")) == NULL)
+    else if(opts.mux)
     {
-        perror("gethostbyname failed");
-        exit(1);
+        actualRecv = muxRequest(&pool, inContent, inFileSize, keyContent,
+                                keyFileSize, inContent, opts.crc);
     }
-
-    // Initialize socket structure with zeroes (once handled by bzero()
-    // which has been deprecated).
-    // 
-    memset((char *)&myServ, 0, sizeof(myServ));
-
-    // Use the server hostent information to help populate the sockaddr_in
-    // struct that holds server connection data. Set the domain to
-    // Internet (AF_INET), convert the port passed on the command line
-    // from host to network byte ordering and assign to the sockaddr_in
-    // port, and copy in the address of the server.
-    //
-    myServ.sin_family = AF_INET;
-    myServ.sin_port = htons(atoi(argv[3])); // host to network endian conversion
-    memcpy(&myServ.sin_addr, server->h_addr_list[0], server->h_length);
-
-    // Connect to the server. Cast the sockaddr_in struct to (sockaddr *)
-    // (required).
-    //
-    if(connect(sock, (struct sockaddr *)&myServ, sizeof(myServ)) == -1)
+    else if(opts.resumable)
     {
-        perror("connect failed");
-        exit(1);
+        actualRecv = resumeRequest(&pool, inContent, inFileSize, keyContent,
+                                   keyFileSize, inContent);
     }
-    
-    //
-    // We're connected. Do something.
-    //
-
-    // Start by identifying which server we connected to: 1 = encode, 0 = decode
-    //
-    // If we are not connected to an appropriate server, exit with an
-    // error.
-    //
-    serverType = recvNum(&sock);
-    if(serverType != CLI_TYPE)
+    else
     {
-        fprintf(stderr, "ERROR: %s cannot find %s_d.\n", argv[0], argv[0]);
-
-        // Close the connection
-        //
-        close(sock);
+        actualRecv = poolStriped(&pool, inContent, inFileSize, keyContent,
+                                 keyFileSize, inContent, opts.stripes);
+    }
+    if(actualRecv == -1)
+    {
+        if(pool.lastError == POOL_ERR_TYPE)
+        {
+            fprintf(stderr, "ERROR: %s cannot find %s_d.\n", argv[0], argv[0]);
+        }
+        else if(pool.lastError == POOL_ERR_CONNECT)
+        {
+            fprintf(stderr, "connect failed: %s\n", opts.servers);
+        }
+        else if(pool.lastError == POOL_ERR_BUSY)
+        {
+            fprintf(stderr, "ERROR: servers busy, gave up after %d seconds: %s\n",
+                    POOL_BUSY_SECS, opts.servers);
+        }
+        else if(pool.lastError == POOL_ERR_TOO_LARGE)
+        {
+            fprintf(stderr, "ERROR: input too large for the server: %s\n",
+                    opts.servers);
+        }
+        else
+        {
+            fprintf(stderr, "ERROR: request failed\n");
+        }
 
         // Free the input file string pointer
         //
@@ -212,45 +240,6 @@ int main(int argc, char **argv)
         exit(1);
     }
 
-    // Send the input file size. First, adjust the size to accommodate for
-    // the removed newline.
-    //
-    inFileSize -= 1;
-    sendNum(&sock, &inFileSize);
-    
-    // Read the input file acknowledgement.
-    //
-    memset((char *)&buf, '\0', sizeof(buf));
-    recvStr(&sock, buf);
-
-    // Send the key file size. First, adjust the size to accommodate for
-    // the removed newline.
-    //
-    keyFileSize -= 1;
-    sendNum(&sock, &keyFileSize);
-    
-    // Read the key file acknowledgement.
-    //
-    memset((char *)&buf, '\0', sizeof(buf));
-    recvStr(&sock, buf);
-
-    // Send the input file
-    //
-    sendStr(&sock, inContent);
-
-    // Read the input file acknowledgement.
-    //
-    memset((char *)&buf, '\0', sizeof(buf));
-    recvStr(&sock, buf);
-
-    // Send the key file
-    //
-    sendStr(&sock, keyContent);
-
-    // Receive the content of the input file back from the server
-    //
-    actualRecv = recvStream(&sock, inContent, inFileSize);
-
     // Add a null terminator
     //
     inContent[actualRecv] = '\0';
@@ -260,9 +249,9 @@ int main(int argc, char **argv)
     //
     printf("%s\n", inContent);
 
-    // Close the connection
+    // Close the pool
     //
-    close(sock);
+    poolDestroy(&pool);
 
     // Free the input file string pointer
     //
@@ -0,0 +1,324 @@
+//
+// *****************************************************************************
+//
+// Author:    Erik Ratcliffe
+// Date:      June 5, 2015
+// Project:   Program 4 - OTP
+// Filename:  otp_handoff.c
+// Class:     CS 344 (Spring 2015)
+//
+//
+// Overview:
+//    Server/client simulation of the classic "One-time Pad" encryption scheme.
+//
+//    This file contains the listening socket handoff between an old and a
+//    new server (see otp_handoff.h).
+//
+// *****************************************************************************
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include "otp_handoff.h"
+
+
+static struct sockaddr_un addr;    // Handoff socket address
+static int   listener = -1;        // Listening handoff socket
+static int   oldConn = -1;         // Connection to the server we took over from
+static long  oldPid;               // Its pid
+
+
+// *****************************************************************************
+//
+// static int handoffListen(void)
+//
+// Purpose: Listen on the handoff socket. Returns 0 on success, -1 on
+// failure.
+//
+// *****************************************************************************
+//
+static int handoffListen(void)
+{
+    // A socket left behind by an earlier run would make bind() fail. An
+    // old server still listening there has removed it by now.
+    //
+    unlink(addr.sun_path);
+
+    if((listener = socket(AF_UNIX, SOCK_STREAM, 0)) == -1)
+    {
+        return -1;
+    }
+    if(bind(listener, (struct sockaddr *)&addr, sizeof(addr)) == -1 ||
+       chmod(addr.sun_path, 0600) == -1 || listen(listener, 4) == -1 ||
+       fcntl(listener, F_SETFL, fcntl(listener, F_GETFL) | O_NONBLOCK) == -1)
+    {
+        close(listener);
+        listener = -1;
+        return -1;
+    }
+
+    return 0;
+}
+
+
+// *****************************************************************************
+//
+// static int handoffTake(int conn)
+//
+// Purpose: Receive the listening socket and the old server's pid. Returns
+// the socket, -1 on failure.
+//
+// *****************************************************************************
+//
+static int handoffTake(int conn)
+{
+    struct msghdr msg;                      // Message from the old server
+    struct iovec  iov;                      // Its payload: the pid
+    struct cmsghdr *cm;                     // Its control part: the socket
+    struct timeval wait;                    // How long we wait for it
+    char   ctl[CMSG_SPACE(sizeof(int))];    // Room for the control part
+    int    fd = -1;                         // The socket
+
+    wait.tv_sec = HANDOFF_WAIT_MS / 1000;
+    wait.tv_usec = (HANDOFF_WAIT_MS % 1000) * 1000;
+    setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &wait, sizeof(wait));
+
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = &oldPid;
+    iov.iov_len = sizeof(oldPid);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctl;
+    msg.msg_controllen = sizeof(ctl);
+
+    if(recvmsg(conn, &msg, MSG_CMSG_CLOEXEC) != sizeof(oldPid))
+    {
+        return -1;
+    }
+
+    cm = CMSG_FIRSTHDR(&msg);
+    if(cm != NULL && cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_RIGHTS &&
+       cm->cmsg_len == CMSG_LEN(sizeof(int)))
+    {
+        memcpy(&fd, CMSG_DATA(cm), sizeof(int));
+    }
+
+    // Close-on-exec was only there so a failure above couldn't leak it;
+    // the socket is ours now.
+    //
+    if(fd != -1)
+    {
+        fcntl(fd, F_SETFD, 0);
+    }
+
+    return fd;
+}
+
+
+// *****************************************************************************
+//
+// int handoffInit(char *path, int *sock)
+//
+// Purpose: Take over from an old server, then listen for the next.
+//
+// *****************************************************************************
+//
+int handoffInit(char *path, int *sock)
+{
+    int conn;  // Connection to an old server
+
+    *sock = -1;
+
+    if(path == NULL)
+    {
+        return 0;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if(strlen(path) >= sizeof(addr.sun_path))
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    // Nothing there (or a socket left behind by a server that died) just
+    // means a fresh start.
+    //
+    if((conn = socket(AF_UNIX, SOCK_STREAM, 0)) == -1)
+    {
+        return -1;
+    }
+    if(connect(conn, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+    {
+        close(conn);
+        return handoffListen();
+    }
+
+    errno = 0;
+    if((*sock = handoffTake(conn)) == -1)
+    {
+        close(conn);
+        errno = (errno == 0) ? EPROTO : errno;
+        return -1;
+    }
+
+    fprintf(stderr, "Took over the listening socket from pid %ld\n", oldPid);
+    oldConn = conn;
+
+    return handoffListen();
+}
+
+
+// *****************************************************************************
+//
+// int handoffSock(void)
+//
+// Purpose: The handoff socket to poll.
+//
+// *****************************************************************************
+//
+int handoffSock(void)
+{
+    return listener;
+}
+
+
+// *****************************************************************************
+//
+// int handoffServe(int sock)
+//
+// Purpose: Hand the listening socket to a new server.
+//
+// *****************************************************************************
+//
+int handoffServe(int sock)
+{
+    struct msghdr msg;                      // Message to the new server
+    struct iovec  iov;                      // Its payload: our pid
+    struct cmsghdr *cm;                     // Its control part: the socket
+    char   ctl[CMSG_SPACE(sizeof(int))];    // Room for the control part
+    long   pid = getpid();                  // Our pid
+    int    conn;                            // Connection from the new server
+
+    if(listener == -1 || (conn = accept(listener, NULL, NULL)) == -1)
+    {
+        return 0;
+    }
+
+    // The socket file goes first, so the new server can listen on it as
+    // soon as it has the socket without us removing its file afterwards.
+    //
+    close(listener);
+    listener = -1;
+    unlink(addr.sun_path);
+
+    memset(&msg, 0, sizeof(msg));
+    memset(ctl, 0, sizeof(ctl));
+    iov.iov_base = &pid;
+    iov.iov_len = sizeof(pid);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctl;
+    msg.msg_controllen = sizeof(ctl);
+    cm = CMSG_FIRSTHDR(&msg);
+    cm->cmsg_level = SOL_SOCKET;
+    cm->cmsg_type = SCM_RIGHTS;
+    cm->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cm), &sock, sizeof(int));
+
+    // If the new server went away, carry on as before.
+    //
+    if(sendmsg(conn, &msg, MSG_NOSIGNAL) != sizeof(pid))
+    {
+        close(conn);
+        if(handoffListen() == -1)
+        {
+            perror("Handoff socket setup failed");
+        }
+        return 0;
+    }
+
+    // The connection stays open until we exit, so the new server knows
+    // when we're gone. Nothing is ever sent on it again.
+    //
+    fprintf(stderr, "Handed the listening socket over; draining\n");
+
+    return 1;
+}
+
+
+// *****************************************************************************
+//
+// int handoffOld(void)
+//
+// Purpose: Connection to the old server, to poll.
+//
+// *****************************************************************************
+//
+int handoffOld(void)
+{
+    return oldConn;
+}
+
+
+// *****************************************************************************
+//
+// int handoffGone(void)
+//
+// Purpose: Has the old server exited?
+//
+// *****************************************************************************
+//
+int handoffGone(void)
+{
+    char byte;  // Nothing is ever sent, so any read means it closed
+
+    if(oldConn == -1)
+    {
+        return 1;
+    }
+
+    if(recv(oldConn, &byte, 1, MSG_DONTWAIT) == -1 &&
+       (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+    {
+        return 0;
+    }
+
+    close(oldConn);
+    oldConn = -1;
+    fprintf(stderr, "Old server (pid %ld) has exited\n", oldPid);
+
+    return 1;
+}
+
+
+// *****************************************************************************
+//
+// void handoffChild(void)
+//
+// Purpose: Close the handoff sockets in a child.
+//
+// *****************************************************************************
+//
+void handoffChild(void)
+{
+    if(listener != -1)
+    {
+        close(listener);
+    }
+    if(oldConn != -1)
+    {
+        close(oldConn);
+    }
+}
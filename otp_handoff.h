@@ -0,0 +1,152 @@
+//
+// *****************************************************************************
+//
+// Author:    Erik Ratcliffe
+// Date:      June 5, 2015
+// Project:   Program 4 - OTP
+// Filename:  otp_handoff.h
+// Class:     CS 344 (Spring 2015)
+//
+//
+// Overview:
+//    Server/client simulation of the classic "One-time Pad" encryption scheme.
+//
+//    This file contains the definitions and function prototypes for
+//    handing a running server's listening socket to a new one (-U), so
+//    the server can be upgraded without refusing a single connection or
+//    dropping a request in flight.
+//
+//    A server started with -U listens on that unix socket (mode 0600) as
+//    well as its port. A second server started with the same -U finds
+//    the first one there and connects:
+//
+//    - the old server removes the unix socket, then passes its listening
+//      socket, and its pid, over the connection (SCM_RIGHTS);
+//    - the new server takes the socket as its own instead of binding the
+//      port (which stays open all along, so connections waiting in the
+//      backlog stay too), and listens on -U itself, ready for the next
+//      upgrade;
+//    - the old server stops accepting, finishes the requests it has,
+//      erases the key they used (see otp_padkey.h), writes out its access
+//      log, and exits, which closes the connection.
+//
+//    Until then, the new server holds requests keyed from the pad store,
+//    since it can't see the key the old one has claimed but not erased
+//    yet. Everything else is served from the moment the socket arrives.
+//    Resumable sessions (otp_resume.h) live in the old server's memory and
+//    don't carry over.
+//
+// *****************************************************************************
+//
+
+#ifndef OTP_HANDOFF_H
+#define OTP_HANDOFF_H
+
+
+#define HANDOFF_WAIT_MS  5000    // Longest a new server waits for the socket
+
+
+// *****************************************************************************
+//
+// int handoffInit(char *path, int *sock)
+//
+//    Entry:   char *path
+//                Handoff socket, or NULL for none
+//             int *sock
+//                Receives the listening socket taken over from an old
+//                server, -1 if there was none (then bind the port as
+//                usual)
+//
+//    Exit:    Returns 0 on success, -1 if the handoff socket can't be set
+//             up or an old server was found but didn't hand over.
+//
+//    Purpose: Take over from the server on path, if one is running, and
+//    listen there for the next. Call once in the server, before setting
+//    up the listening socket.
+//
+// *****************************************************************************
+//
+int handoffInit(char *path, int *sock);
+
+
+// *****************************************************************************
+//
+// int handoffSock(void)
+//
+//    Entry:   None.
+//
+//    Exit:    The handoff socket to poll for a new server, -1 if none.
+//
+//    Purpose: Server side.
+//
+// *****************************************************************************
+//
+int handoffSock(void);
+
+
+// *****************************************************************************
+//
+// int handoffServe(int sock)
+//
+//    Entry:   int sock
+//                Our listening socket
+//
+//    Exit:    1 if it was handed over (stop accepting on it and drain), 0
+//             if not.
+//
+//    Purpose: Server side: hand the listening socket to the new server
+//    connecting to handoffSock().
+//
+// *****************************************************************************
+//
+int handoffServe(int sock);
+
+
+// *****************************************************************************
+//
+// int handoffOld(void)
+//
+//    Entry:   None.
+//
+//    Exit:    Our connection to the server we took over from, to poll, -1
+//             once it has exited (or if there was none).
+//
+//    Purpose: Server side.
+//
+// *****************************************************************************
+//
+int handoffOld(void);
+
+
+// *****************************************************************************
+//
+// int handoffGone(void)
+//
+//    Entry:   None.
+//
+//    Exit:    1 if the old server has exited, 0 if not yet.
+//
+//    Purpose: Server side: call when handoffOld() polls readable.
+//
+// *****************************************************************************
+//
+int handoffGone(void);
+
+
+// *****************************************************************************
+//
+// void handoffChild(void)
+//
+//    Entry:   None.
+//
+//    Exit:    None.
+//
+//    Purpose: Child side: close the handoff sockets, which only the
+//    server uses.
+//
+// *****************************************************************************
+//
+void handoffChild(void);
+
+
+#endif
@@ -0,0 +1,267 @@
+//
+// *****************************************************************************
+//
+// Author:    Erik Ratcliffe
+// Date:      June 5, 2015
+// Project:   Program 4 - OTP
+// Filename:  otp_local.c
+// Class:     CS 344 (Spring 2015)
+//
+//
+// Overview:
+//    Server/client simulation of the classic "One-time Pad" encryption scheme.
+//
+//    This file contains the local (no server) batch path.
+//
+// *****************************************************************************
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "otp.h"
+#include "otp_local.h"
+
+
+// One thread's share of the work.
+//
+struct localRange
+{
+    char *in, *key, *out;  // Input, key and output for this range
+    long len;              // Characters in this range
+    long type;             // OTP_ENCODE or OTP_DECODE
+    int  bad;              // Set if the range held invalid characters
+};
+
+
+// *****************************************************************************
+//
+// static void *localWork(void *arg)
+//
+// Purpose: Thread body. Copy a block of input into the output, check it,
+// and encode/decode it in place while it is still in cache.
+//
+// *****************************************************************************
+//
+static void *localWork(void *arg)
+{
+    struct localRange *range = arg; // Range to process
+    long   off, len;                // Current block
+
+    for(off = 0; off < range->len; off += len)
+    {
+        len = range->len - off;
+        len = (len > LOCAL_BLOCK) ? LOCAL_BLOCK : len;
+
+        memcpy(range->out + off, range->in + off, len);
+
+        if(!verifyBuf(range->out + off, len))
+        {
+            range->bad = 1;
+            break;
+        }
+
+        if(range->type == OTP_ENCODE)
+        {
+            encodeBuf(range->out + off, range->key + off, len);
+        }
+        else
+        {
+            decodeBuf(range->out + off, range->key + off, len);
+        }
+    }
+
+    return NULL;
+}
+
+
+// *****************************************************************************
+//
+// static char *localMap(char *path, long *len)
+//
+// Purpose: Map a file read-only and return its length without the
+// trailing newline. Prints an error and returns NULL on failure.
+//
+// *****************************************************************************
+//
+static char *localMap(char *path, long *len)
+{
+    struct stat info;  // File information
+    char   *map;       // Mapped file
+    int    fd;         // File descriptor
+
+    if((fd = open(path, O_RDONLY)) == -1 || fstat(fd, &info) == -1)
+    {
+        perror(path);
+        return NULL;
+    }
+
+    *len = info.st_size;
+    if(*len == 0)
+    {
+        close(fd);
+        return "";
+    }
+
+    map = mmap(NULL, *len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED)
+    {
+        perror(path);
+        return NULL;
+    }
+
+    // We read front to back once; tell the kernel so it reads ahead.
+    //
+    madvise(map, *len, MADV_SEQUENTIAL);
+
+    if(map[*len - 1] == '\n')
+    {
+        (*len)--;
+    }
+
+    return map;
+}
+
+
+// *****************************************************************************
+//
+// int localRun(char *inPath, char *keyPath, char *outPath, int threads,
+//              long type)
+//
+// Purpose: Encode or decode a file on this host without a server.
+//
+// *****************************************************************************
+//
+int localRun(char *inPath, char *keyPath, char *outPath, int threads,
+             long type)
+{
+    struct localRange range[LOCAL_MAX_THREADS]; // One range per thread
+    pthread_t thread[LOCAL_MAX_THREADS];        // Worker threads
+    int    started[LOCAL_MAX_THREADS];          // Set if the thread started
+    char   *in, *key, *out;  // Mapped input, key and output
+    long   inLen, keyLen;    // Characters of input and key
+    long   per, off;         // Characters per thread, current offset
+    long   written, numSent; // Progress writing to stdout
+    int    outFd = -1;       // Output file descriptor
+    int    bad = 0;          // Set if the input held invalid characters
+    int    idx;              // Loop index
+
+    if((in = localMap(inPath, &inLen)) == NULL ||
+       (key = localMap(keyPath, &keyLen)) == NULL)
+    {
+        return -1;
+    }
+
+    if(keyLen < inLen)
+    {
+        fprintf(stderr, "ERROR: Key file is too short.\n");
+        return -1;
+    }
+
+    // The output is mapped too when it is a file. It's one character
+    // longer than the input for the trailing newline.
+    //
+    if(outPath != NULL)
+    {
+        outFd = open(outPath, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if(outFd == -1 || ftruncate(outFd, inLen + 1) == -1)
+        {
+            perror(outPath);
+            return -1;
+        }
+        out = mmap(NULL, inLen + 1, PROT_READ | PROT_WRITE, MAP_SHARED, outFd, 0);
+    }
+    else
+    {
+        out = mmap(NULL, inLen + 1, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+    if(out == MAP_FAILED)
+    {
+        perror("mmap failed");
+        return -1;
+    }
+
+    if(threads <= 0)
+    {
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    threads = (threads > LOCAL_MAX_THREADS) ? LOCAL_MAX_THREADS : threads;
+    threads = (threads < 1) ? 1 : threads;
+
+    // Don't bother a thread with less than a block.
+    //
+    if(threads > inLen / LOCAL_BLOCK)
+    {
+        threads = (inLen / LOCAL_BLOCK > 0) ? (int)(inLen / LOCAL_BLOCK) : 1;
+    }
+
+    per = inLen / threads;
+    for(idx = 0; idx < threads; idx++)
+    {
+        off = idx * per;
+
+        range[idx].in = in + off;
+        range[idx].key = key + off;
+        range[idx].out = out + off;
+        range[idx].len = (idx == threads - 1) ? inLen - off : per;
+        range[idx].type = type;
+        range[idx].bad = 0;
+
+        started[idx] = (idx > 0 &&
+                        pthread_create(&thread[idx], NULL, localWork, &range[idx]) == 0);
+    }
+
+    // The calling thread takes the first range itself, and any range
+    // whose thread failed to start.
+    //
+    for(idx = 0; idx < threads; idx++)
+    {
+        if(!started[idx])
+        {
+            localWork(&range[idx]);
+        }
+    }
+    for(idx = 0; idx < threads; idx++)
+    {
+        if(started[idx])
+        {
+            pthread_join(thread[idx], NULL);
+        }
+        bad |= range[idx].bad;
+    }
+
+    if(bad)
+    {
+        fprintf(stderr, "ERROR: %s contains invalid characters (only A-Z and spaces allowed)\n", inPath);
+        return -1;
+    }
+
+    out[inLen] = '\n';
+
+    if(outFd != -1)
+    {
+        munmap(out, inLen + 1);
+        close(outFd);
+        return 0;
+    }
+
+    for(written = 0; written < inLen + 1; written += numSent)
+    {
+        if((numSent = write(STDOUT_FILENO, out + written, inLen + 1 - written)) == -1)
+        {
+            perror("write failed");
+            return -1;
+        }
+    }
+    munmap(out, inLen + 1);
+
+    return 0;
+}
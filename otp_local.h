@@ -0,0 +1,57 @@
+//
+// *****************************************************************************
+//
+// Author:    Erik Ratcliffe
+// Date:      June 5, 2015
+// Project:   Program 4 - OTP
+// Filename:  otp_local.h
+// Class:     CS 344 (Spring 2015)
+//
+//
+// Overview:
+//    Server/client simulation of the classic "One-time Pad" encryption scheme.
+//
+//    This file contains the function prototype for the local (no server)
+//    batch path used by otp_enc -l and otp_dec -l.
+//
+// *****************************************************************************
+//
+
+#ifndef OTP_LOCAL_H
+#define OTP_LOCAL_H
+
+
+#define LOCAL_BLOCK 65536  // Characters copied and encoded while cache-hot
+#define LOCAL_MAX_THREADS 256 // Upper limit on worker threads
+
+
+// *****************************************************************************
+//
+// int localRun(char *inPath, char *keyPath, char *outPath, int threads,
+//              long type)
+//
+//    Entry:   char *inPath, char *keyPath
+//                Input and key files (same format the servers take)
+//             char *outPath
+//                Output file, or NULL for stdout
+//             int threads
+//                Worker threads (0 = one per online CPU)
+//             long type
+//                OTP_ENCODE or OTP_DECODE
+//
+//    Exit:    Returns 0 on success, -1 on failure (after printing why).
+//
+//    Purpose: Encode or decode a file on this host without a server. The
+//    input and key are memory mapped and split into one range per thread;
+//    each thread copies its range into the (also mapped) output a block
+//    at a time and runs encodeBuf()/decodeBuf() on it in place, so the
+//    result is identical to what the servers produce. The output gets the
+//    same trailing newline otp_enc/otp_dec print.
+//
+// *****************************************************************************
+//
+int localRun(char *inPath, char *keyPath, char *outPath, int threads,
+             long type);
+
+
+#endif
@@ -0,0 +1,576 @@
+//
+// *****************************************************************************
+//
+// Author:    Erik Ratcliffe
+// Date:      June 5, 2015
+// Project:   Program 4 - OTP
+// Filename:  otp_log.c
+// Class:     CS 344 (Spring 2015)
+//
+//
+// Overview:
+//    Server/client simulation of the classic "One-time Pad" encryption scheme.
+//
+//    This file contains the access log (see otp_log.h).
+//
+// *****************************************************************************
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <time.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "otp_log.h"
+#include "otp_stats.h"
+
+
+// One log line, unformatted. seq is the ticket it was written under,
+// plus one, and is set last, so the thread can tell a finished record
+// from one still being written.
+//
+struct logRecord
+{
+    unsigned long seq;       // Ticket + 1 once written
+    long   when;             // When the connection was accepted (ms since the epoch)
+    long   usec;             // How long it lasted
+    long   bytesIn;          // Bytes received from the client
+    long   bytesOut;         // Bytes sent to the client
+    pid_t  pid;              // Child that served it
+    char   peer[48];         // Client address and port
+    char   op[8];            // Request kind
+    char   status[16];       // "ok" or the error type
+};
+
+
+struct logRing
+{
+    unsigned long head;      // Next ticket to hand out
+    unsigned long tail;      // Next ticket the thread reads
+    unsigned long written;   // Tickets before this one are in the file
+    unsigned long dropped;   // Records lost to a full ring
+    struct logRecord rec[LOG_RING]; // The records
+};
+
+
+static struct logRing *ring = NULL;  // Shared ring
+
+static char  *logPath;               // Server: the log file
+static int   logFd = -1;             // Server: open log file
+static long  logSize;                // Server: its size so far
+static long  logRotate;              // Server: size limit
+static int   logLevel = LOG_ALL;     // Server: what gets written
+
+static int   logging = 0;            // Child: set while a record is due
+static struct logRecord mine;        // Child: the record so far
+static long  connStart;              // Child: when it started (us, monotonic)
+
+
+// *****************************************************************************
+//
+// static long logClock(clockid_t clock, long unit)
+//
+// Purpose: Read a clock in the given fraction of a second (1000 = ms).
+//
+// *****************************************************************************
+//
+static long logClock(clockid_t clock, long unit)
+{
+    struct timespec now;  // Current time
+
+    clock_gettime(clock, &now);
+
+    return now.tv_sec * unit + now.tv_nsec / (1000000000L / unit);
+}
+
+
+// *****************************************************************************
+//
+// static void logPush(struct logRecord *rec)
+//
+// Purpose: Copy a record into the ring, or count it as dropped if the
+// ring is full.
+//
+// *****************************************************************************
+//
+static void logPush(struct logRecord *rec)
+{
+    struct logRecord *slot;  // Ring entry claimed
+    unsigned long ticket;    // Our place in the ring
+
+    ticket = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    do
+    {
+        if(ticket - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= LOG_RING)
+        {
+            __atomic_add_fetch(&ring->dropped, 1, __ATOMIC_RELAXED);
+            return;
+        }
+    } while(!__atomic_compare_exchange_n(&ring->head, &ticket, ticket + 1, 0,
+                                         __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+    slot = &ring->rec[ticket % LOG_RING];
+    memcpy((char *)slot + sizeof(slot->seq), (char *)rec + sizeof(rec->seq),
+           sizeof(*rec) - sizeof(rec->seq));
+    __atomic_store_n(&slot->seq, ticket + 1, __ATOMIC_RELEASE);
+}
+
+
+// *****************************************************************************
+//
+// static int logOpen(void)
+//
+// Purpose: Open (or create) the log for appending.
+//
+// *****************************************************************************
+//
+static int logOpen(void)
+{
+    struct stat st;  // Size of what's already there
+
+    if((logFd = open(logPath, O_WRONLY | O_APPEND | O_CREAT, 0640)) == -1)
+    {
+        return -1;
+    }
+
+    logSize = (fstat(logFd, &st) == 0) ? st.st_size : 0;
+
+    return 0;
+}
+
+
+// *****************************************************************************
+//
+// static void logShift(void)
+//
+// Purpose: Rotate: file.N-1 -> file.N, ..., file -> file.1, and start a
+// new file.
+//
+// *****************************************************************************
+//
+static void logShift(void)
+{
+    char from[PATH_MAX], to[PATH_MAX]; // Names being rotated
+    int  idx;                          // Loop index
+
+    close(logFd);
+
+    for(idx = LOG_KEEP - 1; idx >= 1; idx--)
+    {
+        snprintf(from, sizeof(from), "%s.%d", logPath, idx);
+        snprintf(to, sizeof(to), "%s.%d", logPath, idx + 1);
+        rename(from, to);
+    }
+    snprintf(to, sizeof(to), "%s.1", logPath);
+    rename(logPath, to);
+
+    if(logOpen() == -1)
+    {
+        perror(logPath);
+    }
+}
+
+
+// *****************************************************************************
+//
+// static void logWrite(char *buf, long len)
+//
+// Purpose: Write one batch, rotating first if it would go over the limit.
+// A failed write is reported and the batch lost; the server carries on.
+//
+// *****************************************************************************
+//
+static void logWrite(char *buf, long len)
+{
+    long done = 0;  // Bytes written so far
+    long num;       // Bytes from one write()
+
+    if(logSize > 0 && logSize + len > __atomic_load_n(&logRotate, __ATOMIC_RELAXED))
+    {
+        logShift();
+    }
+    if(logFd == -1)
+    {
+        return;
+    }
+
+    while(done < len)
+    {
+        if((num = write(logFd, buf + done, len - done)) <= 0)
+        {
+            perror(logPath);
+            break;
+        }
+        done += num;
+    }
+    logSize += done;
+}
+
+
+// *****************************************************************************
+//
+// static int logFormat(char *buf, struct logRecord *rec,
+//                      unsigned long dropped)
+//
+// Purpose: Format one line: a record, or (rec NULL) the number of
+// records dropped. Returns its length.
+//
+// *****************************************************************************
+//
+static int logFormat(char *buf, struct logRecord *rec, unsigned long dropped)
+{
+    struct tm tm;                 // Time broken down
+    time_t secs;                  // Seconds part of the time
+    long   when;                  // Time of the line (ms since the epoch)
+    int    len;                   // Line length so far
+
+    when = (rec != NULL) ? rec->when : logClock(CLOCK_REALTIME, 1000);
+    secs = when / 1000;
+    gmtime_r(&secs, &tm);
+    len = strftime(buf, 32, "%Y-%m-%dT%H:%M:%S", &tm);
+
+    if(rec == NULL)
+    {
+        return len + snprintf(buf + len, 256, ".%03ldZ - dropped=%lu\n",
+                              when % 1000, dropped);
+    }
+
+    return len + snprintf(buf + len, 256, ".%03ldZ %s pid=%d op=%s in=%ld out=%ld us=%ld status=%s\n",
+                          when % 1000, rec->peer, (int)rec->pid, rec->op,
+                          rec->bytesIn, rec->bytesOut, rec->usec, rec->status);
+}
+
+
+// *****************************************************************************
+//
+// static void *logMain(void *arg)
+//
+// Purpose: The log thread: drain the ring into batched writes.
+//
+// *****************************************************************************
+//
+static void *logMain(void *arg)
+{
+    static char buf[LOG_BATCH];        // The batch being built
+    struct logRecord *rec;             // Record being formatted
+    struct timespec idle;              // Pause when there's nothing to do
+    unsigned long tail = 0;            // Next ticket to read
+    unsigned long stuckAt = 0;         // Ticket we found half written
+    unsigned long dropped;             // Records lost since the last look
+    long   stuckSince = 0;             // When we first found it (ms)
+    long   len;                        // Batch length
+
+    idle.tv_sec = 0;
+    idle.tv_nsec = LOG_IDLE_MS * 1000000L;
+
+    while(1)
+    {
+        len = 0;
+
+        while(len < LOG_BATCH - 512 && tail != __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE))
+        {
+            rec = &ring->rec[tail % LOG_RING];
+
+            // A child killed between claiming a ticket and finishing its
+            // record would hold up the ring forever, so after a while
+            // the ticket is given up on.
+            //
+            if(__atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE) != tail + 1)
+            {
+                if(stuckAt != tail + 1)
+                {
+                    stuckAt = tail + 1;
+                    stuckSince = logClock(CLOCK_MONOTONIC, 1000);
+                    break;
+                }
+                if(logClock(CLOCK_MONOTONIC, 1000) - stuckSince < LOG_STUCK_MS)
+                {
+                    break;
+                }
+                __atomic_add_fetch(&ring->dropped, 1, __ATOMIC_RELAXED);
+            }
+            else if(__atomic_load_n(&logLevel, __ATOMIC_RELAXED) == LOG_ALL ||
+                    (__atomic_load_n(&logLevel, __ATOMIC_RELAXED) == LOG_ERRORS &&
+                     strcmp(rec->status, "ok") != 0))
+            {
+                len += logFormat(buf + len, rec, 0);
+            }
+
+            tail++;
+            __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+        }
+
+        if((dropped = __atomic_exchange_n(&ring->dropped, 0, __ATOMIC_RELAXED)) != 0)
+        {
+            len += logFormat(buf + len, NULL, dropped);
+        }
+
+        if(len > 0)
+        {
+            logWrite(buf, len);
+        }
+        else if(tail == __atomic_load_n(&ring->written, __ATOMIC_RELAXED))
+        {
+            nanosleep(&idle, NULL);
+        }
+        __atomic_store_n(&ring->written, tail, __ATOMIC_RELEASE);
+    }
+
+    return arg;
+}
+
+
+// *****************************************************************************
+//
+// int logInit(char *path, long rotate)
+//
+// Purpose: Set up the ring, open the log and start its thread.
+//
+// *****************************************************************************
+//
+int logInit(char *path, long rotate)
+{
+    pthread_t thread;  // The log thread
+
+    if(path == NULL)
+    {
+        return 0;
+    }
+
+    logPath = path;
+    logRotate = (rotate > 0) ? rotate : LOG_ROTATE;
+    if(logOpen() == -1)
+    {
+        return -1;
+    }
+
+    ring = mmap(NULL, sizeof(*ring), PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(ring == MAP_FAILED)
+    {
+        ring = NULL;
+        return -1;
+    }
+
+    if(pthread_create(&thread, NULL, logMain, NULL) != 0)
+    {
+        munmap(ring, sizeof(*ring));
+        ring = NULL;
+        return -1;
+    }
+    pthread_detach(thread);
+
+    return 0;
+}
+
+
+// *****************************************************************************
+//
+// void logTune(int *level, long *rotate)
+//
+// Purpose: Change the level and size limit at runtime. Both are read by
+// the log thread, so they're stored atomically.
+//
+// *****************************************************************************
+//
+void logTune(int *level, long *rotate)
+{
+    if(ring == NULL)
+    {
+        *level = -1;
+        *rotate = 0;
+        return;
+    }
+
+    if(*level >= LOG_OFF && *level <= LOG_ALL)
+    {
+        __atomic_store_n(&logLevel, *level, __ATOMIC_RELAXED);
+    }
+    if(*rotate > 0)
+    {
+        __atomic_store_n(&logRotate, *rotate, __ATOMIC_RELAXED);
+    }
+
+    *level = logLevel;
+    *rotate = logRotate;
+}
+
+
+// *****************************************************************************
+//
+// void logDrain(void)
+//
+// Purpose: Wait for the thread to write out everything in the ring.
+//
+// *****************************************************************************
+//
+void logDrain(void)
+{
+    struct timespec idle;  // Pause between looks at the ring
+
+    if(ring == NULL)
+    {
+        return;
+    }
+
+    idle.tv_sec = 0;
+    idle.tv_nsec = LOG_IDLE_MS * 1000000L;
+
+    while(__atomic_load_n(&ring->written, __ATOMIC_ACQUIRE) !=
+          __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE))
+    {
+        nanosleep(&idle, NULL);
+    }
+}
+
+
+// *****************************************************************************
+//
+// static void logExit(void)
+//
+// Purpose: atexit() handler in a child: put its record in the ring.
+//
+// *****************************************************************************
+//
+static void logExit(void)
+{
+    long count[STAT_COUNT];  // What the connection did
+    int  idx;                // Loop index
+
+    if(!logging)
+    {
+        return;
+    }
+    logging = 0;
+
+    // The counts say what the connection was and the first kind of error
+    // it ran into, if any.
+    //
+    statsOwn(count);
+    for(idx = STAT_REQ_CLASSIC; idx <= STAT_REQ_PADKEY; idx++)
+    {
+        if(count[idx] != 0 && strcmp(mine.op, "-") == 0)
+        {
+            snprintf(mine.op, sizeof(mine.op), "%s", statsName(idx));
+        }
+    }
+    for(idx = STAT_ERR_BUSY; idx <= STAT_ERR_IO; idx++)
+    {
+        if(count[idx] != 0 && strcmp(mine.status, "ok") == 0)
+        {
+            snprintf(mine.status, sizeof(mine.status), "%s", statsName(idx));
+        }
+    }
+
+    mine.bytesIn = count[STAT_BYTES_IN];
+    mine.bytesOut = count[STAT_BYTES_OUT];
+    mine.usec = logClock(CLOCK_MONOTONIC, 1000000) - connStart;
+
+    logPush(&mine);
+}
+
+
+// *****************************************************************************
+//
+// void logChild(int *cli)
+//
+// Purpose: Child side: note the peer and start time.
+//
+// *****************************************************************************
+//
+void logChild(int *cli)
+{
+    struct sockaddr_in peer;              // Client address
+    socklen_t peerLen = sizeof(peer);     // Its size
+    char   addr[INET_ADDRSTRLEN];         // Address as text
+
+    if(ring == NULL)
+    {
+        return;
+    }
+
+    memset(&mine, 0, sizeof(mine));
+    mine.when = logClock(CLOCK_REALTIME, 1000);
+    mine.pid = getpid();
+    strcpy(mine.op, "-");
+    strcpy(mine.status, "ok");
+    strcpy(mine.peer, "-");
+    if(getpeername(*cli, (struct sockaddr *)&peer, &peerLen) == 0 &&
+       inet_ntop(AF_INET, &peer.sin_addr, addr, sizeof(addr)) != NULL)
+    {
+        snprintf(mine.peer, sizeof(mine.peer), "%s:%d", addr, ntohs(peer.sin_port));
+    }
+
+    connStart = logClock(CLOCK_MONOTONIC, 1000000);
+    logging = 1;
+    atexit(logExit);
+}
+
+
+// *****************************************************************************
+//
+// void logRejected(struct sockaddr_in *peer)
+//
+// Purpose: Server side: log a connection turned away as busy.
+//
+// *****************************************************************************
+//
+void logRejected(struct sockaddr_in *peer)
+{
+    struct logRecord rec;           // The record
+    char   addr[INET_ADDRSTRLEN];   // Address as text
+
+    if(ring == NULL)
+    {
+        return;
+    }
+
+    memset(&rec, 0, sizeof(rec));
+    rec.when = logClock(CLOCK_REALTIME, 1000);
+    rec.pid = getpid();
+    strcpy(rec.op, "-");
+    strcpy(rec.status, "busy");
+    strcpy(rec.peer, "-");
+    if(inet_ntop(AF_INET, &peer->sin_addr, addr, sizeof(addr)) != NULL)
+    {
+        snprintf(rec.peer, sizeof(rec.peer), "%s:%d", addr, ntohs(peer->sin_port));
+    }
+
+    logPush(&rec);
+}
+
+
+// *****************************************************************************
+//
+// void logKilled(pid_t pid, int sig)
+//
+// Purpose: Server side: log a child that died on a signal.
+//
+// *****************************************************************************
+//
+void logKilled(pid_t pid, int sig)
+{
+    struct logRecord rec;  // The record
+
+    if(ring == NULL)
+    {
+        return;
+    }
+
+    memset(&rec, 0, sizeof(rec));
+    rec.when = logClock(CLOCK_REALTIME, 1000);
+    rec.pid = pid;
+    strcpy(rec.op, "-");
+    strcpy(rec.peer, "-");
+    snprintf(rec.status, sizeof(rec.status), "signal%d", sig);
+
+    logPush(&rec);
+}
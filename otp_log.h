@@ -0,0 +1,168 @@
+//
+// *****************************************************************************
+//
+// Author:    Erik Ratcliffe
+// Date:      June 5, 2015
+// Project:   Program 4 - OTP
+// Filename:  otp_log.h
+// Class:     CS 344 (Spring 2015)
+//
+//
+// Overview:
+//    Server/client simulation of the classic "One-time Pad" encryption scheme.
+//
+//    This file contains the definitions and function prototypes for the
+//    access log (-L). Every connection gets one line:
+//
+//       2026-10-19T12:00:00.123Z 10.0.0.7:51234 pid=4711 op=classic
+//           in=400028 out=200037 us=708 status=ok
+//
+//    (on one line), with the bytes each way and the error type (see
+//    otp_stats.h) as the status. A connection turned away by the server
+//    itself is logged with op=- and status=busy, and a child that dies on
+//    a signal (killed over a deadline, say) with its pid and
+//    status=signal<N>.
+//
+//    Nothing on the request path waits for the disk. A child exiting (or
+//    the server, for the lines it writes itself) copies a fixed-size
+//    record into a ring in shared memory, claiming its entry with a
+//    compare-and-swap, and a thread in the server drains the ring,
+//    formatting records into one buffer per write. The log is rotated
+//    (file -> file.1 -> ... -> file.LOG_KEEP) when the next write would
+//    take it past the size limit. A full ring drops records; the server
+//    logs how many.
+//
+// *****************************************************************************
+//
+
+#ifndef OTP_LOG_H
+#define OTP_LOG_H
+
+
+#include <sys/types.h>
+#include <netinet/in.h>
+
+
+#define LOG_RING        4096     // Records the ring holds
+#define LOG_BATCH       65536    // Largest single write
+#define LOG_IDLE_MS     100      // How often the thread looks at an empty ring
+#define LOG_STUCK_MS    1000     // Longest it waits on a half-written record
+#define LOG_ROTATE      67108864 // Default size limit (bytes)
+#define LOG_KEEP        5        // Rotated files kept
+
+#define LOG_OFF         0        // Levels: nothing written,
+#define LOG_ERRORS      1        // only connections that failed,
+#define LOG_ALL         2        // every connection (the default)
+
+
+// *****************************************************************************
+//
+// int logInit(char *path, long rotate)
+//
+//    Entry:   char *path
+//                Access log file, or NULL for none
+//             long rotate
+//                Size limit in bytes (0 for LOG_ROTATE)
+//
+//    Exit:    Returns 0 on success, -1 if the log can't be opened or the
+//             ring or thread set up.
+//
+//    Purpose: Set up the shared ring, open the log and start the thread
+//    that writes it. Call once in the server before accepting.
+//
+// *****************************************************************************
+//
+int logInit(char *path, long rotate);
+
+
+// *****************************************************************************
+//
+// void logTune(int *level, long *rotate)
+//
+//    Entry:   int *level
+//                New level, LOG_OFF to LOG_ALL (negative leaves it as it
+//                is)
+//             long *rotate
+//                New size limit in bytes (<= 0 leaves it as it is)
+//
+//    Exit:    Both set to the values now in force, -1 and 0 if there's no
+//             access log.
+//
+//    Purpose: Server side: change what's logged at runtime (see
+//    otp_ctl.h). Records are filtered as the thread writes them, so the
+//    children don't need to know.
+//
+// *****************************************************************************
+//
+void logTune(int *level, long *rotate);
+
+
+// *****************************************************************************
+//
+// void logDrain(void)
+//
+//    Entry:   None.
+//
+//    Exit:    None.
+//
+//    Purpose: Server side, once the last child has exited: return when
+//    every record in the ring has been written out.
+//
+// *****************************************************************************
+//
+void logDrain(void);
+
+
+// *****************************************************************************
+//
+// void logChild(int *cli)
+//
+//    Entry:   int *cli
+//                Connection the child is serving
+//
+//    Exit:    None.
+//
+//    Purpose: Child side: note the peer and start time. The record goes
+//    into the ring when the child exits.
+//
+// *****************************************************************************
+//
+void logChild(int *cli);
+
+
+// *****************************************************************************
+//
+// void logRejected(struct sockaddr_in *peer)
+//
+//    Entry:   struct sockaddr_in *peer
+//                Client the server turned away
+//
+//    Exit:    None.
+//
+//    Purpose: Server side: log a connection turned away as busy.
+//
+// *****************************************************************************
+//
+void logRejected(struct sockaddr_in *peer);
+
+
+// *****************************************************************************
+//
+// void logKilled(pid_t pid, int sig)
+//
+//    Entry:   pid_t pid
+//                Child the server has just reaped
+//             int sig
+//                Signal it died on
+//
+//    Exit:    None.
+//
+//    Purpose: Server side: log a child that never got to write its own
+//    record.
+//
+// *****************************************************************************
+//
+void logKilled(pid_t pid, int sig);
+
+
+#endif
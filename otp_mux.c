@@ -0,0 +1,763 @@
+//
+// *****************************************************************************
+//
+// Author:    Erik Ratcliffe
+// Date:      June 5, 2015
+// Project:   Program 4 - OTP
+// Filename:  otp_mux.c
+// Class:     CS 344 (Spring 2015)
+//
+//
+// Overview:
+//    Server/client simulation of the classic "One-time Pad" encryption scheme.
+//
+//    This file contains the client side of the multiplexed protocol and
+//    the framing both sides share (see otp_mux.h for the frame format).
+//    The server side is in otp_mux_d.c.
+//
+// *****************************************************************************
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <time.h>
+#include "otp.h"
+#include "otp_crc.h"
+#include "otp_mux.h"
+#include "otp_probes.h"
+
+
+// *****************************************************************************
+//
+// void muxPutHeader(char *dst, uint32_t stream, int type, int flags,
+//                   uint32_t len)
+//
+// Purpose: Encode a frame header in network byte order.
+//
+// *****************************************************************************
+//
+void muxPutHeader(char *dst, uint32_t stream, int type, int flags,
+                  uint32_t len)
+{
+    uint32_t netStream = htonl(stream); // Stream ID, network byte order
+    uint32_t netLen = htonl(len);       // Payload length, network byte order
+
+    memcpy(dst, &netStream, 4);
+    dst[4] = (char)type;
+    dst[5] = (char)flags;
+    dst[6] = 0; // reserved
+    dst[7] = 0;
+    memcpy(dst + 8, &netLen, 4);
+}
+
+
+// *****************************************************************************
+//
+// void muxGetHeader(char *src, struct muxHeader *hdr)
+//
+// Purpose: Decode a frame header.
+//
+// *****************************************************************************
+//
+void muxGetHeader(char *src, struct muxHeader *hdr)
+{
+    uint32_t netStream, netLen; // Fields as received
+    uint16_t netReserved;
+
+    memcpy(&netStream, src, 4);
+    memcpy(&netReserved, src + 6, 2);
+    memcpy(&netLen, src + 8, 4);
+
+    hdr->stream = ntohl(netStream);
+    hdr->type = (uint8_t)src[4];
+    hdr->flags = (uint8_t)src[5];
+    hdr->reserved = ntohs(netReserved);
+    hdr->len = ntohl(netLen);
+}
+
+
+// *****************************************************************************
+//
+// static int bufReserve(struct muxBuf *q, long extra)
+//
+// Purpose: Make room for `extra` more bytes at the end of a queue, sliding
+// unconsumed bytes to the front before growing.
+//
+// *****************************************************************************
+//
+static int bufReserve(struct muxBuf *q, long extra)
+{
+    long  newCap;   // Grown capacity
+    char  *grown;   // Grown buffer
+
+    if(q->len + extra <= q->cap)
+    {
+        return 0;
+    }
+
+    if(q->off > 0)
+    {
+        memmove(q->data, q->data + q->off, q->len - q->off);
+        q->len -= q->off;
+        q->off = 0;
+        if(q->len + extra <= q->cap)
+        {
+            return 0;
+        }
+    }
+
+    newCap = (q->cap > 0) ? q->cap : MUX_MAX_FRAME;
+    while(newCap < q->len + extra)
+    {
+        newCap *= 2;
+    }
+
+    if((grown = realloc(q->data, newCap)) == NULL)
+    {
+        return -1;
+    }
+    q->data = grown;
+    q->cap = newCap;
+
+    return 0;
+}
+
+
+// *****************************************************************************
+//
+// int muxQueueFrame(struct muxBuf *q, uint32_t stream, int type, int flags,
+//                   char *payload, uint32_t len)
+//
+// Purpose: Append one complete frame to a send queue.
+//
+// *****************************************************************************
+//
+int muxQueueFrame(struct muxBuf *q, uint32_t stream, int type, int flags,
+                  char *payload, uint32_t len)
+{
+    uint32_t netCrc;  // Payload checksum, network byte order
+    long     extra = (flags & MUX_FLAG_CRC) ? CRC_LEN : 0; // Checksum bytes
+
+    if(bufReserve(q, MUX_HDR_LEN + len + extra) == -1)
+    {
+        return -1;
+    }
+
+    muxPutHeader(q->data + q->len, stream, type, flags, len + extra);
+    q->len += MUX_HDR_LEN;
+
+    if(extra > 0)
+    {
+        netCrc = htonl(crcCopy(0, q->data + q->len, payload, len));
+        memcpy(q->data + q->len + len, &netCrc, CRC_LEN);
+    }
+    else if(len > 0)
+    {
+        memcpy(q->data + q->len, payload, len);
+    }
+    q->len += len + extra;
+
+    return 0;
+}
+
+
+// *****************************************************************************
+//
+// long muxBufFill(int *sock, struct muxBuf *q)
+//
+// Purpose: Read whatever the socket has into a receive queue.
+//
+// *****************************************************************************
+//
+long muxBufFill(int *sock, struct muxBuf *q)
+{
+    long numRecv; // Bytes transferred
+
+    if(bufReserve(q, MUX_MAX_FRAME) == -1)
+    {
+        return -1;
+    }
+
+    numRecv = recv(*sock, q->data + q->len, q->cap - q->len, 0);
+    if(numRecv == -1)
+    {
+        return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 1 : -1;
+    }
+
+    q->len += numRecv;
+    otpMoved(0, numRecv);
+    OTP_PROBE2(recv__chunk, getpid(), numRecv);
+
+    return numRecv;
+}
+
+
+// *****************************************************************************
+//
+// int muxBufFlush(int *sock, struct muxBuf *q)
+//
+// Purpose: Write as much of a send queue as the socket will take.
+//
+// *****************************************************************************
+//
+int muxBufFlush(int *sock, struct muxBuf *q)
+{
+    long numSent; // Bytes transferred
+    long from = q->off; // Where this flush started
+    long start = OTP_PROBE_CLOCK(send__done); // For the send-done probe
+
+    while(q->off < q->len)
+    {
+        numSent = send(*sock, q->data + q->off, q->len - q->off, MSG_NOSIGNAL);
+        if(numSent == -1)
+        {
+            if(errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                break;
+            }
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        q->off += numSent;
+        otpMoved(1, numSent);
+    }
+
+    if(q->off > from)
+    {
+        OTP_PROBE3(send__done, getpid(), q->off - from, OTP_PROBE_SINCE(start));
+    }
+
+    if(q->off == q->len)
+    {
+        q->off = q->len = 0;
+    }
+
+    return 0;
+}
+
+
+// *****************************************************************************
+//
+// int muxBufFrame(struct muxBuf *q, struct muxHeader *hdr, char **payload)
+//
+// Purpose: Pop one complete frame off a receive queue.
+//
+// *****************************************************************************
+//
+int muxBufFrame(struct muxBuf *q, struct muxHeader *hdr, char **payload)
+{
+    if(q->len - q->off < MUX_HDR_LEN)
+    {
+        return 0;
+    }
+
+    muxGetHeader(q->data + q->off, hdr);
+    if(hdr->len > MUX_MAX_FRAME || hdr->reserved != 0)
+    {
+        return -1;
+    }
+
+    if(q->len - q->off < MUX_HDR_LEN + (long)hdr->len)
+    {
+        return 0;
+    }
+
+    *payload = q->data + q->off + MUX_HDR_LEN;
+    q->off += MUX_HDR_LEN + hdr->len;
+
+    if(hdr->flags & MUX_FLAG_CRC)
+    {
+        if(hdr->len < CRC_LEN)
+        {
+            return -1;
+        }
+        hdr->len -= CRC_LEN;
+    }
+
+    return 1;
+}
+
+
+// *****************************************************************************
+//
+// int muxTake(struct muxHeader *hdr, char *payload, char *dst, long take)
+//
+// Purpose: Copy payload out of a frame, checking its checksum.
+//
+// *****************************************************************************
+//
+int muxTake(struct muxHeader *hdr, char *payload, char *dst, long take)
+{
+    uint32_t crc;     // Checksum of the payload
+    uint32_t netCrc;  // Checksum that came with it
+
+    if(!(hdr->flags & MUX_FLAG_CRC))
+    {
+        memcpy(dst, payload, take);
+        return 0;
+    }
+
+    crc = crcCopy(0, dst, payload, take);
+    crc = crcCopy(crc, NULL, payload + take, hdr->len - take);
+    memcpy(&netCrc, payload + hdr->len, CRC_LEN);
+
+    return (ntohl(netCrc) == crc) ? 0 : -1;
+}
+
+
+// *****************************************************************************
+//
+// int muxConnect(struct muxConn *mc, char *host, int port, long svrType)
+//
+// Purpose: Connect to a server and switch to the multiplexed protocol.
+//
+// *****************************************************************************
+//
+int muxConnect(struct muxConn *mc, char *host, int port, long svrType)
+{
+    long serverType; // Type reported by the server
+    int  optval = 1; // For setsockopt()
+
+    memset(mc, 0, sizeof(*mc));
+    mc->nextId = 1;
+
+    if((mc->sock = connectServer(host, port)) == -1)
+    {
+        return -1;
+    }
+
+    if(recvLong(&mc->sock, &serverType) == -1)
+    {
+        close(mc->sock);
+        return -1;
+    }
+
+    if(serverType == OTP_BUSY)
+    {
+        recvLong(&mc->sock, &mc->retryMs);
+        close(mc->sock);
+        return -3;
+    }
+
+    if(serverType != svrType)
+    {
+        close(mc->sock);
+        return -2;
+    }
+
+    if(sendLong(&mc->sock, OP_MUX) == -1)
+    {
+        close(mc->sock);
+        return -1;
+    }
+
+    fcntl(mc->sock, F_SETFL, fcntl(mc->sock, F_GETFL) | O_NONBLOCK);
+    setsockopt(mc->sock, IPPROTO_TCP, TCP_NODELAY, &optval, sizeof(optval));
+
+    return 0;
+}
+
+
+// *****************************************************************************
+//
+// long muxSubmit(struct muxConn *mc, char *in, long inSize, char *key,
+//                long keySize, char *out)
+//
+// Purpose: Start an operation.
+//
+// *****************************************************************************
+//
+long muxSubmit(struct muxConn *mc, char *in, long inSize, char *key,
+               long keySize, char *out)
+{
+    struct muxStream *st; // Slot for the new stream
+    uint32_t sizes[2];    // MUX_OPEN payload
+    int idx;              // Loop index
+
+    for(idx = 0; idx < MUX_MAX_STREAMS; idx++)
+    {
+        if(mc->streams[idx].id == 0)
+        {
+            break;
+        }
+    }
+    if(idx == MUX_MAX_STREAMS)
+    {
+        return -1;
+    }
+
+    st = &mc->streams[idx];
+    memset(st, 0, sizeof(*st));
+    st->id = mc->nextId++;
+    if(mc->nextId == 0)
+    {
+        mc->nextId = 1; // 0 marks unused slots
+    }
+    st->in = in;
+    st->key = key;
+    st->out = out;
+    st->inSize = inSize;
+    st->keySize = keySize;
+
+    sizes[0] = htonl(inSize);
+    sizes[1] = htonl(keySize);
+    if(muxQueueFrame(&mc->outq, st->id, MUX_OPEN, mc->crc ? MUX_FLAG_CRC : 0,
+                     (char *)sizes, sizeof(sizes)) == -1)
+    {
+        st->id = 0;
+        return -1;
+    }
+
+    mc->active++;
+
+    return st->id;
+}
+
+
+// *****************************************************************************
+//
+// static int muxPump(struct muxConn *mc)
+//
+// Purpose: Queue data frames, one input and one key chunk per stream in
+// turn, so every open stream makes progress at the same time. Returns -1
+// if a frame couldn't be queued (out of memory).
+//
+// *****************************************************************************
+//
+static int muxPump(struct muxConn *mc)
+{
+    struct muxStream *st; // Stream being pumped
+    long  keyLimit;       // Key characters the server will use
+    long  chunk;          // Characters in the next frame
+    int   progress = 1;   // Set if a pass queued anything
+    int   pos, idx;       // Loop indexes
+
+    while(progress && mc->outq.len - mc->outq.off < MUX_OUT_HIGH / 4)
+    {
+        progress = 0;
+
+        for(pos = 0; pos < MUX_MAX_STREAMS; pos++)
+        {
+            idx = (mc->cursor + pos) % MUX_MAX_STREAMS;
+            st = &mc->streams[idx];
+            if(st->id == 0 || st->done)
+            {
+                continue;
+            }
+
+            keyLimit = (st->keySize < st->inSize) ? st->keySize : st->inSize;
+
+            if(st->inSent < st->inSize)
+            {
+                chunk = st->inSize - st->inSent;
+                chunk = (chunk > MUX_CHUNK) ? MUX_CHUNK : chunk;
+                if(muxQueueFrame(&mc->outq, st->id, MUX_INPUT, mc->crc ? MUX_FLAG_CRC : 0,
+                                 st->in + st->inSent, chunk) == -1)
+                {
+                    return -1; // Nothing counted as sent that wasn't queued
+                }
+                st->inSent += chunk;
+                progress = 1;
+            }
+
+            if(st->keySent < keyLimit)
+            {
+                chunk = keyLimit - st->keySent;
+                chunk = (chunk > MUX_CHUNK) ? MUX_CHUNK : chunk;
+                if(muxQueueFrame(&mc->outq, st->id, MUX_KEY, mc->crc ? MUX_FLAG_CRC : 0,
+                                 st->key + st->keySent, chunk) == -1)
+                {
+                    return -1;
+                }
+                st->keySent += chunk;
+                progress = 1;
+            }
+        }
+
+        mc->cursor = (mc->cursor + 1) % MUX_MAX_STREAMS;
+    }
+
+    return 0;
+}
+
+
+// *****************************************************************************
+//
+// static struct muxStream *muxLookup(struct muxConn *mc, uint32_t id)
+//
+// Purpose: Find an open stream by ID.
+//
+// *****************************************************************************
+//
+static struct muxStream *muxLookup(struct muxConn *mc, uint32_t id)
+{
+    int idx; // Loop index
+
+    for(idx = 0; idx < MUX_MAX_STREAMS; idx++)
+    {
+        if(mc->streams[idx].id == id && id != 0)
+        {
+            return &mc->streams[idx];
+        }
+    }
+
+    return NULL;
+}
+
+
+// *****************************************************************************
+//
+// long muxWait(struct muxConn *mc, int *status)
+//
+// Purpose: Send and receive until any stream completes.
+//
+// *****************************************************************************
+//
+long muxWait(struct muxConn *mc, int *status)
+{
+    struct muxStream *st;   // Stream a frame belongs to
+    struct muxHeader hdr;   // Header of a received frame
+    struct pollfd pfd;      // Poll descriptor for the connection
+    char   *payload;        // Payload of a received frame
+    uint32_t code;          // Error code from MUX_ERROR
+    uint32_t delay;         // Retry delay with MUX_ERR_BUSY
+    long   id;              // Completed stream ID
+    long   numRecv;         // Bytes read
+    long   take;            // Result characters to copy
+    int    got;             // Result of muxBufFrame()
+    int    idx;             // Loop index
+
+    while(1)
+    {
+        // Report finished streams first.
+        //
+        for(idx = 0; idx < MUX_MAX_STREAMS; idx++)
+        {
+            st = &mc->streams[idx];
+            if(st->id != 0 && st->done)
+            {
+                id = st->id;
+                *status = st->error;
+                st->id = 0;
+                mc->active--;
+                return id;
+            }
+        }
+
+        if(mc->active == 0)
+        {
+            return -1;
+        }
+
+        if(muxPump(mc) == -1)
+        {
+            return -1;
+        }
+
+        pfd.fd = mc->sock;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if(mc->outq.len > mc->outq.off)
+        {
+            pfd.events |= POLLOUT;
+        }
+
+        if(poll(&pfd, 1, -1) == -1)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+
+        if((pfd.revents & POLLOUT) && muxBufFlush(&mc->sock, &mc->outq) == -1)
+        {
+            return -1;
+        }
+
+        if(!(pfd.revents & (POLLIN | POLLHUP | POLLERR)))
+        {
+            continue;
+        }
+
+        if((numRecv = muxBufFill(&mc->sock, &mc->inq)) <= 0)
+        {
+            return -1; // Server went away with streams outstanding
+        }
+
+        while((got = muxBufFrame(&mc->inq, &hdr, &payload)) == 1)
+        {
+            if((st = muxLookup(mc, hdr.stream)) == NULL)
+            {
+                continue;
+            }
+
+            switch(hdr.type)
+            {
+                case MUX_RESULT:
+                    take = st->inSize - st->outGot;
+                    take = (take > (long)hdr.len) ? (long)hdr.len : take;
+                    if(muxTake(&hdr, payload, st->out + st->outGot, take) == -1)
+                    {
+                        st->done = 1;
+                        st->error = MUX_ERR_CRC;
+                    }
+                    st->outGot += take;
+                    break;
+
+                case MUX_END:
+                    st->done = 1;
+                    break;
+
+                case MUX_ERROR:
+                    code = MUX_ERR_PROTO;
+                    if(hdr.len >= 4)
+                    {
+                        memcpy(&code, payload, 4);
+                        code = ntohl(code);
+                    }
+                    if(code == MUX_ERR_BUSY && hdr.len >= 8)
+                    {
+                        memcpy(&delay, payload + 4, 4);
+                        mc->retryMs = ntohl(delay);
+                    }
+                    st->done = 1;
+                    st->error = code;
+                    break;
+            }
+        }
+        if(got == -1)
+        {
+            return -1;
+        }
+    }
+}
+
+
+// *****************************************************************************
+//
+// void muxClose(struct muxConn *mc)
+//
+// Purpose: Close the connection and free its queues.
+//
+// *****************************************************************************
+//
+void muxClose(struct muxConn *mc)
+{
+    close(mc->sock);
+    mc->sock = -1;
+
+    free(mc->inq.data);
+    free(mc->outq.data);
+    memset(&mc->inq, 0, sizeof(mc->inq));
+    memset(&mc->outq, 0, sizeof(mc->outq));
+}
+
+
+// *****************************************************************************
+//
+// long muxRequest(struct otpPool *pool, char *in, long inSize, char *key,
+//                 long keySize, char *out, int crc)
+//
+// Purpose: Run one request as a single stream over a new multiplexed
+// connection.
+//
+// *****************************************************************************
+//
+long muxRequest(struct otpPool *pool, char *in, long inSize, char *key,
+                long keySize, char *out, int crc)
+{
+    struct muxConn mc;        // Connection the stream goes over
+    time_t giveUp;            // When to stop retrying busy servers
+    long   result = -1;       // Characters back, -1 on failure
+    long   retryMs;           // Shortest delay a busy server asked for
+    long   delay = 0;         // Current busy backoff
+    int    status;            // How the stream ended
+    int    busy;              // Set if a server said it was busy
+    int    ep;                // Loop index
+    int    rc = -1;           // Result of muxConnect()
+
+    if(keySize < inSize || inSize > 0xffffffffL)
+    {
+        return -1;
+    }
+
+    // Servers in list order, skipping any that can't be reached or are
+    // the wrong type. If all that answered were busy, back off as
+    // poolRequest() does and go round again, for up to POOL_BUSY_SECS.
+    //
+    giveUp = time(NULL) + POOL_BUSY_SECS;
+    while(rc != 0)
+    {
+        busy = 0;
+        retryMs = POOL_BUSY_MAX_MS;
+        pool->lastError = POOL_ERR_CONNECT;
+        for(ep = 0; ep < pool->numEndpoints && rc != 0; ep++)
+        {
+            rc = muxConnect(&mc, pool->ep[ep].host, pool->ep[ep].port, pool->svrType);
+            if(rc == -3)
+            {
+                busy = 1;
+                retryMs = (mc.retryMs < retryMs) ? mc.retryMs : retryMs;
+            }
+            else if(rc == -2)
+            {
+                pool->lastError = POOL_ERR_TYPE;
+            }
+        }
+
+        if(rc != 0 && (!busy || !poolBackoff(&delay, retryMs, giveUp)))
+        {
+            pool->lastError = busy ? POOL_ERR_BUSY : pool->lastError;
+            return -1;
+        }
+    }
+    pool->lastError = POOL_ERR_NONE;
+
+    // Only the key characters the server uses go out. A stream turned
+    // away busy is sent again on the same connection after the same
+    // backoff.
+    //
+    mc.crc = crc;
+    while(muxSubmit(&mc, in, inSize, key, inSize, out) != -1 &&
+          muxWait(&mc, &status) != -1)
+    {
+        if(status == MUX_ERR_BUSY && poolBackoff(&delay, mc.retryMs, giveUp))
+        {
+            continue;
+        }
+
+        result = (status == 0) ? inSize : -1;
+        if(status == MUX_ERR_BUSY)
+        {
+            pool->lastError = POOL_ERR_BUSY;
+        }
+        else if(status == MUX_ERR_TOO_LARGE)
+        {
+            pool->lastError = POOL_ERR_TOO_LARGE;
+        }
+        else if(status != 0)
+        {
+            fprintf(stderr, "stream failed: error %d\n", status);
+        }
+        break;
+    }
+
+    muxClose(&mc);
+
+    return result;
+}
@@ -0,0 +1,410 @@
+//
+// *****************************************************************************
+//
+// Author:    Erik Ratcliffe
+// Date:      June 5, 2015
+// Project:   Program 4 - OTP
+// Filename:  otp_mux.h
+// Class:     CS 344 (Spring 2015)
+//
+//
+// Overview:
+//    Server/client simulation of the classic "One-time Pad" encryption scheme.
+//
+//    This file contains the definitions and function prototypes for the
+//    multiplexed protocol, which carries many encode/decode operations
+//    ("streams") over one connection at the same time.
+//
+//    After the server type, the client sends OP_MUX instead of an input
+//    file size. From then on both sides exchange frames: a 12 byte header
+//    (stream ID, frame type, flags, reserved, payload length; all in
+//    network byte order) followed by up to MUX_MAX_FRAME payload bytes.
+//    Frames of different streams can be interleaved freely and streams
+//    complete in whatever order their data arrives.
+//
+//    A frame with MUX_FLAG_CRC set ends in the CRC32C of its payload (see
+//    otp_crc.h), counted in the payload length. A client that wants its
+//    data checked sets the flag on every frame of a stream, from MUX_OPEN
+//    on, and the server then sets it on that stream's results. A frame
+//    whose checksum doesn't match fails its stream with MUX_ERR_CRC.
+//
+// *****************************************************************************
+//
+
+#ifndef OTP_MUX_H
+#define OTP_MUX_H
+
+
+#include <stdint.h>
+#include "otp_crc.h"
+#include "otp_pool.h"
+
+
+#define MUX_HDR_LEN      12               // Frame header size
+#define MUX_MAX_FRAME    65536            // Largest payload in one frame
+#define MUX_CHUNK        16384            // Payload size our senders use
+#define MUX_MAX_STREAMS  256              // Streams open at once per connection
+#define MUX_OUT_HIGH     (4L * 1024 * 1024) // Stop reading while this much is queued
+
+// Frame types
+//
+#define MUX_OPEN    1   // client: payload is input size, key size (u32 each)
+#define MUX_INPUT   2   // client: next chunk of input characters
+#define MUX_KEY     3   // client: next chunk of key characters
+#define MUX_RESULT  4   // server: next chunk of result characters
+#define MUX_END     5   // server: stream finished successfully
+#define MUX_ERROR   6   // server: stream failed, payload is the code (u32)
+
+// Frame flags
+//
+#define MUX_FLAG_CRC  0x01  // Payload ends in a CRC32C of the rest
+
+// Error codes carried by MUX_ERROR
+//
+#define MUX_ERR_PROTO    1  // Malformed or unexpected frame
+#define MUX_ERR_KEY      2  // Key is shorter than the input
+#define MUX_ERR_CHARS    3  // Input contains invalid characters
+#define MUX_ERR_STREAMS  4  // Too many open streams, or stream ID in use
+#define MUX_ERR_CRC      5  // A frame's checksum didn't match its payload
+#define MUX_ERR_REUSE    6  // Key was used before (see otp_reuse.h)
+#define MUX_ERR_BUSY     7  // Server is full for now; the code is followed
+                            // by a retry delay in ms (u32)
+#define MUX_ERR_TOO_LARGE 8 // Stream too large for the server ever to take
+
+
+struct muxHeader
+{
+    uint32_t stream;    // Stream the frame belongs to (chosen by the client)
+    uint8_t  type;      // MUX_* frame type
+    uint8_t  flags;     // MUX_FLAG_* options
+    uint16_t reserved;  // Must be 0
+    uint32_t len;       // Payload bytes following the header
+};
+
+
+struct muxBuf
+{
+    char *data;         // Buffered bytes
+    long off;           // First unconsumed byte
+    long len;           // One past the last buffered byte
+    long cap;           // Allocated size of data
+};
+
+
+struct muxStream
+{
+    uint32_t id;        // Stream ID (0 = slot unused)
+    int   done;         // Set once the stream has ended or failed
+    int   error;        // MUX_ERR_* code, 0 on success
+    char  *in, *key;    // Caller's input and key characters
+    char  *out;         // Caller's result buffer (inSize characters)
+    long  inSize;       // Number of input characters
+    long  keySize;      // Number of key characters
+    long  inSent;       // Input characters queued so far
+    long  keySent;      // Key characters queued so far
+    long  outGot;       // Result characters received so far
+};
+
+
+struct muxConn
+{
+    int    sock;                              // Connection to the server
+    uint32_t nextId;                          // Next stream ID to hand out
+    int    active;                            // Streams submitted, not yet reported
+    int    cursor;                            // Round robin position for data frames
+    long   retryMs;                           // Delay a busy server asked for
+                                              // (connection or stream)
+    int    crc;                               // Checksum every frame (set after
+                                              // muxConnect())
+    struct muxBuf inq, outq;                  // Receive and send queues
+    struct muxStream streams[MUX_MAX_STREAMS];
+};
+
+
+// *****************************************************************************
+//
+// void muxPutHeader(char *dst, uint32_t stream, int type, int flags,
+//                   uint32_t len)
+//
+//    Entry:   char *dst
+//                At least MUX_HDR_LEN bytes to write the header into
+//             uint32_t stream, int type, int flags, uint32_t len
+//                Header fields (reserved is written as 0)
+//
+//    Exit:    None.
+//
+//    Purpose: Encode a frame header in network byte order.
+//
+// *****************************************************************************
+//
+void muxPutHeader(char *dst, uint32_t stream, int type, int flags,
+                  uint32_t len);
+
+
+// *****************************************************************************
+//
+// void muxGetHeader(char *src, struct muxHeader *hdr)
+//
+//    Entry:   char *src
+//                MUX_HDR_LEN bytes of received header
+//             struct muxHeader *hdr
+//                Receives the decoded header in host byte order
+//
+//    Exit:    None.
+//
+//    Purpose: Decode a frame header.
+//
+// *****************************************************************************
+//
+void muxGetHeader(char *src, struct muxHeader *hdr);
+
+
+// *****************************************************************************
+//
+// int muxQueueFrame(struct muxBuf *q, uint32_t stream, int type, int flags,
+//                   char *payload, uint32_t len)
+//
+//    Entry:   struct muxBuf *q
+//                Send queue to append to
+//             uint32_t stream, int type, int flags
+//                Header fields
+//             char *payload, uint32_t len
+//                Payload to copy in after the header (payload may be NULL
+//                when len is 0)
+//
+//    Exit:    Returns 0 on success, -1 if memory ran out.
+//
+//    Purpose: Append one complete frame to a send queue. With
+//    MUX_FLAG_CRC, the checksum is taken while the payload is copied in
+//    and appended after it.
+//
+// *****************************************************************************
+//
+int muxQueueFrame(struct muxBuf *q, uint32_t stream, int type, int flags,
+                  char *payload, uint32_t len);
+
+
+// *****************************************************************************
+//
+// long muxBufFill(int *sock, struct muxBuf *q)
+//
+//    Entry:   int *sock
+//                Non-blocking connection to read from
+//             struct muxBuf *q
+//                Receive queue to append to
+//
+//    Exit:    Bytes read, 0 on EOF, -1 on error. EAGAIN counts as 1, so
+//             the caller just carries on.
+//
+//    Purpose: Read whatever the socket has into a receive queue. The bytes
+//    are reported to the socket hook (see otpSetHooks()).
+//
+// *****************************************************************************
+//
+long muxBufFill(int *sock, struct muxBuf *q);
+
+
+// *****************************************************************************
+//
+// int muxBufFlush(int *sock, struct muxBuf *q)
+//
+//    Entry:   int *sock
+//                Non-blocking connection to write to
+//             struct muxBuf *q
+//                Send queue to drain
+//
+//    Exit:    Returns 0 unless the connection failed.
+//
+//    Purpose: Write as much of a send queue as the socket will take,
+//    reporting the bytes to the socket hook.
+//
+// *****************************************************************************
+//
+int muxBufFlush(int *sock, struct muxBuf *q);
+
+
+// *****************************************************************************
+//
+// int muxBufFrame(struct muxBuf *q, struct muxHeader *hdr, char **payload)
+//
+//    Entry:   struct muxBuf *q
+//                Receive queue to take the frame from
+//             struct muxHeader *hdr
+//                Receives the frame's header
+//             char **payload
+//                Receives a pointer to its payload, inside q
+//
+//    Exit:    1 if a frame was popped, 0 if more bytes are needed, -1 if
+//             the frame is malformed.
+//
+//    Purpose: Pop one complete frame off a receive queue. With
+//    MUX_FLAG_CRC, the checksum is left after the payload, outside
+//    hdr->len.
+//
+// *****************************************************************************
+//
+int muxBufFrame(struct muxBuf *q, struct muxHeader *hdr, char **payload);
+
+
+// *****************************************************************************
+//
+// int muxTake(struct muxHeader *hdr, char *payload, char *dst, long take)
+//
+//    Entry:   struct muxHeader *hdr, char *payload
+//                Frame popped by muxBufFrame()
+//             char *dst
+//                Where the payload goes
+//             long take
+//                Payload bytes to copy (at most hdr->len); the rest is
+//                still checksummed
+//
+//    Exit:    Returns 0, or -1 if the frame's checksum doesn't match.
+//
+//    Purpose: Copy the first take payload bytes to dst, checking the
+//    frame's checksum (if it has one) on the way.
+//
+// *****************************************************************************
+//
+int muxTake(struct muxHeader *hdr, char *payload, char *dst, long take);
+
+
+// *****************************************************************************
+//
+// void muxServe(int *cli, long svrType)
+//
+//    Entry:   int *cli
+//                Client connection that has just sent OP_MUX
+//             long svrType
+//                OTP_ENCODE or OTP_DECODE
+//
+//    Exit:    Returns once the client has closed its side and every
+//             stream has been answered (or the connection fails).
+//
+//    Purpose: Server side of the multiplexed protocol. Each stream is
+//    encoded/decoded as soon as both its input and key have arrived for a
+//    range, so results flow back while the rest is still being sent.
+//
+// *****************************************************************************
+//
+void muxServe(int *cli, long svrType);
+
+
+// *****************************************************************************
+//
+// int muxConnect(struct muxConn *mc, char *host, int port, long svrType)
+//
+//    Entry:   struct muxConn *mc
+//                Connection state to initialize
+//             char *host, int port
+//                Server to connect to
+//             long svrType
+//                Server type the server must report
+//
+//    Exit:    Returns 0 on success, -1 if the connection failed, -2 if the
+//             server is of the wrong type, -3 if the server is busy
+//             (mc->retryMs says how long to wait before trying again).
+//
+//    Purpose: Connect to a server and switch the connection to the
+//    multiplexed protocol.
+//
+// *****************************************************************************
+//
+int muxConnect(struct muxConn *mc, char *host, int port, long svrType);
+
+
+// *****************************************************************************
+//
+// long muxSubmit(struct muxConn *mc, char *in, long inSize, char *key,
+//                long keySize, char *out)
+//
+//    Entry:   struct muxConn *mc
+//                Connection to submit on
+//             char *in, long inSize
+//                Input characters (not copied, must stay valid until the
+//                stream completes)
+//             char *key, long keySize
+//                Key characters (same lifetime rule)
+//             char *out
+//                Buffer receiving inSize result characters (may be in)
+//
+//    Exit:    The stream ID, or -1 if MUX_MAX_STREAMS are already open.
+//
+//    Purpose: Start an operation. Nothing is sent until muxWait() runs.
+//
+// *****************************************************************************
+//
+long muxSubmit(struct muxConn *mc, char *in, long inSize, char *key,
+               long keySize, char *out);
+
+
+// *****************************************************************************
+//
+// long muxWait(struct muxConn *mc, int *status)
+//
+//    Entry:   struct muxConn *mc
+//                Connection to drive
+//             int *status
+//                Receives 0 if the stream succeeded, else a MUX_ERR_* code
+//
+//    Exit:    ID of a completed stream, -1 if nothing is outstanding or the
+//             connection failed. A result frame that fails its checksum
+//             fails the stream with MUX_ERR_CRC.
+//
+//    Purpose: Send and receive until any stream completes. Streams are
+//    reported in completion order, not submission order.
+//
+// *****************************************************************************
+//
+long muxWait(struct muxConn *mc, int *status);
+
+
+// *****************************************************************************
+//
+// void muxClose(struct muxConn *mc)
+//
+//    Entry:   struct muxConn *mc
+//                Connection to close
+//
+//    Exit:    None.
+//
+//    Purpose: Close the connection and free its queues.
+//
+// *****************************************************************************
+//
+void muxClose(struct muxConn *mc);
+
+
+// *****************************************************************************
+//
+// long muxRequest(struct otpPool *pool, char *in, long inSize, char *key,
+//                 long keySize, char *out, int crc)
+//
+//    Entry:   struct otpPool *pool
+//                Servers to try, in list order (only their addresses and
+//                type are used; nothing is pooled)
+//             char *in, long inSize
+//                Input characters (at most 4G, the MUX_OPEN limit)
+//             char *key, long keySize
+//                Key characters, at least inSize of them
+//             char *out
+//                Buffer receiving inSize result characters (may be in)
+//             int crc
+//                1 to checksum every frame (MUX_FLAG_CRC)
+//
+//    Exit:    Number of result characters, or -1 on failure with
+//             pool->lastError set as for poolRequest() (POOL_ERR_NONE if
+//             the stream itself failed; its MUX_ERR_* code goes to
+//             stderr). MUX_ERR_BUSY and MUX_ERR_TOO_LARGE map to
+//             POOL_ERR_BUSY and POOL_ERR_TOO_LARGE.
+//
+//    Purpose: The clients' -m mode: run one request as a single stream
+//    over a multiplexed connection. Busy servers are retried for up to
+//    POOL_BUSY_SECS.
+//
+// *****************************************************************************
+//
+long muxRequest(struct otpPool *pool, char *in, long inSize, char *key,
+                long keySize, char *out, int crc);
+
+
+#endif
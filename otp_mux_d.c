@@ -0,0 +1,485 @@
+//
+// *****************************************************************************
+//
+// Author:    Erik Ratcliffe
+// Date:      June 5, 2015
+// Project:   Program 4 - OTP
+// Filename:  otp_mux_d.c
+// Class:     CS 344 (Spring 2015)
+//
+//
+// Overview:
+//    Server/client simulation of the classic "One-time Pad" encryption scheme.
+//
+//    This file contains the server side of the multiplexed protocol (see
+//    otp_mux.h for the frame format). The client side and the framing
+//    both sides share are in otp_mux.c.
+//
+// *****************************************************************************
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include "otp.h"
+#include "otp_admit.h"
+#include "otp_buf.h"
+#include "otp_crc.h"
+#include "otp_mux.h"
+#include "otp_reuse.h"
+#include "otp_sched.h"
+#include "otp_stats.h"
+#include "otp_trace.h"
+
+
+// Per-stream state on the server side.
+//
+struct muxServerStream
+{
+    uint32_t id;      // Stream ID (0 = slot unused)
+    long  inSize;     // Input characters announced in MUX_OPEN
+    long  inGot;      // Input characters received
+    long  keyGot;     // Key characters received (only the first inSize kept)
+    long  done;       // Characters already encoded/decoded and queued
+    int   crc;        // Frames carry checksums (MUX_FLAG_CRC on MUX_OPEN)
+    int   sched;      // Large: slices take turns (see otp_sched.h)
+    char  *in;        // Input characters, encoded/decoded in place
+    char  *key;       // Key characters lined up with in
+};
+
+
+// *****************************************************************************
+//
+// static void muxDrop(struct muxServerStream *st)
+//
+// Purpose: Release a server stream slot, and its admission.
+//
+// *****************************************************************************
+//
+static void muxDrop(struct muxServerStream *st)
+{
+    admitDone(st->inSize);
+    bufPut(st->in);
+    bufPut(st->key);
+    memset(st, 0, sizeof(*st));
+}
+
+
+// *****************************************************************************
+//
+// static int muxFail(struct muxBuf *outq, uint32_t stream, uint32_t code)
+//
+// Purpose: Queue a MUX_ERROR frame for a stream, and count it.
+//
+// *****************************************************************************
+//
+static int muxFail(struct muxBuf *outq, uint32_t stream, uint32_t code)
+{
+    uint32_t netCode = htonl(code); // Error code, network byte order
+
+    statsCount((code == MUX_ERR_KEY) ? STAT_ERR_KEY :
+               (code == MUX_ERR_CHARS) ? STAT_ERR_CHARS :
+               (code == MUX_ERR_CRC) ? STAT_ERR_CRC :
+               (code == MUX_ERR_REUSE) ? STAT_ERR_REUSE :
+               (code == MUX_ERR_STREAMS || code == MUX_ERR_TOO_LARGE) ? STAT_ERR_BUSY :
+               STAT_ERR_PROTO, 1);
+
+    return muxQueueFrame(outq, stream, MUX_ERROR, 0, (char *)&netCode, 4);
+}
+
+
+// *****************************************************************************
+//
+// static int muxBusy(struct muxBuf *outq, uint32_t stream, long delay)
+//
+// Purpose: Turn a stream away for load: MUX_ERR_BUSY and how long to wait.
+//
+// *****************************************************************************
+//
+static int muxBusy(struct muxBuf *outq, uint32_t stream, long delay)
+{
+    uint32_t busy[2];  // Code and delay, network byte order
+
+    statsCount(STAT_ERR_BUSY, 1);
+    busy[0] = htonl(MUX_ERR_BUSY);
+    busy[1] = htonl(delay);
+
+    return muxQueueFrame(outq, stream, MUX_ERROR, 0, (char *)busy, sizeof(busy));
+}
+
+
+// *****************************************************************************
+//
+// static int muxAdvance(struct muxServerStream *st, struct muxBuf *outq,
+//                       long svrType)
+//
+// Purpose: Encode/decode whatever range of a stream now has both input and
+// key, queue the result, and finish the stream once it is complete.
+//
+// *****************************************************************************
+//
+static int muxAdvance(struct muxServerStream *st, struct muxBuf *outq,
+                      long svrType)
+{
+    long ready;  // Characters that have both input and key
+    long chunk;  // Result characters in the next frame or slice
+    long off;    // Start of the current scheduler slice
+
+    ready = (st->inGot < st->keyGot) ? st->inGot : st->keyGot;
+
+    // With the reuse index on, an encoding stream waits for all of its
+    // key, which the index checks in one piece (see otp_reuse.h).
+    //
+    if(svrType == OTP_ENCODE && reuseOn() && ready < st->inSize)
+    {
+        return 0;
+    }
+
+    if(ready > st->done)
+    {
+        if(!verifyBuf(st->in + st->done, ready - st->done))
+        {
+            uint32_t id = st->id; // Saved, muxDrop() clears it
+
+            muxDrop(st);
+            return muxFail(outq, id, MUX_ERR_CHARS);
+        }
+        if(svrType == OTP_ENCODE &&
+           reuseCheck(st->in + st->done, st->key + st->done, ready - st->done) == REUSE_FOUND)
+        {
+            uint32_t id = st->id;
+
+            muxDrop(st);
+            return muxFail(outq, id, MUX_ERR_REUSE);
+        }
+
+        // Frames of every stream interleave, so only the codec is traced
+        // on its own; the rest of the connection counts as other. A large
+        // stream takes its turn for the CPU a slice at a time, like a
+        // classic request (see serveSingle()).
+        //
+        traceMark(TRACE_OTHER);
+        for(off = st->done; off < ready; off += chunk)
+        {
+            chunk = (ready - off > SCHED_CHUNK) ? SCHED_CHUNK : ready - off;
+
+            if(st->sched)
+            {
+                schedBegin(chunk);
+                traceMark(TRACE_QUEUE);
+            }
+            if(svrType == OTP_ENCODE)
+            {
+                encodeBuf(st->in + off, st->key + off, chunk);
+            }
+            else
+            {
+                decodeBuf(st->in + off, st->key + off, chunk);
+            }
+            traceMark(TRACE_CODEC);
+            if(st->sched)
+            {
+                schedEnd();
+            }
+        }
+
+        while(st->done < ready)
+        {
+            chunk = ready - st->done;
+            if(chunk > MUX_CHUNK)
+            {
+                chunk = MUX_CHUNK;
+            }
+            if(muxQueueFrame(outq, st->id, MUX_RESULT, st->crc ? MUX_FLAG_CRC : 0,
+                             st->in + st->done, chunk) == -1)
+            {
+                return -1;
+            }
+            st->done += chunk;
+        }
+    }
+
+    if(st->done == st->inSize)
+    {
+        uint32_t id = st->id; // Saved, muxDrop() clears it
+
+        muxDrop(st);
+        return muxQueueFrame(outq, id, MUX_END, 0, NULL, 0);
+    }
+
+    return 0;
+}
+
+
+// *****************************************************************************
+//
+// static int muxFrame(int *cli, struct muxServerStream *streams,
+//                     struct muxHeader *hdr, char *payload,
+//                     struct muxBuf *outq, long svrType)
+//
+// Purpose: Handle one frame from the client. Returns -1 if the connection
+// should be dropped.
+//
+// *****************************************************************************
+//
+static int muxFrame(int *cli, struct muxServerStream *streams,
+                    struct muxHeader *hdr, char *payload,
+                    struct muxBuf *outq, long svrType)
+{
+    struct muxServerStream *st = NULL; // Stream the frame belongs to
+    uint32_t sizes[2];                 // Sizes carried by MUX_OPEN
+    long     take;                     // Key characters worth keeping
+    long     delay;                    // Retry delay if we're full
+    int      idx;                      // Loop index
+    int      freeSlot = -1;            // First unused slot
+
+    if(hdr->stream == 0)
+    {
+        return -1;
+    }
+
+    for(idx = 0; idx < MUX_MAX_STREAMS; idx++)
+    {
+        if(streams[idx].id == hdr->stream)
+        {
+            st = &streams[idx];
+        }
+        else if(streams[idx].id == 0 && freeSlot == -1)
+        {
+            freeSlot = idx;
+        }
+    }
+
+    switch(hdr->type)
+    {
+        case MUX_OPEN:
+            if(hdr->len != sizeof(sizes))
+            {
+                return -1;
+            }
+            if(st != NULL || freeSlot == -1)
+            {
+                return muxFail(outq, hdr->stream, MUX_ERR_STREAMS);
+            }
+            if(muxTake(hdr, payload, (char *)sizes, sizeof(sizes)) == -1)
+            {
+                return muxFail(outq, hdr->stream, MUX_ERR_CRC);
+            }
+            if(ntohl(sizes[1]) < ntohl(sizes[0]))
+            {
+                return muxFail(outq, hdr->stream, MUX_ERR_KEY);
+            }
+
+            // Each stream is admitted on its own, like a classic
+            // request (see serveSingle()), and turned away busy the same
+            // way. The other streams on the connection carry on.
+            //
+            take = ntohl(sizes[0]);
+            if(!bufFits(take + 1, 2))
+            {
+                return muxFail(outq, hdr->stream, MUX_ERR_TOO_LARGE);
+            }
+            if((delay = admitBytes(take)) != 0)
+            {
+                return muxBusy(outq, hdr->stream, delay);
+            }
+
+            statsCount(STAT_REQ_MUX, 1);
+            st = &streams[freeSlot];
+            st->id = hdr->stream;
+            st->crc = hdr->flags & MUX_FLAG_CRC;
+            st->inSize = take;
+            st->sched = schedOpen(cli, take);
+            st->in = bufGet(st->inSize + 1);
+            st->key = bufGet(st->inSize + 1);
+            if(st->in == NULL || st->key == NULL)
+            {
+                muxDrop(st);
+                return muxBusy(outq, hdr->stream, ADMIT_RETRY_MS);
+            }
+            return muxAdvance(st, outq, svrType);
+
+        case MUX_INPUT:
+            // Data for a stream we already failed or finished is dropped
+            // quietly; the client learns what happened from the error.
+            //
+            if(st == NULL)
+            {
+                return 0;
+            }
+            if(st->inGot + hdr->len > st->inSize)
+            {
+                uint32_t id = st->id;
+
+                muxDrop(st);
+                return muxFail(outq, id, MUX_ERR_PROTO);
+            }
+            if(muxTake(hdr, payload, st->in + st->inGot, hdr->len) == -1)
+            {
+                uint32_t id = st->id;
+
+                muxDrop(st);
+                return muxFail(outq, id, MUX_ERR_CRC);
+            }
+            st->inGot += hdr->len;
+            return muxAdvance(st, outq, svrType);
+
+        case MUX_KEY:
+            if(st == NULL)
+            {
+                return 0;
+            }
+            // Only the part of the key that lines up with the input is
+            // ever used.
+            //
+            take = st->inSize - st->keyGot;
+            if(take > (long)hdr->len)
+            {
+                take = hdr->len;
+            }
+            if(muxTake(hdr, payload, st->key + st->keyGot, take) == -1)
+            {
+                uint32_t id = st->id;
+
+                muxDrop(st);
+                return muxFail(outq, id, MUX_ERR_CRC);
+            }
+            st->keyGot += take;
+            return muxAdvance(st, outq, svrType);
+
+        default:
+            return -1;
+    }
+}
+
+
+// *****************************************************************************
+//
+// void muxServe(int *cli, long svrType)
+//
+// Purpose: Server side of the multiplexed protocol.
+//
+// *****************************************************************************
+//
+void muxServe(int *cli, long svrType)
+{
+    struct muxServerStream *streams; // Stream table
+    struct muxBuf inq, outq;         // Receive and send queues
+    struct muxHeader hdr;            // Header of the frame being handled
+    struct pollfd pfd;               // Poll descriptor for the connection
+    char  *payload;                  // Payload of the frame being handled
+    int   eof = 0;                   // Set once the client closes its side
+    int   got;                       // Result of muxBufFrame()
+    int   idx;                       // Loop index
+    int   optval = 1;                // For setsockopt()
+
+    memset(&inq, 0, sizeof(inq));
+    memset(&outq, 0, sizeof(outq));
+    if((streams = calloc(MUX_MAX_STREAMS, sizeof(*streams))) == NULL)
+    {
+        return;
+    }
+
+    // Frames go out whole from the queue, so there's nothing for Nagle
+    // to coalesce; it would only hold a stream's last frame back for the
+    // peer's delayed ACK.
+    //
+    fcntl(*cli, F_SETFL, fcntl(*cli, F_GETFL) | O_NONBLOCK);
+    setsockopt(*cli, IPPROTO_TCP, TCP_NODELAY, &optval, sizeof(optval));
+
+    while(1)
+    {
+        // Once the client is done sending, anything left open can never
+        // complete; flush what we have and leave.
+        //
+        if(eof && outq.len == outq.off)
+        {
+            break;
+        }
+
+        // Stop reading while the client is slow to take its results, so
+        // the send queue can't grow without bound.
+        //
+        pfd.fd = *cli;
+        pfd.events = 0;
+        pfd.revents = 0;
+        if(!eof && outq.len - outq.off < MUX_OUT_HIGH)
+        {
+            pfd.events |= POLLIN;
+        }
+        if(outq.len > outq.off)
+        {
+            pfd.events |= POLLOUT;
+        }
+
+        if(poll(&pfd, 1, -1) == -1)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            break;
+        }
+
+        if(pfd.revents & POLLOUT)
+        {
+            if(muxBufFlush(cli, &outq) == -1)
+            {
+                break;
+            }
+        }
+
+        if(pfd.revents & (POLLIN | POLLHUP | POLLERR))
+        {
+            long numRecv = muxBufFill(cli, &inq); // Bytes read
+
+            if(numRecv == -1)
+            {
+                break;
+            }
+            if(numRecv == 0)
+            {
+                eof = 1;
+            }
+
+            while((got = muxBufFrame(&inq, &hdr, &payload)) == 1)
+            {
+                if(muxFrame(cli, streams, &hdr, payload, &outq, svrType) == -1)
+                {
+                    got = -1;
+                    break;
+                }
+            }
+            if(got == -1)
+            {
+                // Malformed frame: tell the client and hang up.
+                //
+                muxFail(&outq, hdr.stream, MUX_ERR_PROTO);
+                fcntl(*cli, F_SETFL, fcntl(*cli, F_GETFL) & ~O_NONBLOCK);
+                muxBufFlush(cli, &outq);
+                break;
+            }
+        }
+    }
+
+    for(idx = 0; idx < MUX_MAX_STREAMS; idx++)
+    {
+        if(streams[idx].id != 0)
+        {
+            muxDrop(&streams[idx]);
+        }
+    }
+    schedClose();
+    free(streams);
+    free(inq.data);
+    free(outq.data);
+}
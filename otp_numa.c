@@ -0,0 +1,461 @@
+//
+// *****************************************************************************
+//
+// Author:    Erik Ratcliffe
+// Date:      June 5, 2015
+// Project:   Program 4 - OTP
+// Filename:  otp_numa.c
+// Class:     CS 344 (Spring 2015)
+//
+//
+// Overview:
+//    Server/client simulation of the classic "One-time Pad" encryption scheme.
+//
+//    This file contains the placement of children on CPUs and NUMA nodes
+//    (see otp_numa.h).
+//
+// *****************************************************************************
+//
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <dirent.h>
+#include <ifaddrs.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/mempolicy.h>
+#include "otp_buf.h"
+#include "otp_numa.h"
+
+
+// A child pinned to a CPU.
+//
+struct numaKid
+{
+    pid_t  pid;      // Child (0 = free entry)
+    int    cpu;      // CPU it's pinned to
+};
+
+
+static int placing = 0;                    // -A given?
+static int nodeCount = 0;                  // Nodes found
+static int nodeIds[NUMA_MAX_NODES];        // Node ID of each slice
+static int cpuSlice[NUMA_MAX_CPUS];        // Slice of each usable CPU (-1 = not ours)
+static int cpuKids[NUMA_MAX_CPUS];         // Children pinned to each CPU
+static int nicCount = 0;                   // Interface addresses with a node
+static in_addr_t nicAddr[NUMA_MAX_NICS];   // Their addresses
+static int nicSlice[NUMA_MAX_NICS];        // And the slice of their device
+static struct numaKid kids[NUMA_TABLE];    // Pinned children
+
+
+// *****************************************************************************
+//
+// static int numaRead(char *path, char *buf, int size)
+//
+// Purpose: Read a small sysfs file into buf, without its newline. Returns
+// -1 if it can't be read.
+//
+// *****************************************************************************
+//
+static int numaRead(char *path, char *buf, int size)
+{
+    FILE *fp;          // The file
+    char *nl;          // Its newline
+
+    if((fp = fopen(path, "r")) == NULL)
+    {
+        return -1;
+    }
+
+    if(fgets(buf, size, fp) == NULL)
+    {
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+
+    if((nl = strchr(buf, '\n')) != NULL)
+    {
+        *nl = '\0';
+    }
+
+    return 0;
+}
+
+
+// *****************************************************************************
+//
+// static void numaCpus(char *list, int slice, cpu_set_t *allowed)
+//
+// Purpose: Give every CPU in a sysfs CPU list ("0-3,8-11") that we may run
+// on to a slice.
+//
+// *****************************************************************************
+//
+static void numaCpus(char *list, int slice, cpu_set_t *allowed)
+{
+    char *next;        // Rest of the list
+    long first, last;  // Range of CPUs
+    long cpu;          // Loop index
+
+    while(*list != '\0')
+    {
+        first = last = strtol(list, &next, 10);
+        if(next == list)
+        {
+            return;
+        }
+        if(*next == '-')
+        {
+            list = next + 1;
+            last = strtol(list, &next, 10);
+        }
+
+        for(cpu = first; cpu <= last && cpu < NUMA_MAX_CPUS; cpu++)
+        {
+            if(cpu >= 0 && CPU_ISSET(cpu, allowed))
+            {
+                cpuSlice[cpu] = slice;
+            }
+        }
+
+        list = (*next == ',') ? next + 1 : next;
+    }
+}
+
+
+// *****************************************************************************
+//
+// static void numaNics(void)
+//
+// Purpose: Note the node of the device behind every IPv4 address.
+//
+// *****************************************************************************
+//
+static void numaNics(void)
+{
+    struct ifaddrs *ifs, *ifa;  // Interface addresses
+    char   path[256];           // sysfs file of one interface
+    char   line[32];            // Its contents
+    int    node;                // Node it names
+    int    slice;               // Slice of that node
+
+    if(getifaddrs(&ifs) == -1)
+    {
+        return;
+    }
+
+    for(ifa = ifs; ifa != NULL && nicCount < NUMA_MAX_NICS; ifa = ifa->ifa_next)
+    {
+        if(ifa->ifa_addr == NULL || ifa->ifa_addr->sa_family != AF_INET)
+        {
+            continue;
+        }
+
+        // Virtual interfaces (lo, bridges, tunnels) have no device, and
+        // a device on a machine with one node says -1.
+        //
+        snprintf(path, sizeof(path), "/sys/class/net/%s/device/numa_node", ifa->ifa_name);
+        if(numaRead(path, line, sizeof(line)) == -1 || (node = atoi(line)) < 0)
+        {
+            continue;
+        }
+
+        for(slice = 0; slice < nodeCount && nodeIds[slice] != node; slice++)
+        {
+        }
+        if(slice < nodeCount)
+        {
+            nicAddr[nicCount] = ((struct sockaddr_in *)ifa->ifa_addr)->sin_addr.s_addr;
+            nicSlice[nicCount++] = slice;
+            fprintf(stderr, "  %s is on node %d\n", ifa->ifa_name, node);
+        }
+    }
+
+    freeifaddrs(ifs);
+}
+
+
+// *****************************************************************************
+//
+// int numaInit(int on, int *nodes)
+//
+// Purpose: Read the topology and print it.
+//
+// *****************************************************************************
+//
+int numaInit(int on, int *nodes)
+{
+    cpu_set_t allowed;       // CPUs the server may use
+    DIR    *dir;             // Node directory
+    struct dirent *ent;      // One entry in it
+    char   path[256];        // cpulist of one node
+    char   list[4096];       // Its contents
+    int    node;             // Node ID of an entry
+    int    cpus;             // CPUs of a node we may use
+    int    idx, at;          // Loop indexes
+
+    for(idx = 0; idx < NUMA_MAX_CPUS; idx++)
+    {
+        cpuSlice[idx] = -1;
+    }
+
+    if(!on)
+    {
+        return 0;
+    }
+
+    placing = 1;
+
+    // Children only go to CPUs the server itself was allowed (taskset,
+    // cgroups).
+    //
+    if(sched_getaffinity(0, sizeof(allowed), &allowed) == -1)
+    {
+        CPU_ZERO(&allowed);
+    }
+
+    // Nodes in ID order, which readdir() doesn't promise.
+    //
+    if((dir = opendir("/sys/devices/system/node")) != NULL)
+    {
+        while((ent = readdir(dir)) != NULL && nodeCount < NUMA_MAX_NODES)
+        {
+            if(sscanf(ent->d_name, "node%d", &node) != 1)
+            {
+                continue;
+            }
+            for(at = nodeCount; at > 0 && nodeIds[at - 1] > node; at--)
+            {
+                nodeIds[at] = nodeIds[at - 1];
+            }
+            nodeIds[at] = node;
+            nodeCount++;
+        }
+        closedir(dir);
+    }
+
+    // A kernel without NUMA support has no node directory; then all of
+    // the machine is one node.
+    //
+    if(nodeCount == 0)
+    {
+        nodeIds[nodeCount++] = 0;
+        for(idx = 0; idx < NUMA_MAX_CPUS; idx++)
+        {
+            cpuSlice[idx] = CPU_ISSET(idx, &allowed) ? 0 : -1;
+        }
+    }
+
+    fprintf(stderr, "Placing children on %d NUMA node%s:\n", nodeCount,
+            (nodeCount == 1) ? "" : "s");
+
+    for(idx = 0; idx < nodeCount; idx++)
+    {
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist",
+                 nodeIds[idx]);
+        if(numaRead(path, list, sizeof(list)) == 0)
+        {
+            numaCpus(list, idx, &allowed);
+        }
+
+        for(at = 0, cpus = 0; at < NUMA_MAX_CPUS; at++)
+        {
+            cpus += (cpuSlice[at] == idx);
+        }
+        fprintf(stderr, "  node %d: %d CPU%s", nodeIds[idx], cpus, (cpus == 1) ? "" : "s");
+        for(at = 0; at < NUMA_MAX_CPUS; at++)
+        {
+            if(cpuSlice[at] == idx)
+            {
+                fprintf(stderr, " %d", at);
+            }
+        }
+        fprintf(stderr, "\n");
+
+        nodes[idx] = nodeIds[idx];
+    }
+
+    numaNics();
+
+    return nodeCount;
+}
+
+
+// *****************************************************************************
+//
+// int numaPick(int *cli)
+//
+// Purpose: Choose the CPU to serve a connection on.
+//
+// *****************************************************************************
+//
+int numaPick(int *cli)
+{
+    struct sockaddr_in local;       // Address the connection came in on
+    socklen_t len;                  // Its size
+    int    incoming = -1;           // CPU that took its packets
+    int    slice = -1;              // Node to serve it on (-1 = any)
+    int    best = -1;               // Least loaded CPU there
+    int    idx;                     // Loop index
+
+    if(!placing)
+    {
+        return -1;
+    }
+
+    // The CPU that handled the connection's packets is on the node of the
+    // NIC queue it arrived on. Older kernels don't know the option; then
+    // go by the interface the connection's address belongs to.
+    //
+#ifdef SO_INCOMING_CPU
+    len = sizeof(incoming);
+    if(getsockopt(*cli, SOL_SOCKET, SO_INCOMING_CPU, &incoming, &len) == -1 ||
+       incoming < 0 || incoming >= NUMA_MAX_CPUS)
+    {
+        incoming = -1;
+    }
+#endif
+    if(incoming != -1)
+    {
+        slice = cpuSlice[incoming];
+    }
+
+    len = sizeof(local);
+    if(slice == -1 && getsockname(*cli, (struct sockaddr *)&local, &len) == 0)
+    {
+        for(idx = 0; idx < nicCount; idx++)
+        {
+            if(nicAddr[idx] == local.sin_addr.s_addr)
+            {
+                slice = nicSlice[idx];
+            }
+        }
+    }
+
+    // The CPU that took the packets keeps the connection, since its cache
+    // already holds the connection's state, unless it is more than
+    // NUMA_MARGIN children busier than the least loaded one.
+    //
+    for(idx = 0; idx < NUMA_MAX_CPUS; idx++)
+    {
+        if(cpuSlice[idx] != -1 && (slice == -1 || cpuSlice[idx] == slice) &&
+           (best == -1 || cpuKids[idx] < cpuKids[best]))
+        {
+            best = idx;
+        }
+    }
+    if(incoming != -1 && cpuSlice[incoming] != -1 &&
+       (best == -1 || cpuKids[incoming] <= cpuKids[best] + NUMA_MARGIN))
+    {
+        best = incoming;
+    }
+
+    return best;
+}
+
+
+// *****************************************************************************
+//
+// void numaStart(int cpu, pid_t pid)
+//
+// Purpose: Count a child against its CPU.
+//
+// *****************************************************************************
+//
+void numaStart(int cpu, pid_t pid)
+{
+    int idx;   // Loop index
+
+    if(cpu < 0)
+    {
+        return;
+    }
+
+    // A full table only means the child isn't counted.
+    //
+    for(idx = 0; idx < NUMA_TABLE; idx++)
+    {
+        if(kids[idx].pid == 0)
+        {
+            kids[idx].pid = pid;
+            kids[idx].cpu = cpu;
+            cpuKids[cpu]++;
+            return;
+        }
+    }
+}
+
+
+// *****************************************************************************
+//
+// void numaChild(int cpu)
+//
+// Purpose: Move to the CPU and prefer its node's memory.
+//
+// *****************************************************************************
+//
+void numaChild(int cpu)
+{
+    cpu_set_t set;            // Just the one CPU
+    unsigned long mask[16];   // Just its node, for set_mempolicy()
+    int    node;              // Node ID
+
+    if(cpu < 0)
+    {
+        return;
+    }
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    sched_setaffinity(0, sizeof(set), &set);
+
+    // Preferred rather than bound, so a full node spills over rather than
+    // failing the request.
+    //
+    node = nodeIds[cpuSlice[cpu]];
+    if(node < (int)(sizeof(mask) * 8))
+    {
+        memset(mask, 0, sizeof(mask));
+        mask[node / 64] = 1UL << (node % 64);
+        syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask, sizeof(mask) * 8);
+    }
+
+    bufNode(cpuSlice[cpu]);
+}
+
+
+// *****************************************************************************
+//
+// void numaReap(pid_t pid)
+//
+// Purpose: Stop counting a reaped child.
+//
+// *****************************************************************************
+//
+void numaReap(pid_t pid)
+{
+    int idx;   // Loop index
+
+    if(!placing || pid <= 0)
+    {
+        return;
+    }
+
+    for(idx = 0; idx < NUMA_TABLE; idx++)
+    {
+        if(kids[idx].pid == pid)
+        {
+            cpuKids[kids[idx].cpu]--;
+            kids[idx].pid = 0;
+            return;
+        }
+    }
+}
@@ -0,0 +1,145 @@
+//
+// *****************************************************************************
+//
+// Author:    Erik Ratcliffe
+// Date:      June 5, 2015
+// Project:   Program 4 - OTP
+// Filename:  otp_numa.h
+// Class:     CS 344 (Spring 2015)
+//
+//
+// Overview:
+//    Server/client simulation of the classic "One-time Pad" encryption scheme.
+//
+//    This file contains the definitions and function prototypes for
+//    placing children on CPUs (-A). Left alone, a child can run on any
+//    core and its buffers come from wherever the pool's pages happen to
+//    be, so on a machine with several NUMA nodes a large request can
+//    spend much of its time on memory traffic between sockets.
+//
+//    The topology comes from sysfs (/sys/devices/system/node, and the
+//    numa_node of each network interface's device). With -A the server
+//    prints it at startup, and then for every connection:
+//
+//    - picks the node the connection's packets arrive on: the node of
+//      the CPU that handled them (SO_INCOMING_CPU), or failing that the
+//      node of the interface the connection came in on;
+//    - pins the child to the CPU that handled the packets, whose cache
+//      already holds the connection's state, unless it has more than
+//      NUMA_MARGIN children over the least loaded CPU of the node, which
+//      then gets it instead;
+//    - has the child take its buffers from that node's share of the
+//      buffer pool (see bufNode()) and allocate everything else there
+//      too.
+//
+//    System calls stand in for libnuma. Without -A, or on a machine with
+//    one node, children run where the kernel puts them, as before.
+//
+// *****************************************************************************
+//
+
+#ifndef OTP_NUMA_H
+#define OTP_NUMA_H
+
+
+#include <sys/types.h>
+
+
+#define NUMA_MAX_CPUS    1024     // CPUs we keep track of
+#define NUMA_MAX_NODES   16       // Nodes we keep track of (as BUF_MAX_NODES)
+#define NUMA_MAX_NICS    64       // Interface addresses we keep track of
+#define NUMA_TABLE       1024     // Pinned children at once (as ADMIT_TABLE)
+#define NUMA_MARGIN      2        // Children the incoming CPU may have over
+                                  // the least loaded before it's passed over
+
+
+// *****************************************************************************
+//
+// int numaInit(int on, int *nodes)
+//
+//    Entry:   int on
+//                1 to place children (-A), 0 to leave them alone
+//             int *nodes
+//                Receives the ID of each node, in order (room for
+//                NUMA_MAX_NODES)
+//
+//    Exit:    Number of nodes, 0 if placement is off. Pass both to
+//             bufInit() so the buffer pool has a slice on each node.
+//
+//    Purpose: Read the topology and print it. Call once in the server
+//    before bufInit().
+//
+// *****************************************************************************
+//
+int numaInit(int on, int *nodes);
+
+
+// *****************************************************************************
+//
+// int numaPick(int *cli)
+//
+//    Entry:   int *cli
+//                Connection just accepted
+//
+//    Exit:    CPU to run its child on, -1 if placement is off.
+//
+//    Purpose: Server side: choose where the connection is served.
+//
+// *****************************************************************************
+//
+int numaPick(int *cli);
+
+
+// *****************************************************************************
+//
+// void numaStart(int cpu, pid_t pid)
+//
+//    Entry:   int cpu
+//                CPU from numaPick()
+//             pid_t pid
+//                Child serving the connection
+//
+//    Exit:    None.
+//
+//    Purpose: Server side: count the child against its CPU until it's
+//    reaped.
+//
+// *****************************************************************************
+//
+void numaStart(int cpu, pid_t pid);
+
+
+// *****************************************************************************
+//
+// void numaChild(int cpu)
+//
+//    Entry:   int cpu
+//                CPU from numaPick()
+//
+//    Exit:    None.
+//
+//    Purpose: Child side: move to the CPU and make its node the home of
+//    our memory.
+//
+// *****************************************************************************
+//
+void numaChild(int cpu);
+
+
+// *****************************************************************************
+//
+// void numaReap(pid_t pid)
+//
+//    Entry:   pid_t pid
+//                Child the server has just reaped
+//
+//    Exit:    None.
+//
+//    Purpose: Server side: the child's CPU has one child fewer.
+//
+// *****************************************************************************
+//
+void numaReap(pid_t pid);
+
+
+#endif
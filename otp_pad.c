@@ -0,0 +1,639 @@
+//
+// *****************************************************************************
+//
+// Author:    Erik Ratcliffe
+// Date:      June 5, 2015
+// Project:   Program 4 - OTP
+// Filename:  otp_pad.c
+// Class:     CS 344 (Spring 2015)
+//
+//
+// Overview:
+//    Server/client simulation of the classic "One-time Pad" encryption scheme.
+//
+//    This file contains pad (key) generation, including the parallel
+//    generator that writes pads straight into mapped files.
+//
+// *****************************************************************************
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <endian.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/random.h>
+#include "otp.h"
+#include "otp_pad.h"
+
+
+// Lookup table from an accepted random byte (0-242) to its pad character,
+// so the hot loop never divides: the 27 characters, nine times over. It
+// is constant, so threads can share it without any setup.
+//
+#define PAD_CHARS "ABCDEFGHIJKLMNOPQRSTUVWXYZ "
+
+static const char padTable[PAD_ACCEPT + 1] =
+    PAD_CHARS PAD_CHARS PAD_CHARS PAD_CHARS PAD_CHARS
+    PAD_CHARS PAD_CHARS PAD_CHARS PAD_CHARS;
+
+
+// *****************************************************************************
+//
+// static long padMap(char *out, long len, unsigned char *rnd, long got)
+//
+// Purpose: Turn random bytes into pad characters, rejecting bytes of 243
+// and above. Returns the number of characters written (at most len).
+//
+// *****************************************************************************
+//
+static long padMap(char *out, long len, unsigned char *rnd, long got)
+{
+    const char *table = padTable;     // Byte -> character
+    uint64_t word;                    // Eight random bytes at a time
+    long   pos = 0;                   // Random bytes consumed
+    long   done = 0;                  // Characters generated so far
+    int    idx;                       // Loop index
+
+    while(pos < got && done < len)
+    {
+        // Fast path, eight bytes at a time: check all eight for rejects at
+        // once. A byte is 243 or more exactly when its top bit is set and
+        // its low seven bits plus 13 carry into the top bit; the low bits
+        // are masked first so nothing carries between bytes. When no byte
+        // is rejected (97% of words) all eight map straight through the
+        // table.
+        //
+        if(pos + 8 <= got && len - done >= 8)
+        {
+            memcpy(&word, rnd + pos, 8);
+            if((((word & 0x7f7f7f7f7f7f7f7fULL) + 0x0d0d0d0d0d0d0d0dULL) &
+                word & 0x8080808080808080ULL) == 0)
+            {
+                for(idx = 0; idx < 8; idx++)
+                {
+                    out[done + idx] = table[rnd[pos + idx]];
+                }
+                done += 8;
+                pos += 8;
+                continue;
+            }
+        }
+
+        // Slow path: a single byte, either past a reject or in the tail.
+        //
+        if(rnd[pos] < PAD_ACCEPT)
+        {
+            out[done++] = table[rnd[pos]];
+        }
+        pos++;
+    }
+
+    return done;
+}
+
+
+// *****************************************************************************
+//
+// int padFill(char *out, long len)
+//
+// Purpose: Fill a buffer with uniformly distributed pad characters.
+//
+// *****************************************************************************
+//
+int padFill(char *out, long len)
+{
+    unsigned char rnd[PAD_RANDOM];    // Random bytes from the kernel
+    long   got;                       // Random bytes fetched
+    long   done = 0;                  // Characters generated so far
+
+    while(done < len)
+    {
+        // Large reads keep the syscall count down; getrandom() can return
+        // short for big requests or when interrupted.
+        //
+        got = getrandom(rnd, sizeof(rnd), 0);
+        if(got == -1)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+
+        done += padMap(out + done, len - done, rnd, got);
+    }
+
+    return 0;
+}
+
+
+#define ROTL(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+#define QUARTER(a, b, c, d)                              \
+    a += b; d ^= a; d = ROTL(d, 16);                     \
+    c += d; b ^= c; b = ROTL(b, 12);                     \
+    a += b; d ^= a; d = ROTL(d, 8);                      \
+    c += d; b ^= c; b = ROTL(b, 7)
+
+
+// *****************************************************************************
+//
+// static void padBlock(uint32_t *state, uint32_t *out)
+//
+// Purpose: One ChaCha20 block (RFC 8439): 64 bytes of keystream from the
+// current state, then advance the 64-bit block counter.
+//
+// *****************************************************************************
+//
+static void padBlock(uint32_t *state, uint32_t *out)
+{
+    uint32_t x[16];   // Working state
+    int      idx;     // Loop index
+
+    memcpy(x, state, sizeof(x));
+
+    for(idx = 0; idx < 10; idx++)
+    {
+        QUARTER(x[0], x[4], x[8],  x[12]);
+        QUARTER(x[1], x[5], x[9],  x[13]);
+        QUARTER(x[2], x[6], x[10], x[14]);
+        QUARTER(x[3], x[7], x[11], x[15]);
+        QUARTER(x[0], x[5], x[10], x[15]);
+        QUARTER(x[1], x[6], x[11], x[12]);
+        QUARTER(x[2], x[7], x[8],  x[13]);
+        QUARTER(x[3], x[4], x[9],  x[14]);
+    }
+
+    for(idx = 0; idx < 16; idx++)
+    {
+        out[idx] = x[idx] + state[idx];
+    }
+
+    if(++state[12] == 0)
+    {
+        state[13]++;
+    }
+}
+
+
+// *****************************************************************************
+//
+// int padSelfTest(void)
+//
+// Purpose: Check padBlock() against the RFC 8439 test vector.
+//
+// *****************************************************************************
+//
+int padSelfTest(void)
+{
+    // Section 2.3.2: key 00 01 .. 1f, block counter 1, nonce
+    // 00 00 00 09 00 00 00 4a 00 00 00 00, as state words.
+    //
+    uint32_t state[16] = {
+        0x61707865, 0x3320646e, 0x79622d32, 0x6b206574,
+        0x03020100, 0x07060504, 0x0b0a0908, 0x0f0e0d0c,
+        0x13121110, 0x17161514, 0x1b1a1918, 0x1f1e1d1c,
+        0x00000001, 0x09000000, 0x4a000000, 0x00000000
+    };
+    static const uint32_t expect[16] = {
+        0xe4e7f110, 0x15593bd1, 0x1fdd0f50, 0xc47120a3,
+        0xc7f4d1c7, 0x0368c033, 0x9aaa2204, 0x4e6cd4c3,
+        0x466482d2, 0x09aa9f07, 0x05d7c214, 0xa2028bd9,
+        0xd19c12b5, 0xb94e16de, 0xe883d0cb, 0x4e3c50a2
+    };
+    uint32_t out[16];  // Block the state produces
+
+    padBlock(state, out);
+
+    return (memcmp(out, expect, sizeof(out)) == 0) ? 0 : -1;
+}
+
+
+static pthread_once_t selfTestOnce = PTHREAD_ONCE_INIT; // Runs padSelfTest()
+static int selfTestRc;                                  // What it returned
+
+
+// *****************************************************************************
+//
+// static void padSelfTestOnce(void)
+//
+// Purpose: pthread_once() body for padStreamInit().
+//
+// *****************************************************************************
+//
+static void padSelfTestOnce(void)
+{
+    selfTestRc = padSelfTest();
+}
+
+
+// *****************************************************************************
+//
+// int padStreamInit(struct padStream *ps)
+//
+// Purpose: Key a new ChaCha20 stream from the kernel CSPRNG.
+//
+// *****************************************************************************
+//
+int padStreamInit(struct padStream *ps)
+{
+    // A generator that gets the block function wrong would still turn
+    // out plausible looking pads, so check it once before the first.
+    //
+    pthread_once(&selfTestOnce, padSelfTestOnce);
+    if(selfTestRc != 0)
+    {
+        return -1;
+    }
+
+    // "expand 32-byte k"
+    //
+    ps->state[0] = 0x61707865;
+    ps->state[1] = 0x3320646e;
+    ps->state[2] = 0x79622d32;
+    ps->state[3] = 0x6b206574;
+
+    // Key (words 4-11) and nonce (14-15) come from the kernel; the block
+    // counter (12-13) starts at zero.
+    //
+    if(getrandom(&ps->state[4], 32, 0) != 32 ||
+       getrandom(&ps->state[14], 8, 0) != 8)
+    {
+        return -1;
+    }
+    ps->state[12] = 0;
+    ps->state[13] = 0;
+
+    return 0;
+}
+
+
+// *****************************************************************************
+//
+// void padStreamFill(struct padStream *ps, char *out, long len)
+//
+// Purpose: Fill a buffer with pad characters from a ChaCha20 stream.
+//
+// *****************************************************************************
+//
+void padStreamFill(struct padStream *ps, char *out, long len)
+{
+    long done = 0;  // Characters generated so far
+    int  idx;       // Loop index
+
+    while(done < len)
+    {
+        for(idx = 0; idx < PAD_RANDOM / 64; idx++)
+        {
+            padBlock(ps->state, &ps->block[idx * 16]);
+        }
+
+        done += padMap(out + done, len - done,
+                       (unsigned char *)ps->block, PAD_RANDOM);
+    }
+
+    // Keystream is never reused, so don't leave it lying around.
+    //
+    memset(ps->block, 0, sizeof(ps->block));
+}
+
+
+// One thread's share of a pad file.
+//
+struct padRange
+{
+    char *map;        // Mapped pad file
+    long start;       // First pad character (not counting headers)
+    long len;         // Pad characters to generate
+    long pageSize;    // Characters per page (0 = unpaged)
+    int  bad;         // Set if the stream could not be keyed
+};
+
+
+// *****************************************************************************
+//
+// static long padOffset(long pos, long pageSize)
+//
+// Purpose: File offset of pad character `pos`, skipping page headers.
+//
+// *****************************************************************************
+//
+static long padOffset(long pos, long pageSize)
+{
+    if(pageSize == 0)
+    {
+        return pos;
+    }
+
+    return (pos / pageSize) * (PAD_HEADER + pageSize) + PAD_HEADER + pos % pageSize;
+}
+
+
+// *****************************************************************************
+//
+// static void *padWork(void *arg)
+//
+// Purpose: Thread body. Fill one range of the file from the thread's own
+// stream, a block at a time and never across a page header.
+//
+// *****************************************************************************
+//
+static void *padWork(void *arg)
+{
+    struct padRange *range = arg;  // Range to fill
+    struct padStream *ps;          // This thread's stream
+    long   pos, len;               // Current block
+
+    if((ps = malloc(sizeof(*ps))) == NULL || padStreamInit(ps) == -1)
+    {
+        free(ps);
+        range->bad = 1;
+        return NULL;
+    }
+
+    for(pos = range->start; pos < range->start + range->len; pos += len)
+    {
+        len = range->start + range->len - pos;
+        len = (len > PAD_BLOCK) ? PAD_BLOCK : len;
+        if(range->pageSize > 0 && len > range->pageSize - pos % range->pageSize)
+        {
+            len = range->pageSize - pos % range->pageSize;
+        }
+
+        padStreamFill(ps, range->map + padOffset(pos, range->pageSize), len);
+    }
+
+    memset(ps, 0, sizeof(*ps));
+    free(ps);
+
+    return NULL;
+}
+
+
+// *****************************************************************************
+//
+// int padWriteFile(char *path, long length, long pageSize, int threads)
+//
+// Purpose: Generate a pad straight into a preallocated, mapped file.
+//
+// *****************************************************************************
+//
+int padWriteFile(char *path, long length, long pageSize, int threads)
+{
+    struct padRange range[PAD_MAX_THREADS];   // One range per thread
+    pthread_t thread[PAD_MAX_THREADS];        // Worker threads
+    int    started[PAD_MAX_THREADS];          // Set if the thread started
+    struct padHeader *hdr;   // Header being written
+    long   pages, size;      // Pages in the file and file size
+    long   per, idx;         // Characters per thread, loop index
+    char   *map;             // Mapped pad file
+    int    fd;               // Pad file descriptor
+    int    bad = 0;          // Set if any stream failed
+
+    length = (length < 0) ? 0 : length;
+    pageSize = (pageSize < 0) ? 0 : pageSize;
+
+    // Unpaged files are ordinary key files, trailing newline and all.
+    // Paged files are a run of header + characters pages, the last one
+    // possibly short.
+    //
+    pages = (pageSize > 0) ? (length + pageSize - 1) / pageSize : 0;
+    size = (pageSize > 0) ? pages * PAD_HEADER + length : length + 1;
+
+    if((fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600)) == -1)
+    {
+        perror(path);
+        return -1;
+    }
+
+    // Reserve the blocks up front so a pad that won't fit fails now, not
+    // as a SIGBUS halfway through. Filesystems without fallocate() get a
+    // sparse file instead.
+    //
+    if(size > 0 && (errno = posix_fallocate(fd, 0, size)) != 0)
+    {
+        if(errno != EOPNOTSUPP && errno != EINVAL)
+        {
+            perror(path);
+            close(fd);
+            return -1;
+        }
+        if(ftruncate(fd, size) == -1)
+        {
+            perror(path);
+            close(fd);
+            return -1;
+        }
+    }
+
+    if(size == 0)
+    {
+        close(fd);
+        return 0;
+    }
+
+    map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED)
+    {
+        perror("mmap failed");
+        return -1;
+    }
+
+    for(idx = 0; idx < pages; idx++)
+    {
+        hdr = (struct padHeader *)(map + idx * (PAD_HEADER + pageSize));
+        memset(hdr, 0, PAD_HEADER);
+        memcpy(hdr->magic, PAD_MAGIC, sizeof(hdr->magic));
+        hdr->index = htobe64(idx);
+        hdr->pages = htobe64(pages);
+        hdr->pageSize = htobe64(pageSize);
+        hdr->length = htobe64((idx == pages - 1) ? length - idx * pageSize : pageSize);
+    }
+
+    if(threads <= 0)
+    {
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    threads = (threads > PAD_MAX_THREADS) ? PAD_MAX_THREADS : threads;
+    threads = (threads < 1) ? 1 : threads;
+
+    // Don't bother a thread with less than a block.
+    //
+    if(threads > length / PAD_BLOCK)
+    {
+        threads = (length / PAD_BLOCK > 0) ? (int)(length / PAD_BLOCK) : 1;
+    }
+
+    per = length / threads;
+    for(idx = 0; idx < threads; idx++)
+    {
+        range[idx].map = map;
+        range[idx].start = idx * per;
+        range[idx].len = (idx == threads - 1) ? length - idx * per : per;
+        range[idx].pageSize = pageSize;
+        range[idx].bad = 0;
+
+        started[idx] = (idx > 0 &&
+                        pthread_create(&thread[idx], NULL, padWork, &range[idx]) == 0);
+    }
+
+    // The calling thread takes the first range itself, and any range
+    // whose thread failed to start.
+    //
+    for(idx = 0; idx < threads; idx++)
+    {
+        if(!started[idx])
+        {
+            padWork(&range[idx]);
+        }
+    }
+    for(idx = 0; idx < threads; idx++)
+    {
+        if(started[idx])
+        {
+            pthread_join(thread[idx], NULL);
+        }
+        bad |= range[idx].bad;
+    }
+
+    if(pageSize == 0)
+    {
+        map[length] = '\n';
+    }
+
+    munmap(map, size);
+
+    if(bad)
+    {
+        fprintf(stderr, "ERROR: getrandom failed, %s is incomplete\n", path);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+// *****************************************************************************
+//
+// char *padFindPage(char *map, long size, long index, long *len)
+//
+// Purpose: Locate one page of a paged pad file.
+//
+// *****************************************************************************
+//
+char *padFindPage(char *map, long size, long index, long *len)
+{
+    struct padHeader *hdr;   // Page header
+    long   pageSize, off;    // Characters per page, offset of the page
+
+    if(size < PAD_HEADER || memcmp(map, PAD_MAGIC, 8) != 0)
+    {
+        return NULL;
+    }
+
+    pageSize = be64toh(((struct padHeader *)map)->pageSize);
+    if(index < 0 || pageSize <= 0 ||
+       index >= (long)be64toh(((struct padHeader *)map)->pages))
+    {
+        return NULL;
+    }
+
+    off = index * (PAD_HEADER + pageSize);
+    if(off + PAD_HEADER > size)
+    {
+        return NULL;
+    }
+
+    // Every page carries its own header, so a file that was cut short or
+    // pieced together wrongly shows up here.
+    //
+    hdr = (struct padHeader *)(map + off);
+    *len = be64toh(hdr->length);
+    if(memcmp(hdr->magic, PAD_MAGIC, 8) != 0 || (long)be64toh(hdr->index) != index ||
+       *len < 0 || *len > pageSize || off + PAD_HEADER + *len > size)
+    {
+        return NULL;
+    }
+
+    return map + off + PAD_HEADER;
+}
+
+
+// *****************************************************************************
+//
+// long padPack(char *in, long len, unsigned char *out)
+//
+// Purpose: Pack pad characters five to three bytes.
+//
+// *****************************************************************************
+//
+long padPack(char *in, long len, unsigned char *out)
+{
+    unsigned long group;   // Five characters as one base 27 number
+    long   pos, outLen = 0; // Characters packed, bytes written
+    int    idx;            // Loop index
+
+    for(pos = 0; pos < len; pos += PAD_GROUP)
+    {
+        // Most significant character first; a short last group is padded
+        // with 'A' (0), which the receiver drops because it knows the
+        // length.
+        //
+        group = 0;
+        for(idx = PAD_GROUP - 1; idx >= 0; idx--)
+        {
+            group *= 27;
+            if(pos + idx < len)
+            {
+                group += (in[pos + idx] == ' ') ? 26 : in[pos + idx] - 'A';
+            }
+        }
+
+        out[outLen++] = group >> 16;
+        out[outLen++] = group >> 8;
+        out[outLen++] = group;
+    }
+
+    return outLen;
+}
+
+
+// *****************************************************************************
+//
+// int padUnpack(unsigned char *in, long len, char *out)
+//
+// Purpose: Undo padPack().
+//
+// *****************************************************************************
+//
+int padUnpack(unsigned char *in, long len, char *out)
+{
+    static const char allowedChars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ ";
+    unsigned long group;   // Three bytes as one base 27 number
+    long   pos;            // Characters unpacked
+    int    idx;            // Loop index
+
+    for(pos = 0; pos < len; pos += PAD_GROUP, in += 3)
+    {
+        group = ((unsigned long)in[0] << 16) | (in[1] << 8) | in[2];
+        if(group >= PAD_GROUP_MAX)
+        {
+            return -1;
+        }
+
+        for(idx = 0; idx < PAD_GROUP && pos + idx < len; idx++)
+        {
+            out[pos + idx] = allowedChars[group % 27];
+            group /= 27;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,237 @@
+//
+// *****************************************************************************
+//
+// Author:    Erik Ratcliffe
+// Date:      June 5, 2015
+// Project:   Program 4 - OTP
+// Filename:  otp_pad.h
+// Class:     CS 344 (Spring 2015)
+//
+//
+// Overview:
+//    Server/client simulation of the classic "One-time Pad" encryption scheme.
+//
+//    This file contains the definitions and function prototypes for pad
+//    (key) generation.
+//
+//    Large pads can be written straight into a file, optionally split into
+//    fixed-size pages. Each page is a PAD_HEADER byte header (struct
+//    padHeader, numbers big-endian) followed by the page's characters, so
+//    pages can be cut out of the file and used or shipped on their own
+//    (see keygen -x).
+//
+// *****************************************************************************
+//
+
+#ifndef OTP_PAD_H
+#define OTP_PAD_H
+
+
+#include <stdint.h>
+
+
+#define PAD_BLOCK    (1024 * 1024) // Characters generated/written at a time
+#define PAD_RANDOM   16384         // Random bytes fetched per getrandom() call
+#define PAD_ACCEPT   243           // 27 * 9: random bytes below this are used
+#define PAD_MAX_THREADS 256        // Upper limit on generator threads
+#define PAD_HEADER   64            // Bytes of header at the start of each page
+#define PAD_MAGIC    "OTPPAGE1"    // First eight bytes of every page header
+#define PAD_GROUP    5             // Characters packed into three bytes
+#define PAD_GROUP_MAX 14348907     // 27^5, just under 2^24
+
+
+// Page header of a paged pad file.
+//
+struct padHeader
+{
+    char     magic[8];   // PAD_MAGIC
+    uint64_t index;      // Page number, from 0
+    uint64_t pages;      // Pages in the whole file
+    uint64_t pageSize;   // Characters in a full page
+    uint64_t length;     // Characters in this page (the last may be short)
+    char     reserved[24]; // Zero
+};
+
+
+// A ChaCha20 keystream, keyed once from the kernel, so generator threads
+// don't each need a syscall per block of output.
+//
+struct padStream
+{
+    uint32_t state[16];                // Constants, key, counter and nonce
+    uint32_t block[PAD_RANDOM / 4];    // Keystream being turned into characters
+};
+
+
+// *****************************************************************************
+//
+// int padFill(char *out, long len)
+//
+//    Entry:   char *out
+//                Buffer to fill (not null terminated)
+//             long len
+//                Number of pad characters to generate
+//
+//    Exit:    Returns 0 on success, -1 if the kernel CSPRNG failed.
+//
+//    Purpose: Fill a buffer with uniformly distributed pad characters
+//    (A-Z and space) drawn from getrandom(). Bytes of 243 and above are
+//    rejected, so every remaining byte maps to one of the 27 characters
+//    with exactly the same probability (243 = 27 * 9).
+//
+// *****************************************************************************
+//
+int padFill(char *out, long len);
+
+
+// *****************************************************************************
+//
+// int padSelfTest(void)
+//
+//    Entry:   None.
+//
+//    Exit:    Returns 0 if the block function is right, -1 if not.
+//
+//    Purpose: Run the ChaCha20 block function test vector of RFC 8439
+//    (section 2.3.2) through the generator's block function. The RFC
+//    splits the state into a 32-bit counter and a 96-bit nonce where our
+//    streams use 64 bits each, but the block function is the same and a
+//    single block never carries into the nonce.
+//
+// *****************************************************************************
+//
+int padSelfTest(void);
+
+
+// *****************************************************************************
+//
+// int padStreamInit(struct padStream *ps)
+//
+//    Entry:   struct padStream *ps
+//                Stream to key
+//
+//    Exit:    Returns 0 on success, -1 if the kernel CSPRNG failed or
+//             padSelfTest() did (run once per process, on the first call).
+//
+//    Purpose: Key a new ChaCha20 stream with a fresh key and nonce from
+//    getrandom(). Every stream is independent, so each thread keys its own.
+//
+// *****************************************************************************
+//
+int padStreamInit(struct padStream *ps);
+
+
+// *****************************************************************************
+//
+// void padStreamFill(struct padStream *ps, char *out, long len)
+//
+//    Entry:   struct padStream *ps
+//                Stream keyed by padStreamInit()
+//             char *out
+//                Buffer to fill (not null terminated)
+//             long len
+//                Number of pad characters to generate
+//
+//    Exit:    None.
+//
+//    Purpose: Same as padFill(), but the random bytes come from the
+//    stream instead of a syscall, using the same unbiased mapping.
+//
+// *****************************************************************************
+//
+void padStreamFill(struct padStream *ps, char *out, long len);
+
+
+// *****************************************************************************
+//
+// int padWriteFile(char *path, long length, long pageSize, int threads)
+//
+//    Entry:   char *path
+//                File to create (replaced if it exists)
+//             long length
+//                Number of pad characters
+//             long pageSize
+//                Characters per page, or 0 for a plain key file
+//             int threads
+//                Generator threads (0 = one per online CPU)
+//
+//    Exit:    Returns 0 on success, -1 on failure (after printing why).
+//
+//    Purpose: Generate a pad straight into a file. The file is allocated
+//    to its full size first, mapped, and split into one range per thread;
+//    each thread fills its range from its own padStream. A plain key file
+//    ends with a newline like keygen's stdout output; a paged file has a
+//    header in front of every page and no newline.
+//
+// *****************************************************************************
+//
+int padWriteFile(char *path, long length, long pageSize, int threads);
+
+
+// *****************************************************************************
+//
+// char *padFindPage(char *map, long size, long index, long *len)
+//
+//    Entry:   char *map
+//                Paged pad file, mapped or read into memory
+//             long size
+//                Size of the file
+//             long index
+//                Page to find
+//             long *len
+//                Receives the number of characters in the page
+//
+//    Exit:    Pointer to the page's characters, NULL if the page doesn't
+//             exist or its header doesn't check out.
+//
+//    Purpose: Locate one page of a paged pad file.
+//
+// *****************************************************************************
+//
+char *padFindPage(char *map, long size, long index, long *len);
+
+
+// *****************************************************************************
+//
+// long padPack(char *in, long len, unsigned char *out)
+//
+//    Entry:   char *in
+//                Pad characters (A-Z and space only)
+//             long len
+//                Number of characters
+//             unsigned char *out
+//                Receives the packed bytes, 3 for every 5 characters
+//                (rounded up)
+//
+//    Exit:    Number of bytes written to out.
+//
+//    Purpose: Pack pad characters for the wire. Five characters are one
+//    base 27 number below 27^5, which fits in 24 bits, so the pad travels
+//    in 60% of the bytes.
+//
+// *****************************************************************************
+//
+long padPack(char *in, long len, unsigned char *out);
+
+
+// *****************************************************************************
+//
+// int padUnpack(unsigned char *in, long len, char *out)
+//
+//    Entry:   unsigned char *in
+//                Bytes from padPack()
+//             long len
+//                Number of characters to unpack
+//             char *out
+//                Receives the characters (not null terminated)
+//
+//    Exit:    Returns 0 on success, -1 if a group is out of range.
+//
+//    Purpose: Undo padPack().
+//
+// *****************************************************************************
+//
+int padUnpack(unsigned char *in, long len, char *out);
+
+
+#endif
@@ -0,0 +1,90 @@
+//
+// *****************************************************************************
+//
+// Author:    Erik Ratcliffe
+// Date:      June 5, 2015
+// Project:   Program 4 - OTP
+// Filename:  otp_padgen.c
+// Class:     CS 344 (Spring 2015)
+//
+//
+// Overview:
+//    Server/client simulation of the classic "One-time Pad" encryption scheme.
+//
+//    This file contains the client side of server-side pad generation
+//    (see otp_padgen.h for the protocol). The server side is in
+//    otp_padgen_d.c, so keygen links none of the server's modules.
+//
+// *****************************************************************************
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include "otp.h"
+#include "otp_pad.h"
+#include "otp_padgen.h"
+
+
+// *****************************************************************************
+//
+// long padgenRequest(int *sock, long len, int fd, long *retryMs)
+//
+// Purpose: Client side of pad generation.
+//
+// *****************************************************************************
+//
+long padgenRequest(int *sock, long len, int fd, long *retryMs)
+{
+    char   *chars;                 // Current chunk of characters
+    unsigned char *packed;         // Current chunk, packed
+    long   id = -1;                // Pad ID
+    long   done, num;              // Characters received, chunk size
+
+    if(len < 0 || len > PADGEN_MAX ||
+       sendLong(sock, OP_PADGEN) == -1 || sendLong(sock, len) == -1 ||
+       recvLong(sock, &id) == -1 || id == -1 || id == PADGEN_TOO_LARGE)
+    {
+        return (id == PADGEN_TOO_LARGE) ? PADGEN_TOO_LARGE : -1;
+    }
+    if(id == PADGEN_BUSY)
+    {
+        return (recvLong(sock, retryMs) == -1) ? -1 : PADGEN_BUSY;
+    }
+
+    chars = malloc(PADGEN_CHUNK + 1);
+    packed = malloc(PADGEN_CHUNK / PAD_GROUP * 3);
+    if(chars == NULL || packed == NULL)
+    {
+        free(chars);
+        free(packed);
+        return -1;
+    }
+
+    // The server packs each chunk on its own, so we unpack in the same
+    // chunks.
+    //
+    for(done = 0; done < len; done += num)
+    {
+        num = len - done;
+        num = (num > PADGEN_CHUNK) ? PADGEN_CHUNK : num;
+
+        if(recvBuf(sock, (char *)packed, (num + PAD_GROUP - 1) / PAD_GROUP * 3) == -1 ||
+           padUnpack(packed, num, chars) == -1 ||
+           writeAll(fd, chars, num) == -1)
+        {
+            id = -1;
+            break;
+        }
+    }
+
+    if(id != -1 && writeAll(fd, "\n", 1) == -1)
+    {
+        id = -1;
+    }
+
+    memset(chars, 0, PADGEN_CHUNK + 1);
+    free(chars);
+    free(packed);
+
+    return id;
+}
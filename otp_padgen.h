@@ -0,0 +1,95 @@
+//
+// *****************************************************************************
+//
+// Author:    Erik Ratcliffe
+// Date:      June 5, 2015
+// Project:   Program 4 - OTP
+// Filename:  otp_padgen.h
+// Class:     CS 344 (Spring 2015)
+//
+//
+// Overview:
+//    Server/client simulation of the classic "One-time Pad" encryption scheme.
+//
+//    This file contains the definitions and function prototypes for
+//    server-side pad generation. Instead of running keygen locally, a
+//    client asks either server for a pad; the server generates it from a
+//    padStream, keeps a copy in its pad store (if it has one) and streams
+//    it back packed five characters to three bytes (see padPack()).
+//
+//    Protocol, after the server type (all numbers as in sendNum()):
+//
+//       client: OP_PADGEN, number of characters
+//       server: pad ID (0 if the server has no pad store, -1 on failure,
+//               PADGEN_BUSY followed by a delay in ms if it is full,
+//               PADGEN_TOO_LARGE if its buffers can't hold one chunk)
+//       server: the packed pad, ceil(characters / 5) * 3 bytes
+//
+//    A pad is generated and sent a chunk at a time, so the server only
+//    admits (see otp_admit.h) one chunk's worth, however long the pad.
+//
+//    A stored pad is the file <pad store>/<pad ID in hex>.pad, in the same
+//    format keygen writes.
+//
+// *****************************************************************************
+//
+
+#ifndef OTP_PADGEN_H
+#define OTP_PADGEN_H
+
+
+#include "otp_pad.h"
+
+
+#define PADGEN_CHUNK (PAD_GROUP * 65536) // Characters generated and sent at a time
+#define PADGEN_MAX   2147483647L         // Largest pad one request can ask for
+#define PADGEN_BUSY  -2                  // Pad ID of a full server
+#define PADGEN_TOO_LARGE -3              // Pad ID of a server with too small a pool
+#define PADGEN_BUSY_SECS 30              // Seconds keygen retries a busy server
+
+
+// *****************************************************************************
+//
+// void padgenServe(int *cli, char *store)
+//
+//    Entry:   int *cli
+//                Client connection that has just sent OP_PADGEN
+//             char *store
+//                Pad store directory, or NULL to keep no copy
+//
+//    Exit:    None.
+//
+//    Purpose: Server side of pad generation. A stored pad that doesn't
+//    make it to the client in full is deleted again.
+//
+// *****************************************************************************
+//
+void padgenServe(int *cli, char *store);
+
+
+// *****************************************************************************
+//
+// long padgenRequest(int *sock, long len, int fd, long *retryMs)
+//
+//    Entry:   int *sock
+//                Connection whose server type has already been read
+//             long len
+//                Number of pad characters to ask for
+//             int fd
+//                Where to write the pad (followed by a newline, like
+//                keygen)
+//             long *retryMs
+//                Receives the server's retry delay if it was busy
+//
+//    Exit:    The server's pad ID (0 if it kept no copy), -1 on failure,
+//             PADGEN_BUSY if the server was full or PADGEN_TOO_LARGE if
+//             it can never generate (nothing was written either way).
+//
+//    Purpose: Client side of pad generation.
+//
+// *****************************************************************************
+//
+long padgenRequest(int *sock, long len, int fd, long *retryMs);
+
+
+#endif
@@ -0,0 +1,184 @@
+//
+// *****************************************************************************
+//
+// Author:    Erik Ratcliffe
+// Date:      June 5, 2015
+// Project:   Program 4 - OTP
+// Filename:  otp_padgen_d.c
+// Class:     CS 344 (Spring 2015)
+//
+//
+// Overview:
+//    Server/client simulation of the classic "One-time Pad" encryption scheme.
+//
+//    This file contains the server side of server-side pad generation
+//    (see otp_padgen.h for the protocol). The client side is in
+//    otp_padgen.c.
+//
+// *****************************************************************************
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/random.h>
+#include "otp.h"
+#include "otp_admit.h"
+#include "otp_buf.h"
+#include "otp_deadline.h"
+#include "otp_pad.h"
+#include "otp_padgen.h"
+#include "otp_stats.h"
+#include "otp_trace.h"
+
+
+// *****************************************************************************
+//
+// void padgenServe(int *cli, char *store)
+//
+// Purpose: Server side of pad generation.
+//
+// *****************************************************************************
+//
+void padgenServe(int *cli, char *store)
+{
+    struct padStream *ps = NULL;   // Generator for this pad
+    char   path[PATH_MAX];         // Stored copy of the pad
+    char   *chars = NULL;          // Current chunk of characters
+    unsigned char *packed = NULL;  // Current chunk, packed
+    long   len, done, num;         // Pad size, characters sent, chunk size
+    long   held = 0;               // Characters admitted (one chunk's worth)
+    long   delay = 0;              // Retry delay if we're full
+    long   id = 0;                 // Pad ID (0 = not stored)
+    int    fd = -1;                // Stored copy
+    int    ok = 0;                 // Set once the whole pad is out
+
+    if(recvLong(cli, &len) == -1)
+    {
+        return;
+    }
+
+    // Admitted like any other request, but only for the chunk we hold at
+    // a time.
+    //
+    num = (len > PADGEN_CHUNK) ? PADGEN_CHUNK : len;
+    if(len < 0 || len > PADGEN_MAX)
+    {
+        id = -1;
+    }
+    else if(!bufFits(PADGEN_CHUNK + 1, 2))
+    {
+        statsCount(STAT_ERR_BUSY, 1);
+        id = PADGEN_TOO_LARGE;
+        ok = 1;
+    }
+    else if((delay = admitBytes(num)) == 0)
+    {
+        held = num;
+        ps = malloc(sizeof(*ps));
+        chars = bufGet(PADGEN_CHUNK + 1);
+        packed = (unsigned char *)bufGet(PADGEN_CHUNK / PAD_GROUP * 3);
+        if(ps == NULL || padStreamInit(ps) == -1)
+        {
+            id = -1;
+        }
+        else if(chars == NULL || packed == NULL)
+        {
+            delay = ADMIT_RETRY_MS;
+        }
+    }
+
+    if(delay != 0)
+    {
+        statsCount(STAT_ERR_BUSY, 1);
+        sendLong(cli, PADGEN_BUSY);
+        sendLong(cli, delay);
+        id = PADGEN_BUSY;
+        ok = 1;
+    }
+
+    // Pick an unused ID. Same rules as session IDs: hard to guess and
+    // positive through sendNum().
+    //
+    while(id == 0 && store != NULL)
+    {
+        if(getrandom(&id, sizeof(id), 0) != sizeof(id))
+        {
+            id = -1;
+            break;
+        }
+        id &= 0x7fffffff;
+        snprintf(path, sizeof(path), "%s/%08lx.pad", store, id);
+        if(id != 0 && (fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0600)) == -1)
+        {
+            id = (errno == EEXIST) ? 0 : -1;
+        }
+    }
+
+    if(id != PADGEN_BUSY && sendLong(cli, id) == 0 && id >= 0)
+    {
+        traceRequest("padgen", len);
+        traceMark(TRACE_HEADER);
+        deadlinePhase(PHASE_RESPONSE);
+
+        for(done = 0; done < len; done += num)
+        {
+            num = len - done;
+            num = (num > PADGEN_CHUNK) ? PADGEN_CHUNK : num;
+
+            padStreamFill(ps, chars, num);
+            traceMark(TRACE_CODEC);
+
+            // The stored copy is a plain key file, newline and all.
+            //
+            if(done + num == len)
+            {
+                chars[num] = '\n';
+            }
+            if(fd != -1 && writeAll(fd, chars, num + (done + num == len)) == -1)
+            {
+                perror(path);
+                break;
+            }
+            traceMark(TRACE_OTHER);
+
+            if(sendBuf(cli, (char *)packed, padPack(chars, num, packed)) == -1)
+            {
+                break;
+            }
+            traceMark(TRACE_SEND);
+        }
+        ok = (done >= len);
+    }
+
+    if(!ok)
+    {
+        statsCount((id == -1) ? STAT_ERR_PROTO : STAT_ERR_IO, 1);
+    }
+
+    if(fd != -1)
+    {
+        close(fd);
+        if(!ok)
+        {
+            unlink(path);
+        }
+    }
+
+    if(ps != NULL)
+    {
+        memset(ps, 0, sizeof(*ps));
+    }
+    if(chars != NULL)
+    {
+        memset(chars, 0, PADGEN_CHUNK + 1);
+    }
+    free(ps);
+    bufPut(chars);
+    bufPut((char *)packed);
+    admitDone(held);
+}
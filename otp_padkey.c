@@ -0,0 +1,97 @@
+//
+// *****************************************************************************
+//
+// Author:    Erik Ratcliffe
+// Date:      June 5, 2015
+// Project:   Program 4 - OTP
+// Filename:  otp_padkey.c
+// Class:     CS 344 (Spring 2015)
+//
+//
+// Overview:
+//    Server/client simulation of the classic "One-time Pad" encryption scheme.
+//
+//    This file contains the client side of keys by reference to the pad
+//    store (see otp_padkey.h). The server side is in otp_padkey_d.c.
+//
+// *****************************************************************************
+//
+
+#include <unistd.h>
+#include <time.h>
+#include "otp.h"
+#include "otp_padkey.h"
+
+
+// *****************************************************************************
+//
+// long padkeyRequest(struct otpPool *pool, long id, long offset,
+//                    char *inContent, long inSize, char *outContent)
+//
+// Purpose: Client side of a request with its key in the pad store.
+//
+// *****************************************************************************
+//
+long padkeyRequest(struct otpPool *pool, long id, long offset,
+                   char *inContent, long inSize, char *outContent)
+{
+    long   reply;             // Answer to the header
+    long   delay;             // Delay a busy server asked for
+    int    sock, endpoint;    // Pooled connection
+    time_t giveUp = time(NULL) + POOL_BUSY_SECS; // Stop retrying busy servers
+
+    // Once the server has said yes the key is spent, so only a busy
+    // answer (given before anything is claimed) is worth retrying.
+    //
+    while(1)
+    {
+        if((sock = poolGet(pool, &endpoint)) == -1)
+        {
+            if(pool->lastError != POOL_ERR_BUSY ||
+               time(NULL) + pool->retryMs / 1000 >= giveUp)
+            {
+                return -1;
+            }
+            usleep(pool->retryMs * 1000);
+            continue;
+        }
+
+        if(sendLong(&sock, OP_PADKEY) == -1 || sendLong(&sock, id) == -1 ||
+           sendLong(&sock, offset) == -1 || sendLong(&sock, inSize) == -1 ||
+           recvLong(&sock, &reply) == -1 ||
+           (reply == PADKEY_BUSY && recvLong(&sock, &delay) == -1))
+        {
+            poolRelease(pool, endpoint, sock, 0);
+            return -1;
+        }
+
+        if(reply == PADKEY_TOO_LARGE)
+        {
+            pool->lastError = POOL_ERR_TOO_LARGE;
+        }
+        if(reply != PADKEY_BUSY)
+        {
+            break;
+        }
+
+        poolRelease(pool, endpoint, sock, 1);
+        pool->lastError = POOL_ERR_BUSY;
+        pool->retryMs = delay;
+        if(time(NULL) + delay / 1000 >= giveUp)
+        {
+            return -1;
+        }
+        usleep(delay * 1000);
+    }
+
+    if(reply != 0 || sendBuf(&sock, inContent, inSize) == -1 ||
+       recvBuf(&sock, outContent, inSize) == -1)
+    {
+        poolRelease(pool, endpoint, sock, reply < 0);
+        return -1;
+    }
+
+    poolRelease(pool, endpoint, sock, 1);
+
+    return inSize;
+}
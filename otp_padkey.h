@@ -0,0 +1,171 @@
+//
+// *****************************************************************************
+//
+// Author:    Erik Ratcliffe
+// Date:      June 5, 2015
+// Project:   Program 4 - OTP
+// Filename:  otp_padkey.h
+// Class:     CS 344 (Spring 2015)
+//
+//
+// Overview:
+//    Server/client simulation of the classic "One-time Pad" encryption scheme.
+//
+//    This file contains the definitions and function prototypes for keys
+//    taken from the server's pad store (-P, see otp_padgen.h) by
+//    reference. Instead of uploading the key, the client names a stored
+//    pad and an offset into it, and the server reads the key from its own
+//    disk.
+//
+//    Protocol, after the server type (all numbers as in sendNum()):
+//
+//       client: OP_PADKEY, pad ID, offset, input size
+//       server: 0 to go ahead, -1 if refused (no pad store, no such pad,
+//               range past the end of the pad, or key already used),
+//               PADKEY_BUSY and a retry delay in ms if the server is full,
+//               or PADKEY_TOO_LARGE if its buffers could never hold the
+//               input
+//       client: input
+//       server: result, as long as the input
+//
+//    Key read from the pad is never used again. Before reading, the child
+//    claims the range in a ring in shared memory, and a range that
+//    overlaps one already claimed is refused. A thread in the server
+//    works through the ring behind the children: it overwrites each range
+//    with zeros using non-temporal stores (so the erase doesn't push the
+//    live requests' data out of the cache), syncs it to disk, and then
+//    releases the space with fallocate(FALLOC_FL_PUNCH_HOLE). A claim only
+//    leaves the ring once its range is gone, and an erased range reads
+//    back as zeros, which are refused as a bad key.
+//
+//    The thread runs at idle I/O priority and the lowest CPU priority, and
+//    erases at most -e bytes per second, so it only uses the disk and CPU
+//    that requests leave over. The overwrite only destroys the old
+//    contents on file systems that write in place (ext4, xfs); a copy on
+//    write file system keeps them until the space is reused.
+//
+// *****************************************************************************
+//
+
+#ifndef OTP_PADKEY_H
+#define OTP_PADKEY_H
+
+
+#include "otp_pool.h"
+
+
+#define PADKEY_RING      4096          // Claims waiting to be erased
+#define PADKEY_RATE      (32L << 20)   // Default erase rate (bytes per second)
+#define PADKEY_CHUNK     (1L << 20)    // Bytes erased between rate checks
+#define PADKEY_IDLE_MS   100           // How often the thread looks at an empty ring
+#define PADKEY_STUCK_MS  1000          // Longest anyone waits on a half-written claim
+#define PADKEY_BUSY      -2            // Answer of a full server
+#define PADKEY_TOO_LARGE -3            // Answer to an input the server can't hold
+#define PADKEY_HOLD_MS   500           // Retry delay while on hold
+
+
+// *****************************************************************************
+//
+// int padkeyInit(char *store, long rate)
+//
+//    Entry:   char *store
+//                Pad store directory, or NULL for none (keys by reference
+//                are then refused)
+//             long rate
+//                Most bytes erased per second (0 for PADKEY_RATE)
+//
+//    Exit:    Returns 0 on success, -1 if the ring or thread can't be set
+//             up.
+//
+//    Purpose: Set up the shared claim ring and start the thread that
+//    erases used key. Call once in the server before accepting.
+//
+// *****************************************************************************
+//
+int padkeyInit(char *store, long rate);
+
+
+// *****************************************************************************
+//
+// void padkeyServe(int *cli, long svrType)
+//
+//    Entry:   int *cli
+//                Client connection that has just sent OP_PADKEY
+//             long svrType
+//                OTP_ENCODE or OTP_DECODE
+//
+//    Exit:    None.
+//
+//    Purpose: Server side of a request with its key in the pad store. The
+//    key range is claimed, and so erased, whether or not the request
+//    gets through.
+//
+// *****************************************************************************
+//
+void padkeyServe(int *cli, long svrType);
+
+
+// *****************************************************************************
+//
+// void padkeyHold(int on)
+//
+//    Entry:   int on
+//                1 to hold requests, 0 to serve them again
+//
+//    Exit:    None.
+//
+//    Purpose: Server side: while on hold, requests are answered busy
+//    (PADKEY_HOLD_MS) without claiming any key. A server taking over
+//    from another (see otp_handoff.h) holds until the old one has exited,
+//    since the old one's claims not yet erased are in a ring we can't see.
+//
+// *****************************************************************************
+//
+void padkeyHold(int on);
+
+
+// *****************************************************************************
+//
+// void padkeyDrain(void)
+//
+//    Entry:   None.
+//
+//    Exit:    None.
+//
+//    Purpose: Server side, once the last child has exited: erase every
+//    claim left in the ring, ignoring the rate limit, and return when
+//    done.
+//
+// *****************************************************************************
+//
+void padkeyDrain(void);
+
+
+// *****************************************************************************
+//
+// long padkeyRequest(struct otpPool *pool, long id, long offset,
+//                    char *inContent, long inSize, char *outContent)
+//
+//    Entry:   struct otpPool *pool
+//                Pool to take the connection from (the server holding
+//                the pad)
+//             long id, long offset
+//                Stored pad and the first of its characters to use as key
+//             char *inContent, long inSize
+//                Input
+//             char *outContent
+//                Receives the result (may be inContent)
+//
+//    Exit:    Number of result characters received, -1 on failure.
+//
+//    Purpose: Client side of a request with its key in the pad store. A
+//    busy server is retried after the delay it asks for, for up to
+//    POOL_BUSY_SECS seconds.
+//
+// *****************************************************************************
+//
+long padkeyRequest(struct otpPool *pool, long id, long offset,
+                   char *inContent, long inSize, char *outContent);
+
+
+#endif
@@ -0,0 +1,643 @@
+//
+// *****************************************************************************
+//
+// Author:    Erik Ratcliffe
+// Date:      June 5, 2015
+// Project:   Program 4 - OTP
+// Filename:  otp_padkey_d.c
+// Class:     CS 344 (Spring 2015)
+//
+//
+// Overview:
+//    Server/client simulation of the classic "One-time Pad" encryption scheme.
+//
+//    This file contains the server side of keys by reference to the pad
+//    store and the thread that erases them once used (see otp_padkey.h).
+//    The client side is in otp_padkey.c.
+//
+// *****************************************************************************
+//
+
+#define _GNU_SOURCE  // fallocate()
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include "otp.h"
+#include "otp_admit.h"
+#include "otp_buf.h"
+#include "otp_deadline.h"
+#include "otp_padkey.h"
+#include "otp_sched.h"
+#include "otp_stats.h"
+#include "otp_trace.h"
+
+#if defined(__x86_64__)
+#include <emmintrin.h>
+#endif
+
+
+#define PADKEY_NICE       19         // CPU priority of the erase thread
+#define PADKEY_IO_WHO     1          // IOPRIO_WHO_PROCESS (a thread, here)
+#define PADKEY_IO_IDLE    (3 << 13)  // IOPRIO_CLASS_IDLE
+
+
+// One claimed key range. seq is the ticket it was claimed under, plus
+// one, and is set last, so readers can tell a finished claim from one
+// still being written.
+//
+struct padkeyClaim
+{
+    unsigned long seq;       // Ticket + 1 once written
+    long   id;               // Pad
+    long   offset;           // First character of the range
+    long   len;              // Characters in the range
+};
+
+
+struct padkeyRing
+{
+    unsigned long head;      // Next ticket to hand out
+    unsigned long tail;      // Oldest claim not yet erased
+    int    held;             // Answer busy for now (padkeyHold())
+    struct padkeyClaim claim[PADKEY_RING]; // The claims
+};
+
+
+static struct padkeyRing *ring = NULL;  // Shared ring, NULL if off
+static char  *padStore;                 // Pad store directory
+static long  eraseRate;                 // Server: bytes erased per second
+static long  paceStart;                 // Server: when the current run began (us)
+static long  paceDone;                  // Server: bytes erased since then
+static int   draining = 0;              // Server: erase flat out (padkeyDrain())
+
+
+// *****************************************************************************
+//
+// static long padkeyClock(void)
+//
+// Purpose: Monotonic time in microseconds.
+//
+// *****************************************************************************
+//
+static long padkeyClock(void)
+{
+    struct timespec now;  // Current time
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec * 1000000L + now.tv_nsec / 1000;
+}
+
+
+// *****************************************************************************
+//
+// static void padkeyPath(char *path, long id)
+//
+// Purpose: Name of a stored pad (as padgenServe() creates it).
+//
+// *****************************************************************************
+//
+static void padkeyPath(char *path, long id)
+{
+    snprintf(path, PATH_MAX, "%s/%08lx.pad", padStore, id);
+}
+
+
+// *****************************************************************************
+//
+// static void padkeyZero(char *dst, long len)
+//
+// Purpose: Overwrite with zeros. On x86 the stores bypass the cache, so
+// erasing doesn't evict what the live requests are working on.
+//
+// *****************************************************************************
+//
+static void padkeyZero(char *dst, long len)
+{
+#if defined(__x86_64__)
+    __m128i zero = _mm_setzero_si128();  // Sixteen zero bytes
+
+    for(; len > 0 && ((uintptr_t)dst & 15) != 0; len--)
+    {
+        *dst++ = 0;
+    }
+    for(; len >= 16; len -= 16, dst += 16)
+    {
+        _mm_stream_si128((__m128i *)dst, zero);
+    }
+    _mm_sfence();
+#endif
+
+    memset(dst, 0, len);
+}
+
+
+// *****************************************************************************
+//
+// static void padkeyPace(long bytes)
+//
+// Purpose: Sleep as long as it takes to keep erasing at or under the
+// rate. Time spent idle isn't saved up for a burst later.
+//
+// *****************************************************************************
+//
+static void padkeyPace(long bytes)
+{
+    long now = padkeyClock();  // Current time (us)
+    long due;                  // When we're allowed to go on
+
+    if(__atomic_load_n(&draining, __ATOMIC_RELAXED))
+    {
+        return;
+    }
+
+    if(now - paceStart > 1000000 + (long)((double)paceDone * 1e6 / eraseRate))
+    {
+        paceStart = now;
+        paceDone = 0;
+    }
+
+    paceDone += bytes;
+    due = paceStart + (long)((double)paceDone * 1e6 / eraseRate);
+    if(due > now)
+    {
+        usleep(due - now);
+    }
+}
+
+
+// *****************************************************************************
+//
+// static void padkeyErase(struct padkeyClaim *claim)
+//
+// Purpose: Overwrite one claimed range, get that to the disk, then give
+// the space back. A pad that has been deleted is left alone.
+//
+// *****************************************************************************
+//
+static void padkeyErase(struct padkeyClaim *claim)
+{
+    char   path[PATH_MAX];     // The pad
+    struct stat info;          // Its size
+    char   *map;               // The range, mapped from its page on
+    long   start;              // Page the range starts in
+    long   size;               // Bytes mapped
+    long   at, num;            // Current chunk
+    int    fd;                 // Open pad
+
+    padkeyPath(path, claim->id);
+    if(claim->len <= 0 || (fd = open(path, O_RDWR)) == -1)
+    {
+        return;
+    }
+
+    // Writing through the map past the end of a file that has shrunk
+    // would kill the server.
+    //
+    if(fstat(fd, &info) == -1 || claim->offset + claim->len > info.st_size)
+    {
+        close(fd);
+        return;
+    }
+
+    start = claim->offset - claim->offset % sysconf(_SC_PAGESIZE);
+    size = claim->offset + claim->len - start;
+    map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, start);
+    if(map == MAP_FAILED)
+    {
+        perror(path);
+        close(fd);
+        return;
+    }
+
+    for(at = claim->offset; at < claim->offset + claim->len; at += num)
+    {
+        num = claim->offset + claim->len - at;
+        num = (num > PADKEY_CHUNK) ? PADKEY_CHUNK : num;
+
+        padkeyZero(map + (at - start), num);
+        padkeyPace(num);
+    }
+
+    // Punching the hole first would just drop the zeros from the page
+    // cache and leave the key in the freed blocks.
+    //
+    if(msync(map, size, MS_SYNC) == -1 ||
+       fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                 claim->offset, claim->len) == -1)
+    {
+        perror(path);
+    }
+    statsCount(STAT_PAD_ERASED, claim->len);
+
+    munmap(map, size);
+    close(fd);
+}
+
+
+// *****************************************************************************
+//
+// static void *padkeyMain(void *arg)
+//
+// Purpose: The erase thread: work through the ring, oldest claim first.
+//
+// *****************************************************************************
+//
+static void *padkeyMain(void *arg)
+{
+    struct padkeyClaim *claim;         // Claim being erased
+    struct timespec idle;              // Pause when there's nothing to do
+    unsigned long tail = 0;            // Oldest claim not yet erased
+    unsigned long stuckAt = 0;         // Ticket we found half written
+    long   stuckSince = 0;             // When we first found it (us)
+    pid_t  tid = syscall(SYS_gettid);  // This thread
+
+    // Both priorities are per thread on Linux, so the server's own work
+    // (and the children it forks) keeps the normal ones.
+    //
+    setpriority(PRIO_PROCESS, tid, PADKEY_NICE);
+#if defined(SYS_ioprio_set)
+    syscall(SYS_ioprio_set, PADKEY_IO_WHO, tid, PADKEY_IO_IDLE);
+#endif
+
+    idle.tv_sec = 0;
+    idle.tv_nsec = PADKEY_IDLE_MS * 1000000L;
+
+    while(1)
+    {
+        if(tail == __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE))
+        {
+            nanosleep(&idle, NULL);
+            continue;
+        }
+
+        // A child killed between taking a ticket and writing its claim
+        // never read any key, so after a while the ticket is given up on.
+        //
+        claim = &ring->claim[tail % PADKEY_RING];
+        if(__atomic_load_n(&claim->seq, __ATOMIC_ACQUIRE) != tail + 1)
+        {
+            if(stuckAt != tail + 1)
+            {
+                stuckAt = tail + 1;
+                stuckSince = padkeyClock();
+            }
+            if(padkeyClock() - stuckSince < PADKEY_STUCK_MS * 1000L)
+            {
+                nanosleep(&idle, NULL);
+                continue;
+            }
+        }
+        else
+        {
+            padkeyErase(claim);
+        }
+
+        tail++;
+        __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+    }
+
+    return arg;
+}
+
+
+// *****************************************************************************
+//
+// int padkeyInit(char *store, long rate)
+//
+// Purpose: Set up the claim ring and start the erase thread.
+//
+// *****************************************************************************
+//
+int padkeyInit(char *store, long rate)
+{
+    pthread_t thread;  // The erase thread
+
+    if(store == NULL)
+    {
+        return 0;
+    }
+
+    padStore = store;
+    eraseRate = (rate > 0) ? rate : PADKEY_RATE;
+
+    ring = mmap(NULL, sizeof(*ring), PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(ring == MAP_FAILED)
+    {
+        ring = NULL;
+        return -1;
+    }
+
+    if(pthread_create(&thread, NULL, padkeyMain, NULL) != 0)
+    {
+        munmap(ring, sizeof(*ring));
+        ring = NULL;
+        return -1;
+    }
+    pthread_detach(thread);
+
+    return 0;
+}
+
+
+// *****************************************************************************
+//
+// void padkeyHold(int on)
+//
+// Purpose: Hold requests, or serve them again.
+//
+// *****************************************************************************
+//
+void padkeyHold(int on)
+{
+    if(ring != NULL)
+    {
+        __atomic_store_n(&ring->held, on, __ATOMIC_RELEASE);
+    }
+}
+
+
+// *****************************************************************************
+//
+// void padkeyDrain(void)
+//
+// Purpose: Erase what's left in the ring, flat out.
+//
+// *****************************************************************************
+//
+void padkeyDrain(void)
+{
+    struct timespec idle;  // Pause between looks at the ring
+
+    if(ring == NULL)
+    {
+        return;
+    }
+
+    idle.tv_sec = 0;
+    idle.tv_nsec = PADKEY_IDLE_MS * 1000000L;
+
+    __atomic_store_n(&draining, 1, __ATOMIC_RELAXED);
+    while(__atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) !=
+          __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE))
+    {
+        nanosleep(&idle, NULL);
+    }
+}
+
+
+// *****************************************************************************
+//
+// static int padkeyTake(long id, long offset, long len)
+//
+// Purpose: Claim a key range. Returns 0 if it's ours, -1 if the ring is
+// full (nothing claimed), -2 if it overlaps an earlier claim not yet
+// erased. A range that has been erased already isn't caught here; it
+// reads back as zeros.
+//
+// *****************************************************************************
+//
+static int padkeyTake(long id, long offset, long len)
+{
+    struct padkeyClaim *slot;   // Our claim
+    struct padkeyClaim *other;  // Earlier claim
+    unsigned long ticket;       // Our place in the ring
+    unsigned long idx;          // Earlier ticket
+    long   waited;              // ms spent waiting on a half-written claim
+
+    ticket = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    do
+    {
+        if(ticket - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= PADKEY_RING)
+        {
+            return -1;
+        }
+    } while(!__atomic_compare_exchange_n(&ring->head, &ticket, ticket + 1, 0,
+                                         __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+    slot = &ring->claim[ticket % PADKEY_RING];
+    slot->id = id;
+    slot->offset = offset;
+    slot->len = len;
+    __atomic_store_n(&slot->seq, ticket + 1, __ATOMIC_RELEASE);
+
+    // Two children claiming the same range at once both get tickets, and
+    // the later one finds the earlier one here. An earlier ticket whose
+    // claim never turns up is taken as a clash, to be safe.
+    //
+    for(idx = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE); idx < ticket; idx++)
+    {
+        other = &ring->claim[idx % PADKEY_RING];
+        for(waited = 0; waited < PADKEY_STUCK_MS &&
+                        __atomic_load_n(&other->seq, __ATOMIC_ACQUIRE) != idx + 1 &&
+                        __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) <= idx; waited++)
+        {
+            usleep(1000);
+        }
+
+        if(__atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) > idx)
+        {
+            continue; // Erased since
+        }
+        if(__atomic_load_n(&other->seq, __ATOMIC_ACQUIRE) != idx + 1 ||
+           (other->id == id && offset < other->offset + other->len &&
+            other->offset < offset + len))
+        {
+            return -2;
+        }
+    }
+
+    return 0;
+}
+
+
+// *****************************************************************************
+//
+// static int padkeyRead(int fd, char *buf, long offset, long len)
+//
+// Purpose: Read a key range from a pad, looping over short reads.
+//
+// *****************************************************************************
+//
+static int padkeyRead(int fd, char *buf, long offset, long len)
+{
+    long done = 0;  // Characters read so far
+    long num;       // Characters from one pread()
+
+    while(done < len)
+    {
+        if((num = pread(fd, buf + done, len - done, offset + done)) <= 0)
+        {
+            return -1;
+        }
+        done += num;
+    }
+
+    return 0;
+}
+
+
+// *****************************************************************************
+//
+// void padkeyServe(int *cli, long svrType)
+//
+// Purpose: Server side of a request with its key in the pad store.
+//
+// *****************************************************************************
+//
+void padkeyServe(int *cli, long svrType)
+{
+    char   path[PATH_MAX];         // The pad
+    struct stat info;              // Its size
+    long   id, offset, total;      // Pad, first key character, input size
+    long   reply = -1;             // Answer to the header
+    long   delay = 0;              // Retry delay if we're full
+    long   off, num;               // Current scheduler slice
+    int    err = STAT_ERR_PROTO;   // What went wrong, if anything
+    int    admitted = 0;           // Set once our characters are admitted
+    int    fd = -1;                // Open pad
+    int    rc = 0;                 // Result of the last step
+    char   *inContent = NULL;      // Input, then result
+    char   *keyContent = NULL;     // Key read from the pad
+
+    if(recvLong(cli, &id) == -1 || recvLong(cli, &offset) == -1 ||
+       recvLong(cli, &total) == -1)
+    {
+        return;
+    }
+    traceRequest("padkey", total);
+
+    // The pad has a newline after its last character, like any key file.
+    //
+    if(ring != NULL && __atomic_load_n(&ring->held, __ATOMIC_ACQUIRE))
+    {
+        err = STAT_ERR_BUSY;
+        reply = PADKEY_BUSY;
+        delay = PADKEY_HOLD_MS;
+    }
+    else if(ring != NULL && id > 0 && offset >= 0 && total >= 0)
+    {
+        padkeyPath(path, id);
+        err = STAT_ERR_KEY;
+        if((fd = open(path, O_RDONLY)) != -1 && fstat(fd, &info) == 0 &&
+           offset + total <= info.st_size - 1)
+        {
+            err = STAT_ERR_BUSY;
+            if(!bufFits(total + 1, 2))
+            {
+                reply = PADKEY_TOO_LARGE;
+            }
+            else if((delay = admitBytes(total)) == 0)
+            {
+                admitted = 1;
+                if((inContent = bufGet(total + 1)) == NULL ||
+                   (keyContent = bufGet(total + 1)) == NULL ||
+                   (rc = padkeyTake(id, offset, total)) == -1)
+                {
+                    delay = ADMIT_RETRY_MS;
+                }
+                else if(rc == -2)
+                {
+                    err = STAT_ERR_REUSE;
+                }
+                else
+                {
+                    reply = 0;
+                }
+            }
+            reply = (delay != 0) ? PADKEY_BUSY : reply;
+        }
+    }
+
+    if(sendLong(cli, reply) == -1 ||
+       (reply == PADKEY_BUSY && sendLong(cli, delay) == -1) || reply != 0)
+    {
+        err = (reply == 0) ? STAT_ERR_IO : err;
+    }
+    else
+    {
+        traceMark(TRACE_HEADER);
+        deadlinePhase(PHASE_PAYLOAD);
+        schedOpen(cli, total);
+
+        // All the input comes in before any result goes out; the client
+        // doesn't read until it has sent everything.
+        //
+        for(off = 0, rc = 0; off < total && rc == 0; off += num)
+        {
+            num = (total - off > SCHED_CHUNK) ? SCHED_CHUNK : total - off;
+
+            rc = recvBuf(cli, inContent + off, num);
+            traceMark(TRACE_INPUT);
+        }
+
+        // Erased key reads back as zeros, so checking the characters
+        // also catches key that was used before.
+        //
+        if(rc == 0 && (padkeyRead(fd, keyContent, offset, total) == -1 ||
+                       !verifyBuf(keyContent, total)))
+        {
+            err = STAT_ERR_KEY;
+            rc = -2;
+        }
+        traceMark(TRACE_KEY);
+
+        deadlinePhase(PHASE_RESPONSE);
+        for(off = 0; off < total && rc == 0; off += num)
+        {
+            num = (total - off > SCHED_CHUNK) ? SCHED_CHUNK : total - off;
+
+            schedBegin(num);
+            traceMark(TRACE_QUEUE);
+            if(svrType == OTP_ENCODE)
+            {
+                encodeBuf(inContent + off, keyContent + off, num);
+            }
+            else
+            {
+                decodeBuf(inContent + off, keyContent + off, num);
+            }
+            traceMark(TRACE_CODEC);
+            schedEnd();
+
+            rc = sendBuf(cli, inContent + off, num);
+            traceMark(TRACE_SEND);
+        }
+
+        err = (rc == 0) ? -1 : (rc == -2) ? err : STAT_ERR_IO;
+        schedClose();
+    }
+
+    if(err != -1)
+    {
+        statsCount(err, 1);
+    }
+    if(admitted)
+    {
+        admitDone(total);
+    }
+    if(fd != -1)
+    {
+        close(fd);
+    }
+
+    if(keyContent != NULL)
+    {
+        memset(keyContent, 0, total);
+    }
+    bufPut(inContent);
+    bufPut(keyContent);
+}
@@ -0,0 +1,457 @@
+//
+// *****************************************************************************
+//
+// Author:    Erik Ratcliffe
+// Date:      June 5, 2015
+// Project:   Program 4 - OTP
+// Filename:  otp_perf.c
+// Class:     CS 344 (Spring 2015)
+//
+//
+// Overview:
+//    Server/client simulation of the classic "One-time Pad" encryption scheme.
+//
+//    This file contains the hardware counter mode (see otp_perf.h).
+//
+// *****************************************************************************
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <linux/perf_event.h>
+#include "otp_perf.h"
+
+
+static struct perfUsage *table = NULL;      // Shared totals
+
+static __thread int group = -1;             // Thread: group leader (-1 = not
+                                            // open yet, -2 = can't open)
+static __thread int fds[PERF_EVENTS];       // Thread: each event's counter
+static __thread int where[PERF_EVENTS];     // Thread: its place in a group read
+static __thread int inSection = 0;          // Thread: set between begin and end
+static __thread unsigned long start[PERF_EVENTS + 2]; // Thread: counts going in,
+                                            // then time enabled and running
+
+static unsigned long config[PERF_EVENTS] =
+{
+    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+};
+static char *sectionName[PERF_SECTIONS] = { "codec", "recv", "send" };
+static char *eventName[PERF_EVENTS] =
+{
+    "cycles", "instructions", "cache-misses", "branch-misses"
+};
+
+
+// *****************************************************************************
+//
+// static int perfOpen(int event, int leader, int kernel)
+//
+// Purpose: Open one counter for the calling thread, in leader's group
+// (-1 to lead one). Returns the descriptor, -1 on failure.
+//
+// *****************************************************************************
+//
+static int perfOpen(int event, int leader, int kernel)
+{
+    struct perf_event_attr attr;  // What to count
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config[event];
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                       PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.exclude_kernel = !kernel;
+    attr.exclude_hv = 1;
+
+    return syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+}
+
+
+// *****************************************************************************
+//
+// static int perfGroup(int have[PERF_EVENTS], int kernel)
+//
+// Purpose: Open the events in have[] as one group for the calling
+// thread, clearing have[] for any that won't open. Returns the leader,
+// -1 if none opened.
+//
+// *****************************************************************************
+//
+static int perfGroup(int have[PERF_EVENTS], int kernel)
+{
+    int leader = -1;  // Group leader
+    int count = 0;    // Events in the group so far
+    int event;        // Loop index
+
+    for(event = 0; event < PERF_EVENTS; event++)
+    {
+        fds[event] = -1;
+        if(!have[event])
+        {
+            continue;
+        }
+
+        if((fds[event] = perfOpen(event, leader, kernel)) == -1)
+        {
+            have[event] = 0;
+            continue;
+        }
+
+        leader = (leader == -1) ? fds[event] : leader;
+        where[event] = count++;
+    }
+
+    return leader;
+}
+
+
+// *****************************************************************************
+//
+// static void perfClose(void)
+//
+// Purpose: Close the calling thread's counters.
+//
+// *****************************************************************************
+//
+static void perfClose(void)
+{
+    int event;  // Loop index
+
+    for(event = 0; event < PERF_EVENTS; event++)
+    {
+        if(fds[event] != -1)
+        {
+            close(fds[event]);
+            fds[event] = -1;
+        }
+    }
+    group = -1;
+    inSection = 0;
+}
+
+
+// *****************************************************************************
+//
+// static int perfRead(unsigned long now[PERF_EVENTS + 2])
+//
+// Purpose: Read the calling thread's group: each event's count, then the
+// time it was enabled and the time it was running. Returns 0 on success,
+// -1 on failure.
+//
+// *****************************************************************************
+//
+static int perfRead(unsigned long now[PERF_EVENTS + 2])
+{
+    unsigned long buf[3 + PERF_EVENTS];  // Count, times, then values
+    int    event;                        // Loop index
+
+    if(read(group, buf, sizeof(buf)) < (ssize_t)(3 * sizeof(long)))
+    {
+        return -1;
+    }
+
+    for(event = 0; event < PERF_EVENTS; event++)
+    {
+        now[event] = table->have[event] ? buf[3 + where[event]] : 0;
+    }
+    now[PERF_EVENTS] = buf[1];
+    now[PERF_EVENTS + 1] = buf[2];
+
+    return 0;
+}
+
+
+// *****************************************************************************
+//
+// int perfInit(int on)
+//
+// Purpose: Set up the shared table and check which events can be counted.
+//
+// *****************************************************************************
+//
+int perfInit(int on)
+{
+    int kernel;  // Counting the kernel's side too?
+    int event;   // Loop index
+
+    if(!on)
+    {
+        return 0;
+    }
+
+    table = mmap(NULL, sizeof(*table), PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(table == MAP_FAILED)
+    {
+        table = NULL;
+        return -1;
+    }
+
+    // Try with the kernel's side first; most systems only allow our own
+    // (perf_event_paranoid 2).
+    //
+    for(kernel = 1; kernel >= 0; kernel--)
+    {
+        for(event = 0; event < PERF_EVENTS; event++)
+        {
+            table->have[event] = 1;
+        }
+        if((group = perfGroup(table->have, kernel)) != -1)
+        {
+            break;
+        }
+    }
+
+    // ENOENT is how the kernel says it has no such event, which
+    // perror() would report as a missing file.
+    //
+    if(group == -1)
+    {
+        errno = (errno == ENOENT || errno == ENODEV) ? EOPNOTSUPP : errno;
+        munmap(table, sizeof(*table));
+        table = NULL;
+        return -1;
+    }
+    table->kernel = kernel;
+
+    // The caller's counters are kept, since it may well be the one
+    // doing the work (the load generator's main thread, say).
+    //
+    fprintf(stderr, "Counting");
+    for(event = 0; event < PERF_EVENTS; event++)
+    {
+        fprintf(stderr, " %s%s", eventName[event], table->have[event] ? "" : " (not offered)");
+    }
+    fprintf(stderr, ", %s\n", kernel ? "user and kernel" : "user space only");
+
+    return 0;
+}
+
+
+// *****************************************************************************
+//
+// void perfBegin(void)
+//
+// Purpose: Read the counters going into a section.
+//
+// *****************************************************************************
+//
+void perfBegin(void)
+{
+    int have[PERF_EVENTS];  // Events this thread opens
+
+    if(table == NULL)
+    {
+        return;
+    }
+
+    // The first time a thread gets here it opens the same events the
+    // server checked for. A thread that can't gets left out rather than
+    // counted with a different set.
+    //
+    if(group == -1)
+    {
+        memcpy(have, table->have, sizeof(have));
+        group = perfGroup(have, table->kernel);
+        if(group == -1 || memcmp(have, table->have, sizeof(have)) != 0)
+        {
+            perfClose();
+            group = -2;
+        }
+    }
+
+    if(group >= 0 && perfRead(start) == 0)
+    {
+        inSection = 1;
+    }
+}
+
+
+// *****************************************************************************
+//
+// void perfEnd(int section, long bytes)
+//
+// Purpose: Read the counters again and add what the section used.
+//
+// *****************************************************************************
+//
+void perfEnd(int section, long bytes)
+{
+    unsigned long now[PERF_EVENTS + 2];  // Counts coming out
+    unsigned long enabled, running;      // Time the group was enabled and running
+    double scale;                        // Makes up for time not running
+    int    event;                        // Loop index
+
+    if(table == NULL || !inSection)
+    {
+        return;
+    }
+    inSection = 0;
+
+    if(perfRead(now) == -1)
+    {
+        return;
+    }
+
+    // With more groups than the PMU has counters, the kernel takes
+    // turns, and the counts only cover the time ours was running. Scale
+    // them up to the whole section. A section it never ran in says
+    // nothing, so leave it out (bytes and all, so the ratios hold).
+    //
+    enabled = now[PERF_EVENTS] - start[PERF_EVENTS];
+    running = now[PERF_EVENTS + 1] - start[PERF_EVENTS + 1];
+    if(running == 0)
+    {
+        return;
+    }
+    scale = (running < enabled) ? (double)enabled / running : 1.0;
+
+    for(event = 0; event < PERF_EVENTS; event++)
+    {
+        __atomic_add_fetch(&table->count[section][event],
+                           (long)((now[event] - start[event]) * scale), __ATOMIC_RELAXED);
+    }
+    __atomic_add_fetch(&table->bytes[section], bytes, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&table->calls[section], 1, __ATOMIC_RELAXED);
+}
+
+
+// *****************************************************************************
+//
+// void perfChild(void)
+//
+// Purpose: Drop the server's counters in a child.
+//
+// *****************************************************************************
+//
+void perfChild(void)
+{
+    if(group >= 0)
+    {
+        perfClose();
+    }
+}
+
+
+// *****************************************************************************
+//
+// int perfStats(struct perfUsage *usage)
+//
+// Purpose: Copy out the totals.
+//
+// *****************************************************************************
+//
+int perfStats(struct perfUsage *usage)
+{
+    long *src, *dst;  // Totals, and the copy
+    int  idx;         // Loop index
+
+    if(table == NULL)
+    {
+        return 0;
+    }
+
+    memcpy(usage, table, sizeof(*usage));
+    src = (long *)&table->bytes[0];
+    dst = (long *)&usage->bytes[0];
+    for(idx = 0; idx < PERF_SECTIONS * (2 + PERF_EVENTS); idx++)
+    {
+        dst[idx] = __atomic_load_n(&src[idx], __ATOMIC_RELAXED);
+    }
+
+    return 1;
+}
+
+
+// *****************************************************************************
+//
+// char *perfName(int section)
+//
+// Purpose: Label a section.
+//
+// *****************************************************************************
+//
+char *perfName(int section)
+{
+    return sectionName[section];
+}
+
+
+// *****************************************************************************
+//
+// char *perfEventName(int event)
+//
+// Purpose: Label an event.
+//
+// *****************************************************************************
+//
+char *perfEventName(int event)
+{
+    return eventName[event];
+}
+
+
+// *****************************************************************************
+//
+// void perfReport(FILE *out)
+//
+// Purpose: Print the per-byte figures for each section that ran.
+//
+// *****************************************************************************
+//
+void perfReport(FILE *out)
+{
+    struct perfUsage use;  // Totals
+    double bytes;          // Bytes a section handled
+    long   *count;         // Its events
+    int    section;        // Loop index
+
+    if(!perfStats(&use))
+    {
+        return;
+    }
+
+    fprintf(out, "perf        %s\n", use.kernel ? "user and kernel" : "user space only");
+    for(section = 0; section < PERF_SECTIONS; section++)
+    {
+        if(use.bytes[section] == 0)
+        {
+            continue;
+        }
+        bytes = use.bytes[section];
+        count = use.count[section];
+
+        fprintf(out, "perf %-6s %ld bytes in %ld calls:", sectionName[section],
+                use.bytes[section], use.calls[section]);
+        if(use.have[PERF_CYCLES])
+        {
+            fprintf(out, " %.2f cycles/B", count[PERF_CYCLES] / bytes);
+        }
+        if(use.have[PERF_INSTR])
+        {
+            fprintf(out, " %.2f instructions/B", count[PERF_INSTR] / bytes);
+        }
+        if(use.have[PERF_CYCLES] && use.have[PERF_INSTR] && count[PERF_CYCLES] > 0)
+        {
+            fprintf(out, " IPC %.2f", (double)count[PERF_INSTR] / count[PERF_CYCLES]);
+        }
+        if(use.have[PERF_CACHE])
+        {
+            fprintf(out, " %.3f cache-misses/KB", count[PERF_CACHE] * 1024 / bytes);
+        }
+        if(use.have[PERF_BRANCH])
+        {
+            fprintf(out, " %.3f branch-misses/KB", count[PERF_BRANCH] * 1024 / bytes);
+        }
+        fprintf(out, "\n");
+    }
+}
@@ -0,0 +1,215 @@
+//
+// *****************************************************************************
+//
+// Author:    Erik Ratcliffe
+// Date:      June 5, 2015
+// Project:   Program 4 - OTP
+// Filename:  otp_perf.h
+// Class:     CS 344 (Spring 2015)
+//
+//
+// Overview:
+//    Server/client simulation of the classic "One-time Pad" encryption scheme.
+//
+//    This file contains the definitions and function prototypes for the
+//    hardware counter mode of the servers and the load generator (-H).
+//    Throughput and latency say whether a change made things faster, but
+//    not why; this says where the cycles in the hot paths go:
+//
+//    - codec: encodeBuf() and decodeBuf() (and so encodeChars() and
+//      decodeChars(), which call them),
+//    - recv:  recvBuf() and recvStream(),
+//    - send:  sendBuf() and sendStr().
+//
+//    Each thread (every child, in the servers) opens a group of four
+//    counters with perf_event_open(): cycles, instructions, cache misses
+//    and branch misses, scheduled together so their ratios hold. The
+//    group is read going into and coming out of each section, and the
+//    difference, with the bytes the section handled, is added to a table
+//    shared with the server. The report divides through by the bytes:
+//    cycles and instructions per byte, instructions per cycle, and misses
+//    per KB. A codec that is branch-miss bound shows it in the branch
+//    misses, one waiting on memory in the cache misses and a low IPC.
+//
+//    Counting is for our own code only (exclude_kernel) unless the
+//    kernel lets us count its side too (perf_event_paranoid 1 or less, or
+//    CAP_PERFMON), in which case recv and send include the system calls
+//    themselves; the report says which. Each read is a system call of its
+//    own, so the mode costs a few microseconds per section: leave it off
+//    when measuring throughput. Events the CPU (or a VM) doesn't offer are
+//    left out; if it offers none, setup fails.
+//
+//    The servers serve the totals on the stats socket (see otp_stats.h)
+//    and print the report when they exit; the load generator prints it
+//    after its own results.
+//
+// *****************************************************************************
+//
+
+#ifndef OTP_PERF_H
+#define OTP_PERF_H
+
+
+#include <stdio.h>
+
+
+#define PERF_CODEC       0       // encodeBuf(), decodeBuf()
+#define PERF_RECV        1       // recvBuf(), recvStream()
+#define PERF_SEND        2       // sendBuf(), sendStr()
+#define PERF_SECTIONS    3       // Number of sections
+
+#define PERF_CYCLES      0       // CPU cycles
+#define PERF_INSTR       1       // Instructions retired
+#define PERF_CACHE       2       // Last level cache misses
+#define PERF_BRANCH      3       // Mispredicted branches
+#define PERF_EVENTS      4       // Number of events
+
+
+// Counter totals, for the report and the stats.
+//
+struct perfUsage
+{
+    long   bytes[PERF_SECTIONS];              // Bytes handled
+    long   calls[PERF_SECTIONS];              // Times each section ran
+    long   count[PERF_SECTIONS][PERF_EVENTS]; // Events counted in each
+    int    have[PERF_EVENTS];                 // 1 if the event is counted
+    int    kernel;                            // 1 if the kernel's side is too
+};
+
+
+// *****************************************************************************
+//
+// int perfInit(int on)
+//
+//    Entry:   int on
+//                1 to count, 0 for off
+//
+//    Exit:    Returns 0 on success, -1 on failure (no hardware counters,
+//             or the table can't be set up).
+//
+//    Purpose: Set up the shared table and check which events can be
+//    counted. Call once, before forking or starting threads; in the load
+//    generator, after the payloads are encoded, so that isn't counted.
+//
+// *****************************************************************************
+//
+int perfInit(int on);
+
+
+// *****************************************************************************
+//
+// void perfBegin(void)
+//
+//    Entry:   None.
+//
+//    Exit:    None.
+//
+//    Purpose: Read the counters going into a section, opening them the
+//    first time a thread gets here. A no-op when off.
+//
+// *****************************************************************************
+//
+void perfBegin(void);
+
+
+// *****************************************************************************
+//
+// void perfEnd(int section, long bytes)
+//
+//    Entry:   int section
+//                PERF_* section being left
+//             long bytes
+//                Bytes it handled
+//
+//    Exit:    None.
+//
+//    Purpose: Read the counters again and add what the section used. A
+//    no-op when off.
+//
+// *****************************************************************************
+//
+void perfEnd(int section, long bytes);
+
+
+// *****************************************************************************
+//
+// void perfChild(void)
+//
+//    Entry:   None.
+//
+//    Exit:    None.
+//
+//    Purpose: Child side: drop the server's counters, which count the
+//    server and not us, so the child opens its own.
+//
+// *****************************************************************************
+//
+void perfChild(void);
+
+
+// *****************************************************************************
+//
+// int perfStats(struct perfUsage *usage)
+//
+//    Entry:   struct perfUsage *usage
+//                Receives the totals
+//
+//    Exit:    1 if counting, 0 if off (usage is then left alone).
+//
+//    Purpose: For the stats (see otp_stats.h).
+//
+// *****************************************************************************
+//
+int perfStats(struct perfUsage *usage);
+
+
+// *****************************************************************************
+//
+// char *perfName(int section)
+//
+//    Entry:   int section
+//                PERF_CODEC, PERF_RECV or PERF_SEND
+//
+//    Exit:    The section's label ("codec", "recv", "send").
+//
+//    Purpose: Label a section.
+//
+// *****************************************************************************
+//
+char *perfName(int section);
+
+
+// *****************************************************************************
+//
+// char *perfEventName(int event)
+//
+//    Entry:   int event
+//                PERF_CYCLES, PERF_INSTR, PERF_CACHE or PERF_BRANCH
+//
+//    Exit:    The event's label ("cycles", "instructions", ...).
+//
+//    Purpose: Label an event.
+//
+// *****************************************************************************
+//
+char *perfEventName(int event);
+
+
+// *****************************************************************************
+//
+// void perfReport(FILE *out)
+//
+//    Entry:   FILE *out
+//                Where to print
+//
+//    Exit:    None.
+//
+//    Purpose: Print the per-byte figures for each section that ran. A
+//    no-op when off.
+//
+// *****************************************************************************
+//
+void perfReport(FILE *out);
+
+
+#endif
@@ -0,0 +1,707 @@
+//
+// *****************************************************************************
+//
+// Author:    Erik Ratcliffe
+// Date:      June 5, 2015
+// Project:   Program 4 - OTP
+// Filename:  otp_pool.c
+// Class:     CS 344 (Spring 2015)
+//
+//
+// Overview:
+//    Server/client simulation of the classic "One-time Pad" encryption scheme.
+//
+//    This file contains the client connection pool. Warm connections have
+//    already been through the TCP handshake and the server type exchange,
+//    so handing one out skips both.
+//
+// *****************************************************************************
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
+#include "otp.h"
+#include "otp_pool.h"
+
+
+// One range of a striped transfer.
+//
+struct poolStripe
+{
+    struct otpPool *pool;   // Pool to take the connection from
+    char   *in, *key, *out; // Input, key and result for this range
+    long   len;             // Characters in this range
+    long   result;          // poolRequest() result for this range
+};
+
+
+// *****************************************************************************
+//
+// static int poolConnect(struct otpPool *pool, int idx, int *err,
+//                        long *retryMs)
+//
+// Purpose: Open a connection to a server and check its server type.
+// Returns the socket, or -1 with *err set to POOL_ERR_CONNECT,
+// POOL_ERR_TYPE (reached, but the wrong kind of server) or POOL_ERR_BUSY
+// (reached, but full; *retryMs says how long to wait).
+//
+// *****************************************************************************
+//
+static int poolConnect(struct otpPool *pool, int idx, int *err,
+                       long *retryMs)
+{
+    int  sock;        // New socket
+    long serverType;  // Type reported by the server
+
+    *err = POOL_ERR_CONNECT;
+
+    if((sock = connectServer(pool->ep[idx].host, pool->ep[idx].port)) == -1)
+    {
+        return -1;
+    }
+
+    // The server speaks first with its type. A connection that does not
+    // get that far is as good as dead.
+    //
+    if(recvLong(&sock, &serverType) == -1)
+    {
+        close(sock);
+        return -1;
+    }
+
+    if(serverType == OTP_BUSY)
+    {
+        *err = (recvLong(&sock, retryMs) == 0) ? POOL_ERR_BUSY : POOL_ERR_CONNECT;
+        close(sock);
+        return -1;
+    }
+
+    if(serverType != pool->svrType)
+    {
+        *err = POOL_ERR_TYPE;
+        close(sock);
+        return -1;
+    }
+
+    return sock;
+}
+
+
+// *****************************************************************************
+//
+// static int poolAlive(int sock)
+//
+// Purpose: Health check for an idle connection. The server has nothing to
+// say until it gets our first number, so anything readable on an idle
+// socket means it was closed (or timed out) on the server side.
+//
+// *****************************************************************************
+//
+static int poolAlive(int sock)
+{
+    struct pollfd pfd;  // Poll descriptor for the socket
+
+    pfd.fd = sock;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+
+    if(poll(&pfd, 1, 0) != 0)
+    {
+        return 0;
+    }
+
+    return 1;
+}
+
+
+// *****************************************************************************
+//
+// static void poolFailed(struct poolEndpoint *ep)
+//
+// Purpose: Count a failure against a server and rest it once it fails too
+// often in a row. Call with the pool locked.
+//
+// *****************************************************************************
+//
+static void poolFailed(struct poolEndpoint *ep)
+{
+    ep->failures++;
+    if(ep->failures >= POOL_MAX_FAILURES)
+    {
+        ep->restUntil = time(NULL) + POOL_REST_SECS;
+        ep->failures = 0;
+    }
+}
+
+
+// *****************************************************************************
+//
+// static int poolPick(struct otpPool *pool, int skip)
+//
+// Purpose: Choose a server according to the pool policy, ignoring resting
+// servers and the first `skip` candidates already tried. Call with the pool
+// locked. Returns -1 if nothing is available.
+//
+// *****************************************************************************
+//
+static int poolPick(struct otpPool *pool, int skip)
+{
+    time_t now = time(NULL); // Used to skip resting servers
+    int    idx, pos;         // Loop indexes
+    int    best = -1;        // Best candidate so far
+
+    for(pos = 0; pos < pool->numEndpoints; pos++)
+    {
+        idx = (pool->next + skip + pos) % pool->numEndpoints;
+
+        if(pool->ep[idx].restUntil > now)
+        {
+            continue;
+        }
+
+        if(pool->policy == POOL_ROUND_ROBIN)
+        {
+            best = idx;
+            break;
+        }
+
+        // Least loaded: fewest requests out, ties go to whoever has warm
+        // connections waiting.
+        //
+        if(best == -1 ||
+           pool->ep[idx].inFlight < pool->ep[best].inFlight ||
+           (pool->ep[idx].inFlight == pool->ep[best].inFlight &&
+            pool->ep[idx].numIdle > pool->ep[best].numIdle))
+        {
+            best = idx;
+        }
+    }
+
+    // If everything is resting, try the next server anyway rather than
+    // failing outright.
+    //
+    if(best == -1 && pool->numEndpoints > 0)
+    {
+        best = (pool->next + skip) % pool->numEndpoints;
+    }
+
+    return best;
+}
+
+
+// *****************************************************************************
+//
+// int poolInit(struct otpPool *pool, char *endpoints, long svrType,
+//              int warm, int policy)
+//
+// Purpose: Set up a connection pool.
+//
+// *****************************************************************************
+//
+int poolInit(struct otpPool *pool, char *endpoints, long svrType,
+             int warm, int policy)
+{
+    char *list, *entry, *save; // Copy of the endpoint list and strtok state
+    char *colon;               // Separator between host and port
+    struct poolEndpoint *ep;   // Endpoint being filled in
+
+    memset(pool, 0, sizeof(*pool));
+    pool->svrType = svrType;
+    pool->warm = (warm > POOL_MAX_IDLE) ? POOL_MAX_IDLE : warm;
+    pool->policy = policy;
+    pthread_mutex_init(&pool->lock, NULL);
+
+    if((list = strdup(endpoints)) == NULL)
+    {
+        return -1;
+    }
+
+    for(entry = strtok_r(list, ",", &save); entry != NULL;
+        entry = strtok_r(NULL, ",", &save))
+    {
+        if(pool->numEndpoints == POOL_MAX_ENDPOINTS)
+        {
+            break;
+        }
+
+        ep = &pool->ep[pool->numEndpoints];
+
+        // "host:port" or just "port" (localhost, like the original
+        // clients assumed).
+        //
+        if((colon = strrchr(entry, ':')) != NULL)
+        {
+            *colon = '\0';
+            snprintf(ep->host, sizeof(ep->host), "%s", entry);
+            ep->port = atoi(colon + 1);
+        }
+        else
+        {
+            snprintf(ep->host, sizeof(ep->host), "localhost");
+            ep->port = atoi(entry);
+        }
+
+        if(ep->port <= 0 || ep->host[0] == '\0')
+        {
+            free(list);
+            return -1;
+        }
+
+        pool->numEndpoints++;
+    }
+
+    free(list);
+
+    return (pool->numEndpoints > 0) ? 0 : -1;
+}
+
+
+// *****************************************************************************
+//
+// int poolFill(struct otpPool *pool)
+//
+// Purpose: Drop dead idle connections and top every healthy server back up
+// to its warm count.
+//
+// *****************************************************************************
+//
+int poolFill(struct otpPool *pool)
+{
+    struct poolEndpoint *ep;  // Server being topped up
+    int    idx, slot;         // Loop indexes
+    int    need;              // Connections this server is short
+    int    sock;              // New socket
+    int    err;               // Why a connection failed
+    long   retryMs;           // Delay a busy server asked for
+    int    opened = 0;        // New connections added to the pool
+    time_t now = time(NULL);  // Used to skip resting servers
+
+    for(idx = 0; idx < pool->numEndpoints; idx++)
+    {
+        ep = &pool->ep[idx];
+
+        pthread_mutex_lock(&pool->lock);
+
+        // Evict idle connections the server has already closed, or
+        // will soon for sitting through its handshake deadline.
+        //
+        for(slot = 0; slot < ep->numIdle; )
+        {
+            if(now - ep->since[slot] < POOL_WARM_SECS && poolAlive(ep->idle[slot]))
+            {
+                slot++;
+                continue;
+            }
+            close(ep->idle[slot]);
+            ep->numIdle--;
+            ep->idle[slot] = ep->idle[ep->numIdle];
+            ep->since[slot] = ep->since[ep->numIdle];
+            ep->evicted++;
+        }
+
+        need = (ep->restUntil > now) ? 0 : pool->warm - ep->numIdle;
+
+        pthread_mutex_unlock(&pool->lock);
+
+        // Connect without holding the lock so requests keep flowing.
+        //
+        while(need-- > 0)
+        {
+            sock = poolConnect(pool, idx, &err, &retryMs);
+
+            // A busy server is healthy, just not taking warm connections
+            // right now.
+            //
+            pthread_mutex_lock(&pool->lock);
+            if(sock == -1)
+            {
+                if(err != POOL_ERR_BUSY)
+                {
+                    poolFailed(ep);
+                }
+                pthread_mutex_unlock(&pool->lock);
+                break;
+            }
+            if(ep->numIdle < POOL_MAX_IDLE)
+            {
+                ep->since[ep->numIdle] = time(NULL);
+                ep->idle[ep->numIdle++] = sock;
+                ep->failures = 0;
+                opened++;
+                sock = -1;
+            }
+            pthread_mutex_unlock(&pool->lock);
+
+            if(sock != -1)
+            {
+                close(sock);
+            }
+        }
+    }
+
+    return opened;
+}
+
+
+// *****************************************************************************
+//
+// int poolGet(struct otpPool *pool, int *endpoint)
+//
+// Purpose: Hand out a warm connection, opening a new one if none are idle.
+//
+// *****************************************************************************
+//
+int poolGet(struct otpPool *pool, int *endpoint)
+{
+    struct poolEndpoint *ep;  // Chosen server
+    int    tried;             // Servers tried so far
+    int    idx;               // Index of the chosen server
+    int    sock;              // Socket handed out
+    int    err;               // Why a connection failed
+    int    typeErr = 0;       // Set if a server reported the wrong type
+    int    busy = 0;          // Set if a server was too busy
+    long   retryMs;           // Delay a busy server asked for
+
+    pool->lastError = POOL_ERR_NONE;
+
+    for(tried = 0; tried < pool->numEndpoints; tried++)
+    {
+        pthread_mutex_lock(&pool->lock);
+
+        if((idx = poolPick(pool, tried)) == -1)
+        {
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+        ep = &pool->ep[idx];
+
+        // Prefer a warm connection, evicting any that died while idle
+        // or are too old to trust (see POOL_WARM_SECS).
+        //
+        sock = -1;
+        while(ep->numIdle > 0 && sock == -1)
+        {
+            sock = ep->idle[--ep->numIdle];
+            if(time(NULL) - ep->since[ep->numIdle] >= POOL_WARM_SECS || !poolAlive(sock))
+            {
+                close(sock);
+                ep->evicted++;
+                sock = -1;
+            }
+        }
+
+        if(sock != -1)
+        {
+            ep->inFlight++;
+            ep->requests++;
+            if(tried == 0)
+            {
+                pool->next = (idx + 1) % pool->numEndpoints;
+            }
+            pthread_mutex_unlock(&pool->lock);
+
+            *endpoint = idx;
+            return sock;
+        }
+
+        pthread_mutex_unlock(&pool->lock);
+
+        // Nothing warm, so pay for a new connection.
+        //
+        sock = poolConnect(pool, idx, &err, &retryMs);
+
+        pthread_mutex_lock(&pool->lock);
+        if(sock != -1)
+        {
+            ep->failures = 0;
+            ep->inFlight++;
+            ep->requests++;
+            pool->next = (idx + 1) % pool->numEndpoints;
+            pthread_mutex_unlock(&pool->lock);
+
+            *endpoint = idx;
+            return sock;
+        }
+
+        // A busy server isn't failing, so it isn't rested; we remember
+        // the shortest delay any server asked for.
+        //
+        if(err == POOL_ERR_BUSY)
+        {
+            pool->retryMs = (!busy || retryMs < pool->retryMs) ? retryMs : pool->retryMs;
+            busy = 1;
+        }
+        else
+        {
+            typeErr |= (err == POOL_ERR_TYPE);
+            poolFailed(ep);
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    pool->lastError = typeErr ? POOL_ERR_TYPE : busy ? POOL_ERR_BUSY : POOL_ERR_CONNECT;
+
+    return -1;
+}
+
+
+// *****************************************************************************
+//
+// void poolRelease(struct otpPool *pool, int endpoint, int sock, int ok)
+//
+// Purpose: Return a connection and update the server's bookkeeping.
+//
+// *****************************************************************************
+//
+void poolRelease(struct otpPool *pool, int endpoint, int sock, int ok)
+{
+    close(sock);
+
+    pthread_mutex_lock(&pool->lock);
+
+    pool->ep[endpoint].inFlight--;
+    if(ok)
+    {
+        pool->ep[endpoint].failures = 0;
+    }
+    else
+    {
+        poolFailed(&pool->ep[endpoint]);
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+}
+
+
+// *****************************************************************************
+//
+// int poolBackoff(long *delay, long retryMs, time_t giveUp)
+//
+// Purpose: Wait before retrying a busy server.
+//
+// *****************************************************************************
+//
+int poolBackoff(long *delay, long retryMs, time_t giveUp)
+{
+    struct timespec now;  // Cheap source of jitter
+
+    *delay = (*delay * 2 > retryMs) ? *delay * 2 : retryMs;
+    *delay = (*delay > POOL_BUSY_MAX_MS) ? POOL_BUSY_MAX_MS : *delay;
+
+    if(time(NULL) + *delay / 1000 > giveUp)
+    {
+        return 0;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    usleep((*delay + now.tv_nsec % (*delay / 2 + 1)) * 1000);
+
+    return 1;
+}
+
+
+// *****************************************************************************
+//
+// long poolRequest(struct otpPool *pool, char *inContent, long inSize,
+//                  char *keyContent, long keySize, char *outContent)
+//
+// Purpose: Run one request over a pooled connection.
+//
+// *****************************************************************************
+//
+long poolRequest(struct otpPool *pool, char *inContent, long inSize,
+                 char *keyContent, long keySize, char *outContent)
+{
+    int  attempt = 0; // Attempts on dead connections
+    int  sock;        // Pooled socket
+    int  endpoint;    // Server the socket goes to
+    long result;      // Result of the request
+    long retryMs;     // Delay a busy server asked for
+    long delay = 0;   // Current busy backoff
+    time_t giveUp = time(NULL) + POOL_BUSY_SECS; // Stop retrying busy servers
+
+    // A warm connection can die between the health check and its use, so
+    // give the request one more go on another connection, but only if the
+    // server never took it. Once any input or key has gone out, sending
+    // it all again could do the work twice, and the encoding server's
+    // reuse index (see otp_reuse.h) would see the key twice. Busy answers
+    // don't count against the retry; they are retried until giveUp.
+    //
+    while(attempt < 2)
+    {
+        if((sock = poolGet(pool, &endpoint)) == -1)
+        {
+            if(pool->lastError != POOL_ERR_BUSY ||
+               !poolBackoff(&delay, pool->retryMs, giveUp))
+            {
+                return -1;
+            }
+            continue;
+        }
+
+        result = otpRequest(&sock, inContent, inSize, keyContent, keySize,
+                            outContent, &retryMs);
+
+        poolRelease(pool, endpoint, sock, result >= 0 || result == -2);
+
+        if(result == -2)
+        {
+            pool->lastError = POOL_ERR_BUSY;
+            pool->retryMs = retryMs;
+            if(!poolBackoff(&delay, retryMs, giveUp))
+            {
+                return -1;
+            }
+            continue;
+        }
+
+        if(result == -4)
+        {
+            pool->lastError = POOL_ERR_TOO_LARGE;
+            return -1;
+        }
+
+        if(result != -3)
+        {
+            return (result < 0) ? -1 : result;
+        }
+
+        attempt++;
+    }
+
+    return -1;
+}
+
+
+// *****************************************************************************
+//
+// static void *poolStripeRun(void *arg)
+//
+// Purpose: Thread body for one range of a striped transfer.
+//
+// *****************************************************************************
+//
+static void *poolStripeRun(void *arg)
+{
+    struct poolStripe *stripe = arg; // Range to transfer
+
+    stripe->result = poolRequest(stripe->pool, stripe->in, stripe->len,
+                                 stripe->key, stripe->len, stripe->out);
+
+    return NULL;
+}
+
+
+// *****************************************************************************
+//
+// long poolStriped(struct otpPool *pool, char *inContent, long inSize,
+//                  char *keyContent, long keySize, char *outContent,
+//                  int stripes)
+//
+// Purpose: Split one large input/key pair over parallel pooled
+// connections.
+//
+// *****************************************************************************
+//
+long poolStriped(struct otpPool *pool, char *inContent, long inSize,
+                 char *keyContent, long keySize, char *outContent,
+                 int stripes)
+{
+    struct poolStripe stripe[POOL_MAX_STRIPES]; // One entry per range
+    pthread_t thread[POOL_MAX_STRIPES];         // One thread per range
+    int  started[POOL_MAX_STRIPES];             // Set if the thread started
+    long per;                                   // Characters per range
+    long off;                                   // Offset of the current range
+    long result = inSize;                       // Overall result
+    int  idx;                                   // Loop index
+
+    if(keySize < inSize)
+    {
+        return -1;
+    }
+
+    if(stripes > POOL_MAX_STRIPES)
+    {
+        stripes = POOL_MAX_STRIPES;
+    }
+    if(stripes > inSize / POOL_MIN_STRIPE)
+    {
+        stripes = inSize / POOL_MIN_STRIPE;
+    }
+    if(stripes <= 1)
+    {
+        return poolRequest(pool, inContent, inSize, keyContent, keySize,
+                           outContent);
+    }
+
+    // Equal ranges, with the remainder going to the last one.
+    //
+    per = inSize / stripes;
+
+    for(idx = 0; idx < stripes; idx++)
+    {
+        off = idx * per;
+
+        stripe[idx].pool = pool;
+        stripe[idx].in = inContent + off;
+        stripe[idx].key = keyContent + off;
+        stripe[idx].out = outContent + off;
+        stripe[idx].len = (idx == stripes - 1) ? inSize - off : per;
+        stripe[idx].result = -1;
+
+        // If we can't get a thread, just do the range here.
+        //
+        started[idx] = (pthread_create(&thread[idx], NULL, poolStripeRun,
+                                       &stripe[idx]) == 0);
+        if(!started[idx])
+        {
+            poolStripeRun(&stripe[idx]);
+        }
+    }
+
+    for(idx = 0; idx < stripes; idx++)
+    {
+        if(started[idx])
+        {
+            pthread_join(thread[idx], NULL);
+        }
+        if(stripe[idx].result == -1)
+        {
+            result = -1;
+        }
+    }
+
+    return result;
+}
+
+
+// *****************************************************************************
+//
+// void poolDestroy(struct otpPool *pool)
+//
+// Purpose: Close every idle connection in the pool.
+//
+// *****************************************************************************
+//
+void poolDestroy(struct otpPool *pool)
+{
+    int idx; // Loop index
+
+    pthread_mutex_lock(&pool->lock);
+
+    for(idx = 0; idx < pool->numEndpoints; idx++)
+    {
+        while(pool->ep[idx].numIdle > 0)
+        {
+            close(pool->ep[idx].idle[--pool->ep[idx].numIdle]);
+        }
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+    pthread_mutex_destroy(&pool->lock);
+}
@@ -0,0 +1,275 @@
+//
+// *****************************************************************************
+//
+// Author:    Erik Ratcliffe
+// Date:      June 5, 2015
+// Project:   Program 4 - OTP
+// Filename:  otp_pool.h
+// Class:     CS 344 (Spring 2015)
+//
+//
+// Overview:
+//    Server/client simulation of the classic "One-time Pad" encryption scheme.
+//
+//    This file contains the client connection pool definitions and function
+//    prototypes. The pool pre-opens connections to one or more servers
+//    and checks their server type, so a request can skip straight to the
+//    size exchange. It doesn't keep connections for reuse: the classic
+//    protocol is one request per connection, so each pooled connection
+//    carries exactly one request and is closed after it. Call poolFill()
+//    again to have more ready.
+//
+//    Only long-running callers such as otp_bench pre-open anything.
+//    otp_enc and otp_dec make one request and use the pool with warm = 0,
+//    for its server list, failover and busy retries.
+//
+//    A server kills a connection that sends nothing within its handshake
+//    deadline (30 seconds by default, see otp_deadline.h). Warm
+//    connections send nothing until they are used, so the pool drops any
+//    older than POOL_WARM_SECS instead of handing them out.
+//
+// *****************************************************************************
+//
+
+#ifndef OTP_POOL_H
+#define OTP_POOL_H
+
+
+#include <time.h>
+#include <pthread.h>
+
+
+#define POOL_MAX_ENDPOINTS 16   // Servers a single pool can spread over
+#define POOL_MAX_IDLE      32   // Warm connections kept per server
+#define POOL_WARM_SECS     20   // Oldest warm connection handed out
+#define POOL_HOST_LEN      256  // Longest host name we keep
+
+#define POOL_ROUND_ROBIN   0    // Pick servers in turn
+#define POOL_LEAST_LOADED  1    // Pick the server with the fewest requests out
+
+#define POOL_MAX_FAILURES  3    // Consecutive failures before a server rests
+#define POOL_REST_SECS     5    // How long a failing server rests
+
+#define POOL_MAX_STRIPES   64   // Most connections one striped transfer uses
+#define POOL_MIN_STRIPE    65536 // Smallest range worth its own connection
+
+#define POOL_ERR_NONE      0    // No error
+#define POOL_ERR_CONNECT   1    // Could not connect to any server
+#define POOL_ERR_TYPE      2    // Connected, but to the wrong kind of server
+#define POOL_ERR_BUSY      3    // Servers reachable but too busy (see retryMs)
+#define POOL_ERR_TOO_LARGE 4    // Request too large for the server ever to take
+
+#define POOL_BUSY_SECS     30   // Longest a request keeps retrying busy servers
+#define POOL_BUSY_MAX_MS   5000 // Longest single wait for a busy server
+
+
+struct poolEndpoint
+{
+    char   host[POOL_HOST_LEN];   // Server host name
+    int    port;                  // Server port
+    int    idle[POOL_MAX_IDLE];   // Warm, type-checked sockets
+    time_t since[POOL_MAX_IDLE];  // When each of idle[] was opened
+    int    numIdle;               // Number of sockets in idle[]
+    int    inFlight;              // Requests currently using this server
+    int    failures;              // Consecutive connect/handshake failures
+    time_t restUntil;             // Skip this server until this time
+    long   requests;              // Requests handed out to this server
+    long   evicted;               // Warm sockets found dead or too old
+                                  // and dropped
+};
+
+
+struct otpPool
+{
+    struct poolEndpoint ep[POOL_MAX_ENDPOINTS]; // Servers in the pool
+    int    numEndpoints;          // Number of entries in ep[]
+    int    warm;                  // Sockets to pre-open per server
+    int    policy;                // POOL_ROUND_ROBIN or POOL_LEAST_LOADED
+    int    next;                  // Round robin cursor
+    int    lastError;             // POOL_ERR_* from the last failed get
+    long   retryMs;               // Delay a busy server asked for
+    long   svrType;               // Server type every connection must report
+    pthread_mutex_t lock;         // Guards everything above
+};
+
+
+// *****************************************************************************
+//
+// int poolInit(struct otpPool *pool, char *endpoints, long svrType,
+//              int warm, int policy)
+//
+//    Entry:   struct otpPool *pool
+//                Pool to initialize
+//             char *endpoints
+//                Comma separated list of "port" or "host:port" entries.
+//                A bare port means localhost.
+//             long svrType
+//                Server type every pooled connection must report
+//             int warm
+//                Number of connections to pre-open per server (0 = none,
+//                connect on demand)
+//             int policy
+//                POOL_ROUND_ROBIN or POOL_LEAST_LOADED
+//
+//    Exit:    Returns 0 on success, -1 if the endpoint list is bad.
+//
+//    Purpose: Set up a connection pool. No connections are opened until
+//    poolFill() or poolGet() is called.
+//
+// *****************************************************************************
+//
+int poolInit(struct otpPool *pool, char *endpoints, long svrType,
+             int warm, int policy);
+
+
+// *****************************************************************************
+//
+// int poolFill(struct otpPool *pool)
+//
+//    Entry:   struct otpPool *pool
+//                Pool to top up
+//
+//    Exit:    Number of new connections opened.
+//
+//    Purpose: Drop dead idle connections and open new ones until every
+//    healthy server has its warm count. Safe to call periodically from a
+//    background thread.
+//
+// *****************************************************************************
+//
+int poolFill(struct otpPool *pool);
+
+
+// *****************************************************************************
+//
+// int poolGet(struct otpPool *pool, int *endpoint)
+//
+//    Entry:   struct otpPool *pool
+//                Pool to take a connection from
+//             int *endpoint
+//                Receives the index of the server the connection goes to
+//
+//    Exit:    A connected, type-checked socket, -1 on failure (see
+//             pool->lastError).
+//
+//    Purpose: Pick a server according to the pool policy and hand out a
+//    pre-opened connection to it, opening a new one if none are idle.
+//
+// *****************************************************************************
+//
+int poolGet(struct otpPool *pool, int *endpoint);
+
+
+// *****************************************************************************
+//
+// void poolRelease(struct otpPool *pool, int endpoint, int sock, int ok)
+//
+//    Entry:   struct otpPool *pool
+//                Pool the connection came from
+//             int endpoint
+//                Server index returned by poolGet()
+//             int sock
+//                Socket returned by poolGet()
+//             int ok
+//                1 if the request succeeded, 0 if the connection failed
+//
+//    Exit:    None.
+//
+//    Purpose: Return a connection. The servers close a connection after
+//    one request, so the socket itself is closed; the server's load and
+//    health bookkeeping are updated.
+//
+// *****************************************************************************
+//
+void poolRelease(struct otpPool *pool, int endpoint, int sock, int ok);
+
+
+// *****************************************************************************
+//
+// int poolBackoff(long *delay, long retryMs, time_t giveUp)
+//
+//    Entry:   long *delay
+//                Last wait in ms (0 the first time); updated
+//             long retryMs
+//                Delay the busy server asked for
+//             time_t giveUp
+//                When to stop retrying
+//
+//    Exit:    1 after waiting, 0 without waiting if the wait would run
+//             past giveUp.
+//
+//    Purpose: Wait before retrying a busy server: at least as long as it
+//    asked, doubling each time, plus up to half again of jitter so
+//    clients turned away together don't all come back together.
+//
+// *****************************************************************************
+//
+int poolBackoff(long *delay, long retryMs, time_t giveUp);
+
+
+// *****************************************************************************
+//
+// long poolRequest(struct otpPool *pool, char *inContent, long inSize,
+//                  char *keyContent, long keySize, char *outContent)
+//
+//    Entry:   Same as otpRequest(), minus the socket.
+//
+//    Exit:    Number of result characters received, -1 on failure.
+//
+//    Purpose: Run one request over a pooled connection. A pre-opened
+//    connection that turns out to be dead before the server took the
+//    request is retried once on a fresh connection; a failure after any
+//    of the input was sent is not retried. A busy server is retried after
+//    the delay it asked for, backing off exponentially with jitter, for
+//    up to POOL_BUSY_SECS seconds.
+//
+// *****************************************************************************
+//
+long poolRequest(struct otpPool *pool, char *inContent, long inSize,
+                 char *keyContent, long keySize, char *outContent);
+
+
+// *****************************************************************************
+//
+// long poolStriped(struct otpPool *pool, char *inContent, long inSize,
+//                  char *keyContent, long keySize, char *outContent,
+//                  int stripes)
+//
+//    Entry:   Same as poolRequest(), plus
+//             int stripes
+//                Number of parallel connections to split the input over
+//
+//    Exit:    Number of result characters received, -1 on failure.
+//
+//    Purpose: Split one large input/key pair into ranges and run them as
+//    separate requests over parallel pooled connections (spread over the
+//    pool's servers), with each result landing at its own offset in
+//    outContent. The pad transform is position-independent, so each range
+//    only needs the matching range of the key. Ranges smaller than
+//    POOL_MIN_STRIPE are not worth a connection, so small inputs use fewer
+//    stripes than asked for.
+//
+// *****************************************************************************
+//
+long poolStriped(struct otpPool *pool, char *inContent, long inSize,
+                 char *keyContent, long keySize, char *outContent,
+                 int stripes);
+
+
+// *****************************************************************************
+//
+// void poolDestroy(struct otpPool *pool)
+//
+//    Entry:   struct otpPool *pool
+//                Pool to tear down
+//
+//    Exit:    None.
+//
+//    Purpose: Close every idle connection in the pool.
+//
+// *****************************************************************************
+//
+void poolDestroy(struct otpPool *pool);
+
+
+#endif
@@ -0,0 +1,120 @@
+//
+// *****************************************************************************
+//
+// Author:    Erik Ratcliffe
+// Date:      June 5, 2015
+// Project:   Program 4 - OTP
+// Filename:  otp_probes.h
+// Class:     CS 344 (Spring 2015)
+//
+//
+// Overview:
+//    Server/client simulation of the classic "One-time Pad" encryption scheme.
+//
+//    This file contains the static tracepoints (USDT probes, provider
+//    "otp") on the hot paths. When <sys/sdt.h> is available (systemtap-sdt-dev
+//    or similar), each probe is a nop plus an ELF note that bpftrace or
+//    perf can attach to, e.g.
+//
+//       bpftrace -e 'usdt:./otp_enc_d:otp:codec-end { @[arg1] = hist(arg2); }'
+//
+//    Each probe also has an is-enabled semaphore that the tracer bumps
+//    while attached, and the arguments (clock reads included) are only
+//    worked out while it's set, so an unattached probe costs a load and a
+//    branch. Without <sys/sdt.h> every probe compiles away.
+//
+//    Probes (id is the pid of the child serving the connection, one per
+//    connection; times are ns):
+//
+//       accept(id, children)                 server forked a child
+//       request-start(id, first)             first number (size or opcode)
+//       request-end(id, first, time)         connection done
+//       recv-chunk(id, bytes)                bytes from one recv()
+//       codec-start(id, chars)               encodeBuf()/decodeBuf() begins
+//       codec-end(id, chars, time)           ... and ends
+//       send-done(id, bytes, time)           sendBuf() finished, or a
+//                                            multiplexed flush sent bytes
+//
+//    `make probes` builds only if <sys/sdt.h> is there, rather than
+//    quietly leaving the probes out.
+//
+// *****************************************************************************
+//
+
+#ifndef OTP_PROBES_H
+#define OTP_PROBES_H
+
+
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define OTP_HAVE_SDT 1
+#endif
+#endif
+
+
+#ifdef OTP_HAVE_SDT
+
+#define _SDT_HAS_SEMAPHORES 1
+
+#include <time.h>
+#include <sys/sdt.h>
+
+
+// The semaphores have to be in .probes. Weak, so every file that
+// includes this one can define them and the linker keeps one of each.
+//
+#define OTP_PROBE_SEMAPHORE(name) \
+    unsigned short otp_##name##_semaphore __attribute__((weak, section(".probes")))
+
+OTP_PROBE_SEMAPHORE(accept);
+OTP_PROBE_SEMAPHORE(request__start);
+OTP_PROBE_SEMAPHORE(request__end);
+OTP_PROBE_SEMAPHORE(recv__chunk);
+OTP_PROBE_SEMAPHORE(codec__start);
+OTP_PROBE_SEMAPHORE(codec__end);
+OTP_PROBE_SEMAPHORE(send__done);
+
+
+// Monotonic clock in ns, for probe times.
+//
+static inline long otpProbeClock(void)
+{
+    struct timespec now;  // Current time
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+
+#define OTP_PROBE_ON(name)   __builtin_expect(otp_##name##_semaphore != 0, 0)
+#define OTP_PROBE_CLOCK(name) (OTP_PROBE_ON(name) ? otpProbeClock() : 0L)
+#define OTP_PROBE_SINCE(t)   (otpProbeClock() - (t))
+
+#define OTP_PROBE1(name, a) \
+    do { if(OTP_PROBE_ON(name)) DTRACE_PROBE1(otp, name, a); } while(0)
+#define OTP_PROBE2(name, a, b) \
+    do { if(OTP_PROBE_ON(name)) DTRACE_PROBE2(otp, name, a, b); } while(0)
+#define OTP_PROBE3(name, a, b, c) \
+    do { if(OTP_PROBE_ON(name)) DTRACE_PROBE3(otp, name, a, b, c); } while(0)
+
+#else
+
+// No probes. The arguments are still mentioned, so variables kept only
+// for a probe don't trip the unused variable warnings.
+//
+#define OTP_PROBE_ON(name)   0
+#define OTP_PROBE_CLOCK(name) 0L
+#define OTP_PROBE_SINCE(t)   (t)
+
+#define OTP_PROBE1(name, a) \
+    do { if(0) { (void)(a); } } while(0)
+#define OTP_PROBE2(name, a, b) \
+    do { if(0) { (void)(a); (void)(b); } } while(0)
+#define OTP_PROBE3(name, a, b, c) \
+    do { if(0) { (void)(a); (void)(b); (void)(c); } } while(0)
+
+#endif
+
+
+#endif
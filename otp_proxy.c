@@ -0,0 +1,418 @@
+//
+// *****************************************************************************
+//
+// Author:    Erik Ratcliffe
+// Date:      June 5, 2015
+// Project:   Program 4 - OTP
+// Filename:  otp_proxy.c
+// Class:     CS 344 (Spring 2015)
+//
+//
+// Overview:
+//    Server/client simulation of the classic "One-time Pad" encryption scheme.
+//
+//    This file contains a TCP proxy that makes loopback look like a WAN
+//    link, for benchmarking the protocol at realistic round trip times.
+//    Clients connect to the proxy, which connects to the real server and
+//    passes bytes both ways, each direction through its own simulated
+//    link:
+//
+//    - -l ms one way delay (the round trip is twice that),
+//    - -j ms extra random delay, 0 to this, per segment (segments still
+//      arrive in order, as on one TCP connection),
+//    - -b bytes per second: each segment has to wait for the ones before
+//      it to get onto the link,
+//    - -f bytes: data is cut into segments of at most this size, each
+//      delivered on its own, so the other end sees short reads.
+//
+//    Like the servers, the proxy forks a child per connection. Sockets are
+//    non-blocking, so a slow reader on one side never holds up the other
+//    direction.
+//
+// *****************************************************************************
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include "otp.h"
+
+
+#define PROXY_READ      65536    // Most bytes taken from a socket at once
+#define PROXY_QUEUE     4194304  // Bytes a direction holds before it stops reading
+#define PROXY_BACKLOG   128      // listen() backlog
+
+
+// A segment in flight.
+//
+struct proxySeg
+{
+    struct proxySeg *next;  // Next segment in this direction
+    long   due;             // When it comes out of the link (ns)
+    long   len, off;        // Bytes, and bytes already written
+    char   data[];          // The bytes
+};
+
+
+// One direction of a connection.
+//
+struct proxyLink
+{
+    int    from, to;        // Sockets it reads from and writes to
+    struct proxySeg *head, *tail; // Segments in flight, oldest first
+    long   queued;          // Bytes in flight
+    long   linkFree;        // When the link is free for the next segment
+    long   lastDue;         // Delivery time of the newest segment
+    int    eof;             // Nothing more to read
+    int    shut;            // Write side shut down
+};
+
+
+static long delayNs = 0;    // One way delay (-l)
+static long jitterNs = 0;   // Random extra delay (-j)
+static long rate = 0;       // Bytes per second (-b, 0 = unlimited)
+static long segMax = 0;     // Largest segment (-f, 0 = as read)
+
+
+// *****************************************************************************
+//
+// static long proxyNow(void)
+//
+// Purpose: Monotonic clock in ns.
+//
+// *****************************************************************************
+//
+static long proxyNow(void)
+{
+    struct timespec now;  // Current time
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+
+// *****************************************************************************
+//
+// static int proxyRead(struct proxyLink *link, unsigned int *seed)
+//
+// Purpose: Read what's waiting on one side and put it on the link, cut
+// into segments. Returns -1 if the socket failed.
+//
+// *****************************************************************************
+//
+static int proxyRead(struct proxyLink *link, unsigned int *seed)
+{
+    char   buf[PROXY_READ];   // Bytes read
+    struct proxySeg *seg;     // Segment being queued
+    long   numRead;           // Bytes read
+    long   off, len;          // Current segment
+    long   now = proxyNow();  // Arrival time
+
+    if((numRead = recv(link->from, buf, sizeof(buf), 0)) == -1)
+    {
+        return (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+    }
+    if(numRead == 0)
+    {
+        link->eof = 1;
+        return 0;
+    }
+
+    for(off = 0; off < numRead; off += len)
+    {
+        len = (segMax > 0 && numRead - off > segMax) ? segMax : numRead - off;
+        if((seg = malloc(sizeof(*seg) + len)) == NULL)
+        {
+            return -1;
+        }
+        memcpy(seg->data, buf + off, len);
+        seg->len = len;
+        seg->off = 0;
+        seg->next = NULL;
+
+        // Queue for the link, go onto it at the configured rate, then
+        // take the delay (never overtaking the segment before).
+        //
+        link->linkFree = (link->linkFree > now) ? link->linkFree : now;
+        if(rate > 0)
+        {
+            link->linkFree += len * 1000000000L / rate;
+        }
+        seg->due = link->linkFree + delayNs;
+        if(jitterNs > 0)
+        {
+            seg->due += (long)((double)rand_r(seed) / RAND_MAX * jitterNs);
+        }
+        seg->due = (seg->due < link->lastDue) ? link->lastDue : seg->due;
+        link->lastDue = seg->due;
+
+        if(link->tail == NULL)
+        {
+            link->head = seg;
+        }
+        else
+        {
+            link->tail->next = seg;
+        }
+        link->tail = seg;
+        link->queued += len;
+    }
+
+    return 0;
+}
+
+
+// *****************************************************************************
+//
+// static int proxyWrite(struct proxyLink *link)
+//
+// Purpose: Write out the segments that are due, as far as the other side
+// takes them. Returns -1 if the socket failed.
+//
+// *****************************************************************************
+//
+static int proxyWrite(struct proxyLink *link)
+{
+    struct proxySeg *seg;     // Oldest segment
+    long   numWritten;        // Bytes written
+    long   now = proxyNow();  // Current time
+
+    while((seg = link->head) != NULL && seg->due <= now)
+    {
+        if((numWritten = send(link->to, seg->data + seg->off, seg->len - seg->off,
+                              MSG_NOSIGNAL)) == -1)
+        {
+            return (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+        }
+
+        seg->off += numWritten;
+        if(seg->off < seg->len)
+        {
+            return 0;
+        }
+
+        link->head = seg->next;
+        link->tail = (link->head == NULL) ? NULL : link->tail;
+        link->queued -= seg->len;
+        free(seg);
+    }
+
+    // Pass a close on once everything before it is through.
+    //
+    if(link->eof && link->head == NULL && !link->shut)
+    {
+        shutdown(link->to, SHUT_WR);
+        link->shut = 1;
+    }
+
+    return 0;
+}
+
+
+// *****************************************************************************
+//
+// static void proxyServe(int cli, char *host, int port)
+//
+// Purpose: Child side: connect to the server and pass bytes both ways
+// until both sides are done.
+//
+// *****************************************************************************
+//
+static void proxyServe(int cli, char *host, int port)
+{
+    struct proxyLink link[2];  // Client to server, and server to client
+    struct pollfd pfd[4];      // Read and write sides of each direction
+    unsigned int seed = getpid(); // For the jitter
+    long   wait;               // Time until the next segment is due (ns)
+    long   now;                // Current time (ns)
+    int    svr;                // Connection to the server
+    int    optval = 1;         // For setsockopt()
+    int    idx;                // Loop index
+
+    if((svr = connectServer(host, port)) == -1)
+    {
+        fprintf(stderr, "connect failed: %s:%d\n", host, port);
+        return;
+    }
+
+    // Segments go out the moment they're due, each as its own packet.
+    //
+    setsockopt(cli, IPPROTO_TCP, TCP_NODELAY, &optval, sizeof(optval));
+    setsockopt(svr, IPPROTO_TCP, TCP_NODELAY, &optval, sizeof(optval));
+    fcntl(cli, F_SETFL, fcntl(cli, F_GETFL) | O_NONBLOCK);
+    fcntl(svr, F_SETFL, fcntl(svr, F_GETFL) | O_NONBLOCK);
+
+    memset(link, 0, sizeof(link));
+    link[0].from = link[1].to = cli;
+    link[0].to = link[1].from = svr;
+
+    while(!link[0].shut || !link[1].shut)
+    {
+        // Read while there's room on the link, write once something is
+        // due, and sleep until the next segment is due otherwise.
+        //
+        wait = -1;
+        now = proxyNow();
+        for(idx = 0; idx < 2; idx++)
+        {
+            pfd[idx * 2].fd = (!link[idx].eof && link[idx].queued < PROXY_QUEUE) ?
+                              link[idx].from : -1;
+            pfd[idx * 2].events = POLLIN;
+            pfd[idx * 2 + 1].fd = -1;
+            pfd[idx * 2 + 1].events = POLLOUT;
+            if(link[idx].head != NULL)
+            {
+                if(link[idx].head->due <= now)
+                {
+                    pfd[idx * 2 + 1].fd = link[idx].to;
+                }
+                else if(wait == -1 || link[idx].head->due - now < wait)
+                {
+                    wait = link[idx].head->due - now;
+                }
+            }
+        }
+
+        if(poll(pfd, 4, (wait == -1) ? -1 : (int)(wait / 1000000 + 1)) == -1 &&
+           errno != EINTR)
+        {
+            break;
+        }
+
+        for(idx = 0; idx < 2; idx++)
+        {
+            if((pfd[idx * 2].revents && proxyRead(&link[idx], &seed) == -1) ||
+               proxyWrite(&link[idx]) == -1)
+            {
+                link[0].shut = link[1].shut = 1;
+            }
+        }
+    }
+
+    close(svr);
+}
+
+
+int main(int argc, char **argv)
+{
+    struct sockaddr_in myServ;     // Address the proxy listens on
+    int    sock, cli;              // Listening and client sockets
+    int    optval = 1;             // For setsockopt()
+    int    opt;                    // Current command line option
+    char   *host = "localhost";    // Server host
+    char   *colon;                 // Separator between host and port
+    int    port;                   // Server port
+
+    // -l one way delay and -j jitter in ms, -b bytes per second each
+    // way, -f largest segment in bytes.
+    //
+    while((opt = getopt(argc, argv, "b:f:j:l:")) != -1)
+    {
+        switch(opt)
+        {
+            case 'b':
+                rate = atol(optarg);
+                break;
+
+            case 'f':
+                segMax = atol(optarg);
+                break;
+
+            case 'j':
+                jitterNs = (long)(atof(optarg) * 1000000);
+                break;
+
+            case 'l':
+                delayNs = (long)(atof(optarg) * 1000000);
+                break;
+
+            default:
+                argc = 0; // Fall into the usage message below
+                break;
+        }
+    }
+
+    if(argc - optind < 2)
+    {
+        fprintf(stderr, "Usage: %s [-l delay_ms] [-j jitter_ms] [-b bytes_per_sec]\n"
+                        "       [-f segment_bytes] listen_port [host:]port\n", argv[0]);
+        exit(1);
+    }
+
+    if((colon = strrchr(argv[optind + 1], ':')) != NULL)
+    {
+        *colon = '\0';
+        host = argv[optind + 1];
+        port = atoi(colon + 1);
+    }
+    else
+    {
+        port = atoi(argv[optind + 1]);
+    }
+
+    if((sock = socket(AF_INET, SOCK_STREAM, 0)) == -1 ||
+       setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval)) == -1)
+    {
+        perror("Socket failed");
+        exit(1);
+    }
+
+    memset((char *)&myServ, 0, sizeof(myServ));
+    myServ.sin_family = AF_INET;
+    myServ.sin_port = htons(atoi(argv[optind]));
+    myServ.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if(bind(sock, (struct sockaddr *)&myServ, sizeof(myServ)) == -1 ||
+       listen(sock, PROXY_BACKLOG) == -1)
+    {
+        perror("Bind failed");
+        exit(1);
+    }
+
+    // Children are never waited for; let the kernel reap them.
+    //
+    signal(SIGCHLD, SIG_IGN);
+
+    while(1)
+    {
+        if((cli = accept(sock, NULL, NULL)) == -1)
+        {
+            if(errno != EINTR)
+            {
+                perror("Accept failed");
+            }
+            continue;
+        }
+
+        switch(fork())
+        {
+            case -1:
+                perror("Fork failed");
+                break;
+
+            case 0:
+                close(sock);
+                proxyServe(cli, host, port);
+                close(cli);
+                exit(0);
+
+            default:
+                break;
+        }
+
+        close(cli);
+    }
+
+    return 0;
+}
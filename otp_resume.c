@@ -0,0 +1,148 @@
+//
+// *****************************************************************************
+//
+// Author:    Erik Ratcliffe
+// Date:      June 5, 2015
+// Project:   Program 4 - OTP
+// Filename:  otp_resume.c
+// Class:     CS 344 (Spring 2015)
+//
+//
+// Overview:
+//    Server/client simulation of the classic "One-time Pad" encryption scheme.
+//
+//    This file contains the client side of resumable sessions (see
+//    otp_resume.h for the protocol). The server side is in otp_resume_d.c.
+//
+// *****************************************************************************
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "otp.h"
+#include "otp_resume.h"
+
+
+// *****************************************************************************
+//
+// long resumeRequest(struct otpPool *pool, char *inContent, long inSize,
+//                    char *keyContent, long keySize, char *outContent)
+//
+// Purpose: Client side of a resumable session.
+//
+// *****************************************************************************
+//
+long resumeRequest(struct otpPool *pool, char *inContent, long inSize,
+                   char *keyContent, long keySize, char *outContent)
+{
+    long   id = 0;               // Session ID (0 until the server assigns one)
+    long   offset = 0;           // Results received so far
+    long   resumeAt;             // Offset the server has acknowledged
+    long   reply;                // Session ID the server answered with
+    long   len;                  // Characters in the current chunk
+    long   backoff = RESUME_BACKOFF_MS; // Current reconnect delay
+    time_t lastProgress;         // When a chunk last came back
+    int    sock, endpoint;       // Pooled connection
+    char   *chunk;               // Result chunk before it is committed
+
+    if(keySize < inSize || (chunk = malloc(RESUME_CHUNK)) == NULL)
+    {
+        return -1;
+    }
+
+    lastProgress = time(NULL);
+
+    while(time(NULL) - lastProgress <= RESUME_TIMEOUT)
+    {
+        if((sock = poolGet(pool, &endpoint)) == -1)
+        {
+            if(pool->lastError == POOL_ERR_TYPE)
+            {
+                break; // Retrying won't change the server type
+            }
+            if(pool->lastError == POOL_ERR_BUSY && pool->retryMs > backoff)
+            {
+                backoff = pool->retryMs;
+            }
+        }
+        else if(sendLong(&sock, OP_RESUME) == 0 && sendLong64(&sock, id) == 0 &&
+                sendLong64(&sock, inSize) == 0 && recvLong64(&sock, &reply) == 0 &&
+                recvLong64(&sock, &resumeAt) == 0)
+        {
+            // A busy server keeps our session for later and tells us how
+            // long to stay away.
+            //
+            if(reply == RESUME_BUSY)
+            {
+                backoff = (resumeAt > backoff) ? resumeAt : backoff;
+                poolRelease(pool, endpoint, sock, 1);
+                sock = -1;
+            }
+
+            // An unknown or expired session just means we start a new
+            // one, carrying on from our own offset. So does one the
+            // server has at another offset than ours: the chunk in
+            // between can't be sent again (outContent may be inContent),
+            // and the server would drop any other.
+            //
+            else if(reply == -1 || (id != 0 && resumeAt != offset))
+            {
+                id = 0;
+                poolRelease(pool, endpoint, sock, 1);
+                sock = -1;
+            }
+            else
+            {
+                id = reply;
+            }
+
+            while(sock != -1)
+            {
+                len = inSize - offset;
+                len = (len > RESUME_CHUNK) ? RESUME_CHUNK : len;
+
+                if(sendLong64(&sock, offset) == -1 || sendLong64(&sock, len) == -1)
+                {
+                    break;
+                }
+
+                if(len == 0)
+                {
+                    poolRelease(pool, endpoint, sock, 1);
+                    free(chunk);
+                    return inSize;
+                }
+
+                // The result goes to a side buffer first, so a drop in the
+                // middle of a chunk never leaves half a result in
+                // outContent (which may be inContent).
+                //
+                if(sendBuf(&sock, inContent + offset, len) == -1 ||
+                   sendBuf(&sock, keyContent + offset, len) == -1 ||
+                   recvBuf(&sock, chunk, len) == -1)
+                {
+                    break;
+                }
+
+                memcpy(outContent + offset, chunk, len);
+                offset += len;
+                lastProgress = time(NULL);
+                backoff = RESUME_BACKOFF_MS;
+            }
+        }
+
+        if(sock != -1)
+        {
+            poolRelease(pool, endpoint, sock, 0);
+        }
+
+        usleep(backoff * 1000);
+        backoff = (backoff * 2 > RESUME_BACKOFF_MAX) ? RESUME_BACKOFF_MAX : backoff * 2;
+    }
+
+    free(chunk);
+
+    return -1;
+}
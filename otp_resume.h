@@ -0,0 +1,117 @@
+//
+// *****************************************************************************
+//
+// Author:    Erik Ratcliffe
+// Date:      June 5, 2015
+// Project:   Program 4 - OTP
+// Filename:  otp_resume.h
+// Class:     CS 344 (Spring 2015)
+//
+//
+// Overview:
+//    Server/client simulation of the classic "One-time Pad" encryption scheme.
+//
+//    This file contains the definitions and function prototypes for
+//    resumable sessions. A resumable transfer is sent in chunks under a
+//    session ID assigned by the server; if the connection drops, the client
+//    reconnects with the same ID and carries on from the last chunk it got
+//    back instead of starting over.
+//
+//    Protocol, after the server type (OP_RESUME as in sendNum(), all
+//    later numbers 64-bit as in sendLong64()):
+//
+//       client: OP_RESUME, session ID (0 = new session), input size
+//       server: session ID, offset acknowledged so far
+//               (-1, -1 if the session is unknown, expired or mismatched;
+//               RESUME_BUSY and a retry delay in ms if the server is full)
+//       then, repeated:
+//       client: offset, chunk length (0 = done), input chunk, key chunk
+//       server: result chunk
+//
+//    Sending a chunk at an offset acknowledges every result before it.
+//    Chunks follow on from each other: the server drops the connection on
+//    a chunk at any other offset than the one after the last (or, for a
+//    session coming back, the one it acknowledged). A client coming back
+//    goes on if the server's offset is its own. If not (the drop came
+//    after the client had a result but before it could say so), it can't
+//    send that chunk again, since its input may already be overwritten,
+//    so it leaves the session to expire and opens a new one, whose first
+//    chunk can start anywhere.
+//
+//    The server only ever holds one chunk of a session, so that is what it
+//    admits (see otp_admit.h), however large the session.
+//
+// *****************************************************************************
+//
+
+#ifndef OTP_RESUME_H
+#define OTP_RESUME_H
+
+
+#include "otp_pool.h"
+
+
+#define RESUME_MAX_SESSIONS 1024    // Sessions a server remembers at once
+#define RESUME_CHUNK        65536   // Characters per chunk
+#define RESUME_TIMEOUT      120     // Seconds a session survives without progress
+#define RESUME_BACKOFF_MS   100     // First reconnect delay, doubled each time
+#define RESUME_BACKOFF_MAX  5000    // Longest reconnect delay
+#define RESUME_BUSY         -2      // Session ID answer of a full server
+
+
+// *****************************************************************************
+//
+// int resumeInit(void)
+//
+//    Entry:   None.
+//
+//    Exit:    Returns 0 on success, -1 on failure.
+//
+//    Purpose: Set up the session table in memory shared by the server and
+//    every child it forks. Call once in the server before accepting.
+//
+// *****************************************************************************
+//
+int resumeInit(void);
+
+
+// *****************************************************************************
+//
+// void resumeServe(int *cli, long svrType)
+//
+//    Entry:   int *cli
+//                Client connection that has just sent OP_RESUME
+//             long svrType
+//                OTP_ENCODE or OTP_DECODE
+//
+//    Exit:    None. The session outlives the connection until it is
+//             finished or times out.
+//
+//    Purpose: Server side of a resumable session.
+//
+// *****************************************************************************
+//
+void resumeServe(int *cli, long svrType);
+
+
+// *****************************************************************************
+//
+// long resumeRequest(struct otpPool *pool, char *inContent, long inSize,
+//                    char *keyContent, long keySize, char *outContent)
+//
+//    Entry:   Same as poolRequest().
+//
+//    Exit:    Number of result characters received, -1 on failure.
+//
+//    Purpose: Client side of a resumable session. Connection failures are
+//    retried with backoff, resuming where the server's acknowledged
+//    offset and ours agree (in a new session where they don't), until
+//    RESUME_TIMEOUT seconds pass without progress.
+//
+// *****************************************************************************
+//
+long resumeRequest(struct otpPool *pool, char *inContent, long inSize,
+                   char *keyContent, long keySize, char *outContent);
+
+
+#endif
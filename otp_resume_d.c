@@ -0,0 +1,344 @@
+//
+// *****************************************************************************
+//
+// Author:    Erik Ratcliffe
+// Date:      June 5, 2015
+// Project:   Program 4 - OTP
+// Filename:  otp_resume_d.c
+// Class:     CS 344 (Spring 2015)
+//
+//
+// Overview:
+//    Server/client simulation of the classic "One-time Pad" encryption scheme.
+//
+//    This file contains the server side of resumable sessions (see
+//    otp_resume.h for the protocol). The client side is in otp_resume.c.
+//
+// *****************************************************************************
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/random.h>
+#include <sys/types.h>
+#include "otp.h"
+#include "otp_admit.h"
+#include "otp_buf.h"
+#include "otp_deadline.h"
+#include "otp_resume.h"
+#include "otp_reuse.h"
+#include "otp_sched.h"
+#include "otp_stats.h"
+#include "otp_trace.h"
+
+
+// One remembered session. The table lives in shared memory because each
+// connection is served by a different child process.
+//
+struct resumeSession
+{
+    long   id;        // Session ID (0 = slot unused)
+    long   total;     // Input size the session was opened with
+    long   acked;     // Offset the client has acknowledged
+    time_t touched;   // Last time the session made progress
+    pid_t  owner;     // Child currently serving the session
+};
+
+
+struct resumeTable
+{
+    pthread_mutex_t lock;                                // Guards the table
+    struct resumeSession session[RESUME_MAX_SESSIONS];   // Session slots
+};
+
+
+static struct resumeTable *table = NULL; // Shared session table
+
+
+// *****************************************************************************
+//
+// int resumeInit(void)
+//
+// Purpose: Set up the shared session table.
+//
+// *****************************************************************************
+//
+int resumeInit(void)
+{
+    pthread_mutexattr_t attr; // Makes the lock work across processes
+
+    table = mmap(NULL, sizeof(*table), PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(table == MAP_FAILED)
+    {
+        table = NULL;
+        return -1;
+    }
+
+    // Robust, so a child killed while holding the lock doesn't wedge
+    // every later session.
+    //
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&table->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+
+    return 0;
+}
+
+
+// *****************************************************************************
+//
+// static void resumeLock(void)
+//
+// Purpose: Take the table lock, recovering it if its holder died.
+//
+// *****************************************************************************
+//
+static void resumeLock(void)
+{
+    if(pthread_mutex_lock(&table->lock) == EOWNERDEAD)
+    {
+        pthread_mutex_consistent(&table->lock);
+    }
+}
+
+
+// *****************************************************************************
+//
+// static struct resumeSession *resumeOpen(long id, long total)
+//
+// Purpose: Find (id != 0) or create (id == 0) a session and make the
+// calling child its owner. Call with the table locked. Returns NULL if the
+// session is unknown, expired or was opened for a different size, or if
+// the table is full.
+//
+// *****************************************************************************
+//
+static struct resumeSession *resumeOpen(long id, long total)
+{
+    struct resumeSession *slot = NULL; // Session found or created
+    time_t now = time(NULL);           // Used to expire sessions
+    int    idx;                        // Loop index
+
+    for(idx = 0; idx < RESUME_MAX_SESSIONS; idx++)
+    {
+        // Expire sessions as we go.
+        //
+        if(table->session[idx].id != 0 &&
+           now - table->session[idx].touched > RESUME_TIMEOUT)
+        {
+            memset(&table->session[idx], 0, sizeof(table->session[idx]));
+        }
+
+        if(id != 0 && table->session[idx].id == id)
+        {
+            slot = &table->session[idx];
+        }
+        else if(id == 0 && slot == NULL && table->session[idx].id == 0)
+        {
+            slot = &table->session[idx];
+        }
+    }
+
+    if(slot == NULL)
+    {
+        return NULL;
+    }
+
+    if(id == 0)
+    {
+        // IDs only need to be hard to collide with, and to stay positive
+        // through sendNum().
+        //
+        do
+        {
+            if(getrandom(&slot->id, sizeof(slot->id), 0) != sizeof(slot->id))
+            {
+                slot->id = ((long)getpid() << 16) ^ (long)now;
+            }
+            slot->id &= 0x7fffffff;
+        } while(slot->id == 0);
+
+        slot->total = total;
+        slot->acked = 0;
+    }
+    else if(slot->total != total)
+    {
+        return NULL;
+    }
+
+    slot->touched = now;
+    slot->owner = getpid();
+
+    return slot;
+}
+
+
+// *****************************************************************************
+//
+// void resumeServe(int *cli, long svrType)
+//
+// Purpose: Server side of a resumable session.
+//
+// *****************************************************************************
+//
+void resumeServe(int *cli, long svrType)
+{
+    struct resumeSession *slot;  // Our session
+    long   id, total;            // Session ID and input size from the client
+    long   offset, len;          // Current chunk
+    long   acked;                // Offset to report back
+    long   expect;               // Offset the next chunk must have (-1 = any,
+                                 // for the first chunk of a new session)
+    long   delay;                // Retry delay if we're full
+    long   held;                 // Characters admitted (one chunk's worth)
+    int    err = STAT_ERR_IO;    // What went wrong, if the session stops early
+    char   *inChunk, *keyChunk;  // Chunk buffers
+
+    if(table == NULL || recvLong64(cli, &id) == -1 || recvLong64(cli, &total) == -1)
+    {
+        return;
+    }
+
+    // A full server says so before touching the session, which stays as
+    // it was for when the client comes back. Only the chunk we hold at a
+    // time counts against the limit.
+    //
+    held = (total > RESUME_CHUNK) ? RESUME_CHUNK : total;
+    if((delay = admitBytes(held)) != 0)
+    {
+        statsCount(STAT_ERR_BUSY, 1);
+        sendLong64(cli, RESUME_BUSY);
+        sendLong64(cli, delay);
+        return;
+    }
+
+    resumeLock();
+    slot = resumeOpen(id, total);
+    expect = (id != 0 && slot != NULL) ? slot->acked : -1;
+    id = (slot != NULL) ? slot->id : -1;
+    acked = (slot != NULL) ? slot->acked : -1;
+    pthread_mutex_unlock(&table->lock);
+
+    if(slot == NULL)
+    {
+        statsCount(STAT_ERR_PROTO, 1);
+    }
+    if(sendLong64(cli, id) == -1 || sendLong64(cli, acked) == -1 || slot == NULL)
+    {
+        admitDone(held);
+        return;
+    }
+
+    traceRequest("resume", total);
+
+    inChunk = bufGet(RESUME_CHUNK);
+    keyChunk = bufGet(RESUME_CHUNK);
+    if(inChunk == NULL || keyChunk == NULL)
+    {
+        statsCount(STAT_ERR_BUSY, 1);
+        admitDone(held);
+        bufPut(inChunk);
+        bufPut(keyChunk);
+        return;
+    }
+
+    // A large session takes turns with other large requests for the
+    // codec, a chunk at a time. Chunks go both ways, so the rest of the
+    // session counts as payload.
+    //
+    schedOpen(cli, total);
+    deadlinePhase(PHASE_PAYLOAD);
+
+    while(recvLong64(cli, &offset) == 0 && recvLong64(cli, &len) == 0)
+    {
+        traceMark(TRACE_HEADER);
+
+        // A chunk at `offset` acknowledges everything before it, so it
+        // has to follow on from the last one (or, coming back, from the
+        // last acknowledged). If the client has already reconnected
+        // elsewhere, this connection is stale and we bow out.
+        //
+        resumeLock();
+        if(slot->id != id || slot->owner != getpid() ||
+           (expect != -1 && offset != expect) ||
+           offset < 0 || len < 0 || len > RESUME_CHUNK || offset + len > total)
+        {
+            pthread_mutex_unlock(&table->lock);
+            err = STAT_ERR_PROTO;
+            break;
+        }
+        slot->acked = offset;
+        slot->touched = time(NULL);
+        expect = offset + len;
+        if(len == 0 && offset == total)
+        {
+            memset(slot, 0, sizeof(*slot)); // Finished, forget it
+            pthread_mutex_unlock(&table->lock);
+            err = -1;
+            break;
+        }
+        pthread_mutex_unlock(&table->lock);
+
+        if(recvBuf(cli, inChunk, len) == -1)
+        {
+            break;
+        }
+        traceMark(TRACE_INPUT);
+        if(recvBuf(cli, keyChunk, len) == -1)
+        {
+            break;
+        }
+        traceMark(TRACE_KEY);
+
+        // Key used before is refused. The client can't be told mid
+        // session, so it reconnects until it runs out of time.
+        //
+        if(svrType == OTP_ENCODE && reuseCheck(inChunk, keyChunk, len) == REUSE_FOUND)
+        {
+            err = STAT_ERR_REUSE;
+            break;
+        }
+
+        // Only the codec takes a slot; the socket calls above and below
+        // run outside it, so a slow client doesn't hold one.
+        //
+        schedBegin(len);
+        traceMark(TRACE_QUEUE);
+        if(svrType == OTP_ENCODE)
+        {
+            encodeBuf(inChunk, keyChunk, len);
+        }
+        else
+        {
+            decodeBuf(inChunk, keyChunk, len);
+        }
+        traceMark(TRACE_CODEC);
+        schedEnd();
+
+        if(sendBuf(cli, inChunk, len) == -1)
+        {
+            break;
+        }
+        traceMark(TRACE_SEND);
+    }
+
+    if(err != -1)
+    {
+        statsCount(err, 1);
+    }
+
+    schedClose();
+    admitDone(held);
+
+    bufPut(inChunk);
+    bufPut(keyChunk);
+}
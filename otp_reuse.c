@@ -0,0 +1,456 @@
+//
+// *****************************************************************************
+//
+// Author:    Erik Ratcliffe
+// Date:      June 5, 2015
+// Project:   Program 4 - OTP
+// Filename:  otp_reuse.c
+// Class:     CS 344 (Spring 2015)
+//
+//
+// Overview:
+//    Server/client simulation of the classic "One-time Pad" encryption scheme.
+//
+//    This file contains the encoding server's pad reuse index (see
+//    otp_reuse.h).
+//
+// *****************************************************************************
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "otp_reuse.h"
+#include "otp_stats.h"
+
+
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23               // Linux 5.14, newer than some headers
+#endif
+
+#define REUSE_HEAD     4096                  // Header page ahead of the tables
+#define REUSE_PAGE     4096                  // Bloom blocks and buckets sharing a page
+#define REUSE_BLOCKS   32                    // Bloom blocks a page (first half)
+#define REUSE_BUCKETS  16                    // Exact table buckets a page (second half)
+#define REUSE_ODD      0x9e3779b97f4a7c15UL  // Odd multiplier to stir a hash
+#define REUSE_WAYS     16                    // Entries per exact table bucket
+#define REUSE_AHEAD    8                     // Kept hashes fetched ahead of use
+#define REUSE_PREFAULT 16384                 // Messages this long map the whole
+                                             // index in one go
+
+
+// Start of the index file.
+//
+struct reuseHead
+{
+    char   magic[8];       // REUSE_MAGIC
+    long   pages;          // REUSE_PAGE pages of tables
+};
+
+
+// A kept hash on its way into the tables.
+//
+struct reusePending
+{
+    uint64_t *block;       // Its Bloom block
+    uint64_t *bucket;      // Its exact table bucket
+    uint64_t bits;         // Its Bloom bits, 6 bits each
+    uint64_t pick;         // Picks its page, block, bucket and victim
+    uint64_t entry;        // Exact table entry
+};
+
+
+static struct reuseHead *head = NULL;  // Mapped index, NULL if off
+static uint64_t *pages;                // Tables, REUSE_PAGE bytes a page
+static long     mapped;                // Size of the mapping
+static int      faulted = 0;           // Child: whole index mapped in already?
+
+
+// *****************************************************************************
+//
+// static uint64_t reuseMix(uint64_t x)
+//
+// Purpose: Spread a hash's bits over the whole word (splitmix64).
+//
+// *****************************************************************************
+//
+static uint64_t reuseMix(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9UL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebUL;
+    x ^= x >> 31;
+
+    return x;
+}
+
+
+// *****************************************************************************
+//
+// int reuseInit(char *path)
+//
+// Purpose: Map the index, creating it if need be.
+//
+// *****************************************************************************
+//
+int reuseInit(char *path)
+{
+    struct reuseHead fresh;  // Header of a new file
+    struct stat info;        // Size of an existing file
+    long   size;             // Size the header calls for
+    int    fd;               // Index file
+
+    if(path == NULL)
+    {
+        return 0;
+    }
+
+    if((fd = open(path, O_RDWR | O_CREAT, 0600)) == -1 || fstat(fd, &info) == -1)
+    {
+        return -1;
+    }
+
+    // A new file gets all its blocks up front. A sparse one would have
+    // the filesystem allocating a block the first time each page is
+    // written, in the middle of a request.
+    //
+    if(info.st_size == 0)
+    {
+        memset(&fresh, 0, sizeof(fresh));
+        memcpy(fresh.magic, REUSE_MAGIC, sizeof(fresh.magic));
+        fresh.pages = REUSE_SIZE / REUSE_PAGE;
+        info.st_size = REUSE_HEAD + REUSE_SIZE;
+        if((errno = posix_fallocate(fd, 0, info.st_size)) != 0 ||
+           pwrite(fd, &fresh, sizeof(fresh), 0) != sizeof(fresh))
+        {
+            close(fd);
+            return -1;
+        }
+    }
+
+    // Every page is read in now, so lookups never wait on the disk.
+    //
+    head = mmap(NULL, info.st_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                fd, 0);
+    close(fd);
+    if(head == MAP_FAILED)
+    {
+        head = NULL;
+        return -1;
+    }
+
+    size = REUSE_HEAD + head->pages * REUSE_PAGE;
+    if(memcmp(head->magic, REUSE_MAGIC, sizeof(head->magic)) != 0 ||
+       head->pages <= 0 || size != info.st_size)
+    {
+        munmap(head, info.st_size);
+        head = NULL;
+        errno = EINVAL;
+        return -1;
+    }
+
+    pages = (uint64_t *)((char *)head + REUSE_HEAD);
+    mapped = info.st_size;
+
+    return 0;
+}
+
+
+// *****************************************************************************
+//
+// int reuseOn(void)
+//
+// Purpose: Is the index in use?
+//
+// *****************************************************************************
+//
+int reuseOn(void)
+{
+    return head != NULL;
+}
+
+
+// *****************************************************************************
+//
+// static long reuseRange(uint64_t hash, long count)
+//
+// Purpose: Scale the top half of a hash to 0 .. count - 1, with a multiply
+// rather than a much slower divide.
+//
+// *****************************************************************************
+//
+static long reuseRange(uint64_t hash, long count)
+{
+    return (long)(((hash >> 32) * (uint64_t)count) >> 32);
+}
+
+
+// *****************************************************************************
+//
+// static void reusePlace(struct reusePending *pend, uint64_t keyHash,
+//                        uint64_t inHash)
+//
+// Purpose: Work out where a kept hash goes in both tables, and start
+// fetching those cache lines. Its Bloom block and its bucket are on the
+// same page, so each window costs a child one page to map, not two.
+//
+// *****************************************************************************
+//
+static void reusePlace(struct reusePending *pend, uint64_t keyHash,
+                       uint64_t inHash)
+{
+    uint64_t *page;  // Page holding both
+
+    // The page comes from the top of pick, the block, bucket and victim
+    // from its low bits, and the entry from the top of keyHash, so none
+    // of them tells anything about the others.
+    //
+    pend->bits = keyHash;
+    pend->pick = reuseMix(keyHash);
+    page = pages + reuseRange(pend->pick, head->pages) * (REUSE_PAGE / 8);
+    pend->block = page + (pend->pick % REUSE_BLOCKS) * 8;
+    pend->bucket = page + REUSE_PAGE / 16 +
+                   ((pend->pick / REUSE_BLOCKS) % REUSE_BUCKETS) * REUSE_WAYS;
+    pend->entry = ((keyHash >> 24) << 24) | (inHash & 0xffffff);
+    pend->entry = (pend->entry == 0) ? 1 : pend->entry;
+
+    __builtin_prefetch(pend->block, 1);
+    __builtin_prefetch(pend->bucket, 1);
+    __builtin_prefetch(pend->bucket + 8, 1);
+}
+
+
+// *****************************************************************************
+//
+// static int reuseLookup(struct reusePending *pend)
+//
+// Purpose: Look one kept hash up in both tables, without changing either.
+//
+// *****************************************************************************
+//
+static int reuseLookup(struct reusePending *pend)
+{
+    uint64_t have;           // Entry already in the bucket
+    uint64_t bit;            // Bloom bit in one word
+    int      seen = 1;       // All Bloom bits already set?
+    int      idx;            // Loop index
+
+    for(idx = 0; idx < 8; idx++)
+    {
+        bit = 1UL << ((pend->bits >> (6 * idx)) & 63);
+        seen &= (__atomic_load_n(&pend->block[idx], __ATOMIC_RELAXED) & bit) != 0;
+    }
+
+    // Entries fill a bucket from the front and are never removed, so the
+    // first empty one ends the search.
+    //
+    for(idx = 0; idx < REUSE_WAYS; idx++)
+    {
+        have = __atomic_load_n(&pend->bucket[idx], __ATOMIC_RELAXED);
+        if(have == 0)
+        {
+            break;
+        }
+        if((have >> 24) == (pend->entry >> 24))
+        {
+            return (have == pend->entry) ? REUSE_OK : REUSE_FOUND;
+        }
+    }
+
+    return seen ? REUSE_SUSPECT : REUSE_OK;
+}
+
+
+// *****************************************************************************
+//
+// static int reuseRecord(struct reusePending *pend)
+//
+// Purpose: Add one kept hash to both tables. Lock free: every word is read
+// and written whole.
+//
+// *****************************************************************************
+//
+static int reuseRecord(struct reusePending *pend)
+{
+    uint64_t have;           // Entry already in the bucket
+    uint64_t bit;            // Bloom bit in one word
+    uint64_t word;           // Bloom word it goes in
+    int      idx;            // Loop index
+
+    for(idx = 0; idx < 8; idx++)
+    {
+        bit = 1UL << ((pend->bits >> (6 * idx)) & 63);
+        word = __atomic_load_n(&pend->block[idx], __ATOMIC_RELAXED);
+        if(!(word & bit))
+        {
+            // Only write when something changes, so a cache line
+            // everyone has already set stays shared. A plain store
+            // rather than a locked OR: a bit another child sets in the
+            // same word at the same instant can be lost, which at worst
+            // leaves an old reuse unreported, and it saves half the
+            // cost of a new window.
+            //
+            __atomic_store_n(&pend->block[idx], word | bit, __ATOMIC_RELAXED);
+        }
+    }
+
+    for(idx = 0; idx < REUSE_WAYS; idx++)
+    {
+        have = __atomic_load_n(&pend->bucket[idx], __ATOMIC_RELAXED);
+        if(have == 0)
+        {
+            break;
+        }
+        if((have >> 24) == (pend->entry >> 24))
+        {
+            return REUSE_OK; // Already kept (a resend)
+        }
+    }
+
+    idx = (idx < REUSE_WAYS) ? idx : (int)((pend->pick >> 9) % REUSE_WAYS);
+    __atomic_store_n(&pend->bucket[idx], pend->entry, __ATOMIC_RELAXED);
+
+    return REUSE_OK;
+}
+
+
+// *****************************************************************************
+//
+// static uint64_t reuseHash(char *chars)
+//
+// Purpose: Hash REUSE_GRAM characters.
+//
+// *****************************************************************************
+//
+static uint64_t reuseHash(char *chars)
+{
+    uint64_t word[2];  // The characters
+
+    memcpy(word, chars, REUSE_GRAM);
+
+    return reuseMix((word[0] * REUSE_ODD) ^ word[1]);
+}
+
+
+// *****************************************************************************
+//
+// static int reuseScan(char *in, char *key, long len,
+//                      int (*visit)(struct reusePending *pend))
+//
+// Purpose: Hand every kept window of a message to visit(), stopping at the
+// first REUSE_FOUND. Returns the worst answer.
+//
+// *****************************************************************************
+//
+static int reuseScan(char *in, char *key, long len,
+                     int (*visit)(struct reusePending *pend))
+{
+    struct reusePending pend[REUSE_AHEAD]; // Kept hashes being fetched
+    char     *anchor;              // Next anchor character
+    char     *last = key + len;    // End of the key
+    long     at;                   // First character of the window kept
+    long     queued = 0;           // Windows kept so far
+    long     done = 0;             // Of those, visited
+    int      result = REUSE_OK;    // Worst answer so far
+    int      rc;                   // Answer for one window
+
+    // The first window is always kept, which catches a key file used
+    // again from the top however short the message.
+    //
+    reusePlace(&pend[queued++], reuseHash(key), reuseHash(in));
+
+    // memchr() finds the anchors many characters at a time, so the scan
+    // costs next to nothing next to the lookups.
+    //
+    anchor = key + REUSE_GRAM - 1;
+    while(anchor < last && result != REUSE_FOUND &&
+          (anchor = memchr(anchor, REUSE_ANCHOR, last - anchor)) != NULL)
+    {
+        // Visits trail by REUSE_AHEAD windows, so their cache misses
+        // overlap.
+        //
+        if(queued - done == REUSE_AHEAD)
+        {
+            rc = visit(&pend[done++ % REUSE_AHEAD]);
+            result = (rc == REUSE_FOUND || result == REUSE_OK) ? rc : result;
+        }
+        at = anchor + 1 - REUSE_GRAM - key;
+        reusePlace(&pend[queued++ % REUSE_AHEAD], reuseHash(key + at),
+                   reuseHash(in + at));
+        anchor++;
+    }
+
+    while(done < queued && result != REUSE_FOUND)
+    {
+        rc = visit(&pend[done++ % REUSE_AHEAD]);
+        result = (rc == REUSE_FOUND || result == REUSE_OK) ? rc : result;
+    }
+
+    return result;
+}
+
+
+// *****************************************************************************
+//
+// int reuseCheck(char *in, char *key, long len)
+//
+// Purpose: Look the key up in the index and add it.
+//
+// *****************************************************************************
+//
+int reuseCheck(char *in, char *key, long len)
+{
+    int      result;               // Worst answer for the message
+
+    // A window shorter than REUSE_GRAM would match far too much pad by
+    // chance, so messages that short can't be checked.
+    //
+    if(head == NULL || len < REUSE_GRAM)
+    {
+        return REUSE_OK;
+    }
+
+    // A child starts out with none of the index mapped, and a write
+    // fault on a file page is slow (the filesystem is told each page is
+    // about to be dirtied). A long message touches most pages anyway, so
+    // have them all mapped writable with one call rather than one fault
+    // at a time. Kernels before 5.14 don't know MADV_POPULATE_WRITE; they
+    // just fault as they go.
+    //
+    if(!faulted && len >= REUSE_PREFAULT)
+    {
+        madvise(head, mapped, MADV_POPULATE_WRITE);
+        faulted = 1;
+    }
+
+    // Every window is looked up before any is added, so a refused
+    // message leaves nothing behind: its key is still unused, and
+    // keeping part of it would get the legitimate first use refused.
+    // The second pass finds its cache lines where the first left them.
+    //
+    result = reuseScan(in, key, len, reuseLookup);
+    if(result != REUSE_FOUND)
+    {
+        reuseScan(in, key, len, reuseRecord);
+    }
+
+    if(result == REUSE_SUSPECT)
+    {
+        statsCount(STAT_REUSE_SUSPECT, 1);
+    }
+    if(result != REUSE_OK)
+    {
+        fprintf(stderr, "Pad reuse %s: %ld characters of key (pid %d)\n",
+                (result == REUSE_FOUND) ? "refused" : "suspected", len, getpid());
+    }
+
+    return result;
+}
@@ -0,0 +1,151 @@
+//
+// *****************************************************************************
+//
+// Author:    Erik Ratcliffe
+// Date:      June 5, 2015
+// Project:   Program 4 - OTP
+// Filename:  otp_reuse.h
+// Class:     CS 344 (Spring 2015)
+//
+//
+// Overview:
+//    Server/client simulation of the classic "One-time Pad" encryption scheme.
+//
+//    This file contains the definitions and function prototypes for the
+//    encoding server's pad reuse index. Encoding two messages with the
+//    same stretch of pad gives the pad away, so the server remembers what
+//    key it has already used and refuses to use it again.
+//
+//    Keys arrive as bare characters, with no pad name or offset, so the
+//    index goes by content. A pad is random, so any REUSE_GRAM characters
+//    of it are unique to that spot in that pad. The server keeps the
+//    window of REUSE_GRAM key characters ending at each anchor: every
+//    REUSE_ANCHOR in the key, about one character in 27 of a keygen pad.
+//    Anchors depend on the key alone, so the same stretch of pad is
+//    anchored at the same spots wherever it starts in a message. A reused
+//    stretch of 100 characters holds a whole anchored window about 96
+//    times in 100, one of 200 almost always. The first REUSE_GRAM
+//    characters of every message are kept too. Each kept window is paired
+//    with a hash of the input characters at the same spot. Only whole
+//    windows are ever kept or looked up, so a message shorter than
+//    REUSE_GRAM isn't checked at all; shorter windows would turn up in
+//    unrelated keys far too often.
+//
+//    The kept windows go to two tables in one memory mapped file (-K), so
+//    they survive restarts and every child sees them. The file is
+//    REUSE_SIZE bytes (48M) of 4K pages, allocated when it's created and
+//    read into memory whole when the server starts. Half of each page is
+//    Bloom filter and half exact table, and a window's block and bucket
+//    are on the same page:
+//
+//    - a blocked Bloom filter, remembering every hash ever kept. Each hash
+//      sets one bit in each of the eight words of one 64 byte block, so a
+//      lookup touches one cache line.
+//    - an exact table of recent hashes, 16 to a 128 byte bucket. Each
+//      entry holds 40 bits of the key hash and 24 of the input hash in
+//      one word, so it's read and written without a lock. A full bucket
+//      overwrites an entry chosen by the hash.
+//
+//    Key seen in the exact table with different input is reuse, and the
+//    request is refused. The same key with the same input is a resend
+//    (a retried or resumed request), which gives nothing away. A hash the
+//    Bloom filter knows but the exact table has forgotten could be old
+//    reuse or a false positive, so it's only counted and reported. The
+//    exact table holds about the last 80M characters of key; the Bloom
+//    filter stays useful for about 500M.
+//
+//    A message's windows are all looked up before any is added, so a
+//    refused message leaves no trace in either table. They are only
+//    compared with earlier messages, not with each other.
+//
+//    Checking is not cheap, which is why it's off unless asked for (-K).
+//    Each child has to map the pages it touches (a fork doesn't pass on
+//    mappings of a shared file), and a first write to a file page is a
+//    slow page fault: one page per anchor. A message of REUSE_PREFAULT
+//    characters or more maps the whole file in one call instead. Looking
+//    up and then adding means visiting every window twice, and for a
+//    long message the second visit misses the cache again. Measured with
+//    otp_bench -c 1 on a small VM, against the same requests without -K:
+//
+//    - 1000 characters: about 0.1 ms longer (0.5 ms in all, from 0.4);
+//    - 2M characters: about 22 ms longer (28 ms, from 6), or about 11 ns
+//      a character, nearly all of it cache misses in the tables.
+//
+//    Leave it off where that matters more than catching a reused pad.
+//
+// *****************************************************************************
+//
+
+#ifndef OTP_REUSE_H
+#define OTP_REUSE_H
+
+
+#define REUSE_GRAM     16                // Characters hashed together
+#define REUSE_ANCHOR   'Q'               // Key character a kept window ends on
+#define REUSE_SIZE     (48L << 20)       // Table bytes in a new file
+#define REUSE_MAGIC    "OTPREUS2"        // Start of the index file
+
+#define REUSE_OK       0                 // Key not used before
+#define REUSE_SUSPECT  1                 // Key possibly used before
+#define REUSE_FOUND    -1                // Key used before with other input
+
+
+// *****************************************************************************
+//
+// int reuseInit(char *path)
+//
+//    Entry:   char *path
+//                Index file, created if missing (NULL leaves the index off)
+//
+//    Exit:    Returns 0 on success, -1 if the file can't be opened, created
+//             or mapped, or isn't an index.
+//
+//    Purpose: Map the index. Call once in the encoding server before
+//    accepting.
+//
+// *****************************************************************************
+//
+int reuseInit(char *path);
+
+
+// *****************************************************************************
+//
+// int reuseOn(void)
+//
+//    Entry:   None.
+//
+//    Exit:    1 if the index is in use, 0 if not.
+//
+//    Purpose: Tell whether a message has to be held back until all of it
+//    is here, so it can be checked in one piece.
+//
+// *****************************************************************************
+//
+int reuseOn(void);
+
+
+// *****************************************************************************
+//
+// int reuseCheck(char *in, char *key, long len)
+//
+//    Entry:   char *in
+//                Input characters, not yet encoded
+//             char *key
+//                Key characters lined up with in
+//             long len
+//                Number of characters
+//
+//    Exit:    REUSE_OK, REUSE_SUSPECT (counted) or REUSE_FOUND, either of
+//             the last two reported on stderr. Always REUSE_OK with the
+//             index off.
+//
+//    Purpose: Look the key up in the index and add it, unless it turns
+//    out to be reuse: then nothing is added. Call once per message, with
+//    all of it: windows that would straddle two calls are never kept.
+//
+// *****************************************************************************
+//
+int reuseCheck(char *in, char *key, long len);
+
+
+#endif
@@ -0,0 +1,438 @@
+//
+// *****************************************************************************
+//
+// Author:    Erik Ratcliffe
+// Date:      June 5, 2015
+// Project:   Program 4 - OTP
+// Filename:  otp_sched.c
+// Class:     CS 344 (Spring 2015)
+//
+//
+// Overview:
+//    Server/client simulation of the classic "One-time Pad" encryption scheme.
+//
+//    This file contains the server's request scheduler (see otp_sched.h).
+//
+// *****************************************************************************
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include "otp_deadline.h"
+#include "otp_sched.h"
+
+
+// One large request.
+//
+struct schedEntry
+{
+    pid_t  pid;       // Child serving the request (0 = entry unused)
+    int    weight;    // Client weight
+    int    waiting;   // Set while a slice waits for a slot
+    int    running;   // Set while a slice holds a slot
+    double finish;    // Virtual finish tag of the latest slice
+};
+
+
+struct schedTable
+{
+    pthread_mutex_t lock;           // Guards the table
+    pthread_cond_t  wake;           // Signalled when a slot frees up
+    int    slots;                   // Large slices that may run at once
+    int    running;                 // Large slices running now
+    long   small;                   // Small request limit
+    double vtime;                   // Virtual time: start tag of the last grant
+    struct schedEntry entry[SCHED_MAX]; // Large requests
+};
+
+
+// Per-client weights. Set before the server forks, so every child has a
+// copy and they needn't be shared.
+//
+struct schedClient
+{
+    struct in_addr addr;  // Client address
+    int    weight;        // Its weight
+};
+
+
+static struct schedTable *table = NULL;                // Shared table
+static struct schedClient client[SCHED_MAX_WEIGHTS];   // Client weights
+static int    numClients = 0;                          // Entries in client[]
+static struct schedEntry *mine = NULL;                 // Calling child's entry
+
+
+// *****************************************************************************
+//
+// int schedInit(int slots, long small)
+//
+// Purpose: Set up the shared scheduler table.
+//
+// *****************************************************************************
+//
+int schedInit(int slots, long small)
+{
+    pthread_mutexattr_t mattr;  // Makes the lock work across processes
+    pthread_condattr_t  cattr;  // Same for the condition variable
+
+    table = mmap(NULL, sizeof(*table), PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(table == MAP_FAILED)
+    {
+        table = NULL;
+        return -1;
+    }
+
+    if(slots <= 0)
+    {
+        slots = (int)sysconf(_SC_NPROCESSORS_ONLN) - 1;
+    }
+    table->slots = (slots < 1) ? 1 : slots;
+    table->small = (small > 0) ? small : SCHED_SMALL;
+
+    // Robust, so a child killed while holding the lock doesn't wedge the
+    // scheduler.
+    //
+    pthread_mutexattr_init(&mattr);
+    pthread_mutexattr_setpshared(&mattr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&mattr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&table->lock, &mattr);
+    pthread_mutexattr_destroy(&mattr);
+
+    pthread_condattr_init(&cattr);
+    pthread_condattr_setpshared(&cattr, PTHREAD_PROCESS_SHARED);
+    pthread_condattr_setclock(&cattr, CLOCK_MONOTONIC);
+    pthread_cond_init(&table->wake, &cattr);
+    pthread_condattr_destroy(&cattr);
+
+    return 0;
+}
+
+
+// *****************************************************************************
+//
+// int schedWeight(char *spec)
+//
+// Purpose: Give requests from one client address a weight.
+//
+// *****************************************************************************
+//
+int schedWeight(char *spec)
+{
+    char   addr[INET_ADDRSTRLEN];  // Address part of the spec
+    char   *equals;                // Separates address from weight
+    int    weight;                 // Weight part of the spec
+
+    if(numClients == SCHED_MAX_WEIGHTS || (equals = strchr(spec, '=')) == NULL ||
+       equals - spec >= (long)sizeof(addr))
+    {
+        return -1;
+    }
+
+    snprintf(addr, sizeof(addr), "%.*s", (int)(equals - spec), spec);
+    weight = atoi(equals + 1);
+    if(weight < 1 || weight > 1000 ||
+       inet_pton(AF_INET, addr, &client[numClients].addr) != 1)
+    {
+        return -1;
+    }
+
+    client[numClients++].weight = weight;
+
+    return 0;
+}
+
+
+// *****************************************************************************
+//
+// static void schedLock(void)
+//
+// Purpose: Take the table lock, recovering it if its holder died.
+//
+// *****************************************************************************
+//
+static void schedLock(void)
+{
+    if(pthread_mutex_lock(&table->lock) == EOWNERDEAD)
+    {
+        pthread_mutex_consistent(&table->lock);
+    }
+}
+
+
+// *****************************************************************************
+//
+// void schedTune(int *slots, long *small)
+//
+// Purpose: Change the slot count and small request limit at runtime.
+//
+// *****************************************************************************
+//
+void schedTune(int *slots, long *small)
+{
+    if(table == NULL)
+    {
+        *slots = 0;
+        *small = 0;
+        return;
+    }
+
+    schedLock();
+
+    if(*slots > 0)
+    {
+        table->slots = *slots;
+    }
+    if(*small > 0)
+    {
+        table->small = *small;
+    }
+    *slots = table->slots;
+    *small = table->small;
+
+    // Slices waiting for a slot look again, in case there are more now.
+    //
+    pthread_cond_broadcast(&table->wake);
+    pthread_mutex_unlock(&table->lock);
+}
+
+
+// *****************************************************************************
+//
+// int schedOpen(int *cli, long size)
+//
+// Purpose: Classify the calling child's request.
+//
+// *****************************************************************************
+//
+int schedOpen(int *cli, long size)
+{
+    struct sockaddr_in peer;          // Client address
+    socklen_t peerLen = sizeof(peer); // Size of peer
+    int weight = 1;  // Client weight
+    int idx;         // Loop index
+
+    if(table == NULL || size <= table->small)
+    {
+        return 0;
+    }
+    if(mine != NULL)
+    {
+        return 1;
+    }
+
+    if(getpeername(*cli, (struct sockaddr *)&peer, &peerLen) == -1)
+    {
+        peer.sin_addr.s_addr = 0;
+    }
+
+    for(idx = 0; idx < numClients; idx++)
+    {
+        if(client[idx].addr.s_addr == peer.sin_addr.s_addr)
+        {
+            weight = client[idx].weight;
+        }
+    }
+
+    // A request that can't get an entry runs unscheduled rather than
+    // being turned away.
+    //
+    schedLock();
+    for(idx = 0; idx < SCHED_MAX && mine == NULL; idx++)
+    {
+        if(table->entry[idx].pid == 0)
+        {
+            mine = &table->entry[idx];
+            memset(mine, 0, sizeof(*mine));
+            mine->pid = getpid();
+            mine->weight = weight;
+            mine->finish = table->vtime;
+        }
+    }
+    pthread_mutex_unlock(&table->lock);
+
+    return (mine != NULL);
+}
+
+
+// *****************************************************************************
+//
+// static int schedNext(void)
+//
+// Purpose: Check whether our waiting slice goes next: a slot is free and
+// no other waiting slice has a smaller finish tag. Call with the table
+// locked.
+//
+// *****************************************************************************
+//
+static int schedNext(void)
+{
+    int idx;  // Loop index
+
+    if(table->running >= table->slots)
+    {
+        return 0;
+    }
+
+    for(idx = 0; idx < SCHED_MAX; idx++)
+    {
+        if(table->entry[idx].pid != 0 && table->entry[idx].waiting &&
+           table->entry[idx].finish < mine->finish)
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+
+// *****************************************************************************
+//
+// void schedBegin(long len)
+//
+// Purpose: Wait for a slot and our turn before running a slice.
+//
+// *****************************************************************************
+//
+void schedBegin(long len)
+{
+    struct timespec until;  // When to re-check if nobody wakes us
+    double start;           // Virtual start tag of this slice
+
+    if(mine == NULL)
+    {
+        return;
+    }
+
+    schedLock();
+
+    // A request that has been idle (or is new) starts at the current
+    // virtual time rather than cashing in credit for the time it wasn't
+    // asking.
+    //
+    start = (mine->finish > table->vtime) ? mine->finish : table->vtime;
+    mine->finish = start + (double)len / mine->weight;
+    mine->waiting = 1;
+
+    // The timeout covers a waiter that died between being picked and
+    // taking its slot; the server cleans those up in schedReap(). Time
+    // spent waiting isn't the client's fault, so the idle and throughput
+    // limits don't see it.
+    //
+    while(!schedNext())
+    {
+        deadlineQueue(1);
+        clock_gettime(CLOCK_MONOTONIC, &until);
+        until.tv_nsec += SCHED_WAIT_MS * 1000000L;
+        if(until.tv_nsec >= 1000000000L)
+        {
+            until.tv_sec++;
+            until.tv_nsec -= 1000000000L;
+        }
+        if(pthread_cond_timedwait(&table->wake, &table->lock, &until) == EOWNERDEAD)
+        {
+            pthread_mutex_consistent(&table->lock);
+        }
+    }
+
+    deadlineQueue(0);
+    mine->waiting = 0;
+    mine->running = 1;
+    table->running++;
+    table->vtime = start;
+
+    pthread_mutex_unlock(&table->lock);
+}
+
+
+// *****************************************************************************
+//
+// void schedEnd(void)
+//
+// Purpose: Give back the slot taken by schedBegin().
+//
+// *****************************************************************************
+//
+void schedEnd(void)
+{
+    if(mine == NULL || !mine->running)
+    {
+        return;
+    }
+
+    schedLock();
+    mine->running = 0;
+    table->running--;
+    pthread_cond_broadcast(&table->wake);
+    pthread_mutex_unlock(&table->lock);
+}
+
+
+// *****************************************************************************
+//
+// void schedClose(void)
+//
+// Purpose: Drop the calling child's table entry.
+//
+// *****************************************************************************
+//
+void schedClose(void)
+{
+    if(mine == NULL)
+    {
+        return;
+    }
+
+    schedEnd();
+
+    schedLock();
+    memset(mine, 0, sizeof(*mine));
+    pthread_cond_broadcast(&table->wake);
+    pthread_mutex_unlock(&table->lock);
+
+    mine = NULL;
+}
+
+
+// *****************************************************************************
+//
+// void schedReap(pid_t pid)
+//
+// Purpose: Clean up after a child that died without calling schedClose().
+//
+// *****************************************************************************
+//
+void schedReap(pid_t pid)
+{
+    int idx;  // Loop index
+
+    if(table == NULL)
+    {
+        return;
+    }
+
+    schedLock();
+    for(idx = 0; idx < SCHED_MAX; idx++)
+    {
+        if(table->entry[idx].pid == pid)
+        {
+            if(table->entry[idx].running)
+            {
+                table->running--;
+            }
+            memset(&table->entry[idx], 0, sizeof(table->entry[idx]));
+            pthread_cond_broadcast(&table->wake);
+        }
+    }
+    pthread_mutex_unlock(&table->lock);
+}
@@ -0,0 +1,201 @@
+//
+// *****************************************************************************
+//
+// Author:    Erik Ratcliffe
+// Date:      June 5, 2015
+// Project:   Program 4 - OTP
+// Filename:  otp_sched.h
+// Class:     CS 344 (Spring 2015)
+//
+//
+// Overview:
+//    Server/client simulation of the classic "One-time Pad" encryption scheme.
+//
+//    This file contains the definitions and function prototypes for the
+//    server's request scheduler. Each connection is served by its own
+//    child, so without a scheduler a few huge requests compete for the
+//    CPUs on equal terms with small ones and drag out their latency.
+//
+//    Requests are classified by the size they announce:
+//
+//    - Small requests (up to the small limit) run on a reserved lane:
+//      they are never queued.
+//
+//    - Large requests are encoded or decoded a chunk (SCHED_CHUNK
+//      characters) at a time, and each chunk needs one of a fixed number
+//      of slots. A slot only covers the codec on a chunk already in
+//      memory, never a socket call, so a slow client can't hold one.
+//      Waiting chunks are granted in weighted fair queueing order: a
+//      chunk's virtual finish tag is its start tag plus its size over the
+//      client's weight, and the smallest tag goes next. A client with
+//      weight 2 gets twice the share of one with weight 1, and a new
+//      large request interleaves with ones already running instead of
+//      waiting for them. Time spent waiting doesn't count against the
+//      connection's idle and throughput limits (see otp_deadline.h).
+//
+//    The table lives in memory shared by the server and all its children.
+//
+// *****************************************************************************
+//
+
+#ifndef OTP_SCHED_H
+#define OTP_SCHED_H
+
+
+#include <sys/types.h>
+
+
+#define SCHED_MAX         256        // Large requests tracked at once
+#define SCHED_MAX_WEIGHTS 64         // Per-client weights (-w) a server keeps
+#define SCHED_SMALL       65536      // Default small request limit (characters)
+#define SCHED_CHUNK       (1024 * 1024) // Characters per large request slice
+#define SCHED_WAIT_MS     50         // Re-check interval while waiting for a slot
+
+
+// *****************************************************************************
+//
+// int schedInit(int slots, long small)
+//
+//    Entry:   int slots
+//                Chunks of large requests that may run at once (0 = one
+//                less than the number of online CPUs, leaving one for the
+//                small lane, but at least 1)
+//             long small
+//                Largest request that runs on the small lane (0 =
+//                SCHED_SMALL)
+//
+//    Exit:    Returns 0 on success, -1 on failure.
+//
+//    Purpose: Set up the shared scheduler table. Call once in the server
+//    before accepting.
+//
+// *****************************************************************************
+//
+int schedInit(int slots, long small);
+
+
+// *****************************************************************************
+//
+// int schedWeight(char *spec)
+//
+//    Entry:   char *spec
+//                "address=weight", e.g. "10.0.0.7=4"
+//
+//    Exit:    Returns 0 on success, -1 if the spec is bad or the weight
+//             list is full.
+//
+//    Purpose: Give requests from one client address a weight (1-1000,
+//    default 1). Call before accepting.
+//
+// *****************************************************************************
+//
+int schedWeight(char *spec);
+
+
+// *****************************************************************************
+//
+// void schedTune(int *slots, long *small)
+//
+//    Entry:   int *slots, long *small
+//                New slot count and small request limit (<= 0 leaves
+//                either as it is)
+//
+//    Exit:    Both set to the values now in force.
+//
+//    Purpose: Server side: change the scheduler at runtime (see
+//    otp_ctl.h). Slices already running keep their slots; fewer slots
+//    only hold back the next ones.
+//
+// *****************************************************************************
+//
+void schedTune(int *slots, long *small);
+
+
+// *****************************************************************************
+//
+// int schedOpen(int *cli, long size)
+//
+//    Entry:   int *cli
+//                Client connection, whose address picks its weight
+//             long size
+//                Characters the request announced
+//
+//    Exit:    1 if the request is scheduled, 0 if it runs unscheduled.
+//
+//    Purpose: Classify the calling child's request. Large requests get an
+//    entry in the table; small ones (or any request when the table is
+//    full) make schedBegin() and schedEnd() no-ops. A child serving
+//    several requests at once (multiplexed streams) calls this for each;
+//    its large ones share one entry, and so one weight, and it should
+//    only wrap the slices of those that return 1.
+//
+// *****************************************************************************
+//
+int schedOpen(int *cli, long size);
+
+
+// *****************************************************************************
+//
+// void schedBegin(long len)
+//
+//    Entry:   long len
+//                Characters the next slice of work covers
+//
+//    Exit:    None. Returns once the slice may run.
+//
+//    Purpose: Wait for a slot and our turn before running a slice of a
+//    large request.
+//
+// *****************************************************************************
+//
+void schedBegin(long len);
+
+
+// *****************************************************************************
+//
+// void schedEnd(void)
+//
+//    Entry:   None.
+//
+//    Exit:    None.
+//
+//    Purpose: Give back the slot taken by schedBegin().
+//
+// *****************************************************************************
+//
+void schedEnd(void);
+
+
+// *****************************************************************************
+//
+// void schedClose(void)
+//
+//    Entry:   None.
+//
+//    Exit:    None.
+//
+//    Purpose: Drop the calling child's table entry when its request is done.
+//
+// *****************************************************************************
+//
+void schedClose(void);
+
+
+// *****************************************************************************
+//
+// void schedReap(pid_t pid)
+//
+//    Entry:   pid_t pid
+//                Child the server has just reaped
+//
+//    Exit:    None.
+//
+//    Purpose: Clean up after a child that died without calling
+//    schedClose(), giving back any slot it held.
+//
+// *****************************************************************************
+//
+void schedReap(pid_t pid);
+
+
+#endif
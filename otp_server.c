@@ -0,0 +1,913 @@
+//
+// *****************************************************************************
+//
+// Author:    Erik Ratcliffe
+// Date:      June 5, 2015
+// Project:   Program 4 - OTP
+// Filename:  otp_server.c
+// Class:     CS 344 (Spring 2015)
+//
+//
+// Overview:
+//    Server/client simulation of the classic "One-time Pad" encryption scheme.
+//
+//    This file contains the server code shared by the encoding and decoding
+//    servers. The two servers only differ in their server type, which
+//    decides which codec runs.
+//
+// *****************************************************************************
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <wait.h>
+#include <arpa/inet.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include "otp.h"
+#include "otp_admit.h"
+#include "otp_buf.h"
+#include "otp_ctl.h"
+#include "otp_deadline.h"
+#include "otp_handoff.h"
+#include "otp_log.h"
+#include "otp_mux.h"
+#include "otp_numa.h"
+#include "otp_pad.h"
+#include "otp_padgen.h"
+#include "otp_padkey.h"
+#include "otp_perf.h"
+#include "otp_probes.h"
+#include "otp_resume.h"
+#include "otp_reuse.h"
+#include "otp_sched.h"
+#include "otp_server.h"
+#include "otp_stats.h"
+#include "otp_trace.h"
+
+
+static char *padStore = NULL;  // Where generated pads are kept (-P)
+
+
+// *****************************************************************************
+//
+// static int recvSkip(int *cli, long len)
+//
+// Purpose: Receive and throw away len characters (a key's unused tail).
+//
+// *****************************************************************************
+//
+static int recvSkip(int *cli, long len)
+{
+    char scratch[BUF_SKIP];  // Where the characters go
+    long off, num;             // Current slice
+    int  rc = 0;               // Result of the last slice
+
+    for(off = 0; off < len && rc == 0; off += num)
+    {
+        num = (len - off > BUF_SKIP) ? BUF_SKIP : len - off;
+        rc = recvBuf(cli, scratch, num);
+    }
+
+    return rc;
+}
+
+
+// *****************************************************************************
+//
+// static void serveSingle(int *cli, long svrType, long inFileSize)
+//
+// Purpose: The classic protocol: one input file and one key file, each
+// size acknowledged, the result sent back in one piece.
+//
+// *****************************************************************************
+//
+static void serveSingle(int *cli, long svrType, long inFileSize)
+{
+    long  keyFileSize;             // Key file size
+    long  off, num;                // Current scheduler slice
+    long  delay;                   // Retry delay if we're full
+    int   rc = -1;                 // Result of the last transfer
+    char  busy[32];                // Busy or too large acknowledgement
+    char  *inContent = NULL;       // Read content of input file
+    char  *keyContent = NULL;      // Read content of key file
+
+    // The client checks the size before sending it, so a negative one
+    // isn't one of our clients. Nothing is taken on for it.
+    //
+    if(inFileSize < 0)
+    {
+        statsCount(STAT_ERR_PROTO, 1);
+        return;
+    }
+
+    // If taking on this input would put us over our limit, or there's no
+    // room left in the buffer pool for it, say so instead of acknowledging
+    // the size, before the client sends anything else. Only the first
+    // inFileSize characters of the key are used, so that's all the key
+    // buffer needs to hold, however long the key. A request the pool
+    // could never hold gets OTP_TOO_LARGE instead, since waiting won't
+    // help.
+    //
+    if(!bufFits(inFileSize + 1, 2))
+    {
+        statsCount(STAT_ERR_BUSY, 1);
+        snprintf(busy, sizeof(busy), "%-*s", (int)strlen(OTP_ACK_INSIZE), OTP_TOO_LARGE);
+        sendStr(cli, busy);
+        return;
+    }
+    if((delay = admitBytes(inFileSize)) == 0 &&
+            ((inContent = bufGet(inFileSize + 1)) == NULL ||
+             (keyContent = bufGet(inFileSize + 1)) == NULL))
+    {
+        bufPut(inContent);
+        admitDone(inFileSize);
+        delay = ADMIT_RETRY_MS;
+    }
+    if(delay != 0)
+    {
+        statsCount(STAT_ERR_BUSY, 1);
+        snprintf(busy, sizeof(busy), "%s %*ld", OTP_BUSY_ACK,
+                 (int)(strlen(OTP_ACK_INSIZE) - strlen(OTP_BUSY_ACK) - 1), delay);
+        sendStr(cli, busy);
+        return;
+    }
+
+    // Send acknowledgement of receiving input file size
+    //
+    sendStr(cli, OTP_ACK_INSIZE);
+
+    // Get the key file size from the client.
+    //
+    keyFileSize = recvNum(cli);
+
+    // Send acknowledgement of receiving key file size
+    //
+    sendStr(cli, OTP_ACK_KEYSIZE);
+
+    traceMark(TRACE_HEADER);
+    deadlinePhase(PHASE_PAYLOAD);
+
+    // The client checks the key is long enough before sending its size,
+    // so a short one isn't one of our clients either.
+    //
+    if(keyFileSize < inFileSize)
+    {
+        statsCount(STAT_ERR_KEY, 1);
+        admitDone(inFileSize);
+        bufPut(inContent);
+        bufPut(keyContent);
+        return;
+    }
+
+    // Small requests go straight through; large ones are encoded a
+    // slice at a time, taking turns for the CPU with the other large
+    // requests (see otp_sched.h). Only the codec waits its turn: a slot
+    // is never held across a socket call, where a slow client could
+    // keep it.
+    //
+    schedOpen(cli, inFileSize);
+
+    // Get the input file content, acknowledge it, then get the key file
+    // content, keeping only the first inFileSize characters of the key.
+    //
+    if(recvBuf(cli, inContent, inFileSize) == 0)
+    {
+        traceMark(TRACE_INPUT);
+        sendStr(cli, OTP_ACK_INPUT);
+
+        if((rc = recvBuf(cli, keyContent, inFileSize)) == 0 &&
+           (rc = recvSkip(cli, keyFileSize - inFileSize)) == 0)
+        {
+            traceMark(TRACE_KEY);
+
+            // Encode or decode the characters from the input file using
+            // the content from the key file, updating the input in place,
+            // and send each slice back as soon as it's done, after giving
+            // its slot back.
+            //
+            deadlinePhase(PHASE_RESPONSE);
+
+            // The reuse index looks at the whole key in one go (see
+            // otp_reuse.h), before any of the result goes out.
+            //
+            if(svrType == OTP_ENCODE &&
+               reuseCheck(inContent, keyContent, inFileSize) == REUSE_FOUND)
+            {
+                rc = -2; // Key used before: nothing is sent
+            }
+            traceMark(TRACE_CODEC);
+
+            for(off = 0; off < inFileSize && rc == 0; off += num)
+            {
+                num = (inFileSize - off > SCHED_CHUNK) ? SCHED_CHUNK : inFileSize - off;
+
+                schedBegin(num);
+                traceMark(TRACE_QUEUE);
+                if(svrType == OTP_DECODE)
+                {
+                    decodeBuf(inContent + off, keyContent + off, num);
+                }
+                else
+                {
+                    encodeBuf(inContent + off, keyContent + off, num);
+                }
+                traceMark(TRACE_CODEC);
+                schedEnd();
+
+                rc = sendBuf(cli, inContent + off, num);
+                traceMark(TRACE_SEND);
+            }
+        }
+    }
+
+    if(rc != 0)
+    {
+        statsCount((rc == -2) ? STAT_ERR_REUSE : STAT_ERR_IO, 1);
+    }
+
+    schedClose();
+    admitDone(inFileSize);
+
+    // Give the buffers back to the pool
+    //
+    bufPut(inContent);
+    inContent = 0;
+    bufPut(keyContent);
+    keyContent = 0;
+}
+
+
+// *****************************************************************************
+//
+// void serveClient(int *cli, long svrType)
+//
+// Purpose: Send the server type, then dispatch on the client's first
+// number.
+//
+// *****************************************************************************
+//
+void serveClient(int *cli, long svrType)
+{
+    long serverType = svrType; // Type of server (see OTP_ENCODE/OTP_DECODE)
+    long first;                // First number the client sends
+    long start = OTP_PROBE_CLOCK(request__end); // For the request-end probe
+
+    // Send the server type to the client. If the server and client
+    // are not matched (encoding server -> encoding client, for
+    // example), the client will close the connection.
+    //
+    sendNum(cli, &serverType);
+
+    // Classic clients start with the input file size. Anything negative
+    // is an opcode asking for one of the extended protocols.
+    //
+    first = recvNum(cli);
+
+    traceMark(TRACE_HANDSHAKE);
+    deadlinePhase(PHASE_HEADER);
+    OTP_PROBE2(request__start, getpid(), first);
+
+    switch(first)
+    {
+        case OP_MUX:
+            // Streams are counted as they open.
+            //
+            traceRequest("mux", 0);
+            deadlinePhase(PHASE_STREAM);
+            muxServe(cli, svrType);
+            break;
+
+        case OP_RESUME:
+            statsCount(STAT_REQ_RESUME, 1);
+            traceRequest("resume", 0);
+            resumeServe(cli, svrType);
+            break;
+
+        case OP_PADGEN:
+            statsCount(STAT_REQ_PADGEN, 1);
+            traceRequest("padgen", 0);
+            padgenServe(cli, padStore);
+            break;
+
+        case OP_PADKEY:
+            statsCount(STAT_REQ_PADKEY, 1);
+            traceRequest("padkey", 0);
+            padkeyServe(cli, svrType);
+            break;
+
+        default:
+            statsCount(STAT_REQ_CLASSIC, 1);
+            traceRequest("classic", first);
+            serveSingle(cli, svrType, first);
+            break;
+    }
+
+    OTP_PROBE3(request__end, getpid(), first, OTP_PROBE_SINCE(start));
+}
+
+
+// *****************************************************************************
+//
+// static void onChild(int sig)
+//
+// Purpose: SIGCHLD handler. Does nothing; its only job is to interrupt
+// the server's poll() so exited children are reaped promptly.
+//
+// *****************************************************************************
+//
+static void onChild(int sig)
+{
+}
+
+
+// *****************************************************************************
+//
+// static void onMoved(int sent, long bytes)
+//
+// Purpose: Socket hook (see otpSetHooks()): count the bytes, and as
+// progress against the connection's deadlines.
+//
+// *****************************************************************************
+//
+static void onMoved(int sent, long bytes)
+{
+    deadlineProgress(bytes);
+    statsCount(sent ? STAT_BYTES_OUT : STAT_BYTES_IN, bytes);
+}
+
+
+// *****************************************************************************
+//
+// int serverMain(int argc, char **argv, long svrType)
+//
+// Purpose: Set up the listening socket and run the accept loop.
+//
+// *****************************************************************************
+//
+int serverMain(int argc, char **argv, long svrType)
+{
+    int   sock, cli;               // Socket descriptors for parent and child
+    int   optval = 1;              // Holds option values for setsockopt()
+    pid_t pid;                     // Process ID
+    socklen_t myCliLen;            // Holds size of client socket info
+    struct sockaddr_in myServ, myCli; // Info describing client and server sockets
+    int   opt;                     // Current command line option
+    int   slots = 0;               // Large request slots (-j)
+    long  small = 0;               // Small request limit (-s)
+    int   maxConn = 0;             // Connection limit (-c)
+    long  maxBytes = 0;            // Characters in flight limit (-b)
+    int   backlog = ADMIT_BACKLOG; // listen() backlog (-q)
+    int   children = 0;            // Children serving connections now
+    long  delay;                   // Retry delay for a turned away client
+    char  *phases = NULL;          // Phase deadlines (-d)
+    int   idle = DEADLINE_IDLE;    // Idle limit (-i)
+    long  minRate = DEADLINE_RATE; // Minimum throughput (-r)
+    int   slot;                    // Deadline entry for a new child
+    int   idx;                     // Loop index
+    char  *statsPath = NULL;       // Stats socket (-S)
+    char  *ctlPath = NULL;         // Control socket (-C)
+    char  *handoffPath = NULL;     // Handoff socket (-U)
+    int   taken;                   // Listening socket taken over (-1 = none)
+    long  traceMs = -1;            // Slow request threshold (-T, -1 = off)
+    char  *logPath = NULL;         // Access log (-L)
+    char  *reusePath = NULL;       // Pad reuse index (-K)
+    long  logSize = 0;             // Access log size limit (-R)
+    long  eraseRate = 0;           // Used pad erase rate (-e)
+    long  budget = 0;              // Buffer pool size (-m)
+    int   placing = 0;             // Pin children near their NIC queue (-A)
+    int   counting = 0;            // Read hardware counters (-H)
+    int   nodes[NUMA_MAX_NODES];   // NUMA nodes found (-A)
+    int   nodeCount;               // How many
+    int   cpu;                     // CPU picked for a new child
+    int   status;                  // How a reaped child ended
+    int   statsSock;               // Listening stats socket (-1 = none)
+    int   ctlSock;                 // Listening control socket (-1 = none)
+    int   ready;                   // Result of poll()
+    struct pollfd pfd[5];          // Listening, stats, control and handoff sockets,
+                                   // and the server we took over from, for poll()
+    struct sigaction sa;           // SIGCHLD handler
+    struct otpHooks hooks;         // For the shared helpers
+
+    // Options, each described in full in the header named:
+    //
+    //    -A        pin children to CPUs, and their buffers to memory, on the
+    //              NUMA node the connection arrived on (otp_numa.h)
+    //    -C path   take commands to change most of these while running, on
+    //              a unix socket (otp_ctl.h)
+    //    -H        read hardware counters around the codec, receives and
+    //              sends (otp_perf.h)
+    //    -K file   keep the pad reuse index in file; encoding server only,
+    //              and it slows every request (otp_reuse.h)
+    //    -L file   write an access log (otp_log.h)
+    //    -P dir    keep a copy of every pad generated for clients
+    //              (OP_PADGEN), where requests can also take their key
+    //              from (OP_PADKEY) (otp_pad.h)
+    //    -R bytes  rotate the access log at this size
+    //    -S path   serve live metrics on a unix socket (otp_stats.h)
+    //    -T ms     trace requests that take at least this long (otp_trace.h)
+    //    -U path   hand the listening socket over to a new server started
+    //              with the same -U, for upgrades (otp_handoff.h)
+    //    -b chars  admission limit: characters in flight (otp_admit.h)
+    //    -c conns  admission limit: connections
+    //    -d list   connection deadlines per phase, in seconds: handshake,
+    //              header, payload, response (otp_deadline.h)
+    //    -e rate   cap how fast used key is erased, in bytes per second
+    //              (otp_pad.h)
+    //    -i secs   connection deadline while idle
+    //    -j slots  scheduler slots for large requests (otp_sched.h)
+    //    -m bytes  cap the memory for request buffers (otp_buf.h)
+    //    -q len    admission limit: listen backlog
+    //    -r rate   connection deadline: minimum bytes per second
+    //    -s chars  scheduler: largest small request
+    //    -w a=n    scheduler: weight n for client address a (repeatable)
+    //
+    while((opt = getopt(argc, argv, "AC:HK:L:P:R:S:T:U:b:c:d:e:i:j:m:q:r:s:w:")) != -1)
+    {
+        switch(opt)
+        {
+            case 'A':
+                placing = 1;
+                break;
+            case 'H':
+                counting = 1;
+                break;
+            case 'C':
+                ctlPath = optarg;
+                break;
+            case 'U':
+                handoffPath = optarg;
+                break;
+            case 'K':
+                reusePath = optarg;
+                break;
+            case 'L':
+                logPath = optarg;
+                break;
+            case 'R':
+                logSize = atol(optarg);
+                break;
+            case 'T':
+                traceMs = atol(optarg);
+                break;
+            case 'S':
+                statsPath = optarg;
+                break;
+            case 'd':
+                phases = optarg;
+                break;
+            case 'i':
+                idle = atoi(optarg);
+                break;
+            case 'r':
+                minRate = atol(optarg);
+                break;
+            case 'b':
+                maxBytes = atol(optarg);
+                break;
+            case 'c':
+                maxConn = atoi(optarg);
+                break;
+            case 'm':
+                budget = atol(optarg);
+                break;
+            case 'q':
+                backlog = atoi(optarg);
+                break;
+            case 'P':
+                padStore = optarg;
+                break;
+            case 'e':
+                eraseRate = atol(optarg);
+                break;
+            case 'j':
+                slots = atoi(optarg);
+                break;
+            case 's':
+                small = atol(optarg);
+                break;
+            case 'w':
+                if(schedWeight(optarg) == -1)
+                {
+                    fprintf(stderr, "%s: bad weight \"%s\" (want address=1..1000)\n",
+                            argv[0], optarg);
+                    exit(1);
+                }
+                break;
+            default:
+                optind = argc + 1; // Force the usage message
+                break;
+        }
+    }
+
+    // If we did not get a port on our command line, vital information
+    // is missing. Display a usage message and exit.
+    //
+    if(optind != argc - 1 || (reusePath != NULL && svrType != OTP_ENCODE))
+    {
+        fprintf(stderr, "Usage: %s [-P pad_store] [-e erase_bytes_per_sec]\n"
+                        "       [-j large_slots] [-s small_limit]\n"
+                        "       [-w address=weight ...] [-c max_connections]\n"
+                        "       [-b max_chars_in_flight] [-q backlog]\n"
+                        "       [-d handshake,header,payload,response] [-i idle_secs]\n"
+                        "       [-r min_bytes_per_sec] [-S stats_socket] [-C control_socket]\n"
+                        "       [-T trace_ms] [-L access_log] [-R rotate_bytes]\n"
+                        "       [-m buffer_bytes] [-A] [-H] [-U handoff_socket]\n"
+                        "       %sport\n", argv[0],
+                (svrType == OTP_ENCODE) ? "[-K reuse_index] " : "");
+        exit(1);
+    }
+
+    // A server already running on the handoff socket gives us its
+    // listening socket, already bound to the port, and goes away once
+    // it's done with the requests it has.
+    //
+    if(handoffInit(handoffPath, &taken) == -1)
+    {
+        perror(handoffPath);
+        exit(1);
+    }
+    sock = taken;
+
+    // Otherwise set up the socket: AF_INET for Internet domain,
+    // SOCK_STREAM for TCP, 0 for default Internet protocol. If this was a
+    // UDP socket, SOCK_STREAM would be SOCK_DGRAM instead.
+    //
+    if(sock == -1 && (sock = socket(AF_INET, SOCK_STREAM, 0)) == -1)
+    {
+        perror("Socket failed");
+        exit(1);
+    }
+
+    // Helps with the "address in use" errors that pop up when trying to
+    // start a server on a port that still has connections in TIME_WAIT.
+    // optval has to be non-zero to switch the option on; it used to be
+    // left uninitialized, which is why this only worked sometimes.
+    //
+    if(taken == -1 && setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval)) == -1)
+    {
+        perror("Setsockopt failed");
+        exit(1);
+    }
+
+    // Initialize socket structure with zeroes (once handled by bzero()
+    // which has been deprecated).
+    //
+    memset((char *)&myServ, 0, sizeof(myServ));
+
+    // Use the server hostent information to help populate the sockaddr_in
+    // struct that holds server connection data. Set the domain to
+    // Internet (AF_INET), convert the port passed on the command line
+    // from host to network byte ordering and assign to the sockaddr_in
+    // port, and indicate that connections from any address on our network
+    // are okay (INADDR_ANY).
+    //
+    myServ.sin_family = AF_INET;
+    myServ.sin_port = htons(atoi(argv[optind])); // host to network endian conversion
+    myServ.sin_addr.s_addr = htonl(INADDR_ANY);
+
+    // Associate the address assocated with myServ with the socket for
+    // this server.
+    //
+    if(taken == -1 && bind(sock, (struct sockaddr *)&myServ, sizeof(myServ)) == -1)
+    {
+        perror("Bind failed");
+        exit(1);
+    }
+
+    // Listen for connections. The backlog used to be 5, which overflowed
+    // long before the server was actually busy; now the limits below
+    // decide who waits, and the backlog only has to cover bursts between
+    // accept() calls. On a socket taken over, this just sets the backlog.
+    //
+    if(listen(sock, backlog) == -1)
+    {
+        perror("Listen failed");
+        exit(1);
+    }
+
+    // Resumable sessions outlive the child that served them, so their
+    // table has to be shared with every child we fork.
+    //
+    if(resumeInit() == -1)
+    {
+        perror("Session table setup failed");
+        exit(1);
+    }
+
+    // Same for the scheduler and the admission limits, which every child
+    // consults.
+    //
+    if(schedInit(slots, small) == -1 || admitInit(maxConn, maxBytes) == -1)
+    {
+        perror("Scheduler setup failed");
+        exit(1);
+    }
+
+    if(deadlineInit(phases, idle, minRate) == -1)
+    {
+        fprintf(stderr, "%s: bad deadlines \"%s\" (want four comma separated seconds)\n",
+                argv[0], phases);
+        exit(1);
+    }
+
+    // Request buffers come out of one pool shared with the children, so
+    // memory freed by one request is reused by the next. With -A the pool
+    // has a slice on each NUMA node.
+    //
+    nodeCount = numaInit(placing, nodes);
+    if(bufInit(budget, nodes, nodeCount) == -1)
+    {
+        perror("Buffer pool setup failed");
+        exit(1);
+    }
+
+    // Decoding uses a key the second time by design, so only the
+    // encoding server keeps track of what key it has used.
+    //
+    if(reuseInit(reusePath) == -1)
+    {
+        perror(reusePath);
+        exit(1);
+    }
+
+    // Counters are shared with the children too. The server counts
+    // connections, and clients turned away or killed, in its own slot.
+    //
+    if((statsSock = statsInit(statsPath)) == -2)
+    {
+        perror("Stats setup failed");
+        exit(1);
+    }
+
+    if(traceInit(traceMs) == -1)
+    {
+        perror("Trace setup failed");
+        exit(1);
+    }
+
+    // Each child opens its own counters; the totals are shared.
+    //
+    if(perfInit(counting) == -1)
+    {
+        perror("Hardware counter setup failed");
+        exit(1);
+    }
+
+    // The shared socket and codec helpers report to all of the above.
+    //
+    hooks.moved = onMoved;
+    hooks.begin = perfBegin;
+    hooks.end = perfEnd;
+    otpSetHooks(&hooks);
+
+    // The access log is written by a thread of ours, so the children
+    // never wait on the disk.
+    //
+    if(logInit(logPath, logSize) == -1)
+    {
+        perror(logPath);
+        exit(1);
+    }
+
+    // Used key from the pad store is erased by another thread of ours,
+    // at idle priority.
+    //
+    if(padkeyInit(padStore, eraseRate) == -1)
+    {
+        perror("Pad store setup failed");
+        exit(1);
+    }
+
+    // Key the server we took over from has claimed but not yet erased is
+    // in its ring, not ours, so keys from the pad store wait until it's
+    // gone.
+    //
+    if(handoffOld() != -1)
+    {
+        padkeyHold(1);
+    }
+
+    // Last, since it tunes everything above.
+    //
+    if((ctlSock = ctlInit(ctlPath, sock, backlog)) == -2)
+    {
+        perror("Control socket setup failed");
+        exit(1);
+    }
+
+    // A child exiting interrupts poll() below, so it's reaped (and its
+    // slots given back) right away rather than at the next connection.
+    //
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = onChild;
+    sa.sa_flags = SA_RESTART;
+    sigaction(SIGCHLD, &sa, NULL);
+
+    // Once the listening socket has been handed over, carry on until the
+    // last child has finished.
+    //
+    while(sock != -1 || children > 0)
+    {
+        // Wait for a client connection (or someone reading the stats,
+        // tuning the server or taking it over), but no longer than the
+        // next deadline tick. Closed sockets are -1, which poll() skips.
+        //
+        pfd[0].fd = sock;
+        pfd[1].fd = statsSock;
+        pfd[2].fd = ctlSock;
+        pfd[3].fd = handoffSock();
+        pfd[4].fd = handoffOld();
+        for(idx = 0; idx < 5; idx++)
+        {
+            pfd[idx].events = POLLIN;
+            pfd[idx].revents = 0;
+        }
+        if((ready = poll(pfd, 5, deadlineWait())) == -1 && errno != EINTR)
+        {
+            perror("Poll failed");
+            exit(1);
+        }
+
+        // Kill children that are over a deadline.
+        //
+        deadlineRun();
+
+        // Reap any closed server zombies without blocking. Waiting for a
+        // child would serialize the server, and a client holding a warm
+        // (pooled) connection open would stall every other client behind
+        // it. Reaping also gives back any scheduler slot, admission or
+        // deadline entry, or buffer a dead child still held.
+        //
+        while((pid = waitpid(-1, &status, WNOHANG)) > 0)
+        {
+            if(WIFSIGNALED(status))
+            {
+                logKilled(pid, WTERMSIG(status));
+            }
+            schedReap(pid);
+            admitReap(pid);
+            deadlineReap(pid);
+            bufReap(pid);
+            numaReap(pid);
+            children--;
+        }
+
+        // Write out slow requests the children have finished with.
+        //
+        traceDump();
+
+        if(pfd[1].revents & POLLIN)
+        {
+            statsServe(statsSock, children);
+        }
+
+        if(pfd[2].revents & POLLIN)
+        {
+            ctlServe(ctlSock, children);
+        }
+
+        if((pfd[4].revents & (POLLIN | POLLHUP)) && handoffGone())
+        {
+            padkeyHold(0);
+        }
+
+        // A new server has taken over: it accepts from now on, and owns
+        // the stats and control socket paths.
+        //
+        if((pfd[3].revents & POLLIN) && handoffServe(sock))
+        {
+            close(sock);
+            sock = -1;
+            if(statsSock != -1)
+            {
+                close(statsSock);
+                statsSock = -1;
+            }
+            if(ctlSock != -1)
+            {
+                close(ctlSock);
+                ctlSock = -1;
+            }
+            continue;
+        }
+
+        if(ready <= 0 || !(pfd[0].revents & POLLIN))
+        {
+            continue;
+        }
+
+        myCliLen = sizeof(myCli); // Grab the size of the myCli sockaddr_in struct
+
+        // A client is waiting. Accept it and return a socket descriptor
+        // for the new connection. A client that gave up in the meantime
+        // is no reason to stop; anything else is.
+        //
+        cli = accept(sock, (struct sockaddr *)&myCli, &myCliLen);
+        if(cli == -1)
+        {
+            if(errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+            perror("Accept failed");
+            exit(1);
+        }
+
+        statsCount(STAT_CONNECTIONS, 1);
+
+        // Turn the client away if we're full. The answer fits in the
+        // socket buffer of a fresh connection, so the parent never blocks
+        // on it.
+        //
+        if((delay = admitConn(children)) != 0)
+        {
+            statsCount(STAT_ERR_BUSY, 1);
+            logRejected(&myCli);
+            sendLong(&cli, OTP_BUSY);
+            sendLong(&cli, delay);
+            close(cli);
+            cli = -1;
+            continue;
+        }
+
+        // Fork the server. The child starts out in its handshake phase,
+        // on the CPU picked for it (-A).
+        //
+        slot = deadlineReserve();
+        cpu = numaPick(&cli);
+        pid = fork();
+
+        if(pid < 0)      // Error
+        {
+            // No child to time or count. numaPick() only chose a CPU;
+            // nothing is held against it until numaStart().
+            //
+            perror("Fork failed");
+            close(cli);
+            cli = -1;
+
+            deadlineRelease(slot);
+        }
+        else if(pid == 0) // Child process
+        {
+            // Close the server socket connection. We don't need it.
+            //
+            close(sock);
+            sock = -1;
+            if(statsSock != -1)
+            {
+                close(statsSock);
+            }
+            if(ctlSock != -1)
+            {
+                close(ctlSock);
+            }
+            handoffChild();
+
+            numaChild(cpu);
+            deadlineChild(slot);
+            statsChild(slot);
+            perfChild();
+            traceChild();
+            logChild(&cli);
+            serveClient(&cli, svrType);
+
+            // Close the client
+            //
+            close(cli);
+            cli = -1;
+
+            exit(0);
+        }
+        else             // Parent
+        {
+            // Close the client socket
+            //
+            close(cli);
+            cli = -1;
+
+            deadlineStart(slot, pid);
+            numaStart(cpu, pid);
+
+            children++;
+            OTP_PROBE2(accept, pid, children);
+        }
+    }
+
+    // The listening socket went to a new server and our last child is
+    // gone. Erase the key our children used and write out their log
+    // records before exiting, which tells the new server we're done.
+    //
+    traceDump();
+    padkeyDrain();
+    logDrain();
+    perfReport(stderr);
+
+    return 0;
+}
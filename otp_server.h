@@ -0,0 +1,64 @@
+//
+// *****************************************************************************
+//
+// Author:    Erik Ratcliffe
+// Date:      June 5, 2015
+// Project:   Program 4 - OTP
+// Filename:  otp_server.h
+// Class:     CS 344 (Spring 2015)
+//
+//
+// Overview:
+//    Server/client simulation of the classic "One-time Pad" encryption scheme.
+//
+//    This file contains the function prototypes for the server code shared
+//    by otp_enc_d and otp_dec_d.
+//
+// *****************************************************************************
+//
+
+#ifndef OTP_SERVER_H
+#define OTP_SERVER_H
+
+
+// *****************************************************************************
+//
+// int serverMain(int argc, char **argv, long svrType)
+//
+//    Entry:   int argc, char **argv
+//                Command line of the server program
+//             long svrType
+//                OTP_ENCODE or OTP_DECODE
+//
+//    Exit:    Only returns if the server shuts down.
+//
+//    Purpose: Set up the listening socket and run the accept loop, forking
+//    a child to serve each client connection.
+//
+// *****************************************************************************
+//
+int serverMain(int argc, char **argv, long svrType);
+
+
+// *****************************************************************************
+//
+// void serveClient(int *cli, long svrType)
+//
+//    Entry:   int *cli
+//                Socket for the client connection
+//             long svrType
+//                OTP_ENCODE or OTP_DECODE
+//
+//    Exit:    None. The caller closes the connection.
+//
+//    Purpose: Send the server type, then read the client's first number
+//    and run either a classic single request (the number is the input
+//    file size) or one of the extended protocols (the number is a
+//    negative OP_* code).
+//
+// *****************************************************************************
+//
+void serveClient(int *cli, long svrType);
+
+
+#endif
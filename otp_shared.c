@@ -21,9 +21,231 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <errno.h>
+#include <endian.h>
+#include <stdint.h>
+#include <netdb.h>
 #include <arpa/inet.h>
 #include <sys/types.h>
+#include <sys/socket.h>
 #include "otp.h"
+#include "otp_perf.h"
+#include "otp_probes.h"
+
+
+static struct otpHooks hooks;  // Installed by otpSetHooks() (all NULL = none)
+
+
+// *****************************************************************************
+//
+// void otpSetHooks(struct otpHooks *set)
+//
+// Purpose: Install the hooks.
+//
+// *****************************************************************************
+//
+void otpSetHooks(struct otpHooks *set)
+{
+    hooks = *set;
+}
+
+
+// *****************************************************************************
+//
+// static void hookMoved(int sent, long bytes)
+//
+// Purpose: Report bytes that crossed a socket, if anyone's listening.
+//
+// *****************************************************************************
+//
+static void hookMoved(int sent, long bytes)
+{
+    if(hooks.moved != NULL)
+    {
+        hooks.moved(sent, bytes);
+    }
+}
+
+
+// *****************************************************************************
+//
+// void otpMoved(int sent, long bytes)
+//
+// Purpose: Report bytes moved elsewhere to the hook.
+//
+// *****************************************************************************
+//
+void otpMoved(int sent, long bytes)
+{
+    hookMoved(sent, bytes);
+}
+
+
+// *****************************************************************************
+//
+// static void hookBegin(void)
+//
+// Purpose: Go into a PERF_* section, if anyone's counting.
+//
+// *****************************************************************************
+//
+static void hookBegin(void)
+{
+    if(hooks.begin != NULL)
+    {
+        hooks.begin();
+    }
+}
+
+
+// *****************************************************************************
+//
+// static void hookEnd(int section, long bytes)
+//
+// Purpose: Come out of a PERF_* section, if anyone's counting.
+//
+// *****************************************************************************
+//
+static void hookEnd(int section, long bytes)
+{
+    if(hooks.end != NULL)
+    {
+        hooks.end(section, bytes);
+    }
+}
+
+
+// *****************************************************************************
+//
+// int writeAll(int fd, char *buf, long len)
+//
+// Purpose: Write a whole buffer, looping over partial writes.
+//
+// *****************************************************************************
+//
+int writeAll(int fd, char *buf, long len)
+{
+    long written = 0;  // Characters written so far
+    long numWritten;   // Characters written per write() call
+
+    while(written < len)
+    {
+        if((numWritten = write(fd, buf + written, len - written)) == -1)
+        {
+            return -1;
+        }
+        written += numWritten;
+    }
+
+    return 0;
+}
+
+
+// *****************************************************************************
+//
+// int clientOptions(int argc, char **argv, struct clientOpts *opts)
+//
+// Purpose: Parse the options both clients take.
+//
+// *****************************************************************************
+//
+int clientOptions(int argc, char **argv, struct clientOpts *opts)
+{
+    int    opt;  // Current command line option
+
+    memset(opts, 0, sizeof(*opts));
+    opts->stripes = 1;
+
+    // -s N splits one large transfer over N parallel connections, and
+    // -r sends it as a resumable session that survives dropped
+    // connections. -m sends it as one stream over the multiplexed
+    // protocol, and -c puts a checksum on every frame of it. -k takes
+    // the key from the server's pad store ("pad_id:offset", the ID in
+    // hex) instead of a key file. -l skips the server altogether, with
+    // -t for the thread count and -o for an output file.
+    //
+    while((opt = getopt(argc, argv, "ck:lmo:rs:t:")) != -1)
+    {
+        switch(opt)
+        {
+            case 'c':
+                opts->crc = 1;
+                break;
+
+            case 'k':
+                opts->padRef = optarg;
+                break;
+
+            case 'l':
+                opts->local = 1;
+                break;
+
+            case 'm':
+                opts->mux = 1;
+                break;
+
+            case 'o':
+                opts->outPath = optarg;
+                break;
+
+            case 't':
+                opts->threads = atoi(optarg);
+                break;
+
+            case 'r':
+                opts->resumable = 1;
+                break;
+
+            case 's':
+                opts->stripes = atoi(optarg);
+                break;
+
+            default:
+                argc = 0; // Fall into the usage message below
+                break;
+        }
+    }
+
+    // If we did not get three items after the options (two for a local
+    // run or a key in the pad store), vital information is missing.
+    // Display a usage message.
+    //
+    if((opts->mux && (opts->local || opts->resumable || opts->stripes != 1)) ||
+       (opts->crc && !opts->mux))
+    {
+        argc = 0;
+    }
+    if(opts->padRef != NULL &&
+       (opts->local || opts->resumable || opts->mux ||
+        sscanf(opts->padRef, "%lx:%ld", &opts->padId, &opts->padOffset) != 2))
+    {
+        argc = 0;
+    }
+    if(argc - optind < ((opts->local || opts->padRef != NULL) ? 2 : 3))
+    {
+        fprintf(stderr, "Usage: %s [-r] [-s stripes] [input file] [key file] "
+                        "[port | host:port,...]\n", argv[0]);
+        fprintf(stderr, "       %s -m [-c] [input file] [key file] "
+                        "[port | host:port,...]\n", argv[0]);
+        fprintf(stderr, "       %s -k pad_id:offset [input file] "
+                        "[port | host:port]\n", argv[0]);
+        fprintf(stderr, "       %s -l [-t threads] [-o output file] "
+                        "[input file] [key file]\n", argv[0]);
+        return -1;
+    }
+
+    opts->inPath = argv[optind];
+    if(opts->padRef == NULL)
+    {
+        opts->keyPath = argv[optind + 1];
+    }
+    if(!opts->local)
+    {
+        opts->servers = argv[optind + ((opts->padRef == NULL) ? 2 : 1)];
+    }
+
+    return 0;
+}
 
 
 // *****************************************************************************
@@ -82,6 +304,7 @@ void sendNum(int *sock, long *num)
         perror("client send failed");
         exit(1);
     }
+    hookMoved(1, numSent);
 }
 
 
@@ -105,11 +328,14 @@ void sendStr(int *sock, char *str)
     // Send the string, report the number of characters transferred. If
     // -1, exit with an error.
     //
+    hookBegin();
     if((numSent = send(*sock, str, len, 0)) == -1)
     {
         perror("client send failed");
         exit(1);
     }
+    hookEnd(PERF_SEND, numSent);
+    hookMoved(1, numSent);
 }
 
 
@@ -125,20 +351,34 @@ int recvNum(int *sock)
 {
     long outNum;  // Number to return
     long inNum;   // Number received 
+    long got = 0; // Characters received so far
     int  numRecv; // Characters transferred
 
     // Read the number, report the number of characters transferred. If
-    // -1, exit with an error.
+    // -1, exit with an error. A slow or fragmenting link can hand it over
+    // a few bytes at a time, so keep reading until it's all here.
     //
-    if((numRecv = recv(*sock, &inNum, sizeof(inNum), 0)) == -1)
+    while(got < (long)sizeof(inNum))
     {
-        perror("server recv failed (client type)");
-        exit(1);
-    }
-    else if(numRecv == 0)
-    {
-        perror("socket closed during recv");
-        exit(1);
+        numRecv = recv(*sock, (char *)&inNum + got, sizeof(inNum) - got, 0);
+        if(numRecv == -1)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            perror("server recv failed (client type)");
+            exit(1);
+        }
+        else if(numRecv == 0)
+        {
+            perror("socket closed during recv");
+            exit(1);
+        }
+
+        got += numRecv;
+        hookMoved(0, numRecv);
+        OTP_PROBE2(recv__chunk, getpid(), numRecv);
     }
 
     outNum = ntohl(inNum); // Convert the number from network to host byte order
@@ -160,7 +400,7 @@ void recvStr(int *sock, char *str)
     long len;      // Holds the length of the input string
     int  numRecv;  // Characters transferred
 
-    len = MAX_MSG; // Set string length to our MAX_MSG
+    len = MAX_MSG - 1; // Set string length to our MAX_MSG, less the terminator
 
     // Read the string, report the number of characters transferred. If
     // -1, exit with an error.
@@ -170,6 +410,7 @@ void recvStr(int *sock, char *str)
         perror("client recv failed");
         exit(1);
     }
+    str[numRecv] = '\0';
 }
 
 
@@ -185,22 +426,22 @@ int recvStream(int *sock, char *str, long maxChars)
 {
     int  numRecv    = 0;  // Characters transferred per recv() call
     long actualRecv = 0;  // Actual accumulated characters transferred
-    char buf[MAX_MSG];    // Temp. buffer used by recv()
-
-    // Start at the beginning of outStr
-    //
-    str[0] = '\0';
+    long want;            // Characters to ask for next
 
     // Keep looping until the entire input file is received
     //
+    hookBegin();
     while(actualRecv < maxChars)
     {
-       // Read the string, report the number of characters transferred. If
-       // -1, exit with an error. If 0, we're done. Otherwise, concatenate
-       // the contents of buf to the final string and add the number of
-       // characters transferred to the running count (actualRecv).
+       // Read the string straight into place, never asking for more than
+       // is still owed (anything past it belongs to the next message),
+       // report the number of characters transferred. If -1, exit with an
+       // error. If 0, we're done. Otherwise add the number of characters
+       // transferred to the running count (actualRecv).
        //
-       if((numRecv = recv(*sock, buf, sizeof(buf), 0)) == -1)
+       want = maxChars - actualRecv;
+       want = (want > MAX_MSG) ? MAX_MSG : want;
+       if((numRecv = recv(*sock, str + actualRecv, want, 0)) == -1)
        {
            perror("server recv failed (message)");
            exit(1);
@@ -214,13 +455,19 @@ int recvStream(int *sock, char *str, long maxChars)
        {
            // At one point, I was using strcat(). After multiple overruns,
            // I realized that strncat() was the way to go. That had me
-           // stumped for about half a day.
+           // stumped for about half a day. Then it turned out strncat()
+           // walks the whole string every time; with the length known,
+           // copying in place does the same job in linear time.
            //
-           strncat(str, buf, numRecv);
            actualRecv += numRecv;
+           hookMoved(0, numRecv);
+           OTP_PROBE2(recv__chunk, getpid(), numRecv);
        }
     }
 
+    hookEnd(PERF_RECV, actualRecv);
+    str[actualRecv] = '\0';
+
     return actualRecv; // Return the actual number of characters received
 }
 
@@ -271,83 +518,412 @@ int strIdx(char *inString, char ch)
 //
 void encodeChars(char *inputChars, char *keyChars)
 {
-    char allowedChars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ "; // Valid input characters
-    int  inputCh;           // Character to encode
-    int  keyCh;             // Associated character from the key
-    int  sum;               // Sum of inputCh and keyCh (1st pt of OTP)
-    int  mod;               // Modulus of sum and # of allowed chars (2nd pt of OTP)
-    long inputCharsLen;     // Length of input character string
-    long idx = 0;           // Loop index
+    // The per-character strIdx() search used to live here. encodeBuf()
+    // does the same arithmetic without searching, so just hand it the
+    // length of the input string.
+    //
+    encodeBuf(inputChars, keyChars, (long)strlen(inputChars));
+}
 
-    inputCharsLen = strlen(inputChars); // Grab the length of the input string
 
-    while(idx < inputCharsLen)
-    {
-        inputCh = strIdx(allowedChars, inputChars[idx]); // Char from input string
-        keyCh = strIdx(allowedChars, keyChars[idx]);
+// *****************************************************************************
+// 
+// void decodeChars(char *inputChars, char *keyChars)
+//
+// Purpose: Decode an input string using a simulation of the classic
+// "One-time Pad" encryption scheme.
+//
+// *****************************************************************************
+//
+void decodeChars(char *inputChars, char *keyChars)
+{
+    // See encodeChars().
+    //
+    decodeBuf(inputChars, keyChars, (long)strlen(inputChars));
+}
 
-        // Add the numeric value of the two characters together...
-        //
-        sum = inputCh + keyCh;  
 
-        // ...then mod with the total number of allowed characters.
-        //
-        mod = sum % strlen(allowedChars); 
+// *****************************************************************************
+// 
+// int verifyBuf(char *buf, long len)
+//
+// Purpose: Length-based verifyInput() for chunks of a larger input.
+//
+// *****************************************************************************
+//
+int verifyBuf(char *buf, long len)
+{
+    long idx; // Loop index
 
-        inputChars[idx] = allowedChars[mod]; // Replace input char with encoded char
-        idx++;
+    for(idx = 0; idx < len; idx++)
+    {
+        // Same rule as verifyInput(): A-Z (ASCII 65-90) and space.
+        //
+        if((buf[idx] > 90) || ((buf[idx] < 65) && (buf[idx] != 32)))
+        {
+            return 0; // Not validated!
+        }
     }
+
+    return 1; // Validated!
 }
 
 
 // *****************************************************************************
 // 
-// void decodeChars(char *inputChars, char *keyChars)
+// void encodeBuf(char *inputChars, char *keyChars, long len)
 //
-// Purpose: Decode an input string using a simulation of the classic
-// "One-time Pad" encryption scheme.
+// Purpose: Length-based encodeChars() for chunks of a larger input.
 //
 // *****************************************************************************
 //
-void decodeChars(char *inputChars, char *keyChars)
+void encodeBuf(char *inputChars, char *keyChars, long len)
 {
-    char allowedChars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ "; // Valid input characters
-    int  inputCh;           // Character to encode
-    int  keyCh;             // Associated character from the key
-    int  diff;              // Diff of inputCh and keyCh (1st pt of OTP)
-    int  mod;               // Modulus of sum and # of allowed chars (2nd pt of OTP)
-    long inputCharsLen;     // Length of input character string
-    long idx = 0;           // Loop index
+    unsigned char *in = (unsigned char *)inputChars; // Input, as bytes
+    unsigned char *key = (unsigned char *)keyChars;  // Key, as bytes
+    unsigned char inputCh, keyCh;  // Numeric values of the input and key chars
+    unsigned char sum, wrap;       // Sum of inputCh and keyCh, and sum - 27
+    long idx;                      // Loop index
+    long start = OTP_PROBE_CLOCK(codec__end); // For the codec-end probe
+
+    // Same numbering as strIdx() on "ABCDEFGHIJKLMNOPQRSTUVWXYZ ", but
+    // without the search or any branches, so the compiler can vectorize
+    // the loop:
+    //
+    //  - c - 'A' is 0-25 for letters; a space wraps around to 223, so
+    //    clamping to 26 maps it to 26.
+    //  - The sum is at most 52. If it is 27 or more, sum - 27 is the
+    //    smaller value; if not, sum - 27 wraps around to 229 or more and
+    //    sum is the smaller one. Either way min() is the modulus.
+    //  - 26 goes back out as a space, everything else as a letter.
+    //
+    hookBegin();
+    OTP_PROBE2(codec__start, getpid(), len);
+    for(idx = 0; idx < len; idx++)
+    {
+        inputCh = in[idx] - 'A';
+        inputCh = (inputCh > 26) ? 26 : inputCh;
+        keyCh = key[idx] - 'A';
+        keyCh = (keyCh > 26) ? 26 : keyCh;
+
+        sum = inputCh + keyCh;
+        wrap = sum - 27;
+        sum = (wrap < sum) ? wrap : sum;
+
+        in[idx] = (sum == 26) ? ' ' : sum + 'A';
+    }
+    hookEnd(PERF_CODEC, len);
+    OTP_PROBE3(codec__end, getpid(), len, OTP_PROBE_SINCE(start));
+}
 
-    inputCharsLen = strlen(inputChars); // Grab the length of the input string
 
-    while(idx < inputCharsLen)
+// *****************************************************************************
+// 
+// void decodeBuf(char *inputChars, char *keyChars, long len)
+//
+// Purpose: Length-based decodeChars() for chunks of a larger input.
+//
+// *****************************************************************************
+//
+void decodeBuf(char *inputChars, char *keyChars, long len)
+{
+    unsigned char *in = (unsigned char *)inputChars; // Input, as bytes
+    unsigned char *key = (unsigned char *)keyChars;  // Key, as bytes
+    unsigned char inputCh, keyCh;  // Numeric values of the input and key chars
+    unsigned char diff, wrap;      // inputCh - keyCh, and diff + 27
+    long idx;                      // Loop index
+    long start = OTP_PROBE_CLOCK(codec__end); // For the codec-end probe
+
+    // Same tricks as encodeBuf(). A negative difference wraps around to
+    // 230 or more, and adding 27 brings it back into 1-26, which is then
+    // the smaller value; a non-negative difference stays the smaller one.
+    //
+    hookBegin();
+    OTP_PROBE2(codec__start, getpid(), len);
+    for(idx = 0; idx < len; idx++)
     {
-        inputCh = strIdx(allowedChars, inputChars[idx]); // Char from input string
-        keyCh = strIdx(allowedChars, keyChars[idx]);     // Matching char from key
+        inputCh = in[idx] - 'A';
+        inputCh = (inputCh > 26) ? 26 : inputCh;
+        keyCh = key[idx] - 'A';
+        keyCh = (keyCh > 26) ? 26 : keyCh;
 
-        // Subtract the numeric value of the key char from the input char.
-        //
         diff = inputCh - keyCh;
+        wrap = diff + 27;
+        diff = (wrap < diff) ? wrap : diff;
+
+        in[idx] = (diff == 26) ? ' ' : diff + 'A';
+    }
+    hookEnd(PERF_CODEC, len);
+    OTP_PROBE3(codec__end, getpid(), len, OTP_PROBE_SINCE(start));
+}
+
 
-        // If the result of the subtraction is a negative number, add the
-        // total number of allowed characters to bring it back into
-        // positive territory.
+// *****************************************************************************
+// 
+// int sendBuf(int *sock, char *buf, long len)
+//
+// Purpose: Send an entire buffer across a network connection, looping
+// over partial sends.
+//
+// *****************************************************************************
+//
+int sendBuf(int *sock, char *buf, long len)
+{
+    long sent = 0;  // Characters sent so far
+    long numSent;   // Characters transferred per send() call
+    long start = OTP_PROBE_CLOCK(send__done); // For the send-done probe
+
+    hookBegin();
+    while(sent < len)
+    {
+        // MSG_NOSIGNAL keeps a peer that went away from killing us with
+        // SIGPIPE; we want the -1 so the caller can decide what to do.
         //
-        if(diff < 0)
+        if((numSent = send(*sock, buf + sent, len - sent, MSG_NOSIGNAL)) == -1)
         {
-            diff += strlen(allowedChars);
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
         }
+        sent += numSent;
+        hookMoved(1, numSent);
+    }
+
+    hookEnd(PERF_SEND, len);
+    OTP_PROBE3(send__done, getpid(), len, OTP_PROBE_SINCE(start));
+
+    return 0;
+}
 
-        // Mod with the total number of allowed characters.
-        //
-        mod = diff % strlen(allowedChars);
 
-        inputChars[idx] = allowedChars[mod]; // Replace input char with encoded char
-        idx++;
+// *****************************************************************************
+// 
+// int recvBuf(int *sock, char *buf, long len)
+//
+// Purpose: Receive exactly len characters from across a network
+// connection.
+//
+// *****************************************************************************
+//
+int recvBuf(int *sock, char *buf, long len)
+{
+    long got = 0;   // Characters received so far
+    long numRecv;   // Characters transferred per recv() call
+
+    hookBegin();
+    while(got < len)
+    {
+        if((numRecv = recv(*sock, buf + got, len - got, 0)) == -1)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        else if(numRecv == 0)
+        {
+            return -1; // Socket closed before everything arrived
+        }
+        got += numRecv;
+        hookMoved(0, numRecv);
+        OTP_PROBE2(recv__chunk, getpid(), numRecv);
     }
+    hookEnd(PERF_RECV, len);
+
+    return 0;
 }
 
 
+// *****************************************************************************
+// 
+// int sendLong(int *sock, long num)
+//
+// Purpose: Same wire format as sendNum(), but returns errors instead of
+// exiting.
+//
+// *****************************************************************************
+//
+int sendLong(int *sock, long num)
+{
+    long numToSend = htonl(num); // Number to send, in network byte order
+
+    return sendBuf(sock, (char *)&numToSend, sizeof(numToSend));
+}
+
+
+// *****************************************************************************
+// 
+// int recvLong(int *sock, long *num)
+//
+// Purpose: Same wire format as recvNum(), but returns errors instead of
+// exiting.
+//
+// *****************************************************************************
+//
+int recvLong(int *sock, long *num)
+{
+    long inNum; // Number received
+
+    if(recvBuf(sock, (char *)&inNum, sizeof(inNum)) == -1)
+    {
+        return -1;
+    }
+
+    // Same conversion recvNum() does, including the truncation to int so
+    // negative values survive the 32-bit trip.
+    //
+    *num = (int)ntohl(inNum);
+
+    return 0;
+}
 
 
+// *****************************************************************************
+// 
+// int sendLong64(int *sock, long num)
+//
+// Purpose: Send a number with all 64 bits.
+//
+// *****************************************************************************
+//
+int sendLong64(int *sock, long num)
+{
+    uint64_t numToSend = htobe64(num); // Number to send, big endian
+
+    return sendBuf(sock, (char *)&numToSend, sizeof(numToSend));
+}
+
+
+// *****************************************************************************
+// 
+// int recvLong64(int *sock, long *num)
+//
+// Purpose: Receive a number sent by sendLong64().
+//
+// *****************************************************************************
+//
+int recvLong64(int *sock, long *num)
+{
+    uint64_t inNum; // Number received
+
+    if(recvBuf(sock, (char *)&inNum, sizeof(inNum)) == -1)
+    {
+        return -1;
+    }
+
+    *num = (long)be64toh(inNum);
+
+    return 0;
+}
+
+
+// *****************************************************************************
+// 
+// int connectServer(char *host, int port)
+//
+// Purpose: Open a TCP connection to one of the servers.
+//
+// *****************************************************************************
+//
+int connectServer(char *host, int port)
+{
+    int    sock;               // Socket descriptor
+    struct sockaddr_in myServ; // Information describing server socket
+    struct hostent *server;    // Information describing the connected server
+
+    if((sock = socket(AF_INET, SOCK_STREAM, 0)) == -1)
+    { 
+        perror("Socket failed");
+        return -1;
+    }
+
+    if((server = gethostbyname(host)) == NULL)
+    {
+        fprintf(stderr, "gethostbyname failed: %s\n", host);
+        close(sock);
+        return -1;
+    }
+
+    memset((char *)&myServ, 0, sizeof(myServ));
+    myServ.sin_family = AF_INET;
+    myServ.sin_port = htons(port); // host to network endian conversion
+    memcpy(&myServ.sin_addr, server->h_addr_list[0], server->h_length);
+
+    if(connect(sock, (struct sockaddr *)&myServ, sizeof(myServ)) == -1)
+    {
+        close(sock);
+        return -1;
+    }
+
+    return sock;
+}
+
+
+// *****************************************************************************
+// 
+// long otpRequest(int *sock, char *inContent, long inSize, char *keyContent,
+//                 long keySize, char *outContent, long *retryMs)
+//
+// Purpose: Run one size/ack/payload exchange with a server over a
+// connection whose server type has already been checked.
+//
+// *****************************************************************************
+//
+long otpRequest(int *sock, char *inContent, long inSize, char *keyContent,
+                long keySize, char *outContent, long *retryMs)
+{
+    char buf[MAX_MSG]; // Buffer used to read acknowledgements
+
+    // Sizes first, each answered by a short acknowledgement string that
+    // we read in full and discard. A full server answers the input size
+    // with OTP_BUSY_ACK and a retry delay instead, padded to the same
+    // length.
+    //
+    memset(buf, 0, sizeof(buf));
+    if(sendLong(sock, inSize) == -1 ||
+       recvBuf(sock, buf, strlen(OTP_ACK_INSIZE)) == -1)
+    {
+        return -3; // Never taken: safe to send again
+    }
+
+    if(strncmp(buf, OTP_BUSY_ACK " ", strlen(OTP_BUSY_ACK) + 1) == 0)
+    {
+        *retryMs = atol(buf + strlen(OTP_BUSY_ACK) + 1);
+        return -2;
+    }
+    if(strncmp(buf, OTP_TOO_LARGE, strlen(OTP_TOO_LARGE)) == 0)
+    {
+        return -4;
+    }
+
+    if(sendLong(sock, keySize) == -1 ||
+       recvBuf(sock, buf, strlen(OTP_ACK_KEYSIZE)) == -1)
+    {
+        return -1;
+    }
+
+    // Input, acknowledgement, then key.
+    //
+    if(sendBuf(sock, inContent, inSize) == -1 ||
+       recvBuf(sock, buf, strlen(OTP_ACK_INPUT)) == -1)
+    {
+        return -1;
+    }
+
+    if(sendBuf(sock, keyContent, keySize) == -1)
+    {
+        return -1;
+    }
+
+    // The result is exactly as long as the input.
+    //
+    if(recvBuf(sock, outContent, inSize) == -1)
+    {
+        return -1;
+    }
+
+    return inSize;
+}
@@ -0,0 +1,577 @@
+//
+// *****************************************************************************
+//
+// Author:    Erik Ratcliffe
+// Date:      June 5, 2015
+// Project:   Program 4 - OTP
+// Filename:  otp_stats.c
+// Class:     CS 344 (Spring 2015)
+//
+//
+// Overview:
+//    Server/client simulation of the classic "One-time Pad" encryption scheme.
+//
+//    This file contains the server's live metrics (see otp_stats.h).
+//
+// *****************************************************************************
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "otp_admit.h"
+#include "otp_buf.h"
+#include "otp_deadline.h"
+#include "otp_perf.h"
+#include "otp_stats.h"
+
+
+#define STATS_HISTS  (PHASE_COUNT + 1)  // One per phase, plus the whole connection
+#define STATS_TOTAL  PHASE_COUNT        // Histogram of whole connections
+#define STATS_SLOTS  (DEADLINE_MAX + 1) // One per deadline entry, plus the server's
+
+
+// One worker's counts. Only ever added to, so a reader summing slots
+// needs no lock; the alignment keeps neighbouring slots off each other's
+// cache lines.
+//
+struct statsSlot
+{
+    long counter[STAT_COUNT];                   // STAT_*
+    long hist[STATS_HISTS][STATS_BUCKETS];      // Latency buckets
+    long sum[STATS_HISTS];                      // Latency sums (us)
+} __attribute__((aligned(64)));
+
+
+static struct statsSlot *table = NULL;  // Shared slots
+static struct statsSlot *mine = NULL;   // Slot the caller counts into
+
+static int  phaseNow = PHASE_HANDSHAKE; // Child: phase it's in
+static long phaseStart;                 // Child: when that phase started (us)
+static long connStart;                  // Child: when the connection started (us)
+static long own[STAT_COUNT];            // Child: this connection's counts
+
+static char *phaseName[STATS_HISTS] =
+{
+    "handshake", "header", "payload", "response", "stream", "total"
+};
+
+static char *kindName[] = { "classic", "mux", "resume", "padgen", "padkey" };
+static char *errName[] =
+{
+    "busy", "deadline", "protocol", "key", "chars", "crc", "reuse", "io"
+};
+
+
+// *****************************************************************************
+//
+// static long statsNow(void)
+//
+// Purpose: Monotonic clock in microseconds.
+//
+// *****************************************************************************
+//
+static long statsNow(void)
+{
+    struct timespec now;  // Current time
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec * 1000000L + now.tv_nsec / 1000L;
+}
+
+
+// *****************************************************************************
+//
+// static int statsBucket(long usec)
+//
+// Purpose: Histogram bucket for a latency: exact below STATS_SUB, then
+// STATS_SUB buckets per power of two.
+//
+// *****************************************************************************
+//
+static int statsBucket(long usec)
+{
+    int exp;  // Highest bit set
+    int idx;  // Bucket
+
+    if(usec < STATS_SUB)
+    {
+        return (usec < 0) ? 0 : (int)usec;
+    }
+
+    exp = 63 - __builtin_clzl(usec);
+    idx = (exp - STATS_SUB_BITS + 1) * STATS_SUB +
+          (int)((usec >> (exp - STATS_SUB_BITS)) & (STATS_SUB - 1));
+
+    return (idx >= STATS_BUCKETS) ? STATS_BUCKETS - 1 : idx;
+}
+
+
+// *****************************************************************************
+//
+// static long statsBound(int idx)
+//
+// Purpose: First latency (us) past a bucket.
+//
+// *****************************************************************************
+//
+static long statsBound(int idx)
+{
+    int exp;  // Power of two the bucket is in
+
+    if(idx < STATS_SUB)
+    {
+        return idx + 1;
+    }
+
+    exp = idx / STATS_SUB + STATS_SUB_BITS - 1;
+
+    return (long)(STATS_SUB + idx % STATS_SUB + 1) << (exp - STATS_SUB_BITS);
+}
+
+
+// *****************************************************************************
+//
+// static void statsRecord(int hist, long usec)
+//
+// Purpose: Add a latency to one of the caller's histograms.
+//
+// *****************************************************************************
+//
+static void statsRecord(int hist, long usec)
+{
+    __atomic_add_fetch(&mine->hist[hist][statsBucket(usec)], 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&mine->sum[hist], usec, __ATOMIC_RELAXED);
+}
+
+
+// *****************************************************************************
+//
+// static void statsExit(void)
+//
+// Purpose: atexit() handler in a child: record the phase it ended in and
+// the whole connection.
+//
+// *****************************************************************************
+//
+static void statsExit(void)
+{
+    long now = statsNow();  // Time the connection ended
+
+    if(mine != NULL)
+    {
+        statsRecord(phaseNow, now - phaseStart);
+        statsRecord(STATS_TOTAL, now - connStart);
+    }
+}
+
+
+// *****************************************************************************
+//
+// int statsInit(char *path)
+//
+// Purpose: Set up the shared table and the stats socket.
+//
+// *****************************************************************************
+//
+int statsInit(char *path)
+{
+    struct sockaddr_un addr;  // Stats socket address
+    int    sock;              // Stats socket
+
+    table = mmap(NULL, sizeof(*table) * STATS_SLOTS, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(table == MAP_FAILED)
+    {
+        table = NULL;
+        return -2;
+    }
+    mine = &table[STATS_SLOTS - 1];
+
+    if(path == NULL)
+    {
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if(strlen(path) >= sizeof(addr.sun_path))
+    {
+        return -2;
+    }
+    strcpy(addr.sun_path, path);
+
+    // A socket left behind by an earlier run would make bind() fail.
+    //
+    unlink(path);
+
+    // Non-blocking, so a reader that connects and goes away before we
+    // get to it can't hang accept().
+    //
+    if((sock = socket(AF_UNIX, SOCK_STREAM, 0)) == -1)
+    {
+        return -2;
+    }
+    if(bind(sock, (struct sockaddr *)&addr, sizeof(addr)) == -1 ||
+       listen(sock, 16) == -1 ||
+       fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK) == -1)
+    {
+        close(sock);
+        return -2;
+    }
+
+    return sock;
+}
+
+
+// *****************************************************************************
+//
+// void statsChild(int idx)
+//
+// Purpose: Child side: count into our own slot and start timing.
+//
+// *****************************************************************************
+//
+void statsChild(int idx)
+{
+    if(table == NULL)
+    {
+        return;
+    }
+
+    // Without a deadline entry we share the server's slot, which is
+    // still safe since every update is an atomic add.
+    //
+    mine = (idx >= 0) ? &table[idx] : &table[STATS_SLOTS - 1];
+    memset(own, 0, sizeof(own));
+    phaseNow = PHASE_HANDSHAKE;
+    phaseStart = statsNow();
+    connStart = phaseStart;
+    atexit(statsExit);
+}
+
+
+// *****************************************************************************
+//
+// void statsCount(int counter, long n)
+//
+// Purpose: Add to a counter.
+//
+// *****************************************************************************
+//
+void statsCount(int counter, long n)
+{
+    if(mine != NULL)
+    {
+        __atomic_add_fetch(&mine->counter[counter], n, __ATOMIC_RELAXED);
+        own[counter] += n;
+    }
+}
+
+
+// *****************************************************************************
+//
+// void statsPhase(int phase)
+//
+// Purpose: Child side: record the phase being left.
+//
+// *****************************************************************************
+//
+void statsPhase(int phase)
+{
+    long now;  // Time the phase ended
+
+    if(mine == NULL || phase == phaseNow)
+    {
+        return;
+    }
+
+    now = statsNow();
+    statsRecord(phaseNow, now - phaseStart);
+    phaseNow = phase;
+    phaseStart = now;
+}
+
+
+// *****************************************************************************
+//
+// void statsOwn(long count[STAT_COUNT])
+//
+// Purpose: Child side: this connection's counts.
+//
+// *****************************************************************************
+//
+void statsOwn(long count[STAT_COUNT])
+{
+    memcpy(count, own, sizeof(own));
+}
+
+
+// *****************************************************************************
+//
+// char *statsName(int counter)
+//
+// Purpose: Label a request kind or error type.
+//
+// *****************************************************************************
+//
+char *statsName(int counter)
+{
+    if(counter >= STAT_REQ_CLASSIC && counter <= STAT_REQ_PADKEY)
+    {
+        return kindName[counter - STAT_REQ_CLASSIC];
+    }
+    if(counter >= STAT_ERR_BUSY && counter <= STAT_ERR_IO)
+    {
+        return errName[counter - STAT_ERR_BUSY];
+    }
+
+    return NULL;
+}
+
+
+// *****************************************************************************
+//
+// static int statsAdd(char *out, int len, char *fmt, ...)
+//
+// Purpose: Append to the answer, stopping quietly when it's full. Returns
+// the new length.
+//
+// *****************************************************************************
+//
+static int statsAdd(char *out, int len, char *fmt, ...)
+{
+    va_list ap;  // Format arguments
+    int     num; // Characters the format wanted
+
+    if(len >= STATS_OUT - 1)
+    {
+        return len;
+    }
+
+    va_start(ap, fmt);
+    num = vsnprintf(out + len, STATS_OUT - len, fmt, ap);
+    va_end(ap);
+
+    return (num < 0 || len + num >= STATS_OUT) ? STATS_OUT - 1 : len + num;
+}
+
+
+// *****************************************************************************
+//
+// static int statsRender(char *out, int children)
+//
+// Purpose: Sum every slot and write the totals in the Prometheus text
+// format. Returns the length.
+//
+// *****************************************************************************
+//
+static int statsRender(char *out, int children)
+{
+    static struct statsSlot total;  // Sum over every slot
+    long   *src, *dst;              // Slot being added, and the sum
+    long   phases[PHASE_COUNT];     // Connections in each phase now
+    struct bufUsage buf;            // Buffer pool counters
+    static struct perfUsage perf;   // Hardware counters (-H)
+    long   count, seen;             // Values in a histogram, and so far
+    double quant[3] = { 0.5, 0.99, 0.999 }; // Quantiles reported
+    int    len = 0;                 // Answer so far
+    int    slot, idx, h, q, event;  // Loop indexes
+
+    memset(&total, 0, sizeof(total));
+    dst = (long *)&total;
+    for(slot = 0; slot < STATS_SLOTS; slot++)
+    {
+        src = (long *)&table[slot];
+        for(idx = 0; idx < (int)(sizeof(total) / sizeof(long)); idx++)
+        {
+            dst[idx] += __atomic_load_n(&src[idx], __ATOMIC_RELAXED);
+        }
+    }
+
+    len = statsAdd(out, len, "# HELP otp_connections_total Connections accepted.\n"
+                             "# TYPE otp_connections_total counter\n"
+                             "otp_connections_total %ld\n",
+                   total.counter[STAT_CONNECTIONS]);
+
+    len = statsAdd(out, len, "# HELP otp_requests_total Requests by kind.\n"
+                             "# TYPE otp_requests_total counter\n");
+    for(idx = STAT_REQ_CLASSIC; idx <= STAT_REQ_PADKEY; idx++)
+    {
+        len = statsAdd(out, len, "otp_requests_total{kind=\"%s\"} %ld\n",
+                       statsName(idx), total.counter[idx]);
+    }
+
+    len = statsAdd(out, len, "# HELP otp_bytes_total Bytes moved over client connections.\n"
+                             "# TYPE otp_bytes_total counter\n"
+                             "otp_bytes_total{direction=\"in\"} %ld\n"
+                             "otp_bytes_total{direction=\"out\"} %ld\n",
+                   total.counter[STAT_BYTES_IN], total.counter[STAT_BYTES_OUT]);
+
+    len = statsAdd(out, len, "# HELP otp_reuse_suspected_total Requests whose key the reuse index may have seen before.\n"
+                             "# TYPE otp_reuse_suspected_total counter\n"
+                             "otp_reuse_suspected_total %ld\n",
+                   total.counter[STAT_REUSE_SUSPECT]);
+
+    len = statsAdd(out, len, "# HELP otp_pad_erased_bytes_total Bytes of used pad erased from the pad store.\n"
+                             "# TYPE otp_pad_erased_bytes_total counter\n"
+                             "otp_pad_erased_bytes_total %ld\n",
+                   total.counter[STAT_PAD_ERASED]);
+
+    len = statsAdd(out, len, "# HELP otp_errors_total Failed or refused requests by type.\n"
+                             "# TYPE otp_errors_total counter\n");
+    for(idx = STAT_ERR_BUSY; idx <= STAT_ERR_IO; idx++)
+    {
+        len = statsAdd(out, len, "otp_errors_total{type=\"%s\"} %ld\n",
+                       statsName(idx), total.counter[idx]);
+    }
+
+    // Gauges come from the other shared tables, as they are right now.
+    //
+    deadlineCount(phases);
+    len = statsAdd(out, len, "# HELP otp_connections Connections being served, by phase.\n"
+                             "# TYPE otp_connections gauge\n");
+    for(idx = 0; idx < PHASE_COUNT; idx++)
+    {
+        len = statsAdd(out, len, "otp_connections{phase=\"%s\"} %ld\n",
+                       phaseName[idx], phases[idx]);
+    }
+    len = statsAdd(out, len, "# HELP otp_children Child processes serving connections.\n"
+                             "# TYPE otp_children gauge\n"
+                             "otp_children %d\n"
+                             "# HELP otp_chars_in_flight Characters admitted and not yet done.\n"
+                             "# TYPE otp_chars_in_flight gauge\n"
+                             "otp_chars_in_flight %ld\n",
+                   children, admitInFlight());
+
+    bufStats(&buf);
+    len = statsAdd(out, len, "# HELP otp_buffer_bytes Request buffer pool, by state.\n"
+                             "# TYPE otp_buffer_bytes gauge\n"
+                             "otp_buffer_bytes{state=\"budget\"} %ld\n"
+                             "otp_buffer_bytes{state=\"in_use\"} %ld\n"
+                             "otp_buffer_bytes{state=\"high_water\"} %ld\n"
+                             "# HELP otp_buffer_huge_pages Pool backing (2 hugetlbfs, 1 THP, 0 none).\n"
+                             "# TYPE otp_buffer_huge_pages gauge\n"
+                             "otp_buffer_huge_pages %d\n"
+                             "# HELP otp_buffer_allocs_total Buffers handed out.\n"
+                             "# TYPE otp_buffer_allocs_total counter\n"
+                             "otp_buffer_allocs_total %ld\n"
+                             "# HELP otp_buffer_failures_total Buffers the budget couldn't cover.\n"
+                             "# TYPE otp_buffer_failures_total counter\n"
+                             "otp_buffer_failures_total %ld\n",
+                   buf.budget, buf.inUse, buf.highWater, buf.huge,
+                   buf.allocs, buf.failures);
+
+    if(perfStats(&perf))
+    {
+        len = statsAdd(out, len, "# HELP otp_perf_bytes_total Bytes handled in each section counted with -H.\n"
+                                 "# TYPE otp_perf_bytes_total counter\n");
+        for(idx = 0; idx < PERF_SECTIONS; idx++)
+        {
+            len = statsAdd(out, len, "otp_perf_bytes_total{section=\"%s\"} %ld\n",
+                           perfName(idx), perf.bytes[idx]);
+        }
+        len = statsAdd(out, len, "# HELP otp_perf_events_total Hardware events counted in each section.\n"
+                                 "# TYPE otp_perf_events_total counter\n");
+        for(idx = 0; idx < PERF_SECTIONS; idx++)
+        {
+            for(event = 0; event < PERF_EVENTS; event++)
+            {
+                if(perf.have[event])
+                {
+                    len = statsAdd(out, len, "otp_perf_events_total{section=\"%s\",event=\"%s\"} %ld\n",
+                                   perfName(idx), perfEventName(event), perf.count[idx][event]);
+                }
+            }
+        }
+    }
+
+    // The histograms go out with a bucket per power of two, which is
+    // plenty for rate() and histogram_quantile(); the quantiles below use
+    // the full resolution.
+    //
+    len = statsAdd(out, len, "# HELP otp_phase_seconds Time connections spent in each phase.\n"
+                             "# TYPE otp_phase_seconds histogram\n");
+    for(h = 0; h < STATS_HISTS; h++)
+    {
+        seen = 0;
+        for(idx = 0; idx < STATS_BUCKETS; idx++)
+        {
+            seen += total.hist[h][idx];
+            if(idx % STATS_SUB == STATS_SUB - 1)
+            {
+                len = statsAdd(out, len, "otp_phase_seconds_bucket{phase=\"%s\",le=\"%g\"} %ld\n",
+                               phaseName[h], statsBound(idx) / 1e6, seen);
+            }
+        }
+        len = statsAdd(out, len, "otp_phase_seconds_bucket{phase=\"%s\",le=\"+Inf\"} %ld\n"
+                                 "otp_phase_seconds_sum{phase=\"%s\"} %g\n"
+                                 "otp_phase_seconds_count{phase=\"%s\"} %ld\n",
+                       phaseName[h], seen, phaseName[h], total.sum[h] / 1e6,
+                       phaseName[h], seen);
+    }
+
+    // Each quantile is reported as the top of the bucket it falls in, so
+    // it errs on the slow side.
+    //
+    len = statsAdd(out, len, "# HELP otp_phase_quantile_seconds Phase latency quantiles.\n"
+                             "# TYPE otp_phase_quantile_seconds gauge\n");
+    for(h = 0; h < STATS_HISTS; h++)
+    {
+        count = 0;
+        for(idx = 0; idx < STATS_BUCKETS; idx++)
+        {
+            count += total.hist[h][idx];
+        }
+
+        for(q = 0; q < 3 && count > 0; q++)
+        {
+            seen = 0;
+            for(idx = 0; idx < STATS_BUCKETS - 1; idx++)
+            {
+                seen += total.hist[h][idx];
+                if(seen >= quant[q] * count)
+                {
+                    break;
+                }
+            }
+            len = statsAdd(out, len, "otp_phase_quantile_seconds{phase=\"%s\",quantile=\"%g\"} %g\n",
+                           phaseName[h], quant[q], statsBound(idx) / 1e6);
+        }
+    }
+
+    return len;
+}
+
+
+// *****************************************************************************
+//
+// void statsServe(int sock, int children)
+//
+// Purpose: Answer one stats connection.
+//
+// *****************************************************************************
+//
+void statsServe(int sock, int children)
+{
+    static char out[STATS_OUT];  // The answer
+    int    cli;                  // Stats connection
+    int    len;                  // Answer length
+
+    if(table == NULL || (cli = accept(sock, NULL, NULL)) == -1)
+    {
+        return;
+    }
+
+    len = statsRender(out, children);
+    send(cli, out, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+    close(cli);
+}
@@ -0,0 +1,194 @@
+//
+// *****************************************************************************
+//
+// Author:    Erik Ratcliffe
+// Date:      June 5, 2015
+// Project:   Program 4 - OTP
+// Filename:  otp_stats.h
+// Class:     CS 344 (Spring 2015)
+//
+//
+// Overview:
+//    Server/client simulation of the classic "One-time Pad" encryption scheme.
+//
+//    This file contains the definitions and function prototypes for the
+//    server's live metrics. Every child counts into its own slot of a
+//    table shared with the server (the slot of its deadline entry, so no
+//    two live children ever share one), with plain atomic adds and no
+//    locks. Slots are never cleared, so a slot's counts carry on from one
+//    child to the next and the totals are just the sum over all slots.
+//
+//    Each slot keeps:
+//
+//    - counters: requests by kind, bytes in and out, errors by type, and
+//    - a latency histogram per phase (see otp_deadline.h) plus one for
+//      the whole connection. Buckets are log-linear in microseconds, like
+//      an HDR histogram: exact below STATS_SUB, then STATS_SUB buckets
+//      per power of two, so every bucket is within 25% of its values.
+//
+//    The server answers each connection to its stats socket (a unix
+//    socket, -S) with the totals in the Prometheus text format, plus
+//    gauges for the connections in each phase and the characters in
+//    flight, and closes it.
+//
+// *****************************************************************************
+//
+
+#ifndef OTP_STATS_H
+#define OTP_STATS_H
+
+
+#define STATS_SUB_BITS   2       // log2(STATS_SUB)
+#define STATS_SUB        4       // Buckets per power of two
+#define STATS_BUCKETS    144     // Histogram buckets (tops out at ~19 hours)
+#define STATS_OUT        262144  // Largest stats answer
+
+#define STAT_CONNECTIONS 0       // Connections accepted
+#define STAT_REQ_CLASSIC 1       // Classic requests
+#define STAT_REQ_MUX     2       // Multiplexed streams
+#define STAT_REQ_RESUME  3       // Resumable session connections
+#define STAT_REQ_PADGEN  4       // Pads generated for clients
+#define STAT_REQ_PADKEY  5       // Requests keyed from the pad store
+#define STAT_BYTES_IN    6       // Bytes received from clients
+#define STAT_BYTES_OUT   7       // Bytes sent to clients
+#define STAT_ERR_BUSY    8       // Turned away (connections or characters)
+#define STAT_ERR_DEADLINE 9      // Killed over a deadline
+#define STAT_ERR_PROTO   10      // Requests that didn't follow the protocol
+#define STAT_ERR_KEY     11      // Keys shorter than their input
+#define STAT_ERR_CHARS   12      // Input or key with characters outside the set
+#define STAT_ERR_CRC     13      // Frames whose checksum didn't match
+#define STAT_ERR_REUSE   14      // Requests refused for reusing key (otp_reuse.h)
+#define STAT_ERR_IO      15      // Connections lost in the middle of a request
+#define STAT_REUSE_SUSPECT 16    // Requests whose key may have been used before
+#define STAT_PAD_ERASED  17      // Bytes of used pad erased (otp_padkey.h)
+#define STAT_COUNT       18      // Number of counters
+
+
+// *****************************************************************************
+//
+// int statsInit(char *path)
+//
+//    Entry:   char *path
+//                Where to create the stats socket, or NULL for none
+//
+//    Exit:    The listening stats socket (-1 if path is NULL), or -2 if
+//             the table or socket can't be set up.
+//
+//    Purpose: Set up the shared table and the stats socket. Call once in
+//    the server before accepting; the server counts into a slot of its
+//    own until it forks.
+//
+// *****************************************************************************
+//
+int statsInit(char *path);
+
+
+// *****************************************************************************
+//
+// void statsChild(int idx)
+//
+//    Entry:   int idx
+//                The child's deadline entry (-1 = none)
+//
+//    Exit:    None.
+//
+//    Purpose: Child side: count into slot idx from now on, and start
+//    timing the connection. Its last phase and total time are recorded
+//    when the child exits.
+//
+// *****************************************************************************
+//
+void statsChild(int idx);
+
+
+// *****************************************************************************
+//
+// void statsCount(int counter, long n)
+//
+//    Entry:   int counter
+//                STAT_*
+//             long n
+//                Amount to add
+//
+//    Exit:    None.
+//
+//    Purpose: Add to a counter. A no-op outside the server.
+//
+// *****************************************************************************
+//
+void statsCount(int counter, long n);
+
+
+// *****************************************************************************
+//
+// void statsPhase(int phase)
+//
+//    Entry:   int phase
+//                PHASE_* the connection is entering
+//
+//    Exit:    None.
+//
+//    Purpose: Child side: record how long the connection spent in the
+//    phase it is leaving. Called by deadlinePhase().
+//
+// *****************************************************************************
+//
+void statsPhase(int phase);
+
+
+// *****************************************************************************
+//
+// void statsOwn(long count[STAT_COUNT])
+//
+//    Entry:   long count[STAT_COUNT]
+//                Receives the counts
+//
+//    Exit:    None.
+//
+//    Purpose: Child side: what this connection alone has counted, for
+//    the access log (see otp_log.h).
+//
+// *****************************************************************************
+//
+void statsOwn(long count[STAT_COUNT]);
+
+
+// *****************************************************************************
+//
+// char *statsName(int counter)
+//
+//    Entry:   int counter
+//                STAT_REQ_* or STAT_ERR_*
+//
+//    Exit:    The counter's label ("classic", "busy", ...), NULL for
+//             other counters.
+//
+//    Purpose: Label a request kind or error type.
+//
+// *****************************************************************************
+//
+char *statsName(int counter);
+
+
+// *****************************************************************************
+//
+// void statsServe(int sock, int children)
+//
+//    Entry:   int sock
+//                Stats socket from statsInit()
+//             int children
+//                Children serving connections now
+//
+//    Exit:    None.
+//
+//    Purpose: Server side: accept one stats connection, send it the
+//    current totals and close it. The answer is sent without blocking;
+//    a reader that can't take it all at once gets it cut short rather
+//    than stalling the accept loop.
+//
+// *****************************************************************************
+//
+void statsServe(int sock, int children);
+
+
+#endif
@@ -0,0 +1,337 @@
+//
+// *****************************************************************************
+//
+// Author:    Erik Ratcliffe
+// Date:      June 5, 2015
+// Project:   Program 4 - OTP
+// Filename:  otp_trace.c
+// Class:     CS 344 (Spring 2015)
+//
+//
+// Overview:
+//    Server/client simulation of the classic "One-time Pad" encryption scheme.
+//
+//    This file contains per-request tracing (see otp_trace.h).
+//
+// *****************************************************************************
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include "otp_trace.h"
+
+
+// One finished request. seq is the ticket it was written under, plus
+// one, and is set last, so the server can tell a record that's complete
+// from one still being written.
+//
+struct traceRecord
+{
+    unsigned long seq;            // Ticket + 1 once written
+    pid_t  pid;                   // Child that served the request
+    char   kind[8];               // Kind of request
+    long   chars;                 // Characters it carried
+    long   start;                 // When it was accepted (ms since the epoch)
+    long   total;                 // How long it took (us)
+    long   step[TRACE_COUNT];     // Time per step (us)
+};
+
+
+struct traceRing
+{
+    unsigned long head;           // Next ticket to hand out
+    unsigned long tail;           // Next ticket the server reads
+    unsigned long dropped;        // Records lost to a full ring
+    long   threshold;             // Shortest request recorded (us)
+    struct traceRecord rec[TRACE_RING]; // The records
+};
+
+
+static struct traceRing *ring = NULL;     // Shared ring
+
+static int    tracing = 0;                // Child: set while timing a request
+static struct traceRecord now;            // Child: the request being timed
+static long   connStart;                  // Child: when it was accepted (ns)
+static long   lastMark;                   // Child: time of the last mark (ns)
+
+static char *stepName[TRACE_COUNT] =
+{
+    "handshake", "header", "queue", "input", "key", "codec", "send", "other"
+};
+
+
+// *****************************************************************************
+//
+// static long traceClock(void)
+//
+// Purpose: Monotonic clock in ns. It goes through the vDSO, so a mark
+// costs tens of nanoseconds.
+//
+// *****************************************************************************
+//
+static long traceClock(void)
+{
+    struct timespec ts;  // Current time
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+
+// *****************************************************************************
+//
+// int traceInit(long thresholdMs)
+//
+// Purpose: Set up the shared ring.
+//
+// *****************************************************************************
+//
+int traceInit(long thresholdMs)
+{
+    if(thresholdMs < 0)
+    {
+        return 0;
+    }
+
+    ring = mmap(NULL, sizeof(*ring), PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(ring == MAP_FAILED)
+    {
+        ring = NULL;
+        return -1;
+    }
+
+    ring->threshold = thresholdMs * 1000;
+
+    return 0;
+}
+
+
+// *****************************************************************************
+//
+// void traceTune(long *thresholdMs)
+//
+// Purpose: Change the threshold at runtime.
+//
+// *****************************************************************************
+//
+void traceTune(long *thresholdMs)
+{
+    if(*thresholdMs >= 0)
+    {
+        if(ring == NULL && traceInit(*thresholdMs) == -1)
+        {
+            *thresholdMs = -1;
+            return;
+        }
+        __atomic_store_n(&ring->threshold, *thresholdMs * 1000, __ATOMIC_RELAXED);
+    }
+
+    *thresholdMs = (ring == NULL) ? -1 : ring->threshold / 1000;
+}
+
+
+// *****************************************************************************
+//
+// static void traceExit(void)
+//
+// Purpose: atexit() handler in a child: write the request to the ring if
+// it was slow enough.
+//
+// *****************************************************************************
+//
+static void traceExit(void)
+{
+    struct traceRecord *rec;  // Ring entry claimed
+    unsigned long ticket;     // Our place in the ring
+    long   total;             // How long the request took (us)
+    int    idx;               // Loop index
+
+    if(!tracing)
+    {
+        return;
+    }
+    tracing = 0;
+
+    total = (traceClock() - connStart) / 1000;
+    if(total < ring->threshold)
+    {
+        return;
+    }
+
+    // Claim the next ticket unless the server has fallen a whole ring
+    // behind.
+    //
+    ticket = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    do
+    {
+        if(ticket - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= TRACE_RING)
+        {
+            __atomic_add_fetch(&ring->dropped, 1, __ATOMIC_RELAXED);
+            return;
+        }
+    } while(!__atomic_compare_exchange_n(&ring->head, &ticket, ticket + 1, 0,
+                                         __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+    rec = &ring->rec[ticket % TRACE_RING];
+    rec->pid = getpid();
+    memcpy(rec->kind, now.kind, sizeof(rec->kind));
+    rec->chars = now.chars;
+    rec->start = now.start;
+    rec->total = total;
+    for(idx = 0; idx < TRACE_COUNT; idx++)
+    {
+        rec->step[idx] = now.step[idx] / 1000;
+    }
+    __atomic_store_n(&rec->seq, ticket + 1, __ATOMIC_RELEASE);
+}
+
+
+// *****************************************************************************
+//
+// void traceChild(void)
+//
+// Purpose: Child side: start timing a connection.
+//
+// *****************************************************************************
+//
+void traceChild(void)
+{
+    struct timespec wall;  // Wall clock, for the record
+
+    if(ring == NULL)
+    {
+        return;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &wall);
+
+    memset(&now, 0, sizeof(now));
+    strcpy(now.kind, "none");
+    now.start = wall.tv_sec * 1000L + wall.tv_nsec / 1000000L;
+    connStart = traceClock();
+    lastMark = connStart;
+    tracing = 1;
+    atexit(traceExit);
+}
+
+
+// *****************************************************************************
+//
+// void traceRequest(char *kind, long chars)
+//
+// Purpose: Child side: say what the connection turned out to be.
+//
+// *****************************************************************************
+//
+void traceRequest(char *kind, long chars)
+{
+    if(tracing)
+    {
+        snprintf(now.kind, sizeof(now.kind), "%s", kind);
+        now.chars = chars;
+    }
+}
+
+
+// *****************************************************************************
+//
+// void traceMark(int step)
+//
+// Purpose: Child side: add the time since the last mark to a step.
+//
+// *****************************************************************************
+//
+void traceMark(int step)
+{
+    long t;  // Time of this mark (ns)
+
+    if(!tracing)
+    {
+        return;
+    }
+
+    t = traceClock();
+    now.step[step] += t - lastMark;
+    lastMark = t;
+}
+
+
+// *****************************************************************************
+//
+// void traceDump(void)
+//
+// Purpose: Server side: write out every finished record in the ring.
+//
+// *****************************************************************************
+//
+void traceDump(void)
+{
+    static unsigned long stuckAt = 0;  // Ticket we found half written
+    static long stuckSince = 0;        // When we first found it (ns)
+    struct traceRecord *rec;           // Record being written out
+    unsigned long tail;                // Next ticket to read
+    unsigned long dropped;             // Records lost since the last dump
+    long   other;                      // Time not covered by a step
+    int    idx;                        // Loop index
+
+    if(ring == NULL)
+    {
+        return;
+    }
+
+    tail = ring->tail;
+    while(tail != __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE))
+    {
+        rec = &ring->rec[tail % TRACE_RING];
+
+        // A child killed between claiming a ticket and finishing its
+        // record would hold up the ring forever, so after a while the
+        // ticket is given up on.
+        //
+        if(__atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE) != tail + 1)
+        {
+            if(stuckAt != tail + 1)
+            {
+                stuckAt = tail + 1;
+                stuckSince = traceClock();
+                break;
+            }
+            if(traceClock() - stuckSince < TRACE_STUCK_MS * 1000000L)
+            {
+                break;
+            }
+            __atomic_add_fetch(&ring->dropped, 1, __ATOMIC_RELAXED);
+        }
+        else
+        {
+            other = rec->total;
+            fprintf(stderr, "{\"trace\":%lu,\"pid\":%d,\"kind\":\"%s\",\"chars\":%ld,"
+                            "\"start\":%ld,\"total_us\":%ld",
+                    tail, (int)rec->pid, rec->kind, rec->chars, rec->start, rec->total);
+            for(idx = 0; idx < TRACE_COUNT; idx++)
+            {
+                if(idx != TRACE_OTHER)
+                {
+                    fprintf(stderr, ",\"%s_us\":%ld", stepName[idx], rec->step[idx]);
+                    other -= rec->step[idx];
+                }
+            }
+            fprintf(stderr, ",\"other_us\":%ld}\n", (other > 0) ? other : 0);
+        }
+
+        tail++;
+        __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+    }
+
+    if((dropped = __atomic_exchange_n(&ring->dropped, 0, __ATOMIC_RELAXED)) != 0)
+    {
+        fprintf(stderr, "{\"trace_dropped\":%lu}\n", dropped);
+    }
+}
@@ -0,0 +1,157 @@
+//
+// *****************************************************************************
+//
+// Author:    Erik Ratcliffe
+// Date:      June 5, 2015
+// Project:   Program 4 - OTP
+// Filename:  otp_trace.h
+// Class:     CS 344 (Spring 2015)
+//
+//
+// Overview:
+//    Server/client simulation of the classic "One-time Pad" encryption scheme.
+//
+//    This file contains the definitions and function prototypes for
+//    per-request tracing. With tracing on (-T), a child timestamps each
+//    step of its request and adds the time since the previous step to
+//    that step's total, so steps that repeat (a slice at a time, a chunk
+//    at a time) add up. When the child exits, a request that took at
+//    least the threshold is written to a ring shared with the server.
+//    Children claim ring entries with a compare-and-swap, so there is no
+//    lock, and a full ring drops records (and counts them) rather than
+//    making anyone wait.
+//
+//    The server empties the ring from its accept loop and writes each
+//    record to stderr as one line of JSON, e.g.
+//
+//       {"trace":12,"pid":4711,"kind":"classic","chars":30000000,
+//        "start":1718000000123,"total_us":912345,"handshake_us":41,...}
+//
+//    with start in ms since the epoch and a _us field per step. Time not
+//    covered by any step is reported as other_us.
+//
+// *****************************************************************************
+//
+
+#ifndef OTP_TRACE_H
+#define OTP_TRACE_H
+
+
+#define TRACE_RING       1024    // Records the ring holds
+#define TRACE_STUCK_MS   1000    // Longest the server waits on a half-written record
+
+#define TRACE_HANDSHAKE  0       // Connection accepted to first number received
+#define TRACE_HEADER     1       // Sizes, session or chunk headers
+#define TRACE_QUEUE      2       // Waiting for a scheduler slot
+#define TRACE_INPUT      3       // Receiving input
+#define TRACE_KEY        4       // Receiving the key
+#define TRACE_CODEC      5       // Encoding, decoding or generating
+#define TRACE_SEND       6       // Sending the result
+#define TRACE_OTHER      7       // Anything else
+#define TRACE_COUNT      8       // Number of steps
+
+
+// *****************************************************************************
+//
+// int traceInit(long thresholdMs)
+//
+//    Entry:   long thresholdMs
+//                Record requests taking at least this long (0 = every
+//                request, -1 = tracing off)
+//
+//    Exit:    Returns 0 on success, -1 on failure.
+//
+//    Purpose: Set up the shared ring. Call once in the server before
+//    accepting.
+//
+// *****************************************************************************
+//
+int traceInit(long thresholdMs);
+
+
+// *****************************************************************************
+//
+// void traceTune(long *thresholdMs)
+//
+//    Entry:   long *thresholdMs
+//                New threshold (negative leaves it as it is)
+//
+//    Exit:    Set to the threshold now in force, -1 if tracing is off.
+//
+//    Purpose: Server side: change the threshold at runtime (see
+//    otp_ctl.h), turning tracing on if it was off. Children forked from
+//    then on pick it up.
+//
+// *****************************************************************************
+//
+void traceTune(long *thresholdMs);
+
+
+// *****************************************************************************
+//
+// void traceChild(void)
+//
+//    Entry:   None.
+//
+//    Exit:    None.
+//
+//    Purpose: Child side: start timing a connection. The record is
+//    written when the child exits.
+//
+// *****************************************************************************
+//
+void traceChild(void);
+
+
+// *****************************************************************************
+//
+// void traceRequest(char *kind, long chars)
+//
+//    Entry:   char *kind
+//                Kind of request ("classic", "mux", "resume", "padgen")
+//             long chars
+//                Characters it carries, if known
+//
+//    Exit:    None.
+//
+//    Purpose: Child side: say what the connection turned out to be.
+//
+// *****************************************************************************
+//
+void traceRequest(char *kind, long chars);
+
+
+// *****************************************************************************
+//
+// void traceMark(int step)
+//
+//    Entry:   int step
+//                TRACE_* step that just finished
+//
+//    Exit:    None.
+//
+//    Purpose: Child side: add the time since the last mark to step. A
+//    no-op (one test) with tracing off or outside a server child.
+//
+// *****************************************************************************
+//
+void traceMark(int step);
+
+
+// *****************************************************************************
+//
+// void traceDump(void)
+//
+//    Entry:   None.
+//
+//    Exit:    None.
+//
+//    Purpose: Server side: write every finished record in the ring to
+//    stderr, and how many were dropped since the last dump.
+//
+// *****************************************************************************
+//
+void traceDump(void);
+
+
+#endif